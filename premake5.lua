@@ -53,6 +53,129 @@ project "SilentPatchJuicedDemo"
 	dofile "source/VersionInfo.lua"
 	files { "**/MemoryMgr.h", "**/Patterns.*", "**/HookInit.hpp" }
 
+	links { "winmm" }
+
+project "SignatureBench"
+	kind "ConsoleApp"
+	language "C++"
+
+	-- Only the portable scanner, the patch itself is not needed
+	removefiles { "source/**" }
+	files { "tools/SignatureBench/*.h", "tools/SignatureBench/*.cpp", "source/Signature.h", "source/SignatureNearMiss.*" }
+	includedirs { "source" }
+
+project "TextConversionBench"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/TextConversionBench/*.cpp", "source/AsciiConversion.h" }
+	includedirs { "source" }
+
+project "PcmRingStress"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/PcmRingStress/*.cpp", "source/PcmRing.*" }
+	includedirs { "source" }
+
+project "LogQueueStress"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/LogQueueStress/*.cpp", "source/LogQueue.*" }
+	includedirs { "source" }
+
+project "SettingsImageStress"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/SettingsImageStress/*.cpp", "source/SettingsImage.*" }
+	includedirs { "source" }
+
+project "SnapshotStoreBench"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/SnapshotStoreBench/*.cpp", "source/SnapshotStore.h" }
+	includedirs { "source" }
+
+project "TrampolineCheck"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/TrampolineCheck/*.cpp", "source/Trampoline.h", "source/Trampoline.cpp" }
+	includedirs { "source" }
+
+project "PatchManifest"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/PatchManifest/*.cpp", "tools/PatchManifest/*.txt", "source/PatchManifest.h", "source/PatchManifest.cpp", "source/Signature.h" }
+	includedirs { "source" }
+
+project "XrefIndexBench"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/XrefIndexBench/*.cpp", "tools/SignatureBench/SyntheticImage.*", "tools/SignatureBench/PeImage.*", "source/XrefIndex.*", "source/Signature.h" }
+	includedirs { "source" }
+
+project "StringIndexBench"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/StringIndexBench/*.h", "tools/StringIndexBench/*.cpp", "tools/SignatureBench/SyntheticImage.*", "tools/SignatureBench/PeImage.*", "source/Signature.h" }
+	includedirs { "source" }
+
+project "TraceRecorderCheck"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/TraceRecorderCheck/*.cpp", "source/TraceRecorder.*" }
+	includedirs { "source" }
+
+project "FrameCaptureCheck"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/FrameCaptureCheck/*.cpp", "source/CapturePlaylist.*", "source/FrameStats.*" }
+	includedirs { "source" }
+
+project "FramePacerCheck"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/FramePacerCheck/*.cpp", "source/FramePacer.*" }
+	includedirs { "source" }
+
+project "RenderStateCheck"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/RenderStateCheck/*.cpp", "source/RenderStateCache.*" }
+	includedirs { "source" }
+
+project "VertexBufferRingCheck"
+	kind "ConsoleApp"
+	language "C++"
+
+	removefiles { "source/**" }
+	files { "tools/VertexBufferRingCheck/*.cpp", "source/VertexBufferRing.*" }
+	includedirs { "source" }
+
 
 workspace "*"
 	configurations { "Debug", "Release", "Shipping" }
@@ -102,6 +225,7 @@ filter { "platforms:Win64" }
 
 filter { "toolset:*_xp"}
 	defines { "WINVER=0x0501", "_WIN32_WINNT=0x0501" } -- Target WinXP
+	links { "psapi" } -- No K32 exports on XP
 	buildoptions { "/Zc:threadSafeInit-" }
 
 filter { "toolset:not *_xp"}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define ASCII_CONVERSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Conversion of the ASCII prefix of a string between 8-bit and UTF-16 code units, 16 characters at a time where possible.
+// ASCII maps to itself in every ANSI code page, so only the remainder needs the code page aware conversion.
+// Portable, so it can be benchmarked outside of Windows
+namespace AsciiConversion
+{
+	// Returns the number of characters converted, stopping at the first one that is not ASCII
+	inline size_t Widen(const char* src, size_t length, char16_t* dst)
+	{
+		size_t i = 0;
+#if ASCII_CONVERSION_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= length; i += 16)
+		{
+			const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			if (_mm_movemask_epi8(chars) != 0)
+			{
+				break;
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(chars, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(chars, zero));
+		}
+#endif
+		for (; i < length; i++)
+		{
+			const uint8_t ch = static_cast<uint8_t>(src[i]);
+			if (ch >= 0x80)
+			{
+				break;
+			}
+			dst[i] = ch;
+		}
+		return i;
+	}
+
+	// Returns the number of characters converted, stopping at the first one that is not ASCII
+	inline size_t Narrow(const char16_t* src, size_t length, char* dst)
+	{
+		size_t i = 0;
+#if ASCII_CONVERSION_SSE2
+		const __m128i nonAsciiBits = _mm_set1_epi16(static_cast<short>(0xFF80));
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= length; i += 16)
+		{
+			const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+			const __m128i nonAscii = _mm_and_si128(_mm_or_si128(low, high), nonAsciiBits);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonAscii, zero)) != 0xFFFF)
+			{
+				break;
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(low, high));
+		}
+#endif
+		for (; i < length; i++)
+		{
+			const char16_t ch = src[i];
+			if (ch >= 0x80)
+			{
+				break;
+			}
+			dst[i] = static_cast<char>(ch);
+		}
+		return i;
+	}
+}
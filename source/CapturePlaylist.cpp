@@ -0,0 +1,143 @@
+#include "CapturePlaylist.h"
+
+#include <cstdlib>
+#include <utility>
+
+static std::string_view Trim(std::string_view text)
+{
+	while (!text.empty() && text.front() == ' ')
+	{
+		text.remove_prefix(1);
+	}
+	while (!text.empty() && text.back() == ' ')
+	{
+		text.remove_suffix(1);
+	}
+	return text;
+}
+
+static std::optional<uint32_t> ParseNumber(std::string_view text, bool& valid)
+{
+	std::optional<uint32_t> result;
+	if (!text.empty())
+	{
+		const std::string str(text);
+		char* end;
+		const unsigned long value = strtoul(str.c_str(), &end, 10);
+		if (*end != '\0')
+		{
+			valid = false;
+		}
+		else
+		{
+			result.emplace(static_cast<uint32_t>(value));
+		}
+	}
+	return result;
+}
+
+std::optional<CapturePlaylist::Race> CapturePlaylist::ParseRace(std::string_view text)
+{
+	std::optional<Race> result;
+
+	std::vector<std::string_view> fields;
+	std::string_view remaining = text;
+	while (true)
+	{
+		const size_t separator = remaining.find(',');
+		fields.push_back(Trim(remaining.substr(0, separator)));
+		if (separator == std::string_view::npos)
+		{
+			break;
+		}
+		remaining.remove_prefix(separator + 1);
+	}
+
+	if (fields.size() > 6 || (fields.size() == 1 && fields[0].empty()))
+	{
+		return result;
+	}
+	fields.resize(6);
+
+	bool valid = true;
+	Race race;
+	race.description = std::string(Trim(text));
+	race.gameMode = std::string(fields[0]);
+	race.route = std::string(fields[1]);
+	race.timeOfDay = std::string(fields[2]);
+	race.weather = std::string(fields[3]);
+	race.numCars = ParseNumber(fields[4], valid);
+	race.numLaps = ParseNumber(fields[5], valid);
+	if (valid)
+	{
+		result.emplace(std::move(race));
+	}
+	return result;
+}
+
+CapturePlaylist::CapturePlaylist(std::vector<Race> races, double warmupMs, double durationMs)
+	: m_races(std::move(races)), m_warmupMs(warmupMs), m_durationMs(durationMs)
+{
+}
+
+const CapturePlaylist::Race* CapturePlaylist::GetCurrentRace() const
+{
+	return m_currentRace < m_races.size() ? &m_races[m_currentRace] : nullptr;
+}
+
+void CapturePlaylist::BeginRace()
+{
+	if (GetCurrentRace() == nullptr)
+	{
+		return;
+	}
+
+	// The warmup starts on the next frame, as the race is only being set up now
+	m_state = State::Warmup;
+	m_lastPresentStartMs.reset();
+	m_stats.Clear();
+}
+
+const CapturePlaylist::Result* CapturePlaylist::OnFrame(double presentStartMs, double presentEndMs)
+{
+	const Result* result = nullptr;
+	if (m_state == State::Idle)
+	{
+		return result;
+	}
+
+	if (!m_lastPresentStartMs)
+	{
+		m_stateStartMs = presentStartMs;
+	}
+	else if (m_state == State::Warmup)
+	{
+		if (presentStartMs - m_stateStartMs >= m_warmupMs)
+		{
+			m_state = State::Capturing;
+			m_stateStartMs = presentStartMs;
+			m_stats.Reserve(static_cast<size_t>(m_durationMs / 4.0));
+		}
+	}
+	else
+	{
+		FrameStats::Frame frame;
+		frame.frameMs = presentStartMs - *m_lastPresentStartMs;
+		frame.cpuMs = presentStartMs - m_lastPresentEndMs;
+		frame.presentMs = presentEndMs - presentStartMs;
+		m_stats.AddFrame(frame);
+
+		if (presentEndMs - m_stateStartMs >= m_durationMs)
+		{
+			m_results.push_back({ m_races[m_currentRace], std::move(m_stats) });
+			m_stats = FrameStats();
+			m_currentRace++;
+			m_state = State::Idle;
+			result = &m_results.back();
+		}
+	}
+
+	m_lastPresentStartMs = presentStartMs;
+	m_lastPresentEndMs = presentEndMs;
+	return result;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FrameStats.h"
+
+// Runs a list of race configurations one after another, capturing frame timings of each.
+// Portable, so it can be tested outside of Windows with simulated timestamps
+class CapturePlaylist
+{
+public:
+	// Fields follow the Race.* options, empty fields keep the option's value
+	struct Race
+	{
+		std::string description;
+		std::string gameMode;
+		std::string route;
+		std::string timeOfDay;
+		std::string weather;
+		std::optional<uint32_t> numCars;
+		std::optional<uint32_t> numLaps;
+	};
+
+	struct Result
+	{
+		Race race;
+		FrameStats stats;
+	};
+
+	// "gamemode,route,timeofday,weather,numcars,numlaps", e.g. "race,Downtown_r1,night,wet,6,3"
+	static std::optional<Race> ParseRace(std::string_view text);
+
+	CapturePlaylist(std::vector<Race> races, double warmupMs, double durationMs);
+
+	// nullptr once all races have been captured
+	const Race* GetCurrentRace() const;
+
+	// The game is setting up the current race. Restarts the capture if the previous attempt did not finish
+	void BeginRace();
+
+	// Timestamps of every Present in milliseconds. Returns the result if this frame completed the current race
+	const Result* OnFrame(double presentStartMs, double presentEndMs);
+
+	const std::vector<Result>& GetResults() const { return m_results; }
+
+private:
+	enum class State
+	{
+		Idle, // Waiting for the game to set up the current race
+		Warmup, // Loading and countdown, not captured
+		Capturing,
+	};
+
+	std::vector<Race> m_races;
+	size_t m_currentRace = 0;
+	const double m_warmupMs;
+	const double m_durationMs;
+
+	State m_state = State::Idle;
+	double m_stateStartMs = 0.0;
+	std::optional<double> m_lastPresentStartMs;
+	double m_lastPresentEndMs = 0.0;
+
+	FrameStats m_stats;
+	std::vector<Result> m_results;
+};
@@ -0,0 +1,145 @@
+#include "D3D9Hooks.h"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "Log.h"
+#include "VtableHook.h"
+
+static std::vector<D3D9Hooks::DeviceHandler> deviceCreatedHandlers;
+static std::vector<D3D9Hooks::DeviceHandler> beforePresentHandlers;
+static std::vector<D3D9Hooks::DeviceHandler> afterPresentHandlers;
+
+// Index into the IDirect3D9 vtable
+static constexpr size_t IDirect3D9_CreateDevice = 16;
+
+static HRESULT (STDMETHODCALLTYPE* orgPresent)(IDirect3DDevice9* device, const RECT* pSourceRect, const RECT* pDestRect, HWND hDestWindowOverride, const RGNDATA* pDirtyRegion);
+static HRESULT STDMETHODCALLTYPE Present_Hook(IDirect3DDevice9* device, const RECT* pSourceRect, const RECT* pDestRect, HWND hDestWindowOverride, const RGNDATA* pDirtyRegion)
+{
+	for (D3D9Hooks::DeviceHandler handler : beforePresentHandlers)
+	{
+		handler(device);
+	}
+	const HRESULT hr = orgPresent(device, pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+	for (D3D9Hooks::DeviceHandler handler : afterPresentHandlers)
+	{
+		handler(device);
+	}
+	return hr;
+}
+
+static HRESULT (STDMETHODCALLTYPE* orgCreateDevice)(IDirect3D9* d3d, UINT Adapter, D3DDEVTYPE DeviceType, HWND hFocusWindow, DWORD BehaviorFlags,
+	D3DPRESENT_PARAMETERS* pPresentationParameters, IDirect3DDevice9** ppReturnedDeviceInterface);
+static HRESULT STDMETHODCALLTYPE CreateDevice_Hook(IDirect3D9* d3d, UINT Adapter, D3DDEVTYPE DeviceType, HWND hFocusWindow, DWORD BehaviorFlags,
+	D3DPRESENT_PARAMETERS* pPresentationParameters, IDirect3DDevice9** ppReturnedDeviceInterface)
+{
+	const HRESULT hr = orgCreateDevice(d3d, Adapter, DeviceType, hFocusWindow, BehaviorFlags, pPresentationParameters, ppReturnedDeviceInterface);
+	if (SUCCEEDED(hr))
+	{
+		IDirect3DDevice9* device = *ppReturnedDeviceInterface;
+		if (!beforePresentHandlers.empty() || !afterPresentHandlers.empty())
+		{
+			VtableHook::Hook(device, D3D9Hooks::DeviceVtbl::Present, orgPresent, &Present_Hook);
+		}
+		for (D3D9Hooks::DeviceHandler handler : deviceCreatedHandlers)
+		{
+			handler(device);
+		}
+	}
+	return hr;
+}
+
+static decltype(::Direct3DCreate9)* orgDirect3DCreate9;
+static IDirect3D9* WINAPI Direct3DCreate9_Redirect(UINT SDKVersion)
+{
+	IDirect3D9* d3d = orgDirect3DCreate9(SDKVersion);
+	if (d3d != nullptr)
+	{
+		VtableHook::Hook(d3d, IDirect3D9_CreateDevice, orgCreateDevice, &CreateDevice_Hook);
+	}
+	return d3d;
+}
+
+template<typename Func>
+static void ReplaceFunction(void** funcPtr, Func*& orgFunc, Func* redirect)
+{
+	DWORD dwProtect;
+
+	auto func = reinterpret_cast<Func**>(funcPtr);
+
+	VirtualProtect(func, sizeof(*func), PAGE_READWRITE, &dwProtect);
+	orgFunc = std::exchange(*func, redirect);
+	VirtualProtect(func, sizeof(*func), dwProtect, &dwProtect);
+}
+
+void D3D9Hooks::OnDeviceCreated(DeviceHandler handler)
+{
+	deviceCreatedHandlers.push_back(handler);
+}
+
+void D3D9Hooks::OnBeforePresent(DeviceHandler handler)
+{
+	beforePresentHandlers.push_back(handler);
+}
+
+void D3D9Hooks::OnAfterPresent(DeviceHandler handler)
+{
+	afterPresentHandlers.push_back(handler);
+}
+
+void D3D9Hooks::ApplyPatches(void* module)
+{
+	const DWORD_PTR instance = reinterpret_cast<DWORD_PTR>(module);
+	const PIMAGE_NT_HEADERS ntHeader = reinterpret_cast<PIMAGE_NT_HEADERS>(instance + reinterpret_cast<PIMAGE_DOS_HEADER>(instance)->e_lfanew);
+
+	// Find IAT
+	PIMAGE_IMPORT_DESCRIPTOR pImports = reinterpret_cast<PIMAGE_IMPORT_DESCRIPTOR>(instance + ntHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress);
+
+	bool found = false;
+	for ( ; pImports->Name != 0; pImports++ )
+	{
+		if ( _stricmp(reinterpret_cast<const char*>(instance + pImports->Name), "d3d9.dll") == 0 )
+		{
+			if ( pImports->OriginalFirstThunk != 0 )
+			{
+				const PIMAGE_THUNK_DATA pThunk = reinterpret_cast<PIMAGE_THUNK_DATA>(instance + pImports->OriginalFirstThunk);
+
+				for ( ptrdiff_t j = 0; pThunk[j].u1.AddressOfData != 0; j++ )
+				{
+					if ( IMAGE_SNAP_BY_ORDINAL(pThunk[j].u1.Ordinal) )
+					{
+						continue;
+					}
+
+					if ( strcmp(reinterpret_cast<PIMAGE_IMPORT_BY_NAME>(instance + pThunk[j].u1.AddressOfData)->Name, "Direct3DCreate9") == 0 )
+					{
+						void** pAddress = reinterpret_cast<void**>(instance + pImports->FirstThunk) + j;
+						ReplaceFunction(pAddress, orgDirect3DCreate9, &Direct3DCreate9_Redirect);
+						found = true;
+					}
+				}
+			}
+			else
+			{
+				// d3d9.dll is not linked into the patch, so look the function up to compare against
+				const void* direct3DCreate9 = GetProcAddress(GetModuleHandleW(L"d3d9.dll"), "Direct3DCreate9");
+				void** pFunctions = reinterpret_cast<void**>(instance + pImports->FirstThunk);
+
+				for ( ptrdiff_t j = 0; pFunctions[j] != nullptr; j++ )
+				{
+					if ( direct3DCreate9 != nullptr && pFunctions[j] == direct3DCreate9 )
+					{
+						ReplaceFunction(&pFunctions[j], orgDirect3DCreate9, &Direct3DCreate9_Redirect);
+						found = true;
+					}
+				}
+			}
+		}
+	}
+
+	if (!found)
+	{
+		Log::Write("D3D9Hooks: Direct3DCreate9 not imported");
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <d3d9.h>
+
+// Hooks Direct3DCreate9 in the game's imports, so other subsystems can hook the device the game creates
+namespace D3D9Hooks
+{
+	using DeviceHandler = void(*)(IDirect3DDevice9* device);
+
+	// Handlers must be registered before ApplyPatches
+	void OnDeviceCreated(DeviceHandler handler);
+	void OnBeforePresent(DeviceHandler handler);
+	void OnAfterPresent(DeviceHandler handler);
+
+	void ApplyPatches(void* module);
+
+	// Indices into the IDirect3DDevice9 vtable
+	namespace DeviceVtbl
+	{
+		constexpr size_t Reset = 16;
+		constexpr size_t Present = 17;
+		constexpr size_t CreateVertexBuffer = 26;
+		constexpr size_t SetRenderState = 57;
+		constexpr size_t CreateStateBlock = 59;
+		constexpr size_t BeginStateBlock = 60;
+		constexpr size_t EndStateBlock = 61;
+		constexpr size_t SetTexture = 65;
+		constexpr size_t SetTextureStageState = 67;
+		constexpr size_t SetSamplerState = 69;
+	}
+
+	// Indices into the IDirect3DStateBlock9 vtable
+	namespace StateBlockVtbl
+	{
+		constexpr size_t Apply = 5;
+	}
+
+	// Indices into the IDirect3DVertexBuffer9 vtable
+	namespace VertexBufferVtbl
+	{
+		constexpr size_t Lock = 11;
+	}
+}
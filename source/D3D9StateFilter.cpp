@@ -0,0 +1,149 @@
+#include "D3D9StateFilter.h"
+
+#include <cstdlib>
+#include <iterator>
+
+#include "D3D9Hooks.h"
+#include "Log.h"
+#include "RenderStateCache.h"
+#include "VtableHook.h"
+
+// The game only ever creates one device, but the vtable is shared so make sure the cache is for the right one
+static IDirect3DDevice9* cachedDevice;
+static RenderStateCache stateCache;
+
+static RenderStateCache& GetCache(IDirect3DDevice9* device)
+{
+	if (device != cachedDevice)
+	{
+		cachedDevice = device;
+		stateCache.Invalidate();
+	}
+	return stateCache;
+}
+
+static HRESULT (STDMETHODCALLTYPE* orgSetRenderState)(IDirect3DDevice9* device, D3DRENDERSTATETYPE State, DWORD Value);
+static HRESULT STDMETHODCALLTYPE SetRenderState_Filter(IDirect3DDevice9* device, D3DRENDERSTATETYPE State, DWORD Value)
+{
+	if (!GetCache(device).SetRenderState(State, Value))
+	{
+		return D3D_OK;
+	}
+	return orgSetRenderState(device, State, Value);
+}
+
+static HRESULT (STDMETHODCALLTYPE* orgSetTexture)(IDirect3DDevice9* device, DWORD Stage, IDirect3DBaseTexture9* pTexture);
+static HRESULT STDMETHODCALLTYPE SetTexture_Filter(IDirect3DDevice9* device, DWORD Stage, IDirect3DBaseTexture9* pTexture)
+{
+	// The device holds a reference to the bound texture, so its address cannot be reused by another texture while bound
+	if (!GetCache(device).SetTexture(Stage, pTexture))
+	{
+		return D3D_OK;
+	}
+	return orgSetTexture(device, Stage, pTexture);
+}
+
+static HRESULT (STDMETHODCALLTYPE* orgSetTextureStageState)(IDirect3DDevice9* device, DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value);
+static HRESULT STDMETHODCALLTYPE SetTextureStageState_Filter(IDirect3DDevice9* device, DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value)
+{
+	if (!GetCache(device).SetTextureStageState(Stage, Type, Value))
+	{
+		return D3D_OK;
+	}
+	return orgSetTextureStageState(device, Stage, Type, Value);
+}
+
+static HRESULT (STDMETHODCALLTYPE* orgSetSamplerState)(IDirect3DDevice9* device, DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD Value);
+static HRESULT STDMETHODCALLTYPE SetSamplerState_Filter(IDirect3DDevice9* device, DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD Value)
+{
+	if (!GetCache(device).SetSamplerState(Sampler, Type, Value))
+	{
+		return D3D_OK;
+	}
+	return orgSetSamplerState(device, Sampler, Type, Value);
+}
+
+// Reset restores the default state
+static HRESULT (STDMETHODCALLTYPE* orgReset)(IDirect3DDevice9* device, D3DPRESENT_PARAMETERS* pPresentationParameters);
+static HRESULT STDMETHODCALLTYPE Reset_Invalidate(IDirect3DDevice9* device, D3DPRESENT_PARAMETERS* pPresentationParameters)
+{
+	GetCache(device).Invalidate();
+	return orgReset(device, pPresentationParameters);
+}
+
+// State blocks change the device state without going through the device methods
+static HRESULT (STDMETHODCALLTYPE* orgApply)(IDirect3DStateBlock9* stateBlock);
+static HRESULT STDMETHODCALLTYPE Apply_Invalidate(IDirect3DStateBlock9* stateBlock)
+{
+	stateCache.Invalidate();
+	return orgApply(stateBlock);
+}
+
+static HRESULT (STDMETHODCALLTYPE* orgCreateStateBlock)(IDirect3DDevice9* device, D3DSTATEBLOCKTYPE Type, IDirect3DStateBlock9** ppSB);
+static HRESULT STDMETHODCALLTYPE CreateStateBlock_Hook(IDirect3DDevice9* device, D3DSTATEBLOCKTYPE Type, IDirect3DStateBlock9** ppSB)
+{
+	const HRESULT hr = orgCreateStateBlock(device, Type, ppSB);
+	if (SUCCEEDED(hr))
+	{
+		VtableHook::Hook(*ppSB, D3D9Hooks::StateBlockVtbl::Apply, orgApply, &Apply_Invalidate);
+	}
+	return hr;
+}
+
+// Calls made while recording a state block are recorded instead of being applied, so they must not be filtered
+static HRESULT (STDMETHODCALLTYPE* orgBeginStateBlock)(IDirect3DDevice9* device);
+static HRESULT STDMETHODCALLTYPE BeginStateBlock_Hook(IDirect3DDevice9* device)
+{
+	const HRESULT hr = orgBeginStateBlock(device);
+	if (SUCCEEDED(hr))
+	{
+		GetCache(device).SetRecording(true);
+	}
+	return hr;
+}
+
+static HRESULT (STDMETHODCALLTYPE* orgEndStateBlock)(IDirect3DDevice9* device, IDirect3DStateBlock9** ppSB);
+static HRESULT STDMETHODCALLTYPE EndStateBlock_Hook(IDirect3DDevice9* device, IDirect3DStateBlock9** ppSB)
+{
+	const HRESULT hr = orgEndStateBlock(device, ppSB);
+	GetCache(device).SetRecording(false);
+	if (SUCCEEDED(hr))
+	{
+		VtableHook::Hook(*ppSB, D3D9Hooks::StateBlockVtbl::Apply, orgApply, &Apply_Invalidate);
+	}
+	return hr;
+}
+
+static void HookDevice(IDirect3DDevice9* device)
+{
+	using namespace D3D9Hooks;
+
+	VtableHook::Hook(device, DeviceVtbl::SetRenderState, orgSetRenderState, &SetRenderState_Filter);
+	VtableHook::Hook(device, DeviceVtbl::SetTexture, orgSetTexture, &SetTexture_Filter);
+	VtableHook::Hook(device, DeviceVtbl::SetTextureStageState, orgSetTextureStageState, &SetTextureStageState_Filter);
+	VtableHook::Hook(device, DeviceVtbl::SetSamplerState, orgSetSamplerState, &SetSamplerState_Filter);
+	VtableHook::Hook(device, DeviceVtbl::Reset, orgReset, &Reset_Invalidate);
+	VtableHook::Hook(device, DeviceVtbl::CreateStateBlock, orgCreateStateBlock, &CreateStateBlock_Hook);
+	VtableHook::Hook(device, DeviceVtbl::BeginStateBlock, orgBeginStateBlock, &BeginStateBlock_Hook);
+	VtableHook::Hook(device, DeviceVtbl::EndStateBlock, orgEndStateBlock, &EndStateBlock_Hook);
+
+	// The device starts with the default state, but it is not known to the cache yet
+	GetCache(device).Invalidate();
+}
+
+static void LogStatistics()
+{
+	const char* names[] = { "SetRenderState", "SetTexture", "SetSamplerState", "SetTextureStageState" };
+	const RenderStateCache::Counters& counters = stateCache.GetCounters();
+	for (size_t i = 0; i < std::size(names); i++)
+	{
+		const double percentage = counters.calls[i] != 0 ? static_cast<double>(counters.filtered[i]) * 100.0 / counters.calls[i] : 0.0;
+		Log::Write("D3D9StateFilter: %s filtered %llu of %llu calls (%.1f%%)", names[i], counters.filtered[i], counters.calls[i], percentage);
+	}
+}
+
+void D3D9StateFilter::Init()
+{
+	D3D9Hooks::OnDeviceCreated(HookDevice);
+	atexit(LogStatistics);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Drops render state, texture, sampler and texture stage state changes that set a value already in effect
+namespace D3D9StateFilter
+{
+	// Registers with D3D9Hooks, must be called before D3D9Hooks::ApplyPatches
+	void Init();
+}
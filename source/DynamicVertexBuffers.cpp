@@ -0,0 +1,104 @@
+#include "DynamicVertexBuffers.h"
+
+#include <cstdlib>
+#include <unordered_map>
+
+#include "D3D9Hooks.h"
+#include "Log.h"
+#include "VertexBufferRing.h"
+#include "VtableHook.h"
+
+// Buffers are only forgotten on Reset. A stale entry for a released buffer is harmless,
+// as a new buffer at the same address isn't used by the GPU yet, and the ring is recreated if the size differs
+static std::unordered_map<IDirect3DVertexBuffer9*, VertexBufferRing> rings;
+
+static uint64_t locksNoOverwrite, locksDiscard, locksWait;
+
+static HRESULT (STDMETHODCALLTYPE* orgLock)(IDirect3DVertexBuffer9* buffer, UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags);
+static HRESULT STDMETHODCALLTYPE Lock_Ring(IDirect3DVertexBuffer9* buffer, UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags)
+{
+	if (!DynamicVertexBuffers::enabled || (Flags & D3DLOCK_READONLY) != 0)
+	{
+		return orgLock(buffer, OffsetToLock, SizeToLock, ppbData, Flags);
+	}
+
+	// Lock flags other than D3DLOCK_READONLY are only valid on dynamic buffers
+	D3DVERTEXBUFFER_DESC desc;
+	if (FAILED(buffer->GetDesc(&desc)) || (desc.Usage & D3DUSAGE_DYNAMIC) == 0)
+	{
+		return orgLock(buffer, OffsetToLock, SizeToLock, ppbData, Flags);
+	}
+
+	auto it = rings.find(buffer);
+	if (it == rings.end() || it->second.GetSize() != desc.Size)
+	{
+		it = rings.insert_or_assign(buffer, VertexBufferRing(desc.Size)).first;
+	}
+	VertexBufferRing& ring = it->second;
+
+	// Respect the flags if the game already picked a strategy
+	if ((Flags & D3DLOCK_DISCARD) != 0)
+	{
+		ring.Discard(OffsetToLock, SizeToLock);
+	}
+	else if ((Flags & D3DLOCK_NOOVERWRITE) != 0)
+	{
+		ring.NoOverwrite(OffsetToLock, SizeToLock);
+	}
+	else
+	{
+		switch (ring.Lock(OffsetToLock, SizeToLock))
+		{
+		case VertexBufferRing::LockMode::NoOverwrite:
+			Flags |= D3DLOCK_NOOVERWRITE;
+			locksNoOverwrite++;
+			break;
+		case VertexBufferRing::LockMode::Discard:
+			Flags |= D3DLOCK_DISCARD;
+			locksDiscard++;
+			break;
+		default:
+			locksWait++;
+			break;
+		}
+	}
+	return orgLock(buffer, OffsetToLock, SizeToLock, ppbData, Flags);
+}
+
+static HRESULT (STDMETHODCALLTYPE* orgCreateVertexBuffer)(IDirect3DDevice9* device, UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9** ppVertexBuffer, HANDLE* pSharedHandle);
+static HRESULT STDMETHODCALLTYPE CreateVertexBuffer_Hook(IDirect3DDevice9* device, UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9** ppVertexBuffer, HANDLE* pSharedHandle)
+{
+	const HRESULT hr = orgCreateVertexBuffer(device, Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle);
+	if (SUCCEEDED(hr))
+	{
+		VtableHook::Hook(*ppVertexBuffer, D3D9Hooks::VertexBufferVtbl::Lock, orgLock, &Lock_Ring);
+	}
+	return hr;
+}
+
+// Dynamic buffers live in the default pool, so they must all be released before Reset
+static HRESULT (STDMETHODCALLTYPE* orgReset)(IDirect3DDevice9* device, D3DPRESENT_PARAMETERS* pPresentationParameters);
+static HRESULT STDMETHODCALLTYPE Reset_ClearRings(IDirect3DDevice9* device, D3DPRESENT_PARAMETERS* pPresentationParameters)
+{
+	rings.clear();
+	return orgReset(device, pPresentationParameters);
+}
+
+static void HookDevice(IDirect3DDevice9* device)
+{
+	using namespace D3D9Hooks;
+
+	VtableHook::Hook(device, DeviceVtbl::CreateVertexBuffer, orgCreateVertexBuffer, &CreateVertexBuffer_Hook);
+	VtableHook::Hook(device, DeviceVtbl::Reset, orgReset, &Reset_ClearRings);
+}
+
+static void LogStatistics()
+{
+	Log::Write("DynamicVertexBuffers: %llu no-overwrite, %llu discard, %llu waiting locks", locksNoOverwrite, locksDiscard, locksWait);
+}
+
+void DynamicVertexBuffers::Init()
+{
+	D3D9Hooks::OnDeviceCreated(HookDevice);
+	atexit(LogStatistics);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Picks no-overwrite and discard locks for the dynamic vertex buffers the game locks without flags,
+// so it doesn't wait for the GPU to finish drawing from them
+namespace DynamicVertexBuffers
+{
+	// Only locks made while this is set are affected, so the strategy stays limited to the hooked game function
+	inline bool enabled = false;
+
+	// Registers with D3D9Hooks, must be called before D3D9Hooks::ApplyPatches
+	void Init();
+}
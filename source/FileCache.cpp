@@ -0,0 +1,595 @@
+#include "FileCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <wil/resource.h>
+
+#include "LoadTrace.h"
+#include "Log.h"
+#include "VideoReadAhead.h"
+
+namespace FileCache
+{
+	struct MappedFile
+	{
+		wil::unique_mapview_ptr<void> view;
+		uint64_t size;
+	};
+
+	// Either a mapped file, or a video streamed with read-ahead
+	struct OpenFile
+	{
+		const MappedFile* file;
+		std::unique_ptr<VideoReadAhead> video;
+		uint64_t size;
+		uint64_t position;
+	};
+
+	static std::vector<std::string> cachedDirectories; // Full, lowercase paths with a trailing backslash
+	static uint64_t mappedBytesBudget;
+	static uint64_t mappedBytes;
+
+	// Files are never unmapped, so pointers to MappedFile stay valid after the lock is released
+	static wil::srwlock cacheLock;
+	static std::unordered_map<std::string, MappedFile> mappedFiles;
+	static std::unordered_map<HANDLE, OpenFile> openFiles;
+
+	static std::atomic<uint32_t> numHits, numMisses, numBypassed, numPrefetched;
+	static std::atomic<uint64_t> bytesServed;
+
+	static bool videoReadAhead = false;
+	static std::atomic<uint64_t> videoBytesBuffered, videoBytesDirect;
+
+	static std::atomic<bool> tracing;
+	static std::set<std::string> tracedPaths; // Guarded by cacheLock
+	static std::atomic<int64_t> tracedIoTicks;
+
+	static int64_t GetTicks()
+	{
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return counter.QuadPart;
+	}
+
+	static std::string NormalizePath(const char* path)
+	{
+		std::string result;
+
+		char buf[MAX_PATH];
+		const DWORD length = GetFullPathNameA(path, static_cast<DWORD>(std::size(buf)), buf, nullptr);
+		if (length != 0 && length < std::size(buf))
+		{
+			result.assign(buf, length);
+			std::transform(result.begin(), result.end(), result.begin(), [](unsigned char ch) {
+				return ch == '/' ? '\\' : static_cast<char>(std::tolower(ch));
+			});
+		}
+		return result;
+	}
+
+	static bool IsCachedPath(const std::string& path)
+	{
+		return std::any_of(cachedDirectories.begin(), cachedDirectories.end(), [&path](const std::string& dir) {
+			return path.compare(0, dir.size(), dir) == 0;
+		});
+	}
+
+	static bool IsVideoPath(const std::string& path)
+	{
+		return path.size() >= 4 && path.compare(path.size() - 4, 4, ".bik") == 0 && path.find("\\movies\\") != std::string::npos;
+	}
+
+	// Lookups of the prefetch thread aren't counted as hits or misses of the game, only files they map are counted as prefetched
+	static const MappedFile* GetOrMapFile(std::string path, HANDLE hFile, bool prefetch = false)
+	{
+		{
+			auto lock = cacheLock.lock_shared();
+			auto it = mappedFiles.find(path);
+			if (it != mappedFiles.end())
+			{
+				if (!prefetch)
+				{
+					numHits++;
+				}
+				return &it->second;
+			}
+		}
+
+		// Empty files cannot be mapped
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(hFile, &size) == FALSE || size.QuadPart == 0)
+		{
+			return nullptr;
+		}
+
+		wil::unique_handle mapping(CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr));
+		if (!mapping)
+		{
+			return nullptr;
+		}
+
+		wil::unique_mapview_ptr<void> view(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0));
+		if (!view)
+		{
+			return nullptr;
+		}
+
+		auto lock = cacheLock.lock_exclusive();
+		auto it = mappedFiles.find(path);
+		if (it != mappedFiles.end())
+		{
+			// Another thread mapped this file in the meantime
+			if (!prefetch)
+			{
+				numHits++;
+			}
+			return &it->second;
+		}
+
+		// Every view takes address space for the lifetime of the process, so keep it within budget
+		if (mappedBytes + size.QuadPart > mappedBytesBudget)
+		{
+			return nullptr;
+		}
+
+		mappedBytes += size.QuadPart;
+		(prefetch ? numPrefetched : numMisses)++;
+		return &mappedFiles.try_emplace(std::move(path), MappedFile{ std::move(view), static_cast<uint64_t>(size.QuadPart) }).first->second;
+	}
+
+	static bool Seek(OpenFile& file, int64_t distance, DWORD moveMethod, uint64_t& newPosition)
+	{
+		int64_t base;
+		switch (moveMethod)
+		{
+		case FILE_BEGIN:
+			base = 0;
+			break;
+		case FILE_CURRENT:
+			base = static_cast<int64_t>(file.position);
+			break;
+		case FILE_END:
+			base = static_cast<int64_t>(file.size);
+			break;
+		default:
+			SetLastError(ERROR_INVALID_PARAMETER);
+			return false;
+		}
+
+		if (base + distance < 0)
+		{
+			SetLastError(ERROR_NEGATIVE_SEEK);
+			return false;
+		}
+
+		file.position = newPosition = static_cast<uint64_t>(base + distance);
+		SetLastError(NO_ERROR);
+		return true;
+	}
+
+	static DWORD WINAPI PrefetchThread(LPVOID param)
+	{
+		std::unique_ptr<std::vector<std::string>> paths(static_cast<std::vector<std::string>*>(param));
+		for (std::string& path : *paths)
+		{
+			wil::unique_hfile hFile(CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
+			if (!hFile)
+			{
+				continue;
+			}
+
+			const MappedFile* file = GetOrMapFile(std::move(path), hFile.get(), true);
+			if (file != nullptr)
+			{
+				// Touch every page to have the OS read it in now, and not when the game accesses it
+				constexpr size_t PAGE_SIZE = 4096;
+				const volatile uint8_t* data = static_cast<const uint8_t*>(file->view.get());
+				for (uint64_t offset = 0; offset < file->size; offset += PAGE_SIZE)
+				{
+					static_cast<void>(data[offset]);
+				}
+			}
+		}
+		return 0;
+	}
+
+	static bool ReadVideo(HANDLE hFile, OpenFile& file, void* buffer, DWORD size, DWORD& bytesRead)
+	{
+		bytesRead = file.video->Read(file.position, buffer, size);
+		videoBytesBuffered += bytesRead;
+		if (bytesRead < size)
+		{
+			// Not buffered, read the remainder directly. The game's handle is only ever positioned here
+			LARGE_INTEGER filePointer;
+			filePointer.QuadPart = static_cast<LONGLONG>(file.position + bytesRead);
+
+			DWORD directBytesRead = 0;
+			if (SetFilePointerEx(hFile, filePointer, nullptr, FILE_BEGIN) == FALSE ||
+				ReadFile(hFile, static_cast<uint8_t*>(buffer) + bytesRead, size - bytesRead, &directBytesRead, nullptr) == FALSE)
+			{
+				return false;
+			}
+			bytesRead += directBytesRead;
+			videoBytesDirect += directBytesRead;
+		}
+		return true;
+	}
+
+	static void LogStatistics()
+	{
+		Log::Write("FileCache: %u hits, %u misses, %u bypassed, %u prefetched, %llu bytes served from %llu bytes mapped",
+			numHits.load(), numMisses.load(), numBypassed.load(), numPrefetched.load(), bytesServed.load(), mappedBytes);
+	}
+
+	static void LogVideoStatistics()
+	{
+		Log::Write("VideoReadAhead: %llu bytes read ahead, %llu bytes read directly", videoBytesBuffered.load(), videoBytesDirect.load());
+	}
+}
+
+static decltype(::ReadFile)* orgReadFile;
+static BOOL WINAPI ReadFile_Redirect(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped)
+{
+	using namespace FileCache;
+
+	if (lpOverlapped == nullptr)
+	{
+		// A handle is never used by two threads at once, so its entry can be used without holding the lock
+		OpenFile* openFile = nullptr;
+		{
+			auto lock = cacheLock.lock_shared();
+			auto it = openFiles.find(hFile);
+			if (it != openFiles.end())
+			{
+				openFile = &it->second;
+			}
+		}
+
+		if (openFile != nullptr)
+		{
+			const uint64_t bytesLeft = openFile->position < openFile->size ? openFile->size - openFile->position : 0;
+			const DWORD bytesToRead = static_cast<DWORD>(std::min<uint64_t>(nNumberOfBytesToRead, bytesLeft));
+
+			DWORD bytesRead = bytesToRead;
+			if (openFile->video)
+			{
+				if (!ReadVideo(hFile, *openFile, lpBuffer, bytesToRead, bytesRead))
+				{
+					return FALSE;
+				}
+			}
+			else
+			{
+				// Pages that are not resident yet get read from disk during the copy
+				const bool traceRead = tracing.load(std::memory_order_relaxed);
+				const int64_t startTicks = traceRead ? GetTicks() : 0;
+				memcpy(lpBuffer, static_cast<const uint8_t*>(openFile->file->view.get()) + openFile->position, bytesToRead);
+				if (traceRead)
+				{
+					tracedIoTicks += GetTicks() - startTicks;
+				}
+				bytesServed += bytesToRead;
+			}
+			openFile->position += bytesRead;
+
+			if (lpNumberOfBytesRead != nullptr)
+			{
+				*lpNumberOfBytesRead = bytesRead;
+			}
+			return TRUE;
+		}
+	}
+	return orgReadFile(hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+}
+
+static decltype(::SetFilePointer)* orgSetFilePointer;
+static DWORD WINAPI SetFilePointer_Redirect(HANDLE hFile, LONG lDistanceToMove, PLONG lpDistanceToMoveHigh, DWORD dwMoveMethod)
+{
+	using namespace FileCache;
+
+	{
+		auto lock = cacheLock.lock_shared();
+		auto it = openFiles.find(hFile);
+		if (it != openFiles.end())
+		{
+			const int64_t distance = lpDistanceToMoveHigh != nullptr ? (static_cast<int64_t>(*lpDistanceToMoveHigh) << 32) | static_cast<uint32_t>(lDistanceToMove)
+				: lDistanceToMove;
+
+			uint64_t newPosition;
+			if (!Seek(it->second, distance, dwMoveMethod, newPosition))
+			{
+				return INVALID_SET_FILE_POINTER;
+			}
+			if (lpDistanceToMoveHigh != nullptr)
+			{
+				*lpDistanceToMoveHigh = static_cast<LONG>(newPosition >> 32);
+			}
+			return static_cast<DWORD>(newPosition);
+		}
+	}
+	return orgSetFilePointer(hFile, lDistanceToMove, lpDistanceToMoveHigh, dwMoveMethod);
+}
+
+static decltype(::SetFilePointerEx)* orgSetFilePointerEx;
+static BOOL WINAPI SetFilePointerEx_Redirect(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod)
+{
+	using namespace FileCache;
+
+	{
+		auto lock = cacheLock.lock_shared();
+		auto it = openFiles.find(hFile);
+		if (it != openFiles.end())
+		{
+			uint64_t newPosition;
+			if (!Seek(it->second, liDistanceToMove.QuadPart, dwMoveMethod, newPosition))
+			{
+				return FALSE;
+			}
+			if (lpNewFilePointer != nullptr)
+			{
+				lpNewFilePointer->QuadPart = static_cast<LONGLONG>(newPosition);
+			}
+			return TRUE;
+		}
+	}
+	return orgSetFilePointerEx(hFile, liDistanceToMove, lpNewFilePointer, dwMoveMethod);
+}
+
+static decltype(::CloseHandle)* orgCloseHandle;
+static BOOL WINAPI CloseHandle_Redirect(HANDLE hObject)
+{
+	using namespace FileCache;
+
+	// Forget the handle before closing it, so it's not mistaken for a cached file once the value gets reused
+	bool isOpenFile;
+	{
+		auto lock = cacheLock.lock_shared();
+		isOpenFile = openFiles.find(hObject) != openFiles.end();
+	}
+	if (isOpenFile)
+	{
+		// Stopping the video read-ahead waits for its thread, so do it outside of the lock
+		decltype(openFiles)::node_type node;
+		{
+			auto lock = cacheLock.lock_exclusive();
+			node = openFiles.extract(hObject);
+		}
+	}
+	return orgCloseHandle(hObject);
+}
+
+static decltype(::CreateFileA)* orgCreateFileA;
+static HANDLE WINAPI CreateFileA_Redirect(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+	DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+{
+	using namespace FileCache;
+
+	// Covers opening the file and mapping it for the cache, as scripts and other game data get loaded
+	const LoadTrace::Span span("CreateFile", "file", lpFileName);
+	const int64_t startTicks = GetTicks();
+	const HANDLE hFile = orgCreateFileA(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+
+	// Only plain, synchronous reads are served from the cache, and only if the game's file handles can be tracked
+	if (orgReadFile == nullptr || orgCloseHandle == nullptr)
+	{
+		return hFile;
+	}
+	if (hFile == INVALID_HANDLE_VALUE || lpFileName == nullptr || dwDesiredAccess != GENERIC_READ || dwCreationDisposition != OPEN_EXISTING
+		|| (dwFlagsAndAttributes & FILE_FLAG_OVERLAPPED) != 0)
+	{
+		return hFile;
+	}
+
+	const DWORD lastError = GetLastError();
+
+	std::string path = NormalizePath(lpFileName);
+	if (videoReadAhead && IsVideoPath(path))
+	{
+		auto video = VideoReadAhead::Open(path.c_str());
+		if (video)
+		{
+			const uint64_t size = video->GetSize();
+
+			auto lock = cacheLock.lock_exclusive();
+			openFiles.insert_or_assign(hFile, OpenFile{ nullptr, std::move(video), size, 0 });
+		}
+	}
+	else if (IsCachedPath(path))
+	{
+		const MappedFile* file = GetOrMapFile(path, hFile);
+
+		auto lock = cacheLock.lock_exclusive();
+		if (file != nullptr)
+		{
+			openFiles.insert_or_assign(hFile, OpenFile{ file, nullptr, file->size, 0 });
+		}
+		else
+		{
+			numBypassed++;
+		}
+
+		if (tracing.load(std::memory_order_relaxed))
+		{
+			tracedPaths.insert(std::move(path));
+			tracedIoTicks += GetTicks() - startTicks;
+		}
+	}
+
+	SetLastError(lastError);
+	return hFile;
+}
+
+template<typename Func>
+static void ReplaceFunction(void** funcPtr, Func*& orgFunc, Func* redirect)
+{
+	DWORD dwProtect;
+
+	auto func = reinterpret_cast<Func**>(funcPtr);
+
+	VirtualProtect(func, sizeof(*func), PAGE_READWRITE, &dwProtect);
+	orgFunc = std::exchange(*func, redirect);
+	VirtualProtect(func, sizeof(*func), dwProtect, &dwProtect);
+}
+
+void FileCache::Init(const char* directories, size_t maxMappedBytes)
+{
+	mappedBytesBudget = maxMappedBytes;
+
+	std::string_view list(directories);
+	while (!list.empty())
+	{
+		const size_t separator = list.find(';');
+		const std::string dir(list.substr(0, separator));
+		list.remove_prefix(separator != std::string_view::npos ? separator + 1 : list.size());
+
+		std::string fullPath = NormalizePath(dir.c_str());
+		if (!dir.empty() && !fullPath.empty())
+		{
+			if (fullPath.back() != '\\')
+			{
+				fullPath.push_back('\\');
+			}
+			cachedDirectories.push_back(std::move(fullPath));
+		}
+	}
+
+	atexit(LogStatistics);
+}
+
+void FileCache::EnableVideoReadAhead()
+{
+	videoReadAhead = true;
+	atexit(LogVideoStatistics);
+}
+
+void FileCache::BeginTrace()
+{
+	auto lock = cacheLock.lock_exclusive();
+	tracedPaths.clear();
+	tracedIoTicks = 0;
+	tracing = true;
+}
+
+std::vector<std::string> FileCache::EndTrace(double& ioTimeMs)
+{
+	auto lock = cacheLock.lock_exclusive();
+	tracing = false;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	ioTimeMs = static_cast<double>(tracedIoTicks.exchange(0)) * 1000.0 / frequency.QuadPart;
+
+	std::vector<std::string> result(std::make_move_iterator(tracedPaths.begin()), std::make_move_iterator(tracedPaths.end()));
+	tracedPaths.clear();
+	return result;
+}
+
+void FileCache::Prefetch(std::vector<std::string> paths)
+{
+	auto context = std::make_unique<std::vector<std::string>>(std::move(paths));
+
+	wil::unique_handle thread(CreateThread(nullptr, 0, PrefetchThread, context.get(), 0, nullptr));
+	if (thread)
+	{
+		SetThreadPriority(thread.get(), THREAD_PRIORITY_BELOW_NORMAL);
+		context.release();
+	}
+}
+
+void FileCache::ApplyPatches(void* module)
+{
+	const DWORD_PTR instance = reinterpret_cast<DWORD_PTR>(module);
+	const PIMAGE_NT_HEADERS ntHeader = reinterpret_cast<PIMAGE_NT_HEADERS>(instance + reinterpret_cast<PIMAGE_DOS_HEADER>(instance)->e_lfanew);
+
+	// Find IAT
+	PIMAGE_IMPORT_DESCRIPTOR pImports = reinterpret_cast<PIMAGE_IMPORT_DESCRIPTOR>(instance + ntHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress);
+
+	auto redirectByName = [](const char* name, void** pAddress)
+	{
+		if ( strcmp(name, "CreateFileA") == 0 )
+		{
+			ReplaceFunction(pAddress, orgCreateFileA, &CreateFileA_Redirect);
+		}
+		else if ( strcmp(name, "ReadFile") == 0 )
+		{
+			ReplaceFunction(pAddress, orgReadFile, &ReadFile_Redirect);
+		}
+		else if ( strcmp(name, "SetFilePointer") == 0 )
+		{
+			ReplaceFunction(pAddress, orgSetFilePointer, &SetFilePointer_Redirect);
+		}
+		else if ( strcmp(name, "SetFilePointerEx") == 0 )
+		{
+			ReplaceFunction(pAddress, orgSetFilePointerEx, &SetFilePointerEx_Redirect);
+		}
+		else if ( strcmp(name, "CloseHandle") == 0 )
+		{
+			ReplaceFunction(pAddress, orgCloseHandle, &CloseHandle_Redirect);
+		}
+	};
+
+	for ( ; pImports->Name != 0; pImports++ )
+	{
+		if ( _stricmp(reinterpret_cast<const char*>(instance + pImports->Name), "kernel32.dll") == 0 )
+		{
+			if ( pImports->OriginalFirstThunk != 0 )
+			{
+				const PIMAGE_THUNK_DATA pThunk = reinterpret_cast<PIMAGE_THUNK_DATA>(instance + pImports->OriginalFirstThunk);
+
+				for ( ptrdiff_t j = 0; pThunk[j].u1.AddressOfData != 0; j++ )
+				{
+					if ( IMAGE_SNAP_BY_ORDINAL(pThunk[j].u1.Ordinal) )
+					{
+						continue;
+					}
+
+					void** pAddress = reinterpret_cast<void**>(instance + pImports->FirstThunk) + j;
+					redirectByName(reinterpret_cast<PIMAGE_IMPORT_BY_NAME>(instance + pThunk[j].u1.AddressOfData)->Name, pAddress);
+				}
+			}
+			else
+			{
+				void** pFunctions = reinterpret_cast<void**>(instance + pImports->FirstThunk);
+
+				for ( ptrdiff_t j = 0; pFunctions[j] != nullptr; j++ )
+				{
+					if ( pFunctions[j] == &CreateFileA )
+					{
+						ReplaceFunction(&pFunctions[j], orgCreateFileA, &CreateFileA_Redirect);
+					}
+					else if ( pFunctions[j] == &ReadFile )
+					{
+						ReplaceFunction(&pFunctions[j], orgReadFile, &ReadFile_Redirect);
+					}
+					else if ( pFunctions[j] == &SetFilePointer )
+					{
+						ReplaceFunction(&pFunctions[j], orgSetFilePointer, &SetFilePointer_Redirect);
+					}
+					else if ( pFunctions[j] == &SetFilePointerEx )
+					{
+						ReplaceFunction(&pFunctions[j], orgSetFilePointerEx, &SetFilePointerEx_Redirect);
+					}
+					else if ( pFunctions[j] == &CloseHandle )
+					{
+						ReplaceFunction(&pFunctions[j], orgCloseHandle, &CloseHandle_Redirect);
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Serves reads of game data files from memory mapped views kept for the lifetime of the process,
+// and reads of videos from read-ahead buffers
+namespace FileCache
+{
+	// directories is a semicolon separated list of directories relative to the game directory
+	void Init(const char* directories, size_t maxMappedBytes);
+
+	// Streams movies/*.bik files on a low priority thread ahead of the decoder
+	void EnableVideoReadAhead();
+
+	void ApplyPatches(void* module);
+
+	// Records the cached files the game opens, and the time it spends opening and reading them
+	void BeginTrace();
+	std::vector<std::string> EndTrace(double& ioTimeMs);
+
+	// Maps the files on a low priority thread, so the game finds them already cached
+	void Prefetch(std::vector<std::string> paths);
+}
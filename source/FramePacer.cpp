@@ -0,0 +1,69 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr double MIN_SPIN_MARGIN_MS = 0.5;
+static constexpr double MAX_SPIN_MARGIN_MS = 4.0;
+
+FramePacer::FramePacer(Clock& clock, double targetFrameMs)
+	: m_clock(clock), m_targetFrameMs(targetFrameMs)
+{
+}
+
+void FramePacer::Wait()
+{
+	double now = m_clock.NowMs();
+	if (!m_started)
+	{
+		m_started = true;
+		m_deadlineMs = now + m_targetFrameMs;
+		m_lastFrameMs = now;
+		return;
+	}
+
+	const bool missed = now >= m_deadlineMs;
+	if (missed)
+	{
+		m_missedFrames++;
+	}
+	else
+	{
+		const double sleepMs = m_deadlineMs - now - m_spinMarginMs;
+		if (sleepMs >= 1.0)
+		{
+			m_clock.SleepMs(sleepMs);
+			const double afterSleep = m_clock.NowMs();
+
+			// Keep the margin above the worst recent oversleep, and let it shrink back slowly
+			const double oversleepMs = (afterSleep - now) - sleepMs;
+			m_spinMarginMs = std::clamp(std::max(m_spinMarginMs * 0.99, oversleepMs * 1.5), MIN_SPIN_MARGIN_MS, MAX_SPIN_MARGIN_MS);
+			now = afterSleep;
+		}
+
+		while (now < m_deadlineMs)
+		{
+			m_clock.Spin();
+			now = m_clock.NowMs();
+		}
+	}
+
+	const double jitterMs = std::abs((now - m_lastFrameMs) - m_targetFrameMs);
+	m_frames++;
+	m_jitterSumMs += jitterMs;
+	m_jitterMaxMs = std::max(m_jitterMaxMs, jitterMs);
+	m_lastFrameMs = now;
+
+	// Late frames start a new schedule instead of rushing the following frames to catch up
+	m_deadlineMs = (missed ? now : m_deadlineMs) + m_targetFrameMs;
+}
+
+FramePacer::Jitter FramePacer::GetJitter() const
+{
+	Jitter jitter;
+	jitter.frames = m_frames;
+	jitter.averageMs = m_frames != 0 ? m_jitterSumMs / m_frames : 0.0;
+	jitter.maxMs = m_jitterMaxMs;
+	jitter.missedFrames = m_missedFrames;
+	return jitter;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+
+// Paces frames to a fixed frame time, sleeping while there is plenty of time left and spinning for the rest,
+// as sleeps are only accurate to about a millisecond. Portable, the clock is provided by the caller
+class FramePacer
+{
+public:
+	class Clock
+	{
+	public:
+		virtual double NowMs() = 0;
+		virtual void SleepMs(double ms) = 0;
+		virtual void Spin() = 0;
+
+	protected:
+		~Clock() = default;
+	};
+
+	struct Jitter
+	{
+		size_t frames = 0;
+		double averageMs = 0.0; // Average difference between the frame time and the target
+		double maxMs = 0.0;
+		size_t missedFrames = 0; // Frames that took longer than the target even without waiting
+	};
+
+	FramePacer(Clock& clock, double targetFrameMs);
+
+	// Waits until the next frame is due, call right before presenting
+	void Wait();
+
+	Jitter GetJitter() const;
+
+private:
+	Clock& m_clock;
+	const double m_targetFrameMs;
+
+	double m_deadlineMs = 0.0;
+	double m_lastFrameMs = 0.0;
+	bool m_started = false;
+
+	// How long before the deadline to stop sleeping, grows when sleeps overshoot
+	double m_spinMarginMs = 2.0;
+
+	size_t m_frames = 0;
+	double m_jitterSumMs = 0.0;
+	double m_jitterMaxMs = 0.0;
+	size_t m_missedFrames = 0;
+};
@@ -0,0 +1,75 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+// Nearest-rank percentile of sorted values. Multiplied before dividing, as 99.9 / 100.0 * 1000 rounds up past 999
+static double Percentile(const std::vector<double>& sorted, double percentile)
+{
+	const size_t rank = static_cast<size_t>(std::ceil(percentile * sorted.size() / 100.0));
+	return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+double FrameStats::GetTotalMs() const
+{
+	double total = 0.0;
+	for (const Frame& frame : m_frames)
+	{
+		total += frame.frameMs;
+	}
+	return total;
+}
+
+FrameStats::Summary FrameStats::Summarize(double Frame::* metric) const
+{
+	Summary summary;
+	if (m_frames.empty())
+	{
+		return summary;
+	}
+
+	std::vector<double> values;
+	values.reserve(m_frames.size());
+	double total = 0.0;
+	for (const Frame& frame : m_frames)
+	{
+		values.push_back(frame.*metric);
+		total += frame.*metric;
+	}
+	std::sort(values.begin(), values.end());
+
+	summary.average = total / values.size();
+	summary.p50 = Percentile(values, 50.0);
+	summary.p90 = Percentile(values, 90.0);
+	summary.p99 = Percentile(values, 99.0);
+	summary.p999 = Percentile(values, 99.9);
+	summary.max = values.back();
+	return summary;
+}
+
+std::string FrameStats::Format() const
+{
+	std::string result;
+	char line[256];
+
+	const double totalMs = GetTotalMs();
+	snprintf(line, sizeof(line), "Frames: %zu in %.1f s, average %.1f FPS\n", m_frames.size(), totalMs / 1000.0,
+		totalMs > 0.0 ? m_frames.size() * 1000.0 / totalMs : 0.0);
+	result.append(line);
+
+	const std::pair<const char*, double Frame::*> metrics[] = {
+		{ "Frame", &Frame::frameMs },
+		{ "CPU", &Frame::cpuMs },
+		{ "Present", &Frame::presentMs },
+	};
+	for (const auto& metric : metrics)
+	{
+		const Summary summary = Summarize(metric.second);
+		snprintf(line, sizeof(line), "%-8s avg %7.2f  p50 %7.2f  p90 %7.2f  p99 %7.2f  p99.9 %7.2f  max %7.2f ms\n", metric.first,
+			summary.average, summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
+		result.append(line);
+	}
+	return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Per-frame timings and their percentiles. Portable, so it can be tested outside of Windows
+class FrameStats
+{
+public:
+	struct Frame
+	{
+		double frameMs; // From the start of the previous Present to the start of this one
+		double cpuMs; // From the end of the previous Present to the start of this one
+		double presentMs; // Time spent in Present
+	};
+
+	struct Summary
+	{
+		double average = 0.0;
+		double p50 = 0.0;
+		double p90 = 0.0;
+		double p99 = 0.0;
+		double p999 = 0.0;
+		double max = 0.0;
+	};
+
+	void Reserve(size_t frames) { m_frames.reserve(frames); }
+	void Clear() { m_frames.clear(); }
+	void AddFrame(const Frame& frame) { m_frames.push_back(frame); }
+
+	size_t GetFrameCount() const { return m_frames.size(); }
+	double GetTotalMs() const;
+	const std::vector<Frame>& GetFrames() const { return m_frames; }
+
+	Summary Summarize(double Frame::* metric) const;
+
+	// Multi-line human readable summary of all metrics
+	std::string Format() const;
+
+private:
+	std::vector<Frame> m_frames;
+};
@@ -0,0 +1,237 @@
+#include "HeapProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <intrin.h>
+#include <wil/resource.h>
+
+#include "XrefIndex.h"
+
+#include "Utils/MemoryMgr.h"
+
+#pragma intrinsic(_ReturnAddress)
+
+namespace HeapProfiler
+{
+	// Size class N holds allocations in range [2^(N-1), 2^N), size class 0 holds empty allocations
+	static constexpr size_t NUM_SIZE_CLASSES = 33;
+
+	struct Counter
+	{
+		uint64_t count;
+		uint64_t bytes;
+	};
+
+	// Only ever written by the owning thread, so recording needs no synchronization
+	struct ThreadBuffer
+	{
+		ThreadBuffer* next;
+		DWORD threadId;
+		Counter total;
+		Counter sizeClasses[NUM_SIZE_CLASSES];
+		Counter callSites[1]; // Actually callSites.size() + 1 entries, the last one is for unknown callers
+	};
+
+	using AllocFunc = void* (*)(size_t size);
+
+	struct CallSite
+	{
+		uintptr_t returnAddress;
+		AllocFunc original; // The allocator, or the patch the call was redirected to before
+	};
+
+	static AllocFunc orgAllocMemory;
+
+	static std::vector<CallSite> callSites; // Sorted by return address
+	static DWORD tlsIndex = TLS_OUT_OF_INDEXES;
+	static std::atomic<ThreadBuffer*> threadBuffers { nullptr };
+
+	static ThreadBuffer* GetThreadBuffer()
+	{
+		ThreadBuffer* buffer = static_cast<ThreadBuffer*>(TlsGetValue(tlsIndex));
+		if (buffer == nullptr)
+		{
+			buffer = static_cast<ThreadBuffer*>(std::calloc(1, offsetof(ThreadBuffer, callSites) + sizeof(Counter) * (callSites.size() + 1)));
+			if (buffer == nullptr)
+			{
+				return nullptr;
+			}
+
+			buffer->threadId = GetCurrentThreadId();
+			TlsSetValue(tlsIndex, buffer);
+
+			// Buffers are never freed, so they can be pushed without locking
+			buffer->next = threadBuffers.load(std::memory_order_relaxed);
+			while (!threadBuffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed))
+			{
+			}
+		}
+		return buffer;
+	}
+
+	static size_t GetSizeClass(size_t size)
+	{
+		unsigned long index;
+		return _BitScanReverse(&index, static_cast<unsigned long>(size)) != 0 ? index + 1 : 0;
+	}
+
+	static void Record(Counter& counter, size_t size)
+	{
+		counter.count++;
+		counter.bytes += size;
+	}
+
+	static void* AllocMemory_Profiled(size_t size)
+	{
+		const uintptr_t returnAddress = reinterpret_cast<uintptr_t>(_ReturnAddress());
+
+		const auto it = std::lower_bound(callSites.begin(), callSites.end(), returnAddress, [](const CallSite& site, uintptr_t address) {
+			return site.returnAddress < address;
+		});
+		const bool isKnown = it != callSites.end() && it->returnAddress == returnAddress;
+
+		ThreadBuffer* buffer = GetThreadBuffer();
+		if (buffer != nullptr)
+		{
+			const size_t callSiteIndex = isKnown ? std::distance(callSites.begin(), it) : callSites.size();
+
+			Record(buffer->total, size);
+			Record(buffer->sizeClasses[GetSizeClass(size)], size);
+			Record(buffer->callSites[callSiteIndex], size);
+		}
+		return isKnown ? it->original(size) : orgAllocMemory(size);
+	}
+
+	static void WriteReport()
+	{
+		wil::unique_file hFile;
+		_wfopen_s(hFile.put(), L"heap_profile.log", L"w");
+		if (!hFile)
+		{
+			return;
+		}
+
+		// Threads may still be running, but this is a diagnostic, so slightly stale counters are fine
+		Counter total {};
+		Counter sizeClasses[NUM_SIZE_CLASSES] {};
+		std::vector<Counter> sites(callSites.size() + 1);
+
+		fprintf_s(hFile.get(), "Threads:\n");
+		for (const ThreadBuffer* buffer = threadBuffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next)
+		{
+			fprintf_s(hFile.get(), "\tThread %u: %llu allocations, %llu bytes\n", buffer->threadId, buffer->total.count, buffer->total.bytes);
+
+			total.count += buffer->total.count;
+			total.bytes += buffer->total.bytes;
+			for (size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+			{
+				sizeClasses[i].count += buffer->sizeClasses[i].count;
+				sizeClasses[i].bytes += buffer->sizeClasses[i].bytes;
+			}
+			for (size_t i = 0; i < sites.size(); i++)
+			{
+				sites[i].count += buffer->callSites[i].count;
+				sites[i].bytes += buffer->callSites[i].bytes;
+			}
+		}
+
+		// Frees are not intercepted, so those are cumulative numbers
+		fprintf_s(hFile.get(), "\nTotal: %llu allocations, %llu bytes\n", total.count, total.bytes);
+
+		fprintf_s(hFile.get(), "\nSize classes:\n");
+		for (size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+		{
+			if (sizeClasses[i].count != 0)
+			{
+				const uint64_t lower = i != 0 ? 1ull << (i - 1) : 0;
+				const uint64_t upper = 1ull << i;
+				fprintf_s(hFile.get(), "\t[%llu, %llu): %llu allocations, %llu bytes\n", lower, upper, sizeClasses[i].count, sizeClasses[i].bytes);
+			}
+		}
+
+		std::vector<size_t> order(sites.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&sites](size_t left, size_t right) {
+			return sites[left].bytes > sites[right].bytes;
+		});
+
+		fprintf_s(hFile.get(), "\nCall sites (%zu intercepted):\n", callSites.size());
+		for (size_t index : order)
+		{
+			if (sites[index].count == 0)
+			{
+				break;
+			}
+			if (index < callSites.size())
+			{
+				// Report the address of the call instruction
+				fprintf_s(hFile.get(), "\t%08X: %llu allocations, %llu bytes\n", static_cast<uint32_t>(callSites[index].returnAddress - 5), sites[index].count, sites[index].bytes);
+			}
+			else
+			{
+				fprintf_s(hFile.get(), "\tOther (calls routed through patches applied later): %llu allocations, %llu bytes\n", sites[index].count, sites[index].bytes);
+			}
+		}
+	}
+}
+
+size_t HeapProfiler::Install(const XrefIndex& xrefs, void* allocFunc, const std::vector<void*>& hookedSites)
+{
+	using namespace Memory;
+
+	// Every relative call to the allocator. The index also finds E8 bytes in the middle of other instructions,
+	// so only sites that still call the allocator and decode as instructions are patched
+	std::vector<void*> sites;
+	for (const uint8_t* caller : xrefs.Callers(allocFunc))
+	{
+		void* site = const_cast<uint8_t*>(caller);
+		void* target;
+		ReadCallFrom(site, target);
+		if (target == allocFunc && xrefs.IsInstructionStart(site))
+		{
+			sites.push_back(site);
+		}
+	}
+	for (void* site : hookedSites)
+	{
+		if (std::find(sites.begin(), sites.end(), site) == sites.end())
+		{
+			sites.push_back(site);
+		}
+	}
+	if (sites.empty())
+	{
+		return 0;
+	}
+
+	tlsIndex = TlsAlloc();
+	if (tlsIndex == TLS_OUT_OF_INDEXES)
+	{
+		return 0;
+	}
+
+	orgAllocMemory = reinterpret_cast<AllocFunc>(allocFunc);
+	for (void* site : sites)
+	{
+		AllocFunc original;
+		ReadCallFrom(site, original);
+		InjectHook(site, AllocMemory_Profiled, HookType::Call);
+		callSites.push_back({ reinterpret_cast<uintptr_t>(site) + 5, original });
+	}
+	std::sort(callSites.begin(), callSites.end(), [](const CallSite& left, const CallSite& right) {
+		return left.returnAddress < right.returnAddress;
+	});
+
+	atexit(WriteReport);
+	return sites.size();
+}
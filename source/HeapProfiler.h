@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class XrefIndex;
+
+// Allocation profiler for the game's internal allocator
+namespace HeapProfiler
+{
+	// Redirects every call to allocFunc found in the index through the profiler, and writes a report on exit.
+	// Calls other patches have already redirected are listed in hookedSites, and the profiler chains on top of them,
+	// so they are still reported by their call site. Returns the number of intercepted call sites
+	size_t Install(const XrefIndex& xrefs, void* allocFunc, const std::vector<void*>& hookedSites);
+}
@@ -0,0 +1,83 @@
+#include "LoadTrace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#include "TraceRecorder.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <wil/resource.h>
+
+namespace LoadTrace
+{
+	// Startup opens a few thousand files at most, so this only fills up if a session runs for hours
+	static constexpr size_t MAX_SPANS = 65536;
+
+	static std::unique_ptr<TraceRecorder> recorder;
+
+	static void WriteTrace()
+	{
+		wil::unique_file hFile;
+		_wfopen_s(hFile.put(), L"load_trace.json", L"wb");
+		if (!hFile)
+		{
+			return;
+		}
+
+		const std::string trace = recorder->ExportChromeTrace("Juiced");
+		fwrite(trace.data(), 1, trace.size(), hFile.get());
+	}
+}
+
+uint64_t LoadTrace::Now()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return static_cast<uint64_t>(counter.QuadPart);
+}
+
+void LoadTrace::Install()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	recorder = std::make_unique<TraceRecorder>(static_cast<uint64_t>(frequency.QuadPart), MAX_SPANS);
+	recorder->NameThread(GetCurrentThreadId(), "Main");
+
+	atexit(WriteTrace);
+}
+
+LoadTrace::Span::Span(const char* name, const char* category, const char* detail)
+	: m_name(name), m_category(category)
+{
+	if (!recorder)
+	{
+		return;
+	}
+
+	m_beginTicks = Now();
+	if (detail != nullptr)
+	{
+		m_detail = detail;
+	}
+}
+
+LoadTrace::Span::Span(const char* name, uint64_t beginTicks)
+	: m_name(name), m_category("init")
+{
+	if (recorder)
+	{
+		m_beginTicks = beginTicks;
+	}
+}
+
+LoadTrace::Span::~Span()
+{
+	if (m_beginTicks != 0)
+	{
+		recorder->Add({ m_name, m_category, std::move(m_detail), m_beginTicks, Now(), GetCurrentThreadId() });
+	}
+}
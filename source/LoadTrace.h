@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Timeline of patch setup and game loading, written to load_trace.json on exit in the Chrome trace event format
+namespace LoadTrace
+{
+	uint64_t Now();
+
+	// Starts recording. The trace starts with the earliest span, which may have begun before this
+	void Install();
+
+	// Records the time from its construction to its destruction, if recording had started by its construction.
+	// Otherwise it doesn't read the clock at all. detail is copied, and only if recording
+	class Span
+	{
+	public:
+		explicit Span(const char* name, const char* category = "init", const char* detail = nullptr);
+		// For a span that began before recording was started, at beginTicks from Now()
+		Span(const char* name, uint64_t beginTicks);
+		~Span();
+
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+
+	private:
+		const char* m_name;
+		const char* m_category;
+		std::string m_detail;
+		uint64_t m_beginTicks = 0;
+	};
+}
@@ -0,0 +1,190 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <wil/resource.h>
+
+namespace Log
+{
+	// Each thread gets its ring on its first message. Rings are never freed, so messages of threads that have already
+	// exited still get written. Threads past the limit don't log
+	static constexpr size_t MAX_THREADS = 64;
+	static constexpr size_t RING_SIZE = 256;
+	static constexpr DWORD WRITE_INTERVAL_MS = 100;
+
+	static wil::unique_hfile hFile;
+	static std::array<std::atomic<LogQueue::Ring*>, MAX_THREADS> rings;
+	static std::atomic<size_t> numRings { 0 };
+	static std::atomic<uint32_t> nextSequence { 0 };
+
+	static LogQueue::Ring* GetThreadRing()
+	{
+		thread_local LogQueue::Ring* const ring = []() -> LogQueue::Ring* {
+			const size_t index = numRings.fetch_add(1, std::memory_order_relaxed);
+			if (index >= MAX_THREADS)
+			{
+				return nullptr;
+			}
+			LogQueue::Ring* newRing = new LogQueue::Ring(RING_SIZE);
+			rings[index].store(newRing, std::memory_order_release);
+			return newRing;
+		}();
+		return ring;
+	}
+
+	// Only ever called from one thread at a time: the writer thread while the game runs, and the thread exiting the process
+	// once the writer is gone. That may be halfway through a Drain, so this doesn't allocate, in case the writer was killed
+	// holding the heap lock, and records are only marked read once written. A writer killed between the two writes its last
+	// batch twice, but never loses it
+	static void Drain()
+	{
+		static char text[16 * 1024];
+		size_t length = 0;
+
+		std::array<LogQueue::Ring*, MAX_THREADS> drained {};
+		std::array<size_t, MAX_THREADS> taken {};
+		const size_t count = std::min(numRings.load(std::memory_order_relaxed), MAX_THREADS);
+		for (size_t i = 0; i < count; i++)
+		{
+			// Null if the thread is just about to publish its ring
+			drained[i] = rings[i].load(std::memory_order_acquire);
+		}
+
+		auto flush = [&] {
+			if (length != 0)
+			{
+				DWORD bytesWritten;
+				WriteFile(hFile.get(), text, static_cast<DWORD>(length), &bytesWritten, nullptr);
+				length = 0;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				if (taken[i] != 0)
+				{
+					drained[i]->EndRead(taken[i]);
+					taken[i] = 0;
+				}
+			}
+		};
+
+		while (true)
+		{
+			// Messages of different threads are written in the order they were logged in, so take the oldest front record
+			const LogQueue::Record* oldest = nullptr;
+			size_t oldestRing = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				const LogQueue::Record* record = drained[i] != nullptr ? drained[i]->Peek(taken[i]) : nullptr;
+				if (record != nullptr && (oldest == nullptr || static_cast<int32_t>(record->sequence - oldest->sequence) < 0))
+				{
+					oldest = record;
+					oldestRing = i;
+				}
+			}
+			if (oldest == nullptr)
+			{
+				break;
+			}
+
+			// Room for the line break, which is written even if a message alone overflows the buffer and gets cut
+			if (length + 3 > sizeof(text))
+			{
+				flush();
+			}
+			size_t messageLength = LogQueue::Format(*oldest, text + length, sizeof(text) - 2 - length);
+			if (length + messageLength + 2 > sizeof(text) && length != 0)
+			{
+				flush();
+				messageLength = LogQueue::Format(*oldest, text, sizeof(text) - 2);
+			}
+			length += std::min(messageLength, sizeof(text) - 3 - length);
+			text[length++] = '\r';
+			text[length++] = '\n';
+			taken[oldestRing]++;
+		}
+
+		size_t dropped = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			dropped += drained[i] != nullptr ? drained[i]->TakeDropped() : 0;
+		}
+		if (dropped != 0)
+		{
+			if (length + 64 > sizeof(text))
+			{
+				flush();
+			}
+			length += snprintf(text + length, sizeof(text) - length, "Log: %zu messages dropped\r\n", dropped);
+		}
+		flush();
+	}
+
+	static void WriterThread()
+	{
+		while (true)
+		{
+			Sleep(WRITE_INTERVAL_MS);
+			Drain();
+		}
+	}
+
+	// Runs on process exit, so the statistics logged on exit get written too. The writer can't be stopped and waited for here:
+	// atexit handlers of the ASI run on DLL detach, under the loader lock and after ExitProcess has terminated the writer
+	static void DrainAtExit()
+	{
+		Drain();
+	}
+}
+
+void Log::Init(bool enable)
+{
+#ifndef NDEBUG
+	enable = true;
+#endif
+	if (!enable)
+	{
+		return;
+	}
+
+	hFile.reset(CreateFileW(L"patches.log", GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+	if (!hFile)
+	{
+		return;
+	}
+
+	details::enabled = true;
+	atexit(DrainAtExit);
+
+	std::thread writer(WriterThread);
+	SetThreadPriority(writer.native_handle(), THREAD_PRIORITY_BELOW_NORMAL);
+	writer.detach();
+}
+
+LogQueue::Record* Log::details::BeginWrite()
+{
+	LogQueue::Ring* ring = GetThreadRing();
+	if (ring == nullptr)
+	{
+		return nullptr;
+	}
+
+	LogQueue::Record* record = ring->BeginWrite();
+	if (record != nullptr)
+	{
+		record->sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+	}
+	return record;
+}
+
+void Log::details::EndWrite()
+{
+	GetThreadRing()->EndWrite();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "LogQueue.h"
+
+// Patch log, written to patches.log in Debug builds, and in Release builds if enabled in the INI.
+// Messages are captured into a ring owned by the calling thread and written out by a background thread,
+// so hooks can log without waiting on file I/O. Arguments are captured by value, see LogQueue for what is supported.
+// If a thread logs faster than messages are written out, new messages are dropped and counted in the log
+namespace Log
+{
+	void Init(bool enable);
+
+	namespace details
+	{
+		inline bool enabled = false;
+
+		// nullptr if the message has to be dropped
+		LogQueue::Record* BeginWrite();
+		void EndWrite();
+	}
+
+	template<typename... Args>
+	void Write(const char* format, const Args&... args)
+	{
+		if (!details::enabled)
+		{
+			return;
+		}
+
+		if (LogQueue::Record* record = details::BeginWrite(); record != nullptr)
+		{
+			LogQueue::Capture(*record, format, args...);
+			details::EndWrite();
+		}
+	}
+}
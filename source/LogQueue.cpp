@@ -0,0 +1,194 @@
+#include "LogQueue.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+	constexpr const char* FLAGS = "-+ #0";
+	constexpr const char* LENGTH_MODIFIERS = "hljztLI";
+	constexpr const char* CONVERSIONS = "diouxXcsfFeEgGaAp";
+
+	double AsDouble(LogQueue::ArgType type, uint64_t value)
+	{
+		switch (type)
+		{
+		case LogQueue::ArgType::Double:
+		{
+			double number;
+			std::memcpy(&number, &value, sizeof(number));
+			return number;
+		}
+		case LogQueue::ArgType::Signed:
+			return static_cast<double>(static_cast<int64_t>(value));
+		default:
+			return static_cast<double>(value);
+		}
+	}
+
+	uint64_t AsInteger(LogQueue::ArgType type, uint64_t value)
+	{
+		return type == LogQueue::ArgType::Double ? static_cast<uint64_t>(static_cast<int64_t>(AsDouble(type, value))) : value;
+	}
+}
+
+size_t LogQueue::Format(const Record& record, char* buffer, size_t size)
+{
+	// Counts everything, but only copies what fits with the null terminator
+	size_t length = 0;
+	auto append = [&](const char* str, size_t count) {
+		if (length + 1 < size)
+		{
+			std::memcpy(buffer + length, str, std::min(count, size - 1 - length));
+		}
+		length += count;
+	};
+
+	size_t arg = 0;
+	const char* format = record.format;
+	while (*format != '\0')
+	{
+		const char* percent = strchr(format, '%');
+		if (percent == nullptr)
+		{
+			append(format, strlen(format));
+			break;
+		}
+		append(format, percent - format);
+		if (percent[1] == '%')
+		{
+			append("%", 1);
+			format = percent + 2;
+			continue;
+		}
+
+		// %[flags][width][.precision][length]conversion, rebuilt with the length matching the captured value
+		const char* cursor = percent + 1;
+		while (*cursor != '\0' && strchr(FLAGS, *cursor) != nullptr) cursor++;
+		while (*cursor >= '0' && *cursor <= '9') cursor++;
+		if (*cursor == '.')
+		{
+			cursor++;
+			while (*cursor >= '0' && *cursor <= '9') cursor++;
+		}
+		const size_t specLength = cursor - percent;
+		while (*cursor != '\0' && strchr(LENGTH_MODIFIERS, *cursor) != nullptr)
+		{
+			// MSVC's I64 and I32
+			cursor += (cursor[0] == 'I' && (cursor[1] == '6' || cursor[1] == '3')) ? 3 : 1;
+		}
+		const char conversion = *cursor;
+		char spec[32];
+		if (conversion == '\0' || strchr(CONVERSIONS, conversion) == nullptr || specLength > sizeof(spec) - 4)
+		{
+			// Not something this can format, e.g. * width, keep it as written
+			append(percent, cursor - percent);
+			format = cursor;
+			continue;
+		}
+		format = cursor + 1;
+
+		if (arg >= record.argCount)
+		{
+			append("<missing>", 9);
+			continue;
+		}
+		const ArgType type = record.types[arg];
+		const uint64_t value = record.values[arg++];
+
+		std::memcpy(spec, percent, specLength);
+		char* specEnd = spec + specLength;
+		if (strchr("diouxX", conversion) != nullptr)
+		{
+			*specEnd++ = 'l';
+			*specEnd++ = 'l';
+		}
+		*specEnd++ = conversion;
+		*specEnd = '\0';
+
+		char buf[128];
+		switch (conversion)
+		{
+		case 'd': case 'i':
+			snprintf(buf, sizeof(buf), spec, static_cast<long long>(AsInteger(type, value)));
+			break;
+		case 'o': case 'u': case 'x': case 'X':
+			snprintf(buf, sizeof(buf), spec, static_cast<unsigned long long>(AsInteger(type, value)));
+			break;
+		case 'c':
+			snprintf(buf, sizeof(buf), spec, static_cast<int>(AsInteger(type, value)));
+			break;
+		case 's':
+			snprintf(buf, sizeof(buf), spec, type == ArgType::String ? record.text + value : "(null)");
+			break;
+		case 'p':
+			snprintf(buf, sizeof(buf), spec, reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+			break;
+		default:
+			snprintf(buf, sizeof(buf), spec, AsDouble(type, value));
+			break;
+		}
+		append(buf, strlen(buf));
+	}
+
+	if (size != 0)
+	{
+		buffer[std::min(length, size - 1)] = '\0';
+	}
+	return length;
+}
+
+std::string LogQueue::Format(const Record& record)
+{
+	char buffer[1024];
+	const size_t length = Format(record, buffer, sizeof(buffer));
+	if (length < sizeof(buffer))
+	{
+		return std::string(buffer, length);
+	}
+
+	std::string result(length, '\0');
+	Format(record, result.data(), length + 1);
+	return result;
+}
+
+LogQueue::Ring::Ring(size_t slotCount)
+	: m_slotCount(slotCount), m_slots(std::make_unique<Record[]>(slotCount))
+{
+}
+
+LogQueue::Record* LogQueue::Ring::BeginWrite()
+{
+	const size_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+	if (writeIndex - m_readIndex.load(std::memory_order_acquire) == m_slotCount)
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	return &m_slots[writeIndex % m_slotCount];
+}
+
+void LogQueue::Ring::EndWrite()
+{
+	m_writeIndex.store(m_writeIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+const LogQueue::Record* LogQueue::Ring::BeginRead()
+{
+	return Peek(0);
+}
+
+const LogQueue::Record* LogQueue::Ring::Peek(size_t index) const
+{
+	const size_t readIndex = m_readIndex.load(std::memory_order_relaxed);
+	if (m_writeIndex.load(std::memory_order_acquire) - readIndex <= index)
+	{
+		return nullptr;
+	}
+	return &m_slots[(readIndex + index) % m_slotCount];
+}
+
+void LogQueue::Ring::EndRead(size_t count)
+{
+	m_readIndex.store(m_readIndex.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
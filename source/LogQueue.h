@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+// Log messages captured as fixed size binary records, formatted later by whoever drains them.
+// A record holds the format string, which must outlive it (a string literal), and up to MAX_ARGS arguments by value.
+// String arguments are copied into the record and truncated if they don't fit.
+// Portable, so it can be stress tested outside of Windows
+namespace LogQueue
+{
+	constexpr size_t MAX_ARGS = 8;
+	constexpr size_t TEXT_SIZE = 128;
+
+	enum class ArgType : uint8_t
+	{
+		Signed,
+		Unsigned,
+		Double,
+		String, // Offset of the null terminated copy in Record::text
+		Pointer,
+	};
+
+	struct Record
+	{
+		const char* format;
+		uint32_t sequence; // Orders records of different rings
+		uint8_t argCount;
+		uint8_t textSize;
+		ArgType types[MAX_ARGS];
+		uint64_t values[MAX_ARGS];
+		char text[TEXT_SIZE];
+	};
+
+	namespace details
+	{
+		inline void AddString(Record& record, const char* str)
+		{
+			const size_t offset = record.textSize;
+			const size_t length = strnlen(str, TEXT_SIZE - 1 - offset);
+			std::memcpy(record.text + offset, str, length);
+			record.text[offset + length] = '\0';
+			record.textSize = static_cast<uint8_t>(offset + length + 1);
+
+			record.types[record.argCount] = ArgType::String;
+			record.values[record.argCount++] = offset;
+		}
+
+		template<typename T>
+		void Add(Record& record, const T& value)
+		{
+			using Type = std::decay_t<T>;
+			if constexpr (std::is_same_v<Type, char*> || std::is_same_v<Type, const char*>)
+			{
+				// Always leave room for at least the null terminator. Null strings and strings that don't fit are null pointers
+				const char* str = value;
+				if (str != nullptr && record.textSize < TEXT_SIZE)
+				{
+					AddString(record, str);
+				}
+				else
+				{
+					record.types[record.argCount] = ArgType::Pointer;
+					record.values[record.argCount++] = 0;
+				}
+			}
+			else if constexpr (std::is_floating_point_v<Type>)
+			{
+				const double number = value;
+				record.types[record.argCount] = ArgType::Double;
+				std::memcpy(&record.values[record.argCount++], &number, sizeof(number));
+			}
+			else if constexpr (std::is_pointer_v<Type>)
+			{
+				record.types[record.argCount] = ArgType::Pointer;
+				record.values[record.argCount++] = reinterpret_cast<uintptr_t>(value);
+			}
+			else if constexpr (std::is_enum_v<Type>)
+			{
+				Add(record, static_cast<std::underlying_type_t<Type>>(value));
+			}
+			else
+			{
+				static_assert(std::is_integral_v<Type>, "Log arguments must be numbers, pointers or C strings");
+				record.types[record.argCount] = std::is_signed_v<Type> ? ArgType::Signed : ArgType::Unsigned;
+				record.values[record.argCount++] = static_cast<uint64_t>(static_cast<std::conditional_t<std::is_signed_v<Type>, int64_t, uint64_t>>(value));
+			}
+		}
+	}
+
+	// Fills everything but the sequence number, which is up to the owner of the rings
+	template<typename... Args>
+	void Capture(Record& record, const char* format, const Args&... args)
+	{
+		static_assert(sizeof...(Args) <= MAX_ARGS, "Too many log arguments");
+
+		record.format = format;
+		record.argCount = 0;
+		record.textSize = 0;
+		(details::Add(record, args), ...);
+	}
+
+	// printf-style formatting of a record. Length modifiers in the format are ignored, since arguments carry their own types;
+	// conversions not matching the captured type convert the value like a cast would
+	std::string Format(const Record& record);
+
+	// Same, into a buffer and without touching the heap. Truncates like snprintf, and returns the length of the whole text
+	size_t Format(const Record& record, char* buffer, size_t size);
+
+	// Lock-free single producer, single consumer ring of records, laid out like PcmRing.
+	// A full ring drops new records instead of waiting, and counts them
+	class Ring
+	{
+	public:
+		explicit Ring(size_t slotCount);
+
+		// Producer only. Returns nullptr and counts a dropped record if the ring is full
+		Record* BeginWrite();
+		void EndWrite();
+
+		// Consumer only. Returns nullptr if the ring is empty
+		const Record* BeginRead();
+		// Consumer only. Returns the record index places past the oldest unread one, or nullptr if there are not that many.
+		// Records stay in place until EndRead frees their slots
+		const Record* Peek(size_t index) const;
+		void EndRead(size_t count = 1);
+
+		// Resets the count
+		size_t TakeDropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+	private:
+		size_t m_slotCount;
+		std::unique_ptr<Record[]> m_slots;
+		std::atomic<size_t> m_dropped { 0 };
+
+		alignas(64) std::atomic<size_t> m_writeIndex { 0 };
+		alignas(64) std::atomic<size_t> m_readIndex { 0 };
+	};
+}
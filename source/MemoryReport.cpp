@@ -0,0 +1,137 @@
+#include "MemoryReport.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#include <wil/resource.h>
+
+namespace MemoryReport
+{
+	struct AddressSpaceInfo
+	{
+		SIZE_T userSpace = 0;
+		SIZE_T committed = 0;
+		SIZE_T reserved = 0;
+		SIZE_T totalFree = 0;
+		SIZE_T largestFree = 0;
+		SIZE_T freeRegions = 0;
+
+		// Free blocks bucketed by size: <1MB, <16MB, <64MB, <256MB, >=256MB
+		SIZE_T freeBuckets[5] {};
+	};
+
+	static bool largeAddressAware = false;
+	static AddressSpaceInfo startupInfo;
+
+	static AddressSpaceInfo QueryAddressSpace()
+	{
+		AddressSpaceInfo info;
+
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+
+		const uintptr_t minAddress = reinterpret_cast<uintptr_t>(systemInfo.lpMinimumApplicationAddress);
+		const uintptr_t maxAddress = reinterpret_cast<uintptr_t>(systemInfo.lpMaximumApplicationAddress);
+		info.userSpace = maxAddress - minAddress + 1;
+
+		MEMORY_BASIC_INFORMATION mbi;
+		for (uintptr_t address = minAddress; address < maxAddress; address += mbi.RegionSize)
+		{
+			if (VirtualQuery(reinterpret_cast<void*>(address), &mbi, sizeof(mbi)) == 0)
+			{
+				break;
+			}
+
+			if (mbi.State == MEM_COMMIT)
+			{
+				info.committed += mbi.RegionSize;
+			}
+			else if (mbi.State == MEM_RESERVE)
+			{
+				info.reserved += mbi.RegionSize;
+			}
+			else if (mbi.State == MEM_FREE)
+			{
+				// Anything smaller than the allocation granularity can never be reserved
+				if (mbi.RegionSize < systemInfo.dwAllocationGranularity)
+				{
+					continue;
+				}
+
+				info.totalFree += mbi.RegionSize;
+				info.largestFree = std::max(info.largestFree, mbi.RegionSize);
+				info.freeRegions++;
+
+				constexpr SIZE_T MB = 1024 * 1024;
+				const SIZE_T bucket = mbi.RegionSize < 1 * MB ? 0 : mbi.RegionSize < 16 * MB ? 1 : mbi.RegionSize < 64 * MB ? 2 : mbi.RegionSize < 256 * MB ? 3 : 4;
+				info.freeBuckets[bucket]++;
+			}
+		}
+
+		return info;
+	}
+
+	static double ToMB(SIZE_T bytes)
+	{
+		return static_cast<double>(bytes) / (1024.0 * 1024.0);
+	}
+
+	static void PrintAddressSpace(FILE* file, const char* header, const AddressSpaceInfo& info)
+	{
+		fprintf_s(file, "%s:\n", header);
+		fprintf_s(file, "\tCommitted: %.1f MB, reserved: %.1f MB\n", ToMB(info.committed), ToMB(info.reserved));
+		fprintf_s(file, "\tFree: %.1f MB in %zu blocks, largest free block: %.1f MB\n", ToMB(info.totalFree), info.freeRegions, ToMB(info.largestFree));
+		fprintf_s(file, "\tFree blocks <1MB: %zu, <16MB: %zu, <64MB: %zu, <256MB: %zu, >=256MB: %zu\n",
+			info.freeBuckets[0], info.freeBuckets[1], info.freeBuckets[2], info.freeBuckets[3], info.freeBuckets[4]);
+
+		// 1.0 means all free space is in one contiguous block
+		const double fragmentation = info.totalFree != 0 ? 1.0 - (static_cast<double>(info.largestFree) / info.totalFree) : 0.0;
+		fprintf_s(file, "\tFragmentation: %.1f%%\n", fragmentation * 100.0);
+	}
+
+	static void WriteReport()
+	{
+		wil::unique_file hFile;
+		_wfopen_s(hFile.put(), L"memory_report.log", L"w");
+		if (!hFile)
+		{
+			return;
+		}
+
+		const AddressSpaceInfo exitInfo = QueryAddressSpace();
+
+		fprintf_s(hFile.get(), "Large address aware: %s\n", largeAddressAware ? "yes" : "no");
+		fprintf_s(hFile.get(), "User address space: %.1f MB\n\n", ToMB(exitInfo.userSpace));
+
+		PrintAddressSpace(hFile.get(), "On startup", startupInfo);
+		PrintAddressSpace(hFile.get(), "On exit", exitInfo);
+
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			fprintf_s(hFile.get(), "\nPeak commit: %.1f MB\n", ToMB(counters.PeakPagefileUsage));
+			fprintf_s(hFile.get(), "Peak working set: %.1f MB\n", ToMB(counters.PeakWorkingSetSize));
+		}
+	}
+}
+
+bool MemoryReport::IsLargeAddressAware(void* module)
+{
+	const DWORD_PTR instance = reinterpret_cast<DWORD_PTR>(module);
+	const PIMAGE_NT_HEADERS ntHeader = reinterpret_cast<PIMAGE_NT_HEADERS>(instance + reinterpret_cast<PIMAGE_DOS_HEADER>(instance)->e_lfanew);
+
+	return (ntHeader->FileHeader.Characteristics & IMAGE_FILE_LARGE_ADDRESS_AWARE) != 0;
+}
+
+void MemoryReport::Install(void* module)
+{
+	largeAddressAware = IsLargeAddressAware(module);
+	startupInfo = QueryAddressSpace();
+
+	atexit(WriteReport);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Address space diagnostics, used to size content unlocks safely
+namespace MemoryReport
+{
+	// The flag can only be set in the executable header, as it's read by the OS on process creation
+	bool IsLargeAddressAware(void* module);
+
+	// Takes an address space snapshot now and writes a report comparing it against the state on exit
+	void Install(void* module);
+}
@@ -0,0 +1,330 @@
+#include <initguid.h>
+
+#include "MusicDecodeAhead.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <wil/com.h>
+#include <wil/resource.h>
+
+#include "Log.h"
+#include "PcmRing.h"
+#include "VtableHook.h"
+
+namespace MusicDecodeAhead
+{
+	// Indices into the IDirectSoundBuffer vtable
+	namespace BufferVtbl
+	{
+		constexpr size_t Lock = 11;
+		constexpr size_t Play = 12;
+		constexpr size_t Stop = 18;
+		constexpr size_t Unlock = 19;
+	}
+
+	// Waiting for the music thread to catch up after an underrun, before giving up on decoding ahead
+	static constexpr DWORD UNDERRUN_WAIT_MS = 100;
+
+	struct Session
+	{
+		Session(size_t chunksAhead, DWORD regionSize)
+			: ring(std::make_unique<PcmRing>(chunksAhead, regionSize))
+		{
+		}
+
+		wil::com_ptr_nothrow<IDirectSoundBuffer> buffer;
+		std::vector<HANDLE> gameEvents;
+		std::vector<wil::unique_event_nothrow> notifyEvents;
+		wil::unique_event_nothrow committedEvent;
+		wil::unique_event_nothrow stopEvent;
+		// Released once the session ends. Hooks only touch it while ahead is set
+		std::unique_ptr<PcmRing> ring;
+
+		// Set while the game was woken to produce a chunk and didn't commit it yet
+		std::atomic<bool> signalOutstanding { false };
+		// Only touched by whoever set signalOutstanding, before it signals the game
+		size_t nextGameEvent = 0;
+		std::atomic<bool> playing { false };
+		// Cleared when the music thread falls behind or the music stops, the game's events are then forwarded as they come
+		std::atomic<bool> ahead { true };
+
+		// Producer side, only touched by the music thread
+		bool writing = false;
+		DWORD writeOffset = 0;
+
+		std::thread feeder;
+	};
+
+	static size_t chunksAhead;
+	static std::atomic<Session*> currentSession;
+	// Sessions are never freed, as the music thread may still be in a hook of an old one. Their rings are
+	// released when they end, so only the small Session structs are kept
+	static std::vector<std::unique_ptr<Session>> sessions;
+
+	static uint64_t chunksFed, underruns;
+
+	static HRESULT (STDMETHODCALLTYPE* orgLock)(IDirectSoundBuffer* buffer, DWORD dwOffset, DWORD dwBytes, LPVOID* ppvAudioPtr1, LPDWORD pdwAudioBytes1,
+		LPVOID* ppvAudioPtr2, LPDWORD pdwAudioBytes2, DWORD dwFlags);
+	static HRESULT (STDMETHODCALLTYPE* orgUnlock)(IDirectSoundBuffer* buffer, LPVOID pvAudioPtr1, DWORD dwAudioBytes1, LPVOID pvAudioPtr2, DWORD dwAudioBytes2);
+	static HRESULT (STDMETHODCALLTYPE* orgPlay)(IDirectSoundBuffer* buffer, DWORD dwReserved1, DWORD dwPriority, DWORD dwFlags);
+	static HRESULT (STDMETHODCALLTYPE* orgStop)(IDirectSoundBuffer* buffer);
+
+	static Session* GetSession(IDirectSoundBuffer* buffer)
+	{
+		Session* session = currentSession.load(std::memory_order_acquire);
+		return session != nullptr && session->buffer.get() == buffer ? session : nullptr;
+	}
+
+	// Wakes the music thread to decode the next chunk, if there's room for it and it's not busy with one already
+	static void Pump(Session& session)
+	{
+		if (!session.ahead || !session.playing || session.ring->GetCount() >= session.ring->GetSlotCount())
+		{
+			return;
+		}
+		if (!session.signalOutstanding.exchange(true, std::memory_order_acq_rel))
+		{
+			// Advanced before waking the music thread, which can commit its chunk and be back here right after
+			const size_t gameEvent = session.nextGameEvent;
+			session.nextGameEvent = (gameEvent + 1) % session.gameEvents.size();
+			SetEvent(session.gameEvents[gameEvent]);
+		}
+	}
+
+	static void Feed(Session& session, const PcmRing::Chunk& chunk)
+	{
+		LPVOID ptr1, ptr2;
+		DWORD bytes1, bytes2;
+		if (SUCCEEDED(orgLock(session.buffer.get(), chunk.tag, chunk.size, &ptr1, &bytes1, &ptr2, &bytes2, 0)))
+		{
+			memcpy(ptr1, chunk.data, bytes1);
+			if (ptr2 != nullptr)
+			{
+				memcpy(ptr2, chunk.data + bytes1, bytes2);
+			}
+			orgUnlock(session.buffer.get(), ptr1, bytes1, ptr2, bytes2);
+		}
+		chunksFed++;
+	}
+
+	static void FeederThread(Session& session)
+	{
+		std::vector<HANDLE> handles;
+		for (const auto& event : session.notifyEvents)
+		{
+			handles.push_back(event.get());
+		}
+		handles.push_back(session.stopEvent.get());
+
+		while (true)
+		{
+			const DWORD result = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE, INFINITE);
+			const DWORD index = result - WAIT_OBJECT_0;
+			if (index >= session.notifyEvents.size())
+			{
+				break;
+			}
+
+			if (session.ahead)
+			{
+				const PcmRing::Chunk* chunk = session.ring->BeginRead();
+				if (chunk == nullptr)
+				{
+					underruns++;
+					if (WaitForSingleObject(session.committedEvent.get(), UNDERRUN_WAIT_MS) == WAIT_OBJECT_0)
+					{
+						chunk = session.ring->BeginRead();
+					}
+				}
+
+				if (chunk != nullptr)
+				{
+					Feed(session, *chunk);
+					session.ring->EndRead();
+					Pump(session);
+					continue;
+				}
+
+				// Decoding can't keep up, so let the music thread refill the buffer directly like it used to
+				session.ahead = false;
+			}
+			SetEvent(session.gameEvents[index]);
+		}
+	}
+
+	static HRESULT STDMETHODCALLTYPE Lock_DecodeAhead(IDirectSoundBuffer* buffer, DWORD dwOffset, DWORD dwBytes, LPVOID* ppvAudioPtr1, LPDWORD pdwAudioBytes1,
+		LPVOID* ppvAudioPtr2, LPDWORD pdwAudioBytes2, DWORD dwFlags)
+	{
+		Session* session = GetSession(buffer);
+		if (session != nullptr && session->ahead && session->signalOutstanding && !session->writing && dwFlags == 0 && dwBytes <= session->ring->GetSlotSize())
+		{
+			if (uint8_t* slot = session->ring->BeginWrite(); slot != nullptr)
+			{
+				session->writing = true;
+				session->writeOffset = dwOffset;
+
+				*ppvAudioPtr1 = slot;
+				*pdwAudioBytes1 = dwBytes;
+				if (ppvAudioPtr2 != nullptr)
+				{
+					*ppvAudioPtr2 = nullptr;
+				}
+				if (pdwAudioBytes2 != nullptr)
+				{
+					*pdwAudioBytes2 = 0;
+				}
+				return DS_OK;
+			}
+		}
+		return orgLock(buffer, dwOffset, dwBytes, ppvAudioPtr1, pdwAudioBytes1, ppvAudioPtr2, pdwAudioBytes2, dwFlags);
+	}
+
+	static HRESULT STDMETHODCALLTYPE Unlock_DecodeAhead(IDirectSoundBuffer* buffer, LPVOID pvAudioPtr1, DWORD dwAudioBytes1, LPVOID pvAudioPtr2, DWORD dwAudioBytes2)
+	{
+		Session* session = GetSession(buffer);
+		if (session != nullptr && session->writing)
+		{
+			session->writing = false;
+			session->ring->EndWrite(dwAudioBytes1, session->writeOffset);
+			session->signalOutstanding.store(false, std::memory_order_release);
+			SetEvent(session->committedEvent.get());
+			Pump(*session);
+			return DS_OK;
+		}
+		return orgUnlock(buffer, pvAudioPtr1, dwAudioBytes1, pvAudioPtr2, dwAudioBytes2);
+	}
+
+	// The buffer is prefilled before it starts playing, so only start decoding ahead after that
+	static HRESULT STDMETHODCALLTYPE Play_DecodeAhead(IDirectSoundBuffer* buffer, DWORD dwReserved1, DWORD dwPriority, DWORD dwFlags)
+	{
+		const HRESULT hr = orgPlay(buffer, dwReserved1, dwPriority, dwFlags);
+		Session* session = GetSession(buffer);
+		if (SUCCEEDED(hr) && session != nullptr)
+		{
+			session->playing = true;
+			Pump(*session);
+		}
+		return hr;
+	}
+
+	// Decoded chunks would play after a restart, so stopped music goes back to the game's own refills
+	static HRESULT STDMETHODCALLTYPE Stop_DecodeAhead(IDirectSoundBuffer* buffer)
+	{
+		Session* session = GetSession(buffer);
+		if (session != nullptr)
+		{
+			session->ahead = false;
+		}
+		return orgStop(buffer);
+	}
+
+	// The music thread refills the region between two notification positions at a time, so chunks never get bigger than the largest one
+	static DWORD GetLargestRegion(DWORD bufferBytes, DWORD count, LPCDSBPOSITIONNOTIFY positions)
+	{
+		std::vector<DWORD> offsets;
+		for (DWORD i = 0; i < count; i++)
+		{
+			if (positions[i].dwOffset != DSBPN_OFFSETSTOP && positions[i].dwOffset < bufferBytes)
+			{
+				offsets.push_back(positions[i].dwOffset);
+			}
+		}
+		if (offsets.empty())
+		{
+			return bufferBytes;
+		}
+
+		std::sort(offsets.begin(), offsets.end());
+		DWORD largest = bufferBytes - offsets.back() + offsets.front();
+		for (size_t i = 1; i < offsets.size(); i++)
+		{
+			largest = std::max(largest, offsets[i] - offsets[i - 1]);
+		}
+		return largest;
+	}
+
+	static void EndSession(Session& session)
+	{
+		session.ahead = false;
+		session.playing = false;
+		SetEvent(session.stopEvent.get());
+		if (session.feeder.joinable())
+		{
+			session.feeder.join();
+		}
+		session.buffer.reset();
+		session.ring.reset();
+	}
+
+	static void LogStatistics()
+	{
+		Log::Write("MusicDecodeAhead: %llu chunks fed, %llu underruns", chunksFed, underruns);
+	}
+}
+
+void MusicDecodeAhead::Init(size_t chunks)
+{
+	chunksAhead = chunks;
+	atexit(LogStatistics);
+}
+
+HRESULT MusicDecodeAhead::SetNotificationPositions(IDirectSoundNotify* notify, DWORD count, LPCDSBPOSITIONNOTIFY positions)
+{
+	if (Session* previous = currentSession.exchange(nullptr); previous != nullptr)
+	{
+		EndSession(*previous);
+	}
+
+	wil::com_ptr_nothrow<IDirectSoundBuffer> buffer;
+	DSBCAPS caps { sizeof(caps) };
+	if (FAILED(notify->QueryInterface(IID_IDirectSoundBuffer, buffer.put_void())) || FAILED(buffer->GetCaps(&caps)))
+	{
+		return notify->SetNotificationPositions(count, positions);
+	}
+
+	auto session = std::make_unique<Session>(chunksAhead, GetLargestRegion(caps.dwBufferBytes, count, positions));
+	session->buffer = std::move(buffer);
+	if (!session->committedEvent.try_create(wil::EventOptions::None) || !session->stopEvent.try_create(wil::EventOptions::ManualReset))
+	{
+		return notify->SetNotificationPositions(count, positions);
+	}
+
+	// DirectSound signals our events, and the feeder thread decides when the game's get signalled
+	std::vector<DSBPOSITIONNOTIFY> ownPositions(positions, positions + count);
+	for (DSBPOSITIONNOTIFY& position : ownPositions)
+	{
+		session->gameEvents.push_back(position.hEventNotify);
+
+		wil::unique_event_nothrow event;
+		if (!event.try_create(wil::EventOptions::None))
+		{
+			return notify->SetNotificationPositions(count, positions);
+		}
+		position.hEventNotify = event.get();
+		session->notifyEvents.push_back(std::move(event));
+	}
+
+	const HRESULT hr = notify->SetNotificationPositions(count, ownPositions.data());
+	if (FAILED(hr))
+	{
+		return notify->SetNotificationPositions(count, positions);
+	}
+
+	// All DirectSound buffers share a vtable
+	IDirectSoundBuffer* bufferPtr = session->buffer.get();
+	VtableHook::Hook(bufferPtr, BufferVtbl::Lock, orgLock, &Lock_DecodeAhead);
+	VtableHook::Hook(bufferPtr, BufferVtbl::Unlock, orgUnlock, &Unlock_DecodeAhead);
+	VtableHook::Hook(bufferPtr, BufferVtbl::Play, orgPlay, &Play_DecodeAhead);
+	VtableHook::Hook(bufferPtr, BufferVtbl::Stop, orgStop, &Stop_DecodeAhead);
+
+	Session& newSession = *session;
+	newSession.feeder = std::thread(FeederThread, std::ref(newSession));
+	sessions.push_back(std::move(session));
+	currentSession.store(&newSession, std::memory_order_release);
+	return hr;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <mmsystem.h>
+#include <dsound.h>
+
+// Lets the music thread decode several buffers ahead of playback into a PcmRing. The game's notification events
+// are signalled whenever the ring has room, and its locks of the music buffer are redirected to the ring.
+// The real notifications only copy the next decoded chunk into the buffer, so refilling it no longer waits on decoding.
+// This relies on the music thread picking the part of the buffer to refill from the event it was woken with
+namespace MusicDecodeAhead
+{
+	void Init(size_t chunksAhead);
+
+	// Replaces IDirectSoundNotify::SetNotificationPositions of the music buffer
+	HRESULT SetNotificationPositions(IDirectSoundNotify* notify, DWORD count, LPCDSBPOSITIONNOTIFY positions);
+}
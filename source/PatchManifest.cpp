@@ -0,0 +1,1016 @@
+#include "PatchManifest.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#include "Signature.h"
+
+// Bytecode layout, all integers little endian:
+//   Header
+//   Per patch: name, ops, OP_END
+// Strings are a varint length followed by the characters. Signatures are stored parsed, with the mask
+// omitted if they have no wildcards, so they are matched straight from the mapped file
+namespace
+{
+	struct Header
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint16_t patchCount;
+		uint32_t size; // Including the header
+		uint32_t checksum; // FNV-1a of everything past the header
+	};
+	static_assert(sizeof(Header) == 16);
+
+	enum Op : uint8_t
+	{
+		OP_END,
+		OP_FIND, // size u8, flags u8, anchor u8, bytes, [mask], count, index
+		OP_WRITE, // label u8, offset, length, bytes
+		OP_NOP, // label u8, offset, count
+		OP_CALL, // label u8, offset, symbol
+		OP_JUMP,
+		OP_INTERCEPT,
+		OP_ADDRESS,
+	};
+
+	constexpr uint8_t FIND_HAS_MASK = 1;
+	constexpr size_t MAX_LABELS = 16;
+	constexpr size_t MAX_MATCHES = 16;
+	constexpr size_t MAX_SIGNATURE_SIZE = 255;
+
+	// Used as the mask of signatures without wildcards
+	const uint8_t FULL_MASK[MAX_SIGNATURE_SIZE] = {
+#define FF16 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+		FF16, FF16, FF16, FF16, FF16, FF16, FF16, FF16, FF16, FF16, FF16, FF16, FF16, FF16, FF16,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+#undef FF16
+	};
+
+	uint32_t Checksum(const uint8_t* data, size_t size)
+	{
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ data[i]) * 16777619u;
+		}
+		return hash;
+	}
+
+	class Writer
+	{
+	public:
+		void Byte(uint8_t value) { m_data.push_back(value); }
+		void Bytes(const uint8_t* data, size_t size) { m_data.insert(m_data.end(), data, data + size); }
+
+		void Varint(uint64_t value)
+		{
+			do
+			{
+				uint8_t byte = value & 0x7F;
+				value >>= 7;
+				if (value != 0)
+				{
+					byte |= 0x80;
+				}
+				Byte(byte);
+			}
+			while (value != 0);
+		}
+
+		void SignedVarint(int64_t value)
+		{
+			Varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+		}
+
+		void String(std::string_view str)
+		{
+			Varint(str.size());
+			Bytes(reinterpret_cast<const uint8_t*>(str.data()), str.size());
+		}
+
+		std::vector<uint8_t>& Data() { return m_data; }
+
+	private:
+		std::vector<uint8_t> m_data;
+	};
+
+	// Bounds checked, as the bytecode comes from a file anyone can edit
+	class Reader
+	{
+	public:
+		Reader(const uint8_t* data, size_t size)
+			: m_data(data), m_size(size)
+		{
+		}
+
+		bool Ok() const { return m_ok; }
+		bool AtEnd() const { return m_position >= m_size; }
+
+		uint8_t Byte()
+		{
+			if (m_position >= m_size)
+			{
+				m_ok = false;
+				return 0;
+			}
+			return m_data[m_position++];
+		}
+
+		const uint8_t* Bytes(size_t size)
+		{
+			if (size > m_size - m_position)
+			{
+				m_ok = false;
+				m_position = m_size;
+				return nullptr;
+			}
+			const uint8_t* result = m_data + m_position;
+			m_position += size;
+			return result;
+		}
+
+		uint64_t Varint()
+		{
+			uint64_t value = 0;
+			for (unsigned int shift = 0; shift < 64; shift += 7)
+			{
+				const uint8_t byte = Byte();
+				value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+				{
+					return value;
+				}
+			}
+			m_ok = false;
+			return 0;
+		}
+
+		int64_t SignedVarint()
+		{
+			const uint64_t value = Varint();
+			return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+		}
+
+		std::string_view String()
+		{
+			const uint64_t size = Varint();
+			const uint8_t* data = size <= m_size ? Bytes(static_cast<size_t>(size)) : nullptr;
+			if (data == nullptr)
+			{
+				m_ok = false;
+				return {};
+			}
+			return { reinterpret_cast<const char*>(data), static_cast<size_t>(size) };
+		}
+
+	private:
+		const uint8_t* m_data;
+		size_t m_size;
+		size_t m_position = 0;
+		bool m_ok = true;
+	};
+
+	struct Find
+	{
+		Signature::PatternView pattern;
+		uint64_t count; // 0 to take the first match
+		uint64_t index;
+	};
+
+	struct Operation
+	{
+		Op op;
+		uint8_t label;
+		int64_t offset;
+		// OP_WRITE bytes
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		// OP_NOP count
+		uint64_t count = 0;
+		std::string_view symbol;
+	};
+
+	// Reads a find after its opcode
+	bool ReadFind(Reader& reader, Find& find)
+	{
+		const size_t size = reader.Byte();
+		const uint8_t flags = reader.Byte();
+		const size_t anchor = reader.Byte();
+		const uint8_t* bytes = reader.Bytes(size);
+		const uint8_t* mask = (flags & FIND_HAS_MASK) != 0 ? reader.Bytes(size) : FULL_MASK;
+		find.count = reader.Varint();
+		find.index = reader.Varint();
+		if (!reader.Ok() || size == 0 || anchor >= size || mask == nullptr || mask[anchor] != 0xFF)
+		{
+			return false;
+		}
+		find.pattern = { bytes, mask, size, anchor };
+		return true;
+	}
+
+	// Reads any other op after its opcode
+	bool ReadOperation(Reader& reader, Op op, Operation& operation)
+	{
+		operation.op = op;
+		operation.label = reader.Byte();
+		operation.offset = reader.SignedVarint();
+		switch (op)
+		{
+		case OP_WRITE:
+			operation.size = static_cast<size_t>(reader.Varint());
+			operation.data = reader.Bytes(operation.size);
+			break;
+		case OP_NOP:
+			operation.count = reader.Varint();
+			break;
+		case OP_CALL:
+		case OP_JUMP:
+		case OP_INTERCEPT:
+		case OP_ADDRESS:
+			operation.symbol = reader.String();
+			break;
+		default:
+			return false;
+		}
+		return reader.Ok();
+	}
+
+	// Bytes the operation writes, to check it stays within the searched range
+	size_t OperationSize(const Operation& operation)
+	{
+		switch (operation.op)
+		{
+		case OP_WRITE: return operation.size;
+		case OP_NOP: return static_cast<size_t>(operation.count);
+		case OP_ADDRESS: return 4;
+		default: return 5;
+		}
+	}
+
+	const PatchManifest::Symbol* FindSymbol(const PatchManifest::Host& host, std::string_view name)
+	{
+		for (size_t i = 0; i < host.symbolCount; i++)
+		{
+			if (name == host.symbols[i].name)
+			{
+				return &host.symbols[i];
+			}
+		}
+		return nullptr;
+	}
+
+	const void* SymbolAddress(const PatchManifest::Symbol& symbol)
+	{
+		return symbol.create != nullptr ? symbol.create() : symbol.address;
+	}
+
+	void WriteBranch(const PatchManifest::Host& host, uint8_t* address, uint8_t opcode, const void* target)
+	{
+		uint8_t code[5];
+		code[0] = opcode;
+		const uint32_t rel = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(target) - (reinterpret_cast<uintptr_t>(address) + 5));
+		std::memcpy(&code[1], &rel, sizeof(rel));
+		host.write(address, code, sizeof(code));
+	}
+
+	std::string Format(const char* format, ...)
+	{
+		char buffer[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+		return buffer;
+	}
+
+	// Runs a patch after its name, leaving the reader past its OP_END.
+	// Malformed patches clear wellFormed, as the following patches can't be located anymore
+	PatchManifest::PatchResult RunPatch(Reader& reader, const PatchManifest::Host& host, bool& wellFormed)
+	{
+		wellFormed = false;
+		PatchManifest::PatchResult result;
+		result.name = std::string(reader.String());
+		result.applied = false;
+
+		std::vector<Operation> operations;
+		uint8_t* labels[MAX_LABELS];
+		size_t labelCount = 0;
+		bool failed = false;
+		for (uint8_t op = reader.Byte(); op != OP_END; op = reader.Byte())
+		{
+			if (!reader.Ok())
+			{
+				result.reason = "Truncated";
+				return result;
+			}
+
+			if (op == OP_FIND)
+			{
+				Find find;
+				if (!ReadFind(reader, find) || labelCount >= MAX_LABELS || find.count > MAX_MATCHES || find.index >= MAX_MATCHES)
+				{
+					result.reason = "Malformed find";
+					return result;
+				}
+				// Keep reading past a failed find, to get to the next patch
+				if (failed)
+				{
+					continue;
+				}
+
+				const uint8_t* matches[MAX_MATCHES];
+				size_t matchCount = 0;
+				const size_t maxCount = find.count != 0 ? static_cast<size_t>(find.count) + 1 : static_cast<size_t>(find.index) + 1;
+				Signature::ForEachMatch(host.begin, host.end, find.pattern, [&](const uint8_t* match) {
+					matches[matchCount++] = match;
+					return matchCount < maxCount && matchCount < MAX_MATCHES;
+				});
+
+				if (find.count != 0 && matchCount != find.count)
+				{
+					result.reason = Format("Signature %zu expected %llu matches, found %zu", labelCount, static_cast<unsigned long long>(find.count), matchCount);
+					failed = true;
+				}
+				else if (find.index >= matchCount)
+				{
+					result.reason = Format("Signature %zu not found", labelCount);
+					failed = true;
+				}
+				else
+				{
+					labels[labelCount++] = const_cast<uint8_t*>(matches[find.index]);
+				}
+				continue;
+			}
+
+			Operation operation;
+			if (!ReadOperation(reader, static_cast<Op>(op), operation))
+			{
+				result.reason = "Malformed operation";
+				return result;
+			}
+			operations.push_back(operation);
+		}
+		if (!reader.Ok())
+		{
+			result.reason = "Truncated";
+			return result;
+		}
+		wellFormed = true;
+		if (failed)
+		{
+			return result;
+		}
+
+		// Validate everything before the first write, so a patch is never applied partially
+		std::vector<void**> intercepted;
+		for (const Operation& operation : operations)
+		{
+			if (operation.label >= labelCount)
+			{
+				result.reason = "Unknown label";
+				return result;
+			}
+			const int64_t rangeSize = host.end - host.begin;
+			const int64_t position = (labels[operation.label] - host.begin) + operation.offset;
+			const size_t size = OperationSize(operation);
+			if (position < 0 || position >= rangeSize || size == 0 || size > static_cast<uint64_t>(rangeSize - position))
+			{
+				result.reason = "Write out of range";
+				return result;
+			}
+			const uint8_t* address = host.begin + position;
+			if (!operation.symbol.empty())
+			{
+				const PatchManifest::Symbol* symbol = FindSymbol(host, operation.symbol);
+				if (symbol == nullptr)
+				{
+					result.reason = "Unknown symbol " + std::string(operation.symbol);
+					return result;
+				}
+				if (operation.op == OP_INTERCEPT)
+				{
+					if (symbol->original == nullptr || (address[0] != 0xE8 && address[0] != 0xE9))
+					{
+						result.reason = "Can't intercept with " + std::string(operation.symbol);
+						return result;
+					}
+					if (*symbol->original != nullptr || std::find(intercepted.begin(), intercepted.end(), symbol->original) != intercepted.end())
+					{
+						result.reason = "Already intercepted with " + std::string(operation.symbol);
+						return result;
+					}
+					intercepted.push_back(symbol->original);
+				}
+				if (SymbolAddress(*symbol) == nullptr)
+				{
+					result.reason = "Can't build " + std::string(operation.symbol);
+					return result;
+				}
+			}
+		}
+
+		for (const Operation& operation : operations)
+		{
+			uint8_t* address = labels[operation.label] + operation.offset;
+			const PatchManifest::Symbol* symbol = !operation.symbol.empty() ? FindSymbol(host, operation.symbol) : nullptr;
+			switch (operation.op)
+			{
+			case OP_WRITE:
+				host.write(address, operation.data, operation.size);
+				break;
+			case OP_NOP:
+			{
+				const std::vector<uint8_t> nops(static_cast<size_t>(operation.count), 0x90);
+				host.write(address, nops.data(), nops.size());
+				break;
+			}
+			case OP_CALL:
+				WriteBranch(host, address, 0xE8, SymbolAddress(*symbol));
+				break;
+			case OP_JUMP:
+				WriteBranch(host, address, 0xE9, SymbolAddress(*symbol));
+				break;
+			case OP_INTERCEPT:
+			{
+				int32_t rel;
+				std::memcpy(&rel, address + 1, sizeof(rel));
+				*symbol->original = address + 5 + rel;
+				WriteBranch(host, address, address[0], SymbolAddress(*symbol));
+				break;
+			}
+			case OP_ADDRESS:
+			{
+				const uint32_t value = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(SymbolAddress(*symbol)));
+				host.write(address, &value, sizeof(value));
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		result.applied = true;
+		return result;
+	}
+}
+
+// ===== Compiler =====
+
+namespace
+{
+	struct Token
+	{
+		std::string text;
+		bool quoted;
+	};
+
+	// Splits a line into words and quoted strings, stopping at a comment
+	bool Tokenize(std::string_view line, std::vector<Token>& tokens, std::string& error)
+	{
+		size_t i = 0;
+		while (i < line.size())
+		{
+			const char ch = line[i];
+			if (ch == ' ' || ch == '\t' || ch == '\r')
+			{
+				i++;
+			}
+			else if (ch == '#')
+			{
+				break;
+			}
+			else if (ch == '"')
+			{
+				const size_t end = line.find('"', i + 1);
+				if (end == std::string_view::npos)
+				{
+					error = "Unterminated string";
+					return false;
+				}
+				tokens.push_back({ std::string(line.substr(i + 1, end - i - 1)), true });
+				i = end + 1;
+			}
+			else
+			{
+				const size_t end = line.find_first_of(" \t\r#\"", i);
+				const size_t length = end == std::string_view::npos ? line.size() - i : end - i;
+				tokens.push_back({ std::string(line.substr(i, length)), false });
+				i += length;
+			}
+		}
+		return true;
+	}
+
+	bool ParseInteger(const std::string& text, long long minimum, unsigned long long maximum, long long& value)
+	{
+		if (text.empty())
+		{
+			return false;
+		}
+		const bool negative = text[0] == '-';
+		const char* digits = text.c_str() + (negative || text[0] == '+' ? 1 : 0);
+		if (*digits == '\0' || *digits == '-' || *digits == '+')
+		{
+			return false;
+		}
+
+		char* end;
+		errno = 0;
+		const unsigned long long magnitude = std::strtoull(digits, &end, 0);
+		if (*end != '\0' || errno != 0)
+		{
+			return false;
+		}
+		if (negative)
+		{
+			if (magnitude > static_cast<unsigned long long>(-(minimum + 1)) + 1)
+			{
+				return false;
+			}
+			value = -static_cast<long long>(magnitude - 1) - 1;
+		}
+		else
+		{
+			if (magnitude > maximum)
+			{
+				return false;
+			}
+			value = static_cast<long long>(magnitude);
+		}
+		return true;
+	}
+
+	class Compiler
+	{
+	public:
+		std::string error;
+
+		bool Line(std::string_view line)
+		{
+			std::vector<Token> tokens;
+			if (!Tokenize(line, tokens, error))
+			{
+				return false;
+			}
+			if (tokens.empty())
+			{
+				return true;
+			}
+
+			const std::string& keyword = tokens[0].text;
+			if (tokens[0].quoted)
+			{
+				return Error("Expected a statement");
+			}
+			if (keyword == "patch")
+			{
+				if (m_inPatch)
+				{
+					return Error("Missing end of the previous patch");
+				}
+				if (tokens.size() != 2 || !tokens[1].quoted)
+				{
+					return Error("Expected patch \"<name>\"");
+				}
+				if (m_patchCount == UINT16_MAX)
+				{
+					return Error("Too many patches");
+				}
+				m_inPatch = true;
+				m_labels.clear();
+				m_writer.String(tokens[1].text);
+				return true;
+			}
+			if (!m_inPatch)
+			{
+				return Error("Statements must be inside a patch");
+			}
+			if (keyword == "end")
+			{
+				if (tokens.size() != 1)
+				{
+					return Error("Unexpected tokens after end");
+				}
+				m_writer.Byte(OP_END);
+				m_inPatch = false;
+				m_patchCount++;
+				return true;
+			}
+			if (keyword == "find")
+			{
+				return FindStatement(tokens);
+			}
+			if (keyword == "write")
+			{
+				return WriteStatement(tokens);
+			}
+			if (keyword == "nop")
+			{
+				uint8_t label;
+				int64_t offset;
+				long long count;
+				if (tokens.size() != 3 || !Location(tokens[1], label, offset) || !ParseInteger(tokens[2].text, 0, 4096, count) || count == 0)
+				{
+					return Error("Expected nop <label>[+-offset] <count>");
+				}
+				Location(OP_NOP, label, offset);
+				m_writer.Varint(static_cast<uint64_t>(count));
+				return true;
+			}
+			if (keyword == "call" || keyword == "jump" || keyword == "intercept")
+			{
+				uint8_t label;
+				int64_t offset;
+				if (tokens.size() != 3 || !Location(tokens[1], label, offset) || tokens[2].quoted)
+				{
+					return Error(("Expected " + keyword + " <label>[+-offset] <symbol>").c_str());
+				}
+				Location(keyword == "call" ? OP_CALL : keyword == "jump" ? OP_JUMP : OP_INTERCEPT, label, offset);
+				m_writer.String(tokens[2].text);
+				return true;
+			}
+			return Error(("Unknown statement " + keyword).c_str());
+		}
+
+		bool Finish(std::vector<uint8_t>& bytecode)
+		{
+			if (m_inPatch)
+			{
+				return Error("Missing end of the last patch");
+			}
+
+			std::vector<uint8_t>& body = m_writer.Data();
+			Header header;
+			header.magic = PatchManifest::MAGIC;
+			header.version = PatchManifest::VERSION;
+			header.patchCount = m_patchCount;
+			header.size = static_cast<uint32_t>(sizeof(header) + body.size());
+			header.checksum = Checksum(body.data(), body.size());
+
+			bytecode.resize(sizeof(header));
+			std::memcpy(bytecode.data(), &header, sizeof(header));
+			bytecode.insert(bytecode.end(), body.begin(), body.end());
+			return true;
+		}
+
+	private:
+		bool Error(const char* message)
+		{
+			error = message;
+			return false;
+		}
+
+		bool FindStatement(const std::vector<Token>& tokens)
+		{
+			if (tokens.size() < 3 || tokens[1].quoted || !tokens[2].quoted)
+			{
+				return Error("Expected find <label> \"<signature>\" [count <n>] [index <i>]");
+			}
+			for (const std::string& label : m_labels)
+			{
+				if (label == tokens[1].text)
+				{
+					return Error("Label defined twice");
+				}
+			}
+			if (m_labels.size() >= MAX_LABELS)
+			{
+				return Error("Too many finds in one patch");
+			}
+
+			std::vector<uint8_t> bytes, mask;
+			bool hasWildcards = false;
+			try
+			{
+				Signature::details::Tokenize(tokens[2].text, [&](uint8_t byte, bool isWildcard) {
+					bytes.push_back(byte);
+					mask.push_back(isWildcard ? 0x00 : 0xFF);
+					hasWildcards |= isWildcard;
+				});
+			}
+			catch (const char* message)
+			{
+				return Error(message);
+			}
+			size_t anchor = 0;
+			while (anchor < mask.size() && mask[anchor] == 0)
+			{
+				anchor++;
+			}
+			if (anchor == mask.size())
+			{
+				return Error("Signature must contain at least one byte that is not a wildcard");
+			}
+			if (bytes.size() > MAX_SIGNATURE_SIZE)
+			{
+				return Error("Signature is too long");
+			}
+
+			long long count = 0, index = 0;
+			for (size_t i = 3; i < tokens.size(); i += 2)
+			{
+				if (i + 1 >= tokens.size())
+				{
+					return Error("Expected a value");
+				}
+				if (tokens[i].text == "count")
+				{
+					if (!ParseInteger(tokens[i + 1].text, 0, MAX_MATCHES, count) || count == 0)
+					{
+						return Error("Count must be between 1 and 16");
+					}
+				}
+				else if (tokens[i].text == "index")
+				{
+					if (!ParseInteger(tokens[i + 1].text, 0, MAX_MATCHES - 1, index))
+					{
+						return Error("Index must be between 0 and 15");
+					}
+				}
+				else
+				{
+					return Error("Expected count or index");
+				}
+			}
+			if (count != 0 && index >= count)
+			{
+				return Error("Index must be lower than count");
+			}
+
+			m_labels.push_back(tokens[1].text);
+			m_writer.Byte(OP_FIND);
+			m_writer.Byte(static_cast<uint8_t>(bytes.size()));
+			m_writer.Byte(hasWildcards ? FIND_HAS_MASK : 0);
+			m_writer.Byte(static_cast<uint8_t>(anchor));
+			m_writer.Bytes(bytes.data(), bytes.size());
+			if (hasWildcards)
+			{
+				m_writer.Bytes(mask.data(), mask.size());
+			}
+			m_writer.Varint(static_cast<uint64_t>(count));
+			m_writer.Varint(static_cast<uint64_t>(index));
+			return true;
+		}
+
+		bool WriteStatement(const std::vector<Token>& tokens)
+		{
+			uint8_t label;
+			int64_t offset;
+			if (tokens.size() != 4 || !Location(tokens[1], label, offset))
+			{
+				return Error("Expected write <label>[+-offset] <type> <value>");
+			}
+
+			const std::string& type = tokens[2].text;
+			const std::string& value = tokens[3].text;
+			if (type == "address")
+			{
+				Location(OP_ADDRESS, label, offset);
+				m_writer.String(value);
+				return true;
+			}
+
+			std::vector<uint8_t> bytes;
+			auto appendInteger = [&](long long minimum, unsigned long long maximum, size_t size) {
+				long long number;
+				if (!ParseInteger(value, minimum, maximum, number))
+				{
+					return false;
+				}
+				for (size_t i = 0; i < size; i++)
+				{
+					bytes.push_back(static_cast<uint8_t>(static_cast<unsigned long long>(number) >> (i * 8)));
+				}
+				return true;
+			};
+
+			bool valid;
+			if (type == "bytes")
+			{
+				valid = tokens[3].quoted;
+				try
+				{
+					Signature::details::Tokenize(value, [&](uint8_t byte, bool isWildcard) {
+						if (isWildcard)
+						{
+							throw "Wildcards can't be written";
+						}
+						bytes.push_back(byte);
+					});
+				}
+				catch (const char* message)
+				{
+					return Error(message);
+				}
+				valid = valid && !bytes.empty();
+			}
+			else if (type == "u8") valid = appendInteger(0, UINT8_MAX, 1);
+			else if (type == "i8") valid = appendInteger(INT8_MIN, INT8_MAX, 1);
+			else if (type == "u16") valid = appendInteger(0, UINT16_MAX, 2);
+			else if (type == "i16") valid = appendInteger(INT16_MIN, INT16_MAX, 2);
+			else if (type == "u32") valid = appendInteger(0, UINT32_MAX, 4);
+			else if (type == "i32") valid = appendInteger(INT32_MIN, INT32_MAX, 4);
+			else if (type == "f32")
+			{
+				char* end;
+				const float number = std::strtof(value.c_str(), &end);
+				valid = !value.empty() && *end == '\0';
+				uint8_t raw[sizeof(number)];
+				std::memcpy(raw, &number, sizeof(number));
+				bytes.assign(std::begin(raw), std::end(raw));
+			}
+			else
+			{
+				return Error(("Unknown type " + type).c_str());
+			}
+			if (!valid)
+			{
+				return Error(("Invalid " + type + " value").c_str());
+			}
+
+			Location(OP_WRITE, label, offset);
+			m_writer.Varint(bytes.size());
+			m_writer.Bytes(bytes.data(), bytes.size());
+			return true;
+		}
+
+		// Parses label, label+offset or label-offset
+		bool Location(const Token& token, uint8_t& label, int64_t& offset)
+		{
+			if (token.quoted)
+			{
+				return false;
+			}
+			const size_t sign = token.text.find_first_of("+-");
+			const std::string name = token.text.substr(0, sign);
+			offset = 0;
+			if (sign != std::string::npos)
+			{
+				long long value;
+				if (!ParseInteger(token.text.substr(sign), INT32_MIN, INT32_MAX, value))
+				{
+					return false;
+				}
+				offset = value;
+			}
+			for (size_t i = 0; i < m_labels.size(); i++)
+			{
+				if (m_labels[i] == name)
+				{
+					label = static_cast<uint8_t>(i);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void Location(Op op, uint8_t label, int64_t offset)
+		{
+			m_writer.Byte(op);
+			m_writer.Byte(label);
+			m_writer.SignedVarint(offset);
+		}
+
+		Writer m_writer;
+		std::vector<std::string> m_labels;
+		uint16_t m_patchCount = 0;
+		bool m_inPatch = false;
+	};
+}
+
+PatchManifest::CompileResult PatchManifest::Compile(std::string_view source)
+{
+	CompileResult result;
+	Compiler compiler;
+
+	size_t lineNumber = 1;
+	for (size_t start = 0; start <= source.size(); lineNumber++)
+	{
+		const size_t end = std::min(source.find('\n', start), source.size());
+		if (!compiler.Line(source.substr(start, end - start)))
+		{
+			result.error = "line " + std::to_string(lineNumber) + ": " + compiler.error;
+			return result;
+		}
+		start = end + 1;
+	}
+
+	if (!compiler.Finish(result.bytecode))
+	{
+		result.error = "line " + std::to_string(lineNumber - 1) + ": " + compiler.error;
+		result.bytecode.clear();
+	}
+	return result;
+}
+
+bool PatchManifest::Validate(const uint8_t* bytecode, size_t size)
+{
+	if (size < sizeof(Header))
+	{
+		return false;
+	}
+	Header header;
+	std::memcpy(&header, bytecode, sizeof(header));
+	return header.magic == MAGIC && header.version == VERSION && header.size == size
+		&& header.checksum == Checksum(bytecode + sizeof(header), size - sizeof(header));
+}
+
+std::optional<std::vector<PatchManifest::PatchResult>> PatchManifest::Run(const uint8_t* bytecode, size_t size, const Host& host)
+{
+	if (!Validate(bytecode, size))
+	{
+		return std::nullopt;
+	}
+
+	Header header;
+	std::memcpy(&header, bytecode, sizeof(header));
+
+	std::vector<PatchResult> results;
+	Reader reader(bytecode + sizeof(header), size - sizeof(header));
+	for (uint16_t i = 0; i < header.patchCount && !reader.AtEnd(); i++)
+	{
+		bool wellFormed;
+		results.push_back(RunPatch(reader, host, wellFormed));
+		if (!wellFormed)
+		{
+			break;
+		}
+	}
+	return results;
+}
+
+std::optional<std::string> PatchManifest::Disassemble(const uint8_t* bytecode, size_t size)
+{
+	if (!Validate(bytecode, size))
+	{
+		return std::nullopt;
+	}
+
+	Header header;
+	std::memcpy(&header, bytecode, sizeof(header));
+
+	std::string listing = Format("%u patches, %zu bytes\n", header.patchCount, size);
+	Reader reader(bytecode + sizeof(header), size - sizeof(header));
+	for (uint16_t i = 0; i < header.patchCount && reader.Ok(); i++)
+	{
+		listing += "patch \"" + std::string(reader.String()) + "\"\n";
+		size_t labelCount = 0;
+		for (uint8_t op = reader.Byte(); op != OP_END && reader.Ok(); op = reader.Byte())
+		{
+			if (op == OP_FIND)
+			{
+				Find find;
+				if (!ReadFind(reader, find))
+				{
+					return std::nullopt;
+				}
+				std::string signature;
+				for (size_t j = 0; j < find.pattern.size; j++)
+				{
+					signature += find.pattern.mask[j] != 0 ? Format("%s%02X", j != 0 ? " " : "", find.pattern.bytes[j]) : (j != 0 ? " ?" : "?");
+				}
+				listing += Format("\tfind %zu \"%s\" count %llu index %llu\n", labelCount++, signature.c_str(),
+					static_cast<unsigned long long>(find.count), static_cast<unsigned long long>(find.index));
+				continue;
+			}
+
+			Operation operation;
+			if (!ReadOperation(reader, static_cast<Op>(op), operation))
+			{
+				return std::nullopt;
+			}
+			static const char* const names[] = { "end", "find", "write", "nop", "call", "jump", "intercept", "write address" };
+			listing += Format("\t%s %u%+lld", names[operation.op], operation.label, static_cast<long long>(operation.offset));
+			if (operation.op == OP_WRITE)
+			{
+				listing += " bytes \"";
+				for (size_t j = 0; j < operation.size; j++)
+				{
+					listing += Format("%s%02X", j != 0 ? " " : "", operation.data[j]);
+				}
+				listing += "\"";
+			}
+			else if (operation.op == OP_NOP)
+			{
+				listing += Format(" %llu", static_cast<unsigned long long>(operation.count));
+			}
+			else
+			{
+				listing += " " + std::string(operation.symbol);
+			}
+			listing += "\n";
+		}
+		listing += "end\n";
+	}
+	if (!reader.Ok())
+	{
+		return std::nullopt;
+	}
+	return listing;
+}
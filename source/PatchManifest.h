@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Patches described outside of the code, so builds found later can be supported without rebuilding SilentPatch.
+// A text manifest is compiled ahead of time into bytecode with signatures already parsed, which is then
+// mapped and run at startup. The text format, one statement per line:
+//
+//   # Comment
+//   patch "Name"
+//       find <label> "<signature>" [count <n>] [index <i>]
+//       write <label>[+-offset] bytes "<hex bytes>"
+//       write <label>[+-offset] u8|i8|u16|i16|u32|i32|f32 <value>
+//       write <label>[+-offset] address <symbol>
+//       nop <label>[+-offset] <count>
+//       call|jump <label>[+-offset] <symbol>
+//       intercept <label>[+-offset] <symbol>
+//   end
+//
+// Patches are applied all or nothing: if any signature doesn't match or any symbol is unknown, nothing is written.
+// find takes the first match by default, count requires the exact number of matches, and index picks one of them.
+// Symbols are functions and variables SilentPatch exposes to manifests. intercept redirects a call or a jump, keeping
+// which of the two it is, and stores the function it went to in the symbol's original function pointer first.
+// That pointer can only be set once, so a symbol already intercepted with, in this patch or an earlier one, is rejected.
+// Portable, so manifests can be compiled and tested outside of Windows
+namespace PatchManifest
+{
+	constexpr uint32_t MAGIC = 0x4D4A5053; // SPJM
+	constexpr uint16_t VERSION = 1;
+
+	struct CompileResult
+	{
+		std::vector<uint8_t> bytecode;
+		std::string error; // "line <n>: <message>" if compilation failed
+	};
+	CompileResult Compile(std::string_view source);
+
+	struct Symbol
+	{
+		const char* name;
+		const void* address;
+		// Set by intercept, nullptr for symbols that can't be used with it
+		void** original;
+		// Builds the symbol the first time a patch uses it, in place of address, for symbols that cost something to build.
+		// Called for every use, so it must keep returning the same address. nullptr if the symbol can't be built
+		const void* (*create)() = nullptr;
+	};
+
+	struct Host
+	{
+		// Signatures are searched for in this range
+		const uint8_t* begin;
+		const uint8_t* end;
+
+		const Symbol* symbols;
+		size_t symbolCount;
+
+		// Writes to code, taking care of page protection
+		void (*write)(uint8_t* address, const void* data, size_t size);
+	};
+
+	struct PatchResult
+	{
+		std::string name;
+		bool applied;
+		std::string reason; // Why the patch wasn't applied
+	};
+
+	// Checks the header and the checksum of the whole bytecode, so a truncated or corrupted file is never run
+	bool Validate(const uint8_t* bytecode, size_t size);
+
+	// Returns std::nullopt if the bytecode is not valid. Malformed patches are reported and skipped
+	std::optional<std::vector<PatchResult>> Run(const uint8_t* bytecode, size_t size, const Host& host);
+
+	// Human readable listing of the bytecode, for checking what a manifest compiled to
+	std::optional<std::string> Disassemble(const uint8_t* bytecode, size_t size);
+}
@@ -0,0 +1,50 @@
+#include "PcmRing.h"
+
+PcmRing::PcmRing(size_t slotCount, size_t slotSize)
+	: m_slotSize(slotSize), m_data(std::make_unique<uint8_t[]>(slotCount * slotSize)), m_slots(slotCount)
+{
+	for (size_t i = 0; i < slotCount; i++)
+	{
+		m_slots[i].data = m_data.get() + i * slotSize;
+	}
+}
+
+uint8_t* PcmRing::BeginWrite()
+{
+	const size_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+	if (writeIndex - m_readIndex.load(std::memory_order_acquire) == m_slots.size())
+	{
+		return nullptr;
+	}
+	return m_slots[writeIndex % m_slots.size()].data;
+}
+
+void PcmRing::EndWrite(uint32_t size, uint32_t tag)
+{
+	const size_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+	Chunk& chunk = m_slots[writeIndex % m_slots.size()];
+	chunk.size = size;
+	chunk.tag = tag;
+	m_writeIndex.store(writeIndex + 1, std::memory_order_release);
+}
+
+const PcmRing::Chunk* PcmRing::BeginRead()
+{
+	const size_t readIndex = m_readIndex.load(std::memory_order_relaxed);
+	if (readIndex == m_writeIndex.load(std::memory_order_acquire))
+	{
+		return nullptr;
+	}
+	return &m_slots[readIndex % m_slots.size()];
+}
+
+void PcmRing::EndRead()
+{
+	m_readIndex.store(m_readIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+size_t PcmRing::GetCount() const
+{
+	const size_t readIndex = m_readIndex.load(std::memory_order_acquire);
+	return m_writeIndex.load(std::memory_order_acquire) - readIndex;
+}
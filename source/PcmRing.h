@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Lock-free single producer, single consumer ring of fixed size PCM chunks.
+// The producer writes straight into a free slot and commits it, the consumer reads committed slots in order
+// and releases them; neither side ever waits on the other. Each chunk carries a tag, e.g. where it goes in the sound buffer.
+// Portable, so it can be stress tested outside of Windows
+class PcmRing
+{
+public:
+	struct Chunk
+	{
+		uint8_t* data;
+		uint32_t size;
+		uint32_t tag;
+	};
+
+	PcmRing(size_t slotCount, size_t slotSize);
+
+	size_t GetSlotCount() const { return m_slots.size(); }
+	size_t GetSlotSize() const { return m_slotSize; }
+
+	// Producer only. Returns nullptr if the ring is full
+	uint8_t* BeginWrite();
+	void EndWrite(uint32_t size, uint32_t tag);
+
+	// Consumer only. Returns nullptr if the ring is empty
+	const Chunk* BeginRead();
+	void EndRead();
+
+	// Exact from the producer's and the consumer's own thread for its own side, a snapshot otherwise
+	size_t GetCount() const;
+
+private:
+	size_t m_slotSize;
+	std::unique_ptr<uint8_t[]> m_data;
+	std::vector<Chunk> m_slots;
+
+	// Both only ever grow, written by one side each. Kept apart so the two threads don't share a cache line
+	alignas(64) std::atomic<size_t> m_writeIndex { 0 };
+	alignas(64) std::atomic<size_t> m_readIndex { 0 };
+};
@@ -1,13 +1,25 @@
 #include "Registry.h"
 
+#include "LoadTrace.h"
+#include "Log.h"
+#include "SettingsImage.h"
+#include "SnapshotStore.h"
+#include "TextConversion.h"
+
+#include <algorithm>
+#include <cwctype>
 #include <filesystem>
+#include <memory>
 #include <string>
+#include <variant>
+#include <vector>
 
 #include <guiddef.h>
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <Windows.h>
+#include <wil/resource.h>
 #include <wil/win32_helpers.h>
 
 static std::wstring pathToPatchIni = L".\\" rsc_Name ".ini";
@@ -19,40 +31,276 @@ namespace Registry
 
 	std::optional<int32_t> GetRegistryInt(const wchar_t* section, const wchar_t* key, const std::wstring& path);
 	std::optional<uint32_t> GetRegistryDword(const wchar_t* section, const wchar_t* key, const std::wstring& path);
-	std::optional<CLSID> GetRegistryCLSID(const wchar_t* section, const wchar_t* key, const std::wstring& path);
 	std::optional<std::string> GetRegistryAnsiString(const wchar_t* section, const wchar_t* key, const std::wstring& path);
 	std::optional<std::wstring> GetRegistryString(const wchar_t* section, const wchar_t* key, const std::wstring& path);
 
 	void SetRegistryDword(const wchar_t* section, const wchar_t* key, uint32_t value, const std::wstring& path);
 	void SetRegistryCLSID(const wchar_t* section, const wchar_t* key, const CLSID& value, const std::wstring& path);
+
+	// The game's settings live in a binary image in shared memory, mapped by both the game and JuicedConfig.exe.
+	// The first process to map it imports settings.ini, and every process exports the image back to it on exit,
+	// so the processes never parse the INI file or race on it while running.
+	// Registry reads come from several threads, so they read an immutable snapshot of the image,
+	// refreshed when the image's sequence number shows another process or thread changed it
+	struct GameSettings
+	{
+		using Data = std::variant<uint32_t, CLSID>;
+		struct Value
+		{
+			std::string name;
+			Data data;
+		};
+
+		// Sorted by name, case insensitive like registry value names
+		std::vector<Value> values;
+		uint32_t sequence = 0;
+
+		const Value* Find(const char* name) const;
+		void Set(const char* name, Data data);
+
+	private:
+		std::vector<Value>::const_iterator LowerBound(const char* name) const;
+	};
+
+	static SnapshotStore<GameSettings> gameSettings;
+
+	static std::optional<SettingsImage> settingsImage;
+	static wil::unique_handle settingsMapping;
+	static wil::unique_mapview_ptr<void> settingsView;
+	static std::unique_ptr<uint8_t[]> settingsLocalImage;
+	// Serializes writes to the image across processes
+	static wil::unique_mutex_nothrow settingsMutex;
+
+	static void OpenGameSettings();
+	static void ImportGameSettings();
+	static void ExportGameSettings();
+	static void RefreshGameSettings();
+	static const GameSettings& GetGameSettings();
+	static void WriteGameSetting(const char* name, SettingsImage::Type type, const void* data, uint32_t size);
+	static void WriteSettingsImage(const char* name, SettingsImage::Type type, const void* data, uint32_t size);
 }
 
-static std::wstring AnsiToWchar(std::string_view text)
+std::vector<Registry::GameSettings::Value>::const_iterator Registry::GameSettings::LowerBound(const char* name) const
 {
-	std::wstring result;
+	return std::lower_bound(values.begin(), values.end(), name, [](const Value& value, const char* name) {
+		return _stricmp(value.name.c_str(), name) < 0;
+	});
+}
 
-	const int count = MultiByteToWideChar(CP_ACP, 0, text.data(), text.size(), nullptr, 0);
-	if (count != 0)
+const Registry::GameSettings::Value* Registry::GameSettings::Find(const char* name) const
+{
+	auto it = LowerBound(name);
+	if (it != values.end() && _stricmp(it->name.c_str(), name) == 0)
 	{
-		result.resize(count);
-		MultiByteToWideChar(CP_ACP, 0, text.data(), text.size(), result.data(), count);
+		return &*it;
 	}
+	return nullptr;
+}
 
-	return result;
+void Registry::GameSettings::Set(const char* name, Data data)
+{
+	auto it = LowerBound(name);
+	if (it != values.end() && _stricmp(it->name.c_str(), name) == 0)
+	{
+		values[it - values.begin()].data = data;
+	}
+	else
+	{
+		values.insert(it, Value{name, data});
+	}
 }
 
-static std::string WcharToAnsi(std::wstring_view text)
+void Registry::OpenGameSettings()
 {
-	std::string result;
+	// Name the objects after the game directory, so different demos don't share settings
+	uint32_t hash = 2166136261u;
+	for (wchar_t ch : pathToGameIni)
+	{
+		hash = (hash ^ towlower(ch)) * 16777619u;
+	}
+	wchar_t mutexName[64], mappingName[64];
+	swprintf_s(mutexName, L"Local\\" rsc_Name L".Settings.%08X.Lock", hash);
+	swprintf_s(mappingName, L"Local\\" rsc_Name L".Settings.%08X", hash);
 
-	const int count = WideCharToMultiByte(CP_ACP, 0, text.data(), text.size(), nullptr, 0, nullptr, nullptr);
-	if (count != 0)
+	if (!settingsMutex.try_create(mutexName) && !settingsMutex.try_create(nullptr))
 	{
-		result.resize(count);
-		WideCharToMultiByte(CP_ACP, 0, text.data(), text.size(), result.data(), count, nullptr, nullptr);
+		return;
 	}
 
-	return result;
+	// Hold the lock until the image is initialized, so the other process doesn't see it half imported
+	DWORD status;
+	auto lock = settingsMutex.acquire(&status);
+
+	settingsMapping.reset(CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(SettingsImage::SIZE), mappingName));
+	if (settingsMapping)
+	{
+		settingsView.reset(MapViewOfFile(settingsMapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, SettingsImage::SIZE));
+	}
+
+	// Without shared memory, settings still work but are private to this process
+	if (settingsView)
+	{
+		settingsImage.emplace(settingsView.get());
+	}
+	else
+	{
+		settingsLocalImage = std::make_unique<uint8_t[]>(SettingsImage::SIZE);
+		settingsImage.emplace(settingsLocalImage.get());
+	}
+
+	if (!settingsImage->IsValid())
+	{
+		settingsImage->Initialize();
+		ImportGameSettings();
+	}
+	else if (status == WAIT_ABANDONED)
+	{
+		settingsImage->Repair();
+	}
+	lock.reset();
+
+	RefreshGameSettings();
+	atexit(ExportGameSettings);
+}
+
+void Registry::ImportGameSettings()
+{
+	// Returns the size minus 2 if the buffer is too small
+	std::vector<wchar_t> section(4096);
+	while (GetPrivateProfileSectionW(REGISTRY_SECTION_NAME, section.data(), static_cast<DWORD>(section.size()), pathToGameIni.c_str()) == section.size() - 2)
+	{
+		section.resize(section.size() * 2);
+	}
+
+	for (const wchar_t* line = section.data(); *line != L'\0'; line += wcslen(line) + 1)
+	{
+		const wchar_t* separator = wcschr(line, L'=');
+		if (separator == nullptr)
+		{
+			continue;
+		}
+
+		const std::wstring name(line, separator);
+		const wchar_t* value = separator + 1;
+		const TextConversion::AnsiString ansiName(name);
+		if (_wcsicmp(name.c_str(), L"Adapter") == 0)
+		{
+			CLSID clsid;
+			if (SUCCEEDED(CLSIDFromString(value, &clsid)))
+			{
+				WriteSettingsImage(ansiName.c_str(), SettingsImage::Type::Guid, &clsid, sizeof(clsid));
+			}
+		}
+		else
+		{
+			// Same rules as GetPrivateProfileInt
+			const uint32_t dword = static_cast<uint32_t>(wcstol(value, nullptr, 10));
+			WriteSettingsImage(ansiName.c_str(), SettingsImage::Type::Dword, &dword, sizeof(dword));
+		}
+	}
+}
+
+void Registry::ExportGameSettings()
+{
+	auto lock = settingsMutex.acquire();
+
+	std::vector<SettingsImage::Entry> entries;
+	uint32_t sequence;
+	if (!settingsImage->ReadAll(entries, sequence))
+	{
+		return;
+	}
+
+	for (const SettingsImage::Entry& entry : entries)
+	{
+		const TextConversion::WideString name(entry.name);
+		if (entry.type == SettingsImage::Type::Guid && entry.size == sizeof(CLSID))
+		{
+			CLSID clsid;
+			memcpy(&clsid, entry.data, sizeof(clsid));
+			SetRegistryCLSID(REGISTRY_SECTION_NAME, name.c_str(), clsid, pathToGameIni);
+		}
+		else if (entry.type == SettingsImage::Type::Dword && entry.size == sizeof(uint32_t))
+		{
+			uint32_t dword;
+			memcpy(&dword, entry.data, sizeof(dword));
+			SetRegistryDword(REGISTRY_SECTION_NAME, name.c_str(), dword, pathToGameIni);
+		}
+	}
+}
+
+void Registry::RefreshGameSettings()
+{
+	std::vector<SettingsImage::Entry> entries;
+	uint32_t sequence;
+	if (!settingsImage->ReadAll(entries, sequence))
+	{
+		// A writer died halfway through, the mutex tells which one
+		auto lock = settingsMutex.acquire();
+		settingsImage->Repair();
+		if (!settingsImage->ReadAll(entries, sequence))
+		{
+			return;
+		}
+	}
+
+	GameSettings settings;
+	settings.sequence = sequence;
+	for (const SettingsImage::Entry& entry : entries)
+	{
+		if (entry.type == SettingsImage::Type::Guid && entry.size == sizeof(CLSID))
+		{
+			CLSID clsid;
+			memcpy(&clsid, entry.data, sizeof(clsid));
+			settings.Set(entry.name.c_str(), clsid);
+		}
+		else if (entry.type == SettingsImage::Type::Dword && entry.size == sizeof(uint32_t))
+		{
+			// Negative values count as missing, like with GetPrivateProfileInt
+			uint32_t dword;
+			memcpy(&dword, entry.data, sizeof(dword));
+			if (static_cast<int32_t>(dword) >= 0)
+			{
+				settings.Set(entry.name.c_str(), dword);
+			}
+		}
+	}
+	gameSettings.Reset(std::move(settings));
+}
+
+const Registry::GameSettings& Registry::GetGameSettings()
+{
+	const GameSettings& settings = gameSettings.Get();
+	if (settingsImage && settingsImage->GetSequence() != settings.sequence)
+	{
+		RefreshGameSettings();
+		return gameSettings.Get();
+	}
+	return settings;
+}
+
+void Registry::WriteGameSetting(const char* name, SettingsImage::Type type, const void* data, uint32_t size)
+{
+	if (!settingsImage)
+	{
+		return;
+	}
+
+	{
+		auto lock = settingsMutex.acquire();
+		WriteSettingsImage(name, type, data, size);
+	}
+	RefreshGameSettings();
+}
+
+void Registry::WriteSettingsImage(const char* name, SettingsImage::Type type, const void* data, uint32_t size)
+{
+	// Settings that don't fit can't be read back by the game, nor saved to settings.ini on exit
+	if (!settingsImage->Write(name, type, data, size))
+	{
+		Log::Write("Registry: Setting %s was lost, names are limited to %zu characters and the image to %zu settings",
+			name, SettingsImage::MAX_NAME_LENGTH, SettingsImage::MAX_SLOTS);
+	}
 }
 
 bool Registry::Init()
@@ -127,23 +375,6 @@ std::optional<uint32_t> Registry::GetRegistryDword(const wchar_t* section, const
 	return result;
 }
 
-std::optional<CLSID> Registry::GetRegistryCLSID(const wchar_t* section, const wchar_t* key, const std::wstring& path)
-{
-	std::optional<CLSID> result;
-
-	wchar_t buf[wil::guid_string_buffer_length];
-	GetPrivateProfileStringW(section, key, L"", buf, static_cast<DWORD>(std::size(buf)), path.c_str());
-	if (buf[0] != '\0')
-	{
-		CLSID clsid;
-		if (SUCCEEDED(CLSIDFromString(buf, &clsid)))
-		{
-			result.emplace(clsid);
-		}
-	}
-	return result;
-}
-
 std::optional<std::string> Registry::GetRegistryAnsiString(const wchar_t* section, const wchar_t* key, const std::wstring& path)
 {
 	std::optional<std::string> result;
@@ -152,7 +383,8 @@ std::optional<std::string> Registry::GetRegistryAnsiString(const wchar_t* sectio
 	GetPrivateProfileStringW(section, key, L"", buf, static_cast<DWORD>(std::size(buf)), path.c_str());
 	if (buf[0] != '\0')
 	{
-		result.emplace(WcharToAnsi(buf));
+		const TextConversion::AnsiString ansi(buf);
+		result.emplace(ansi.c_str());
 	}
 	return result;
 }
@@ -216,31 +448,18 @@ static LSTATUS WINAPI RegQueryValueExA_Redirect(HKEY hKey, LPCSTR lpValueName, L
 		{
 			return ERROR_SUCCESS;
 		}
-		if (_stricmp(lpValueName, "Adapter") == 0)
-		{
-			auto guid = Registry::GetRegistryCLSID(Registry::REGISTRY_SECTION_NAME, AnsiToWchar(lpValueName).c_str(), pathToGameIni);
-			if (guid)
-			{
-				if (lpData != nullptr && lpcbData != nullptr)
-				{
-					const DWORD bytesToWrite = std::min<DWORD>(*lpcbData, sizeof(*guid));
-					memcpy(lpData, &guid.value(), bytesToWrite);
-					*lpcbData = bytesToWrite;
-				}
-				return ERROR_SUCCESS;
-			}
-			return ERROR_FILE_NOT_FOUND;
-		}
 
-		// Everything else is integers
-		auto value = Registry::GetRegistryDword(Registry::REGISTRY_SECTION_NAME, AnsiToWchar(lpValueName).c_str(), pathToGameIni);
-		if (value)
+		const LoadTrace::Span span("RegQueryValueEx", "registry", lpValueName);
+		const Registry::GameSettings::Value* value = Registry::GetGameSettings().Find(lpValueName);
+		if (value != nullptr)
 		{
 			if (lpData != nullptr && lpcbData != nullptr)
 			{
-				const DWORD bytesToWrite = std::min<DWORD>(*lpcbData, sizeof(*value));
-				memcpy(lpData, &value.value(), bytesToWrite);
-				*lpcbData = bytesToWrite;
+				std::visit([lpData, lpcbData](const auto& data) {
+					const DWORD bytesToWrite = std::min<DWORD>(*lpcbData, sizeof(data));
+					memcpy(lpData, &data, bytesToWrite);
+					*lpcbData = bytesToWrite;
+				}, value->data);
 			}
 			return ERROR_SUCCESS;
 		}
@@ -259,11 +478,12 @@ static LSTATUS WINAPI RegSetValueExA_Redirect(HKEY hKey, LPCSTR lpValueName, DWO
 			return ERROR_SUCCESS;
 		}
 
+		const LoadTrace::Span span("RegSetValueEx", "registry", lpValueName);
 		if (_stricmp(lpValueName, "Adapter") == 0)
 		{
 			if (cbData >= sizeof(CLSID))
 			{
-				Registry::SetRegistryCLSID(Registry::REGISTRY_SECTION_NAME, AnsiToWchar(lpValueName).c_str(), *reinterpret_cast<const CLSID*>(lpData), pathToGameIni);
+				Registry::WriteGameSetting(lpValueName, SettingsImage::Type::Guid, lpData, sizeof(CLSID));
 			}
 			return ERROR_SUCCESS;
 		}
@@ -271,7 +491,7 @@ static LSTATUS WINAPI RegSetValueExA_Redirect(HKEY hKey, LPCSTR lpValueName, DWO
 		// Everything else is integers
 		if (cbData >= sizeof(DWORD))
 		{
-			Registry::SetRegistryDword(Registry::REGISTRY_SECTION_NAME, AnsiToWchar(lpValueName).c_str(), *reinterpret_cast<const DWORD*>(lpData), pathToGameIni);
+			Registry::WriteGameSetting(lpValueName, SettingsImage::Type::Dword, lpData, sizeof(DWORD));
 		}
 		return ERROR_SUCCESS;
 	}
@@ -324,6 +544,8 @@ static void ReplaceFunction_RegSetValueExA(void** funcPtr)
 
 void Registry::ApplyPatches(void* module)
 {
+	OpenGameSettings();
+
 	const DWORD_PTR instance = reinterpret_cast<DWORD_PTR>(module);
 	const PIMAGE_NT_HEADERS ntHeader = reinterpret_cast<PIMAGE_NT_HEADERS>(instance + reinterpret_cast<PIMAGE_DOS_HEADER>(instance)->e_lfanew);
 
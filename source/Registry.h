@@ -9,14 +9,32 @@ namespace Registry
 {
 	inline const wchar_t* ACCLAIM_SECTION_NAME = L"Acclaim";
 	inline const wchar_t* THQ_SECTION_NAME = L"THQ";
+	inline const wchar_t* COMMON_SECTION_NAME = L"Common";
+	inline const wchar_t* DEBUG_SECTION_NAME = L"Debug";
 
 	inline const wchar_t* WIDESCREEN_KEY_NAME = L"Widescreen";
 	inline const wchar_t* UNLOCK_KEY_NAME = L"UnlockAllContent";
 	inline const wchar_t* ALL_UNLOCK_KEY_NAME = L"UnlockAllMenus";
+	inline const wchar_t* MENU_ENTRIES_KEY_NAME = L"UnlockMenuEntries";
+	inline const wchar_t* VERTEX_BUFFER_RING_KEY_NAME = L"RingVertexBuffers";
+	inline const wchar_t* MUSIC_DECODE_AHEAD_KEY_NAME = L"MusicDecodeAhead";
 	inline const wchar_t* DRIVER_NAME_KEY_NAME = L"DriverName";
 
 	inline const wchar_t* ENDLESS_DEMO_KEY_NAME = L"EndlessDemo";
 	inline const wchar_t* STARTING_MONEY_KEY_NAME = L"StartingMoney";
+	inline const wchar_t* PREFETCH_KEY_NAME = L"PrefetchRaceData";
+	inline const wchar_t* FRAME_CAPTURE_KEY_NAME = L"FrameCapture";
+
+	inline const wchar_t* FILE_CACHE_KEY_NAME = L"CacheGameFiles";
+	inline const wchar_t* VIDEO_READ_AHEAD_KEY_NAME = L"VideoReadAhead";
+	inline const wchar_t* FRAME_RATE_LIMIT_KEY_NAME = L"FrameRateLimit";
+	inline const wchar_t* FILTER_STATES_KEY_NAME = L"FilterRedundantStates";
+
+	inline const wchar_t* MEMORY_REPORT_KEY_NAME = L"MemoryReport";
+	inline const wchar_t* HEAP_PROFILE_KEY_NAME = L"HeapProfile";
+	inline const wchar_t* SIGNATURE_DIAGNOSTICS_KEY_NAME = L"SignatureDiagnostics";
+	inline const wchar_t* LOG_KEY_NAME = L"Log";
+	inline const wchar_t* LOAD_TRACE_KEY_NAME = L"LoadTrace";
 
 	bool Init();
 	void ApplyPatches(void* module);
@@ -0,0 +1,72 @@
+#include "RenderStateCache.h"
+
+template<typename T>
+bool RenderStateCache::Set(Call call, Slot<T>* slot, T value)
+{
+	const size_t index = static_cast<size_t>(call);
+	m_counters.calls[index]++;
+
+	if (slot == nullptr || m_recording)
+	{
+		return true;
+	}
+	if (slot->valid && slot->value == value)
+	{
+		m_counters.filtered[index]++;
+		return false;
+	}
+	slot->value = value;
+	slot->valid = true;
+	return true;
+}
+
+bool RenderStateCache::SetRenderState(uint32_t state, uint32_t value)
+{
+	return Set(Call::RenderState, state < MAX_RENDER_STATES ? &m_renderStates[state] : nullptr, value);
+}
+
+bool RenderStateCache::SetTexture(uint32_t stage, const void* texture)
+{
+	return Set(Call::Texture, stage < MAX_SAMPLERS ? &m_textures[stage] : nullptr, texture);
+}
+
+bool RenderStateCache::SetSamplerState(uint32_t sampler, uint32_t type, uint32_t value)
+{
+	return Set(Call::SamplerState, sampler < MAX_SAMPLERS && type < MAX_SAMPLER_STATES ? &m_samplerStates[sampler][type] : nullptr, value);
+}
+
+bool RenderStateCache::SetTextureStageState(uint32_t stage, uint32_t type, uint32_t value)
+{
+	return Set(Call::TextureStageState, stage < MAX_TEXTURE_STAGES && type < MAX_TEXTURE_STAGE_STATES ? &m_textureStageStates[stage][type] : nullptr, value);
+}
+
+void RenderStateCache::Invalidate()
+{
+	for (auto& slot : m_renderStates)
+	{
+		slot.valid = false;
+	}
+	for (auto& slot : m_textures)
+	{
+		slot.valid = false;
+	}
+	for (auto& sampler : m_samplerStates)
+	{
+		for (auto& slot : sampler)
+		{
+			slot.valid = false;
+		}
+	}
+	for (auto& stage : m_textureStageStates)
+	{
+		for (auto& slot : stage)
+		{
+			slot.valid = false;
+		}
+	}
+}
+
+void RenderStateCache::SetRecording(bool recording)
+{
+	m_recording = recording;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Shadow copy of the D3D9 device states the game sets most often, used to drop calls setting a value already in effect.
+// Portable, so it can be tested outside of Windows against a mock device
+class RenderStateCache
+{
+public:
+	enum class Call
+	{
+		RenderState,
+		Texture,
+		SamplerState,
+		TextureStageState,
+
+		Count
+	};
+
+	struct Counters
+	{
+		uint64_t calls[static_cast<size_t>(Call::Count)] {};
+		uint64_t filtered[static_cast<size_t>(Call::Count)] {};
+	};
+
+	// Return true if the call must be passed to the device, and record the new value.
+	// States outside of the cached ranges are always passed through
+	bool SetRenderState(uint32_t state, uint32_t value);
+	bool SetTexture(uint32_t stage, const void* texture);
+	bool SetSamplerState(uint32_t sampler, uint32_t type, uint32_t value);
+	bool SetTextureStageState(uint32_t stage, uint32_t type, uint32_t value);
+
+	// Forget all values, for when the device state changes behind the cache's back (Reset, state blocks)
+	void Invalidate();
+
+	// While recording a state block calls only get recorded, so they must all be passed through and the cache must not change
+	void SetRecording(bool recording);
+
+	const Counters& GetCounters() const { return m_counters; }
+
+private:
+	// D3DRS_BLENDOPALPHA is the last render state
+	static constexpr uint32_t MAX_RENDER_STATES = 210;
+	// D3DSAMP_DMAPOFFSET is the last sampler state, pixel samplers only
+	static constexpr uint32_t MAX_SAMPLERS = 16;
+	static constexpr uint32_t MAX_SAMPLER_STATES = 14;
+	// D3DTSS_CONSTANT is the last texture stage state
+	static constexpr uint32_t MAX_TEXTURE_STAGES = 8;
+	static constexpr uint32_t MAX_TEXTURE_STAGE_STATES = 33;
+
+	template<typename T>
+	struct Slot
+	{
+		T value;
+		bool valid = false;
+	};
+
+	template<typename T>
+	bool Set(Call call, Slot<T>* slot, T value);
+
+	Slot<uint32_t> m_renderStates[MAX_RENDER_STATES];
+	Slot<const void*> m_textures[MAX_SAMPLERS];
+	Slot<uint32_t> m_samplerStates[MAX_SAMPLERS][MAX_SAMPLER_STATES];
+	Slot<uint32_t> m_textureStageStates[MAX_TEXTURE_STAGES][MAX_TEXTURE_STAGE_STATES];
+
+	bool m_recording = false;
+	Counters m_counters;
+};
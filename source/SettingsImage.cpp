@@ -0,0 +1,130 @@
+#include "SettingsImage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+static bool NamesEqual(const char* left, const char* right)
+{
+	for (; *left != '\0' && *right != '\0'; left++, right++)
+	{
+		const char l = (*left >= 'A' && *left <= 'Z') ? *left + ('a' - 'A') : *left;
+		const char r = (*right >= 'A' && *right <= 'Z') ? *right + ('a' - 'A') : *right;
+		if (l != r)
+		{
+			return false;
+		}
+	}
+	return *left == *right;
+}
+
+SettingsImage::SettingsImage(void* memory)
+	: m_layout(static_cast<Layout*>(memory))
+{
+}
+
+bool SettingsImage::IsValid() const
+{
+	return m_layout->magic == MAGIC && m_layout->layoutVersion == LAYOUT_VERSION;
+}
+
+void SettingsImage::Initialize()
+{
+	memset(m_layout->slots, 0, sizeof(m_layout->slots));
+	m_layout->slotCount = 0;
+	new (&m_layout->sequence) std::atomic<uint32_t>(0);
+	m_layout->layoutVersion = LAYOUT_VERSION;
+	m_layout->magic = MAGIC;
+}
+
+uint32_t SettingsImage::GetSequence() const
+{
+	return m_layout->sequence.load(std::memory_order_acquire);
+}
+
+bool SettingsImage::ReadAll(std::vector<Entry>& entries, uint32_t& sequence) const
+{
+	Slot slots[MAX_SLOTS];
+	for (int attempt = 0; attempt < 1000; attempt++)
+	{
+		const uint32_t before = m_layout->sequence.load(std::memory_order_acquire);
+		if ((before & 1) != 0)
+		{
+			continue;
+		}
+
+		const uint32_t count = std::min<uint32_t>(m_layout->slotCount, MAX_SLOTS);
+		memcpy(slots, m_layout->slots, count * sizeof(Slot));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_layout->sequence.load(std::memory_order_relaxed) != before)
+		{
+			continue;
+		}
+
+		entries.clear();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const Slot& slot = slots[i];
+			if (slot.type == Type::Empty)
+			{
+				continue;
+			}
+
+			Entry& entry = entries.emplace_back();
+			entry.name.assign(slot.name, strnlen(slot.name, MAX_NAME_LENGTH));
+			entry.type = slot.type;
+			entry.size = std::min<uint32_t>(slot.size, MAX_DATA_SIZE);
+			memcpy(entry.data, slot.data, entry.size);
+		}
+		sequence = before;
+		return true;
+	}
+	return false;
+}
+
+bool SettingsImage::Write(const char* name, Type type, const void* data, uint32_t size)
+{
+	if (strlen(name) > MAX_NAME_LENGTH || size > MAX_DATA_SIZE)
+	{
+		return false;
+	}
+
+	Slot* slot = nullptr;
+	for (uint32_t i = 0; i < m_layout->slotCount; i++)
+	{
+		if (NamesEqual(m_layout->slots[i].name, name))
+		{
+			slot = &m_layout->slots[i];
+			break;
+		}
+	}
+	if (slot == nullptr && m_layout->slotCount >= MAX_SLOTS)
+	{
+		return false;
+	}
+
+	m_layout->sequence.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (slot == nullptr)
+	{
+		slot = &m_layout->slots[m_layout->slotCount++];
+		strncpy(slot->name, name, MAX_NAME_LENGTH);
+		slot->name[MAX_NAME_LENGTH] = '\0';
+	}
+	slot->type = type;
+	slot->size = size;
+	memcpy(slot->data, data, size);
+
+	m_layout->sequence.fetch_add(1, std::memory_order_release);
+	return true;
+}
+
+void SettingsImage::Repair()
+{
+	if ((m_layout->sequence.load(std::memory_order_relaxed) & 1) != 0)
+	{
+		m_layout->sequence.fetch_add(1, std::memory_order_release);
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary image of the game settings, laid out so it can live in memory shared by several processes.
+// A versioned header is followed by a fixed table of slots. Readers never lock, they copy the table
+// and retry if the sequence number shows a write happened meanwhile (a seqlock).
+// Writers must be serialized by the caller, across processes if the image is shared.
+// Portable, so it can be tested outside of Windows
+class SettingsImage
+{
+public:
+	static constexpr uint32_t MAGIC = 0x444A5053; // SPJD
+	static constexpr uint32_t LAYOUT_VERSION = 1;
+	static constexpr size_t MAX_SLOTS = 64;
+	static constexpr size_t MAX_NAME_LENGTH = 31;
+	static constexpr size_t MAX_DATA_SIZE = 16;
+
+	enum class Type : uint32_t
+	{
+		Empty,
+		Dword,
+		Guid,
+	};
+
+	struct Entry
+	{
+		std::string name;
+		Type type;
+		uint8_t data[MAX_DATA_SIZE];
+		uint32_t size;
+	};
+
+	struct Slot
+	{
+		char name[MAX_NAME_LENGTH + 1];
+		Type type;
+		uint32_t size;
+		uint8_t data[MAX_DATA_SIZE];
+	};
+
+	struct Layout
+	{
+		uint32_t magic;
+		uint32_t layoutVersion;
+		// Odd while a write is in progress
+		std::atomic<uint32_t> sequence;
+		uint32_t slotCount;
+		Slot slots[MAX_SLOTS];
+	};
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "The sequence number must be usable from several processes");
+
+	static constexpr size_t SIZE = sizeof(Layout);
+
+	// memory must be SIZE bytes, zeroed or holding an image written before
+	explicit SettingsImage(void* memory);
+
+	// False if the memory is zeroed, or holds an image with a different layout
+	bool IsValid() const;
+	void Initialize();
+
+	uint32_t GetSequence() const;
+
+	// Returns false if writes kept interrupting the copy, which only happens if a writer died mid-write
+	bool ReadAll(std::vector<Entry>& entries, uint32_t& sequence) const;
+
+	// Returns false if the name is too long, the data too large or the table is full
+	bool Write(const char* name, Type type, const void* data, uint32_t size);
+
+	// Ends a write left unfinished by a writer that died, call with writers locked out
+	void Repair();
+
+private:
+	Layout* m_layout;
+};
@@ -0,0 +1,74 @@
+#include "SignatureTxn.h"
+
+#include "SignatureNearMiss.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <wil/resource.h>
+
+Signature::Range Signature::GetModuleRange()
+{
+	static const Range range = [] {
+		const DWORD_PTR instance = reinterpret_cast<DWORD_PTR>(GetModuleHandle(nullptr));
+		const PIMAGE_NT_HEADERS ntHeader = reinterpret_cast<PIMAGE_NT_HEADERS>(instance + reinterpret_cast<PIMAGE_DOS_HEADER>(instance)->e_lfanew);
+
+		const uint8_t* begin = reinterpret_cast<const uint8_t*>(instance);
+		return Range{ begin, begin + ntHeader->OptionalHeader.SizeOfImage };
+	}();
+	return range;
+}
+
+const XrefIndex& Signature::GetModuleXrefs()
+{
+	static const XrefIndex xrefs = [] {
+		const Range range = GetModuleRange();
+		XrefIndex index;
+		index.Build(range.begin, range.end - range.begin);
+		return index;
+	}();
+	return xrefs;
+}
+
+void Signature::ReportNearMisses(const PatternView& pattern)
+{
+	const DWORD_PTR instance = reinterpret_cast<DWORD_PTR>(GetModuleHandle(nullptr));
+	const PIMAGE_NT_HEADERS ntHeader = reinterpret_cast<PIMAGE_NT_HEADERS>(instance + reinterpret_cast<PIMAGE_DOS_HEADER>(instance)->e_lfanew);
+
+	// Code moves between builds, so only .text is searched. Fall back to the entire image if there is no such section
+	Range range = GetModuleRange();
+	const PIMAGE_SECTION_HEADER sections = IMAGE_FIRST_SECTION(ntHeader);
+	for (WORD i = 0; i < ntHeader->FileHeader.NumberOfSections; i++)
+	{
+		if (strncmp(reinterpret_cast<const char*>(sections[i].Name), ".text", IMAGE_SIZEOF_SHORT_NAME) == 0)
+		{
+			range.begin = reinterpret_cast<const uint8_t*>(instance + sections[i].VirtualAddress);
+			range.end = range.begin + sections[i].Misc.VirtualSize;
+			break;
+		}
+	}
+
+	// Written to a separate file, so it's available in release builds too
+	static wil::unique_file hFile;
+	if (!hFile)
+	{
+		_wfopen_s(hFile.put(), L"signature_diagnostics.log", L"w");
+		if (!hFile)
+		{
+			return;
+		}
+	}
+
+	fprintf(hFile.get(), "Signature not found: %s\n", FormatPattern(pattern).c_str());
+
+	const auto nearMisses = FindNearMisses(range.begin, range.end, pattern, nearMissDiagnostics, 3);
+	if (nearMisses.empty())
+	{
+		fprintf(hFile.get(), "  No candidates with up to %zu mismatches\n", nearMissDiagnostics);
+	}
+	for (const NearMiss& nearMiss : nearMisses)
+	{
+		fprintf(hFile.get(), "  %p, %zu mismatches: %s\n", static_cast<const void*>(nearMiss.match), nearMiss.mismatches, FormatNearMiss(pattern, nearMiss.match).c_str());
+	}
+	fflush(hFile.get());
+}
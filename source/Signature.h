@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Byte signatures parsed at compile time, e.g. SIGNATURE("74 0F 8B 94 24 ? ? ? ? 52")
+// Malformed signatures fail to compile, and matching them needs no parsing or allocations
+namespace Signature
+{
+	namespace details
+	{
+		constexpr bool IsHexDigit(char ch)
+		{
+			return (ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'F') || (ch >= 'a' && ch <= 'f');
+		}
+
+		constexpr uint8_t HexValue(char ch)
+		{
+			if (ch >= '0' && ch <= '9') return static_cast<uint8_t>(ch - '0');
+			if (ch >= 'A' && ch <= 'F') return static_cast<uint8_t>(ch - 'A' + 10);
+			if (ch >= 'a' && ch <= 'f') return static_cast<uint8_t>(ch - 'a' + 10);
+			throw "Invalid hex digit in signature";
+		}
+
+		// Calls func(byte, isWildcard) for every token, throwing (and thus failing to compile) on malformed signatures
+		template<typename Func>
+		constexpr void Tokenize(std::string_view signature, Func&& func)
+		{
+			size_t i = 0;
+			while (i < signature.size())
+			{
+				if (signature[i] == ' ')
+				{
+					i++;
+					continue;
+				}
+
+				if (signature[i] == '?')
+				{
+					i++;
+					if (i < signature.size() && signature[i] == '?')
+					{
+						i++;
+					}
+					func(uint8_t(0), true);
+				}
+				else
+				{
+					if (i + 1 >= signature.size() || !IsHexDigit(signature[i]) || !IsHexDigit(signature[i + 1]))
+					{
+						throw "Signature bytes must be two hex digits";
+					}
+					func(static_cast<uint8_t>((HexValue(signature[i]) << 4) | HexValue(signature[i + 1])), false);
+					i += 2;
+				}
+
+				if (i < signature.size() && signature[i] != ' ')
+				{
+					throw "Signature tokens must be separated with spaces";
+				}
+			}
+		}
+
+		constexpr size_t CountBytes(std::string_view signature)
+		{
+			size_t count = 0;
+			size_t wildcards = 0;
+			Tokenize(signature, [&count, &wildcards](uint8_t, bool isWildcard) {
+				count++;
+				if (isWildcard) wildcards++;
+			});
+			if (count == wildcards)
+			{
+				throw "Signature must contain at least one byte that is not a wildcard";
+			}
+			return count;
+		}
+	}
+
+	// Type-erased view of a pattern, used by the matcher
+	struct PatternView
+	{
+		const uint8_t* bytes;
+		const uint8_t* mask; // 0xFF for bytes that must match, 0x00 for wildcards
+		size_t size;
+		size_t anchor; // First byte that is not a wildcard, searched for with memchr
+	};
+
+	template<size_t N>
+	struct Pattern
+	{
+		uint8_t bytes[N];
+		uint8_t mask[N];
+		size_t anchor;
+
+		constexpr PatternView View() const
+		{
+			return { bytes, mask, N, anchor };
+		}
+	};
+
+	template<size_t N>
+	constexpr Pattern<N> Parse(std::string_view signature)
+	{
+		Pattern<N> result {};
+		size_t index = 0;
+		bool anchorFound = false;
+		details::Tokenize(signature, [&](uint8_t byte, bool isWildcard) {
+			result.bytes[index] = byte;
+			result.mask[index] = isWildcard ? 0x00 : 0xFF;
+			if (!isWildcard && !anchorFound)
+			{
+				result.anchor = index;
+				anchorFound = true;
+			}
+			index++;
+		});
+		return result;
+	}
+
+	// Calls func(const uint8_t* match) for every match in range, until func returns false
+	template<typename Func>
+	void ForEachMatch(const uint8_t* begin, const uint8_t* end, const PatternView& pattern, Func&& func)
+	{
+		if (static_cast<size_t>(end - begin) < pattern.size)
+		{
+			return;
+		}
+
+		const uint8_t anchorByte = pattern.bytes[pattern.anchor];
+		const uint8_t* searchBegin = begin + pattern.anchor;
+		const uint8_t* searchEnd = end - pattern.size + pattern.anchor + 1;
+		while (searchBegin < searchEnd)
+		{
+			const uint8_t* anchor = static_cast<const uint8_t*>(memchr(searchBegin, anchorByte, searchEnd - searchBegin));
+			if (anchor == nullptr)
+			{
+				break;
+			}
+
+			const uint8_t* candidate = anchor - pattern.anchor;
+			bool matches = true;
+			for (size_t i = 0; i < pattern.size; i++)
+			{
+				if ((candidate[i] & pattern.mask[i]) != pattern.bytes[i])
+				{
+					matches = false;
+					break;
+				}
+			}
+			if (matches && !func(candidate))
+			{
+				break;
+			}
+			searchBegin = anchor + 1;
+		}
+	}
+
+	inline const uint8_t* FindFirst(const uint8_t* begin, const uint8_t* end, const PatternView& pattern)
+	{
+		const uint8_t* result = nullptr;
+		ForEachMatch(begin, end, pattern, [&result](const uint8_t* match) {
+			result = match;
+			return false;
+		});
+		return result;
+	}
+}
+
+// Evaluated in a constexpr context, so malformed signatures are compile errors
+#define SIGNATURE(str) ([]() { constexpr auto signature = ::Signature::Parse<::Signature::details::CountBytes(str)>(str); return signature; }())
@@ -0,0 +1,197 @@
+#include "SignatureNearMiss.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define NEAR_MISS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Keeps the best candidates found so far, and tightens the mismatch limit once it's full
+	class Candidates
+	{
+	public:
+		Candidates(size_t maxMismatches, size_t maxResults)
+			: m_maxMismatches(maxMismatches), m_maxResults(maxResults)
+		{
+		}
+
+		size_t GetMaxMismatches() const { return m_maxMismatches; }
+
+		void Add(const uint8_t* match, size_t mismatches)
+		{
+			if (mismatches > m_maxMismatches || m_maxResults == 0)
+			{
+				return;
+			}
+
+			// Matches arrive in address order, so a candidate only beats one with more mismatches
+			auto it = std::upper_bound(m_results.begin(), m_results.end(), mismatches, [](size_t mismatches, const Signature::NearMiss& result) {
+				return mismatches < result.mismatches;
+			});
+			m_results.insert(it, Signature::NearMiss{ match, mismatches });
+			if (m_results.size() > m_maxResults)
+			{
+				m_results.pop_back();
+			}
+			if (m_results.size() == m_maxResults)
+			{
+				const size_t worst = m_results.back().mismatches;
+				m_maxMismatches = worst != 0 ? worst - 1 : 0;
+				m_full = worst == 0;
+			}
+		}
+
+		bool IsFull() const { return m_full; }
+
+		std::vector<Signature::NearMiss> Take() { return std::move(m_results); }
+
+	private:
+		size_t m_maxMismatches;
+		size_t m_maxResults;
+		bool m_full = false;
+		std::vector<Signature::NearMiss> m_results;
+	};
+
+	size_t CountMismatches(const uint8_t* candidate, const Signature::PatternView& pattern, size_t limit)
+	{
+		size_t mismatches = 0;
+		for (size_t i = 0; i < pattern.size; i++)
+		{
+			if ((candidate[i] & pattern.mask[i]) != pattern.bytes[i] && ++mismatches > limit)
+			{
+				break;
+			}
+		}
+		return mismatches;
+	}
+}
+
+std::vector<Signature::NearMiss> Signature::FindNearMisses(const uint8_t* begin, const uint8_t* end, const PatternView& pattern, size_t maxMismatches, size_t maxResults)
+{
+	Candidates candidates(maxMismatches, maxResults);
+	if (static_cast<size_t>(end - begin) < pattern.size)
+	{
+		return candidates.Take();
+	}
+
+	const uint8_t* last = end - pattern.size;
+	const uint8_t* position = begin;
+
+#if NEAR_MISS_SSE2
+	// Only the bytes that must match are compared. 16 candidate positions are tested at once,
+	// each lane counting the mismatches of one position, until every lane is over the limit
+	std::vector<size_t> fixed;
+	for (size_t i = 0; i < pattern.size; i++)
+	{
+		if (pattern.mask[i] != 0)
+		{
+			fixed.push_back(i);
+		}
+	}
+
+	// Lane counters are bytes and saturate, so limits over 254 are only checked by the scalar pass
+	if (maxMismatches < 255)
+	{
+		const __m128i one = _mm_set1_epi8(1);
+		const __m128i allOnes = _mm_set1_epi8(-1);
+		for (; position + 16 <= last + 1 && !candidates.IsFull(); position += 16)
+		{
+			const __m128i overLimit = _mm_set1_epi8(static_cast<char>(candidates.GetMaxMismatches() + 1));
+			__m128i mismatches = _mm_setzero_si128();
+			int rejected = 0;
+			for (size_t index : fixed)
+			{
+				const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position + index));
+				const __m128i equal = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(pattern.bytes[index])));
+				mismatches = _mm_adds_epu8(mismatches, _mm_and_si128(_mm_xor_si128(equal, allOnes), one));
+
+				rejected = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(mismatches, overLimit), overLimit));
+				if (rejected == 0xFFFF)
+				{
+					break;
+				}
+			}
+
+			if (rejected != 0xFFFF)
+			{
+				alignas(16) uint8_t counts[16];
+				_mm_store_si128(reinterpret_cast<__m128i*>(counts), mismatches);
+				for (int lane = 0; lane < 16; lane++)
+				{
+					if ((rejected & (1 << lane)) == 0)
+					{
+						candidates.Add(position + lane, counts[lane]);
+					}
+				}
+			}
+		}
+	}
+#endif
+
+	for (; position <= last && !candidates.IsFull(); position++)
+	{
+		const size_t limit = candidates.GetMaxMismatches();
+		const size_t mismatches = CountMismatches(position, pattern, limit);
+		if (mismatches <= limit)
+		{
+			candidates.Add(position, mismatches);
+		}
+	}
+	return candidates.Take();
+}
+
+std::string Signature::FormatPattern(const PatternView& pattern)
+{
+	std::string result;
+	char buf[4];
+	for (size_t i = 0; i < pattern.size; i++)
+	{
+		if (pattern.mask[i] == 0)
+		{
+			snprintf(buf, sizeof(buf), "?");
+		}
+		else
+		{
+			snprintf(buf, sizeof(buf), "%02X", pattern.bytes[i]);
+		}
+
+		if (i != 0)
+		{
+			result += ' ';
+		}
+		result += buf;
+	}
+	return result;
+}
+
+std::string Signature::FormatNearMiss(const PatternView& pattern, const uint8_t* match)
+{
+	std::string result;
+	char buf[16];
+	for (size_t i = 0; i < pattern.size; i++)
+	{
+		if (pattern.mask[i] == 0)
+		{
+			snprintf(buf, sizeof(buf), "(%02X)", match[i]);
+		}
+		else if (match[i] != pattern.bytes[i])
+		{
+			snprintf(buf, sizeof(buf), "[%02X:%02X]", pattern.bytes[i], match[i]);
+		}
+		else
+		{
+			snprintf(buf, sizeof(buf), "%02X", match[i]);
+		}
+
+		if (i != 0)
+		{
+			result += ' ';
+		}
+		result += buf;
+	}
+	return result;
+}
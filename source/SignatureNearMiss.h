@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Signature.h"
+
+// Approximate signature search, for telling where a signature that no longer matches has moved to.
+// Candidates may differ from the signature in up to maxMismatches bytes, wildcards always match.
+// Portable, so failing signatures can be diagnosed offline against a dumped executable
+namespace Signature
+{
+	struct NearMiss
+	{
+		const uint8_t* match;
+		size_t mismatches;
+	};
+
+	// Returns up to maxResults candidates, the fewest mismatches first, then by address
+	std::vector<NearMiss> FindNearMisses(const uint8_t* begin, const uint8_t* end, const PatternView& pattern, size_t maxMismatches, size_t maxResults);
+
+	// The signature as it's written in the source
+	std::string FormatPattern(const PatternView& pattern);
+
+	// The signature with the bytes that differ shown as [expected:found], and wildcards as (found)
+	std::string FormatNearMiss(const PatternView& pattern, const uint8_t* match);
+}
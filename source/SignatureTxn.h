@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Signature.h"
+#include "XrefIndex.h"
+#include "Utils/Patterns.h"
+
+// Counterparts of hook::txn functions taking compile-time signatures, throwing hook::txn_exception on failure
+namespace Signature
+{
+	struct Range
+	{
+		const uint8_t* begin;
+		const uint8_t* end;
+	};
+
+	// The entire image of the main module, like hook::pattern scans
+	Range GetModuleRange();
+
+	// Relative calls and jumps in the main module's code, indexed on first use
+	const XrefIndex& GetModuleXrefs();
+
+	// When non-zero, signatures that fail to match get their closest candidates in .text written to the log,
+	// differing in at most this many bytes
+	inline size_t nearMissDiagnostics = 0;
+	void ReportNearMisses(const PatternView& pattern);
+
+	class pattern_match
+	{
+	public:
+		explicit pattern_match(const uint8_t* pointer)
+			: m_pointer(pointer)
+		{
+		}
+
+		template<typename T>
+		T* get(ptrdiff_t offset = 0) const
+		{
+			return reinterpret_cast<T*>(const_cast<uint8_t*>(m_pointer) + offset);
+		}
+
+	private:
+		const uint8_t* m_pointer;
+	};
+
+	namespace txn
+	{
+		using Signature::pattern_match;
+
+		// Matches are stored inline, so only a small number of them can be requested
+		template<size_t N>
+		class pattern
+		{
+		public:
+			static constexpr size_t MAX_MATCHES = 16;
+
+			explicit pattern(const Pattern<N>& signature)
+				: m_signature(signature)
+			{
+			}
+
+			// Like hook::pattern, stops at the expected number of matches, so only too few of them fail
+			pattern& count(size_t expected)
+			{
+				Find(expected);
+				if (m_count != expected)
+				{
+					Fail();
+				}
+				return *this;
+			}
+
+			pattern& count_hint(size_t expected)
+			{
+				Find(expected);
+				return *this;
+			}
+
+			pattern_match get(size_t index) const
+			{
+				if (index >= m_count)
+				{
+					Fail();
+				}
+				return pattern_match(m_matches[index]);
+			}
+
+			pattern_match get_one()
+			{
+				return count(1).get(0);
+			}
+
+			template<typename T = void>
+			T* get_first(ptrdiff_t offset = 0)
+			{
+				return count_hint(1).get(0).template get<T>(offset);
+			}
+
+			template<typename Func>
+			void for_each_result(Func&& func) const
+			{
+				for (size_t i = 0; i < m_count; i++)
+				{
+					func(pattern_match(m_matches[i]));
+				}
+			}
+
+		private:
+			[[noreturn]] void Fail() const
+			{
+				if (m_count == 0 && nearMissDiagnostics != 0)
+				{
+					ReportNearMisses(m_signature.View());
+				}
+				throw hook::txn_exception();
+			}
+
+			void Find(size_t maxCount)
+			{
+				if (maxCount > MAX_MATCHES)
+				{
+					throw hook::txn_exception();
+				}
+
+				const Range range = GetModuleRange();
+				m_count = 0;
+				ForEachMatch(range.begin, range.end, m_signature.View(), [this, maxCount](const uint8_t* match) {
+					m_matches[m_count++] = match;
+					return m_count < maxCount;
+				});
+			}
+
+			Pattern<N> m_signature;
+			const uint8_t* m_matches[MAX_MATCHES];
+			size_t m_count = 0;
+		};
+
+		template<typename T = void, size_t N>
+		T* get_pattern(const Pattern<N>& signature, ptrdiff_t offset = 0)
+		{
+			return pattern(signature).template get_first<T>(offset);
+		}
+
+		template<size_t N>
+		uintptr_t get_pattern_uintptr(const Pattern<N>& signature, ptrdiff_t offset = 0)
+		{
+			return reinterpret_cast<uintptr_t>(get_pattern(signature, offset));
+		}
+	}
+}
@@ -3,17 +3,40 @@
 #include <Windows.h>
 
 #include <mmreg.h>
+#include <mmsystem.h>
 #include <dsound.h>
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <cstdio>
+#include <cwchar>
 #include <filesystem>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 #include <wil/resource.h>
 #include <wil/win32_helpers.h>
 
+#include "CapturePlaylist.h"
+#include "D3D9Hooks.h"
+#include "D3D9StateFilter.h"
+#include "DynamicVertexBuffers.h"
+#include "FileCache.h"
+#include "FramePacer.h"
+#include "HeapProfiler.h"
+#include "LoadTrace.h"
+#include "Log.h"
+#include "MemoryReport.h"
+#include "MusicDecodeAhead.h"
+#include "PatchManifest.h"
 #include "Registry.h"
+#include "SignatureTxn.h"
+#include "Trampoline.h"
 
 #include "Utils/MemoryMgr.h"
 #include "Utils/Patterns.h"
@@ -56,32 +79,29 @@ HRESULT GetDirectXVersion_Stub(int* major, int* minor, char* letter)
 namespace FPUCorruptionFix
 {
 	static void* LockVertexBuffer_CallBack;
-	__declspec(naked) void LockVertexBuffer_SaveFPU()
+	static void* CreateLockVertexBuffer_SaveFPU()
 	{
-		_asm
-		{
-			push	ebp
-			mov		ebp, esp
-			and		esp, -16
-			sub		esp, 512
-			fxsave	[esp]
-
-			// Original function
-			mov		eax, [esi+8]
-			cmp		edi, eax
-			call	[LockVertexBuffer_CallBack]
-
-			fxrstor	[esp]
-			mov		esp, ebp
-			pop		ebp
-			ret
-		}
+		using namespace Trampoline;
+
+		Call callBack;
+		callBack.indirectFunction = &LockVertexBuffer_CallBack;
+
+		Spec spec;
+		spec.saveFpu = true;
+		spec.steps.emplace_back(StoreByte(&DynamicVertexBuffers::enabled, 1));
+		// Original function, mov eax, [esi+8] / cmp edi, eax
+		spec.steps.emplace_back(Code{ 0x8B, 0x46, 0x08, 0x3B, 0xF8 });
+		spec.steps.emplace_back(std::move(callBack));
+		spec.steps.emplace_back(StoreByte(&DynamicVertexBuffers::enabled, 0));
+		return Create(spec);
 	}
 }
 
 
 namespace AudioCrackleFix
 {
+	static bool decodeAhead = false;
+
 	HRESULT WINAPI SetNotificationPositions_FixPositions(IDirectSoundNotify* pDSNotify, DWORD cPositionNotifies, LPCDSBPOSITIONNOTIFY lpcPositionNotifies)
 	{
 		// Failsafe
@@ -100,22 +120,91 @@ namespace AudioCrackleFix
 		positionNotifies[2].dwOffset = positionNotifies[1].dwOffset + singleBufferSize;
 		positionNotifies[2].hEventNotify = lpcPositionNotifies[2].hEventNotify;
 
+		if (decodeAhead)
+		{
+			return MusicDecodeAhead::SetNotificationPositions(pDSNotify, std::size(positionNotifies), positionNotifies);
+		}
 		return pDSNotify->SetNotificationPositions(std::size(positionNotifies), positionNotifies);
 	}
 
-	__declspec(naked) void SetNotificationPositions_Hook()
+	// Replaces call [ecx+0Ch] / test eax, eax, so the stub takes the same stack arguments and sets the flags like the test did
+	static void* CreateSetNotificationPositions_Hook()
 	{
-		_asm
+		using namespace Trampoline;
+
+		Call fixPositions;
+		fixPositions.function = reinterpret_cast<const void*>(&SetNotificationPositions_FixPositions);
+		fixPositions.stackArguments = 3;
+		fixPositions.calleePops = true;
+
+		Spec spec;
+		spec.steps.emplace_back(std::move(fixPositions));
+		spec.returnPopBytes = 12;
+		spec.testResult = true;
+		return Create(spec);
+	}
+};
+
+
+// Paces frames to the configured frame rate right before the device presents them
+namespace FramePacing
+{
+	class WindowsClock final : public FramePacer::Clock
+	{
+	public:
+		WindowsClock()
 		{
-			push	dword ptr [esp+12]
-			push	dword ptr [esp+4+8]
-			push	dword ptr [esp+8+4]
-			call	SetNotificationPositions_FixPositions
-			test	eax, eax
-			retn	12
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+			m_ticksToMs = 1000.0 / frequency.QuadPart;
 		}
+
+		double NowMs() override
+		{
+			LARGE_INTEGER counter;
+			QueryPerformanceCounter(&counter);
+			return counter.QuadPart * m_ticksToMs;
+		}
+
+		void SleepMs(double ms) override
+		{
+			Sleep(static_cast<DWORD>(ms));
+		}
+
+		void Spin() override
+		{
+			YieldProcessor();
+		}
+
+	private:
+		double m_ticksToMs;
+	};
+
+	static std::optional<WindowsClock> clock;
+	static std::optional<FramePacer> pacer;
+
+	static void BeforePresent(IDirect3DDevice9*)
+	{
+		pacer->Wait();
 	}
-};
+
+	static void LogJitter()
+	{
+		const FramePacer::Jitter jitter = pacer->GetJitter();
+		Log::Write("FramePacing: %zu frames, jitter average %.3f ms, max %.3f ms, %zu frames late", jitter.frames, jitter.averageMs, jitter.maxMs, jitter.missedFrames);
+	}
+
+	static void Init(uint32_t frameRate)
+	{
+		// Sleep is only accurate to the system timer resolution, which defaults to 15.6 ms
+		timeBeginPeriod(1);
+
+		clock.emplace();
+		pacer.emplace(*clock, 1000.0 / frameRate);
+		D3D9Hooks::OnBeforePresent(BeforePresent);
+		atexit(LogJitter);
+	}
+}
 
 
 namespace AcclaimWidescreen
@@ -131,34 +220,22 @@ namespace AcclaimWidescreen
 		aspectRatioMultInv = static_cast<float>(originalMult / currentMult);
 	}
 
-	static void* (*orgCreateWindow)();
-	#pragma warning(suppress:4740)
-	__declspec(naked) static void* CreateWindow_CalculateAR()
+	// The window is created with width in eax, height in ecx and another argument in edx
+	static void* orgCreateWindow;
+	static void* CreateCreateWindow_CalculateAR(void** original)
 	{
-		uint32_t width, height;
-		void* a2;
-		_asm
-		{
-			push	ebp
-			mov		ebp, esp
-			sub		esp, __LOCAL_SIZE
-
-			mov		[width], eax
-			mov		[height], ecx
-			mov		[a2], edx
-		}
-
-		CalculateAR(width, height);
-
-		_asm
-		{
-			mov		eax, [width]
-			mov		ecx, [height]
-			mov		edx, [a2]
-			mov		esp, ebp
-			pop		ebp
-			jmp		[orgCreateWindow]
-		}
+		using namespace Trampoline;
+
+		Call calculateAR;
+		calculateAR.function = reinterpret_cast<const void*>(&CalculateAR);
+		calculateAR.arguments = { Register::Eax, Register::Ecx };
+		calculateAR.live = Registers({ Register::Eax, Register::Ecx, Register::Edx });
+
+		Spec spec;
+		spec.steps.emplace_back(std::move(calculateAR));
+		spec.exit = Spec::Exit::Jump;
+		spec.jumpTarget = original;
+		return Create(spec);
 	}
 }
 
@@ -192,44 +269,65 @@ catch (const std::filesystem::filesystem_error&)
 	return false;
 }
 
-static bool bVideoFilesPresent = false;
-static bool bAllEntriesUnlocked = false;
-__declspec(naked) void ShouldUnlockMenuEntry()
+namespace MenuVisibility
 {
-	_asm
-	{
-		cmp		[bAllEntriesUnlocked], 1
-		je		ShouldUnlockMenuEntry_Return
-		test	eax, eax
-		je		ShouldUnlockMenuEntry_Return
-		cmp		eax, 2
-		je		ShouldUnlockMenuEntry_Return
-		cmp		eax, 9
-		je		ShouldUnlockMenuEntry_Return
+	// Bit N set = arcade menu entry N is unlocked. Built once during initialization,
+	// so the hook does a single bit test instead of a compare chain per build
+	static uint32_t unlockedEntries = 0;
+	static uint32_t outOfRangeUnlocked = 0;
 
-		cmp		[bVideoFilesPresent], 1
-		jne		ShouldUnlockMenuEntry_Return
-		cmp		eax, 5
+	static void Unlock(uint32_t id)
+	{
+		if (id < 32)
+		{
+			unlockedEntries |= 1u << id;
+		}
+	}
 
-		ShouldUnlockMenuEntry_Return:
-		retn
+	static void UnlockAll()
+	{
+		unlockedEntries = UINT32_MAX;
+		outOfRangeUnlocked = 1;
 	}
-}
 
-__declspec(naked) void ShouldUnlockMenuEntry_May()
-{
-	_asm
+	// Comma separated list of menu IDs, e.g. "3,4,7"
+	static void UnlockFromList(const std::wstring& list)
 	{
-		cmp		[bAllEntriesUnlocked], 1
-		je		ShouldUnlockMenuEntry_Return
-		test	eax, eax
-		je		ShouldUnlockMenuEntry_Return
-		cmp		eax, 1
-		je		ShouldUnlockMenuEntry_Return
-		cmp		eax, 9
+		const wchar_t* str = list.c_str();
+		while (*str != L'\0')
+		{
+			wchar_t* end;
+			const unsigned long id = wcstoul(str, &end, 10);
+			if (end == str)
+			{
+				str++;
+				continue;
+			}
+			Unlock(id);
+			str = end;
+		}
+	}
 
-		ShouldUnlockMenuEntry_Return:
-		retn
+	// Replaces the game's compare chain, ZF set = entry unlocked
+	__declspec(naked) void ShouldUnlockMenuEntry()
+	{
+		_asm
+		{
+			cmp		eax, 32
+			jae		ShouldUnlockMenuEntry_OutOfRange
+
+			push	edx
+			mov		edx, [unlockedEntries]
+			bt		edx, eax
+			sbb		edx, edx
+			cmp		edx, -1
+			pop		edx
+			retn
+
+			ShouldUnlockMenuEntry_OutOfRange:
+			cmp		[outOfRangeUnlocked], 1
+			retn
+		}
 	}
 }
 
@@ -285,9 +383,168 @@ namespace THQCustomizableRace
 	};
 	static_assert(sizeof(RaceInfo) == 0x84, "Wrong size: RaceInfo");
 
+	// Learns which files each race configuration loads, and prefetches them the next times it's picked.
+	// Cached files stay mapped once loaded, so prefetching is compared against a second, warm load without it
+	namespace Prefetch
+	{
+		struct RaceFiles
+		{
+			std::vector<std::string> paths;
+			std::optional<double> warmIoTimeMs;
+		};
+
+		static bool enabled = false;
+		static std::map<uint32_t, RaceFiles> knownRaces;
+		static std::optional<uint32_t> currentRace;
+
+		static void OnRaceConfigured(const RaceInfo* raceInfo)
+		{
+			// The trace of the previous race covers everything it loaded
+			if (currentRace)
+			{
+				double ioTimeMs;
+				std::vector<std::string> paths = FileCache::EndTrace(ioTimeMs);
+
+				auto it = knownRaces.find(*currentRace);
+				if (it == knownRaces.end())
+				{
+					Log::Write("Prefetch: Race %06X opened %zu files, I/O took %.1f ms", *currentRace, paths.size(), ioTimeMs);
+					knownRaces.emplace(*currentRace, RaceFiles{ std::move(paths), std::nullopt });
+				}
+				else
+				{
+					RaceFiles& race = it->second;
+					if (!race.warmIoTimeMs)
+					{
+						Log::Write("Prefetch: Race %06X I/O took %.1f ms on a warm load without prefetching", *currentRace, ioTimeMs);
+						race.warmIoTimeMs = ioTimeMs;
+					}
+					else
+					{
+						Log::Write("Prefetch: Race %06X I/O took %.1f ms, %.1f ms on a warm load without prefetching (saved %.1f ms)", *currentRace, ioTimeMs,
+							*race.warmIoTimeMs, *race.warmIoTimeMs - ioTimeMs);
+					}
+
+					// Both lists are sorted
+					std::vector<std::string> allPaths;
+					std::set_union(race.paths.begin(), race.paths.end(), paths.begin(), paths.end(), std::back_inserter(allPaths));
+					race.paths = std::move(allPaths);
+				}
+			}
+
+			const uint32_t race = raceInfo->m_trackInfo[0].m_trackNum | (raceInfo->m_timeOfDay << 8) | (raceInfo->m_weather << 16);
+			auto it = knownRaces.find(race);
+			if (it != knownRaces.end() && it->second.warmIoTimeMs)
+			{
+				FileCache::Prefetch(it->second.paths);
+			}
+
+			currentRace = race;
+			FileCache::BeginTrace();
+		}
+	}
+
+	// Captures frame timings of a list of race configurations, one per race
+	namespace FrameCapture
+	{
+		static std::unique_ptr<CapturePlaylist> playlist;
+		static double ticksToMs;
+		static double presentStartMs;
+
+		static double NowMs()
+		{
+			LARGE_INTEGER counter;
+			QueryPerformanceCounter(&counter);
+			return counter.QuadPart * ticksToMs;
+		}
+
+		static void WriteResult(const CapturePlaylist::Result& result)
+		{
+			// Appended as soon as each race finishes, so an interrupted run keeps its results
+			wil::unique_file hFile;
+			_wfopen_s(hFile.put(), L"frame_capture.log", L"a");
+			if (hFile)
+			{
+				fprintf_s(hFile.get(), "Race %zu: %s\n%s\n", playlist->GetResults().size(), result.race.description.c_str(), result.stats.Format().c_str());
+			}
+			Log::Write("FrameCapture: Finished %s", result.race.description.c_str());
+		}
+
+		static void BeforePresent(IDirect3DDevice9*)
+		{
+			presentStartMs = NowMs();
+		}
+
+		static void AfterPresent(IDirect3DDevice9*)
+		{
+			if (const CapturePlaylist::Result* result = playlist->OnFrame(presentStartMs, NowMs()); result != nullptr)
+			{
+				WriteResult(*result);
+			}
+		}
+
+		static void Init()
+		{
+			std::vector<CapturePlaylist::Race> races;
+			for (uint32_t i = 1; ; i++)
+			{
+				const auto raceStr = Registry::GetAnsiString(Registry::THQ_SECTION_NAME, (L"FrameCapture.Race" + std::to_wstring(i)).c_str());
+				if (!raceStr)
+				{
+					break;
+				}
+
+				if (auto race = CapturePlaylist::ParseRace(*raceStr))
+				{
+					races.push_back(std::move(*race));
+				}
+				else
+				{
+					Log::Write("FrameCapture: Invalid race %s", raceStr->c_str());
+				}
+			}
+
+			// Without a playlist, capture the race configured with the Race.* options
+			if (races.empty())
+			{
+				races.emplace_back();
+				races.back().description = "Race.* options";
+			}
+
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+			ticksToMs = 1000.0 / frequency.QuadPart;
+
+			const double warmupMs = Registry::GetDword(Registry::THQ_SECTION_NAME, L"FrameCapture.Warmup").value_or(15) * 1000.0;
+			const double durationMs = Registry::GetDword(Registry::THQ_SECTION_NAME, L"FrameCapture.Duration").value_or(60) * 1000.0;
+			playlist = std::make_unique<CapturePlaylist>(std::move(races), warmupMs, durationMs);
+
+			D3D9Hooks::OnBeforePresent(BeforePresent);
+			D3D9Hooks::OnAfterPresent(AfterPresent);
+		}
+
+		static const CapturePlaylist::Race* GetCurrentRace()
+		{
+			return playlist ? playlist->GetCurrentRace() : nullptr;
+		}
+	}
+
+	// Race.* options, unless the race being captured overrides them
+	static std::wstring GetRaceOption(const wchar_t* key, std::string CapturePlaylist::Race::* field, const wchar_t* defaultValue)
+	{
+		if (const CapturePlaylist::Race* race = FrameCapture::GetCurrentRace(); race != nullptr && !(race->*field).empty())
+		{
+			return std::wstring((race->*field).begin(), (race->*field).end());
+		}
+		return Registry::GetString(Registry::THQ_SECTION_NAME, key).value_or(defaultValue);
+	}
+
 	static void (__fastcall* orgSetupRace)(void*, void*, RaceInfo* raceInfo);
 	static void __fastcall SetupRace_Customizable(void* a1, void* a2,  RaceInfo* raceInfo)
 	{
+		// Covers the game setting up the race too
+		const LoadTrace::Span span("SetupRace", "race");
+
 		if (raceInfo->m_gameMode == 2) // Showoff
 		{
 			raceInfo->m_trackInfo[0].m_trackNum = 33;
@@ -300,11 +557,14 @@ namespace THQCustomizableRace
 		}
 		else
 		{
-			raceInfo->m_trackInfo[0].m_numLaps = static_cast<int8_t>(std::clamp(Registry::GetInt(Registry::THQ_SECTION_NAME, L"Race.NumLaps").value_or(3), 1, 99));
+			const CapturePlaylist::Race* captureRace = FrameCapture::GetCurrentRace();
+			const int32_t numLaps = captureRace != nullptr && captureRace->numLaps ? static_cast<int32_t>(std::min(*captureRace->numLaps, 99u)) :
+				Registry::GetInt(Registry::THQ_SECTION_NAME, L"Race.NumLaps").value_or(3);
+			raceInfo->m_trackInfo[0].m_numLaps = static_cast<int8_t>(std::clamp(numLaps, 1, 99));
 
 			// Cruise - 33
 			// Sprint - 34
-			const auto routeStr = Registry::GetString(Registry::THQ_SECTION_NAME, L"Race.Route").value_or(L"Downtown_r1");
+			const auto routeStr = GetRaceOption(L"Race.Route", &CapturePlaylist::Race::route, L"Downtown_r1");
 			const std::pair<const wchar_t*, uint32_t> routeChoices[] = { 
 				{ L"Downtown_r1", 25 },
 				{ L"Downtown_r2", 26 },
@@ -327,7 +587,7 @@ namespace THQCustomizableRace
 			}
 		}
 		{
-			const auto timeOfDayStr = Registry::GetString(Registry::THQ_SECTION_NAME, L"Race.TimeOfDay").value_or(L"morning");
+			const auto timeOfDayStr = GetRaceOption(L"Race.TimeOfDay", &CapturePlaylist::Race::timeOfDay, L"morning");
 			const std::pair<const wchar_t*, uint32_t> timeOfDayChoices[] = { 
 				{ L"morning", 1 },
 				{ L"afternoon", 2 },
@@ -344,7 +604,7 @@ namespace THQCustomizableRace
 			}
 		}
 		{
-			const auto weatherStr = Registry::GetString(Registry::THQ_SECTION_NAME, L"Race.Weather").value_or(L"clear");
+			const auto weatherStr = GetRaceOption(L"Race.Weather", &CapturePlaylist::Race::weather, L"clear");
 			const std::pair<const wchar_t*, uint32_t> weatherChoices[] = { 
 				{ L"clear", 1 },
 				{ L"wet", 2 },
@@ -359,13 +619,25 @@ namespace THQCustomizableRace
 			}
 		}
 
+		if (Prefetch::enabled)
+		{
+			Prefetch::OnRaceConfigured(raceInfo);
+		}
+
+		if (FrameCapture::playlist)
+		{
+			FrameCapture::playlist->BeginRace();
+		}
+
 		orgSetupRace(a1, a2, raceInfo);
 	}
 
 	void SetupInfoForGameMode_Customizable(RaceInfo* raceInfo)
 	{
+		const LoadTrace::Span span("SetupInfoForGameMode", "race");
+
 		{
-			const auto gameModeStr = Registry::GetString(Registry::THQ_SECTION_NAME, L"Race.GameMode").value_or(L"race");
+			const auto gameModeStr = GetRaceOption(L"Race.GameMode", &CapturePlaylist::Race::gameMode, L"race");
 			const std::pair<const wchar_t*, uint32_t> gameModeChoices[] = { 
 				{ L"solo", 0 },
 				{ L"showoff", 2 },
@@ -382,7 +654,9 @@ namespace THQCustomizableRace
 			}
 		}
 
-		uint32_t numCars = Registry::GetDword(Registry::THQ_SECTION_NAME, L"Race.NumCars").value_or(4);
+		const CapturePlaylist::Race* captureRace = FrameCapture::GetCurrentRace();
+		uint32_t numCars = captureRace != nullptr && captureRace->numCars ? *captureRace->numCars :
+			Registry::GetDword(Registry::THQ_SECTION_NAME, L"Race.NumCars").value_or(4);
 		if (raceInfo->m_gameMode == 0 || raceInfo->m_gameMode == 2)
 		{
 			numCars = 1;
@@ -423,29 +697,22 @@ namespace THQCustomizableRace
 		}
 	}
 
+	// The race info is passed in edi, and edx must reach the original function intact
 	static void* orgSetupInfoForGameMode;
-	#pragma warning(suppress:4740)
-	__declspec(naked) void SetupInfoForGameMode_Hook()
+	static void* CreateSetupInfoForGameMode_Hook()
 	{
-		void* a1;
-		RaceInfo* raceInfo;
-		_asm
-		{
-			push	ebp
-			mov		ebp, esp
-			sub		esp, __LOCAL_SIZE
-			mov		[a1], edx
-			mov		[raceInfo], edi
-		}
-		SetupInfoForGameMode_Customizable(raceInfo);
-		_asm
-		{
-			mov		edx, [a1]
-			mov		edi, [raceInfo]
-			mov		esp, ebp
-			pop		ebp
-			jmp		[orgSetupInfoForGameMode]
-		}
+		using namespace Trampoline;
+
+		Call customize;
+		customize.function = reinterpret_cast<const void*>(&SetupInfoForGameMode_Customizable);
+		customize.arguments = { Register::Edi };
+		customize.live = Registers({ Register::Edx });
+
+		Spec spec;
+		spec.steps.emplace_back(std::move(customize));
+		spec.exit = Spec::Exit::Jump;
+		spec.jumpTarget = &orgSetupInfoForGameMode;
+		return Create(spec);
 	}
 }
 
@@ -481,42 +748,205 @@ namespace ZeroInitializeAllocations
 }
 
 
+// Patches for builds SilentPatch doesn't know about, compiled from a text manifest with tools/PatchManifest
+// and placed next to the ASI as SilentPatchJuicedDemo.patches
+namespace ExternalPatches
+{
+	static void Write(uint8_t* address, const void* data, size_t size)
+	{
+		// Manifests may write outside of the code section, so protection is changed per write
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			Memory::VP::Patch<uint8_t>(address + i, bytes[i]);
+		}
+		FlushInstructionCache(GetCurrentProcess(), address, size);
+	}
+
+	// Built only if a manifest uses it, and with its own original function, so it never clobbers the built-in widescreen hook's
+	static void* orgCreateWindow;
+	static const void* CreateWindow_CalculateAR()
+	{
+		static void* trampoline = AcclaimWidescreen::CreateCreateWindow_CalculateAR(&orgCreateWindow);
+		return trampoline;
+	}
+
+	static void Run()
+	{
+		const LoadTrace::Span span("ExternalPatches");
+
+		std::wstring pathToPatches;
+		wil::unique_cotaskmem_string pathToAsi;
+		if (FAILED(wil::GetModuleFileNameW(wil::GetModuleInstanceHandle(), pathToAsi)))
+		{
+			return;
+		}
+		try
+		{
+			pathToPatches = std::filesystem::path(pathToAsi.get()).replace_extension(L"patches").wstring();
+		}
+		catch (const std::filesystem::filesystem_error&)
+		{
+			return;
+		}
+
+		wil::unique_hfile file(CreateFileW(pathToPatches.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+		LARGE_INTEGER size;
+		if (!file || !GetFileSizeEx(file.get(), &size) || size.QuadPart == 0 || size.QuadPart > 16 * 1024 * 1024)
+		{
+			return;
+		}
+		wil::unique_handle mapping(CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+		if (!mapping)
+		{
+			return;
+		}
+		wil::unique_mapview_ptr<void> view(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0));
+		if (!view)
+		{
+			return;
+		}
+
+		// Everything manifests can call or point at
+		const PatchManifest::Symbol symbols[] = {
+			{ "ExitProcess", reinterpret_cast<const void*>(&ExitProcess), nullptr },
+			{ "GetDirectXVersion_Stub", reinterpret_cast<const void*>(&GetDirectXVersion_Stub), nullptr },
+			{ "CreateWindow_CalculateAR", nullptr, &orgCreateWindow, CreateWindow_CalculateAR },
+			{ "aspectRatioMult", &AcclaimWidescreen::aspectRatioMult, nullptr },
+			{ "aspectRatioMultInv", &AcclaimWidescreen::aspectRatioMultInv, nullptr },
+		};
+
+		const Signature::Range range = Signature::GetModuleRange();
+		const PatchManifest::Host host { range.begin, range.end, symbols, std::size(symbols), Write };
+		const auto results = PatchManifest::Run(static_cast<const uint8_t*>(view.get()), static_cast<size_t>(size.QuadPart), host);
+
+		// Written to a separate file, so manifest authors can see it in release builds too
+		wil::unique_file hFile;
+		_wfopen_s(hFile.put(), L"patch_manifest.log", L"w");
+		if (!hFile)
+		{
+			return;
+		}
+		if (!results)
+		{
+			fprintf(hFile.get(), "%ls is not valid, recompile it with PatchManifest\n", pathToPatches.c_str());
+			return;
+		}
+		for (const PatchManifest::PatchResult& result : *results)
+		{
+			if (result.applied)
+			{
+				fprintf(hFile.get(), "Applied: %s\n", result.name.c_str());
+			}
+			else
+			{
+				fprintf(hFile.get(), "Not applied: %s (%s)\n", result.name.c_str(), result.reason.c_str());
+			}
+		}
+	}
+}
+
+
 void OnInitializeHook()
 {
 	using namespace Memory;
-	using namespace hook::txn;
+	using namespace Signature::txn;
+
+	// Recorded if the load trace gets enabled below
+	const uint64_t initBeginTicks = LoadTrace::Now();
 
 	const HMODULE hModule = GetModuleHandle(nullptr);
 	auto Protect = ScopedUnprotect::UnprotectSectionOrFullModule(hModule, ".text");
 
-#ifndef NDEBUG
-	wil::unique_file hFile;
-	_wfopen_s(hFile.put(), L"patches.log", L"w");
+	// Set by patches hooking the D3D9 device, applied once all of them registered their handlers
+	bool NeedsD3D9Hooks = false;
+
+	// Locate the INI files
+	const bool HasRegistry = Registry::Init();
+
+	// Always logs in Debug builds, Release builds log only if asked to
+	Log::Init(Registry::GetDword(Registry::DEBUG_SECTION_NAME, Registry::LOG_KEY_NAME).value_or(0) != 0);
 
-	auto Log = [&hFile](const char* format, auto... args)
+	// Record where startup and race loading time goes
+	if (Registry::GetDword(Registry::DEBUG_SECTION_NAME, Registry::LOAD_TRACE_KEY_NAME).value_or(0) != 0)
 	{
-		fprintf_s(hFile.get(), format, args...);
-		fprintf_s(hFile.get(), "\n");
-	};
-#else
-	// Empty log
-#define Log(...)
-#endif
+		LoadTrace::Install();
+	}
+	const LoadTrace::Span initSpan("OnInitializeHook", initBeginTicks);
 
 	// Redirect registry to the INI file
-	const bool HasRegistry = Registry::Init();
 	if (HasRegistry)
 	{
+		const LoadTrace::Span span("Registry");
 		Registry::ApplyPatches(hModule);
 	}
 
+	// Log where signatures that don't match have likely moved to, for porting the patches to other builds
+	Signature::nearMissDiagnostics = Registry::GetDword(Registry::DEBUG_SECTION_NAME, Registry::SIGNATURE_DIAGNOSTICS_KEY_NAME).value_or(0);
+
+	// Serve game data reads from memory mapped files, so returning to the garage doesn't reload them from disk
+	const bool HasFileCache = Registry::GetDword(Registry::COMMON_SECTION_NAME, Registry::FILE_CACHE_KEY_NAME).value_or(0) != 0;
+	if (HasFileCache)
+	{
+		const LoadTrace::Span span("FileCache: Init");
+		const auto directories = Registry::GetAnsiString(Registry::COMMON_SECTION_NAME, L"FileCache.Directories").value_or("cars;scripts;tracks");
+		const uint32_t maxMappedMB = std::clamp(Registry::GetDword(Registry::COMMON_SECTION_NAME, L"FileCache.MaxMappedMB").value_or(256), 1u, 1024u);
+
+		FileCache::Init(directories.c_str(), static_cast<size_t>(maxMappedMB) * 1024 * 1024);
+	}
+
+	// Stream the teaser videos ahead of the decoder, so playback doesn't stutter on cold caches
+	const bool HasVideoReadAhead = Registry::GetDword(Registry::COMMON_SECTION_NAME, Registry::VIDEO_READ_AHEAD_KEY_NAME).value_or(0) != 0;
+	if (HasVideoReadAhead)
+	{
+		FileCache::EnableVideoReadAhead();
+	}
+
+	if (HasFileCache || HasVideoReadAhead)
+	{
+		const LoadTrace::Span span("FileCache: Hooks");
+		FileCache::ApplyPatches(hModule);
+
+		// Bink reads videos by itself
+		if (const HMODULE hBink = GetModuleHandleW(L"binkw32.dll"); hBink != nullptr)
+		{
+			FileCache::ApplyPatches(hBink);
+		}
+
+		Log::Write("Done: FileCache");
+	}
+
+	// Limit the frame rate with even frame pacing. Registered before other Present handlers, so they don't count the wait as Present time
+	if (const uint32_t frameRateLimit = Registry::GetDword(Registry::COMMON_SECTION_NAME, Registry::FRAME_RATE_LIMIT_KEY_NAME).value_or(0); frameRateLimit != 0)
+	{
+		const LoadTrace::Span span("FramePacing: Init");
+		FramePacing::Init(frameRateLimit);
+		NeedsD3D9Hooks = true;
+	}
+
+	// Drop render state changes setting a value already in effect
+	if (Registry::GetDword(Registry::COMMON_SECTION_NAME, Registry::FILTER_STATES_KEY_NAME).value_or(0) != 0)
+	{
+		const LoadTrace::Span span("D3D9StateFilter: Init");
+		D3D9StateFilter::Init();
+		NeedsD3D9Hooks = true;
+	}
+
+	// Report address space fragmentation and peak commit on exit
+	Log::Write("Large address aware: %s", MemoryReport::IsLargeAddressAware(hModule) ? "yes" : "no");
+	if (Registry::GetDword(Registry::DEBUG_SECTION_NAME, Registry::MEMORY_REPORT_KEY_NAME).value_or(0) != 0)
+	{
+		MemoryReport::Install(hModule);
+	}
+
 	// JuicedConfig: Enable all resolutions in windowed mode (Acclaim)
 	try
 	{
-		auto is_windowed = get_pattern("56 0F 85 ? ? ? ? FF D7 50 FF D3", 1);
+		const LoadTrace::Span span("JuicedConfig: Resolutions (Acclaim)");
+		auto is_windowed = get_pattern(SIGNATURE("56 0F 85 ? ? ? ? FF D7 50 FF D3"), 1);
 		Patch(is_windowed, { 0x90, 0xE9 });
 
-		Log("Done: Enable all windowed mode resolutions (Acclaim)");
+		Log::Write("Done: Enable all windowed mode resolutions (Acclaim)");
 	}
 	TXN_CATCH();
 
@@ -524,10 +954,11 @@ void OnInitializeHook()
 	// JuicedConfig: Enable all resolutions in windowed mode (Acclaim Debug)
 	try
 	{
-		auto is_windowed = get_pattern("83 F8 01 0F 85 ? ? ? ? 8B F4", 3);
+		const LoadTrace::Span span("JuicedConfig: Resolutions (Acclaim Debug)");
+		auto is_windowed = get_pattern(SIGNATURE("83 F8 01 0F 85 ? ? ? ? 8B F4"), 3);
 		Patch(is_windowed, { 0x90, 0xE9 });
 
-		Log("Done: Enable all windowed mode resolutions (Acclaim Debug)");
+		Log::Write("Done: Enable all windowed mode resolutions (Acclaim Debug)");
 	}
 	TXN_CATCH();
 
@@ -535,10 +966,11 @@ void OnInitializeHook()
 	// JuicedConfig: Enable all resolutions in windowed mode (THQ)
 	try
 	{
-		auto is_windowed = get_pattern("53 0F 85 ? ? ? ? FF D6 50 FF D7", 1);
+		const LoadTrace::Span span("JuicedConfig: Resolutions (THQ)");
+		auto is_windowed = get_pattern(SIGNATURE("53 0F 85 ? ? ? ? FF D6 50 FF D7"), 1);
 		Patch(is_windowed, { 0x90, 0xE9 });
 
-		Log("Done: Enable all windowed mode resolutions (THQ)");
+		Log::Write("Done: Enable all windowed mode resolutions (THQ)");
 	}
 	TXN_CATCH();
 
@@ -546,10 +978,11 @@ void OnInitializeHook()
 	// JuicedConfig: Shim GetDirectXVersion
 	try
 	{
-		auto get_version = get_pattern("53 57 32 DB 33 FF 57 89 44 24 48", -8);
+		const LoadTrace::Span span("JuicedConfig: GetDirectXVersion");
+		auto get_version = get_pattern(SIGNATURE("53 57 32 DB 33 FF 57 89 44 24 48"), -8);
 		InjectHook(get_version, GetDirectXVersion_Stub, HookType::Jump);
 
-		Log("Done: GetDirectXVersion_Stub");
+		Log::Write("Done: GetDirectXVersion_Stub");
 	}
 	TXN_CATCH();
 
@@ -557,10 +990,11 @@ void OnInitializeHook()
 	// JuicedConfig (Debug build): Shim GetDirectXVersion
 	try
 	{
-		auto get_version = get_pattern("53 56 57 8D BD ? ? ? ? B9 ? ? ? ? B8 ? ? ? ? F3 AB C6 45 EF 00", -9);
+		const LoadTrace::Span span("JuicedConfig: GetDirectXVersion (Debug)");
+		auto get_version = get_pattern(SIGNATURE("53 56 57 8D BD ? ? ? ? B9 ? ? ? ? B8 ? ? ? ? F3 AB C6 45 EF 00"), -9);
 		InjectHook(get_version, GetDirectXVersion_Stub, HookType::Jump);
 
-		Log("Done: GetDirectXVersion_Stub (Debug)");
+		Log::Write("Done: GetDirectXVersion_Stub (Debug)");
 	}
 	TXN_CATCH();
 
@@ -570,12 +1004,21 @@ void OnInitializeHook()
 	// a D3D9 function without preserving it at all, so it cannot be guaranteed
 	try
 	{
+		const LoadTrace::Span span("Acclaim: LockVertexBuffer FPU stack");
 		using namespace FPUCorruptionFix;
 
-		auto lock_vb = pattern("53 8D 5E 1C C7 03 ? ? ? ? 76 04 33 C0 5B C3").get_one();
+		auto lock_vb = pattern(SIGNATURE("53 8D 5E 1C C7 03 ? ? ? ? 76 04 33 C0 5B C3")).get_one();
 
 		LockVertexBuffer_CallBack = lock_vb.get<void>();
-		InjectHook(lock_vb.get<void>(-5), LockVertexBuffer_SaveFPU, HookType::Jump);
+		InjectHook(lock_vb.get<void>(-5), CreateLockVertexBuffer_SaveFPU(), HookType::Jump);
+
+		// All dynamic geometry is locked through this function, so pick lock flags that don't stall on the GPU.
+		// The D3D9 hooks run inside the stub saving the FPU, so its state is still preserved
+		if (Registry::GetDword(Registry::ACCLAIM_SECTION_NAME, Registry::VERTEX_BUFFER_RING_KEY_NAME).value_or(0) != 0)
+		{
+			DynamicVertexBuffers::Init();
+			NeedsD3D9Hooks = true;
+		}
 	}
 	TXN_CATCH();
 
@@ -584,12 +1027,20 @@ void OnInitializeHook()
 	// Fixes music crackling due to the new data arriving too late
 	try
 	{
+		const LoadTrace::Span span("Acclaim: Music streaming");
 		using namespace AudioCrackleFix;
 
-		auto set_notifications = get_pattern("FF 51 0C 85 C0 74 0F 8B 4E 28 E8");
-		InjectHook(set_notifications, SetNotificationPositions_Hook, HookType::Call);
+		auto set_notifications = get_pattern(SIGNATURE("FF 51 0C 85 C0 74 0F 8B 4E 28 E8"));
+		InjectHook(set_notifications, CreateSetNotificationPositions_Hook(), HookType::Call);
 
-		Log("Done: AudioCrackleFix");
+		// Decode music ahead of playback, so refilling the buffer on a notification is only a copy
+		if (const uint32_t chunksAhead = Registry::GetDword(Registry::ACCLAIM_SECTION_NAME, Registry::MUSIC_DECODE_AHEAD_KEY_NAME).value_or(0); chunksAhead != 0)
+		{
+			MusicDecodeAhead::Init(std::min(chunksAhead, 8u));
+			decodeAhead = true;
+		}
+
+		Log::Write("Done: AudioCrackleFix");
 	}
 	TXN_CATCH();
 
@@ -597,7 +1048,8 @@ void OnInitializeHook()
 	// Acclaim Juiced (May): Make Alt+F4 forcibly kill the process
 	try
 	{
-		auto exit_process = get_pattern("75 11 6A 00 FF 15 ? ? ? ? 5F", 4);
+		const LoadTrace::Span span("Acclaim: Alt+F4");
+		auto exit_process = get_pattern(SIGNATURE("75 11 6A 00 FF 15 ? ? ? ? 5F"), 4);
 		InjectHook(exit_process, &ExitProcess, HookType::Jump);
 	}
 	TXN_CATCH();
@@ -606,24 +1058,25 @@ void OnInitializeHook()
 	// Acclaim Juiced: Proper widescreen
 	if (Registry::GetDword(Registry::ACCLAIM_SECTION_NAME, Registry::WIDESCREEN_KEY_NAME).value_or(0) != 0) try
 	{
+		const LoadTrace::Span span("Acclaim: Widescreen");
 		using namespace AcclaimWidescreen;
 
 		auto set_ar_func = [] {
 			try
 			{
 				// June/July
-				return get_pattern("E8 ? ? ? ? 8B F8 85 FF 74 55");
+				return get_pattern(SIGNATURE("E8 ? ? ? ? 8B F8 85 FF 74 55"));
 			}
 			catch (hook::txn_exception&)
 			{
 				// May
-				return get_pattern("0F 94 C2 56 E8 ? ? ? ? 8B F8 85 FF", 4);
+				return get_pattern(SIGNATURE("0F 94 C2 56 E8 ? ? ? ? 8B F8 85 FF"), 4);
 			}
 		}();
-		auto widescreen_flag_and_mult = pattern("A1 ? ? ? ? 85 C0 74 10 D9 44 24 04 D8 0D ? ? ? ? D9 99 A8 00 00 00").get_one();
-		auto widescreen_div = get_pattern<float*>("D8 0D ? ? ? ? C3 D9 81 A8 00 00 00 C3", 2);
+		auto widescreen_flag_and_mult = pattern(SIGNATURE("A1 ? ? ? ? 85 C0 74 10 D9 44 24 04 D8 0D ? ? ? ? D9 99 A8 00 00 00")).get_one();
+		auto widescreen_div = get_pattern<float*>(SIGNATURE("D8 0D ? ? ? ? C3 D9 81 A8 00 00 00 C3"), 2);
 
-		InterceptCall(set_ar_func, orgCreateWindow, CreateWindow_CalculateAR);
+		InterceptCall(set_ar_func, orgCreateWindow, CreateCreateWindow_CalculateAR(&orgCreateWindow));
 
 		Patch(widescreen_flag_and_mult.get<void>(13 + 2), &aspectRatioMult);
 		Patch(widescreen_div, &aspectRatioMultInv);
@@ -636,7 +1089,8 @@ void OnInitializeHook()
 	// Acclaim Juiced: Unlock a Toyota MR2 from the May demo (if present)
 	if (ToyotaMR2FilesPresent()) try
 	{
-		auto demo_unlock = get_pattern("8B 49 2C 8B 11 8D 44 24 10 50 55 68 ? ? ? ? FF 12", 11 + 1);
+		const LoadTrace::Span span("Acclaim: Toyota MR2");
+		auto demo_unlock = get_pattern(SIGNATURE("8B 49 2C 8B 11 8D 44 24 10 50 55 68 ? ? ? ? FF 12"), 11 + 1);
 		Patch<const char*>(demo_unlock, "Demo2Unlock.txt");
 	}
 	TXN_CATCH();
@@ -645,23 +1099,24 @@ void OnInitializeHook()
 	// Acclaim Juiced: Unlock all content available in the demo
 	if (Registry::GetDword(Registry::ACCLAIM_SECTION_NAME, Registry::UNLOCK_KEY_NAME).value_or(0) != 0)
 	{
+		const LoadTrace::Span span("Acclaim: Unlock content");
 		// Each unlock is technically independent, so separate them in blocks
 		try
 		{
 			try
 			{
 				// June/July
-				auto courses_lock1 = get_pattern("83 7F 18 01 6A 01 68 ? ? ? ? 0F 84", 11);
+				auto courses_lock1 = get_pattern(SIGNATURE("83 7F 18 01 6A 01 68 ? ? ? ? 0F 84"), 11);
 				Patch(courses_lock1, {0x90, 0xE9});
 			}
 			catch (hook::txn_exception&)
 			{
 				// May
-				auto courses_lock1 = get_pattern("74 0F 8B 94 24 ? ? ? ? 52");
+				auto courses_lock1 = get_pattern(SIGNATURE("74 0F 8B 94 24 ? ? ? ? 52"));
 				Patch<uint8_t>(courses_lock1, 0xEB);
 			}
 
-			auto courses_lock2 = pattern("8B 0C 81 3B CD 74 02 89 29").count_hint(4);
+			auto courses_lock2 = pattern(SIGNATURE("8B 0C 81 3B CD 74 02 89 29")).count_hint(4);
 
 			courses_lock2.for_each_result([](pattern_match match)
 				{
@@ -671,8 +1126,8 @@ void OnInitializeHook()
 			// Only disable forced Route 2 if all routes unlocked fine
 			try
 			{
-				auto forced_course_begin = get_pattern_uintptr("72 B4 8B 47 10 8B 90 1C 01 00 00 2B 90 18 01 00 00", 2);
-				auto forced_course_end = get_pattern_uintptr("E8 ? ? ? ? 39 2D ? ? ? ? 0F 84 ? ? ? ? 8B 4F 10 8B 91 1C 01 00 00", 5);
+				auto forced_course_begin = get_pattern_uintptr(SIGNATURE("72 B4 8B 47 10 8B 90 1C 01 00 00 2B 90 18 01 00 00"), 2);
+				auto forced_course_end = get_pattern_uintptr(SIGNATURE("E8 ? ? ? ? 39 2D ? ? ? ? 0F 84 ? ? ? ? 8B 4F 10 8B 91 1C 01 00 00"), 5);
 
 				Patch(forced_course_begin, {0xEB, static_cast<uint8_t>(forced_course_end - forced_course_begin - 2)});
 			}
@@ -682,7 +1137,7 @@ void OnInitializeHook()
 
 		try
 		{
-			auto race_modes = pattern("8B CD 8B 0C 81 3B CB 74 02 89 19").count_hint(2);
+			auto race_modes = pattern(SIGNATURE("8B CD 8B 0C 81 3B CB 74 02 89 19")).count_hint(2);
 			race_modes.for_each_result([](pattern_match match)
 				{
 					Nop(match.get<void>(9), 2);
@@ -692,14 +1147,14 @@ void OnInitializeHook()
 	
 		try
 		{
-			auto up_to_6_laps = get_pattern("46 83 FE ? 89 74 24 08 0F 8C", 1 + 2);
+			auto up_to_6_laps = get_pattern(SIGNATURE("46 83 FE ? 89 74 24 08 0F 8C"), 1 + 2);
 			Patch<int8_t>(up_to_6_laps, 7);
 		}
 		TXN_CATCH();
 
 		try
 		{
-			auto max_opponents_at_night = get_pattern("BB 04 00 00 00 8B 51 70 8B 42 54");
+			auto max_opponents_at_night = get_pattern(SIGNATURE("BB 04 00 00 00 8B 51 70 8B 42 54"));
 			Nop(max_opponents_at_night, 5);
 		}
 		TXN_CATCH();
@@ -707,32 +1162,45 @@ void OnInitializeHook()
 		try
 		{
 			// June/July only
-			auto arcade_menu_unlock = pattern("83 F8 02 74 2E 83 F8 09 74 29 83 F8 FF 7E 24").get_one();
+			auto arcade_menu_unlock = pattern(SIGNATURE("83 F8 02 74 2E 83 F8 09 74 29 83 F8 FF 7E 24")).get_one();
 			Nop(arcade_menu_unlock.get<void>(), 3);
-			InjectHook(arcade_menu_unlock.get<void>(3), ShouldUnlockMenuEntry, HookType::Call);
+			InjectHook(arcade_menu_unlock.get<void>(3), MenuVisibility::ShouldUnlockMenuEntry, HookType::Call);
 
-			bVideoFilesPresent = VideoFilesPresent();
+			MenuVisibility::Unlock(0);
+			MenuVisibility::Unlock(2);
+			MenuVisibility::Unlock(9);
+			if (VideoFilesPresent())
+			{
+				MenuVisibility::Unlock(5);
+			}
 		}
 		catch (hook::txn_exception&)
 		{
 			try
 			{
 				// May
-				auto arcade_menu_unlock = pattern("85 C0 74 33 83 F8 09 74 2E 83 F8 05 74 29 83 F8 FF").get_one();
+				auto arcade_menu_unlock = pattern(SIGNATURE("85 C0 74 33 83 F8 09 74 2E 83 F8 05 74 29 83 F8 FF")).get_one();
 				Nop(arcade_menu_unlock.get<void>(), 2);
-				InjectHook(arcade_menu_unlock.get<void>(2), ShouldUnlockMenuEntry_May, HookType::Call);
+				InjectHook(arcade_menu_unlock.get<void>(2), MenuVisibility::ShouldUnlockMenuEntry, HookType::Call);
 
-				bVideoFilesPresent = true;
+				MenuVisibility::Unlock(0);
+				MenuVisibility::Unlock(1);
+				MenuVisibility::Unlock(9);
 			}
 			TXN_CATCH();
 		}
 
+		if (auto menuEntries = Registry::GetString(Registry::ACCLAIM_SECTION_NAME, Registry::MENU_ENTRIES_KEY_NAME))
+		{
+			MenuVisibility::UnlockFromList(*menuEntries);
+		}
+
 		// Also unlock all menu options if requested
 		if (Registry::GetDword(Registry::ACCLAIM_SECTION_NAME, Registry::ALL_UNLOCK_KEY_NAME).value_or(0) != 0) try
 		{
-			bAllEntriesUnlocked = true;
+			MenuVisibility::UnlockAll();
 
-			auto cheats_multiplay_hide = pattern("E8 ? ? ? ? BB ? ? ? ? E8 ? ? ? ? 8B 15 ? ? ? ?").get_one();
+			auto cheats_multiplay_hide = pattern(SIGNATURE("E8 ? ? ? ? BB ? ? ? ? E8 ? ? ? ? 8B 15 ? ? ? ?")).get_one();
 
 			Nop(cheats_multiplay_hide.get<void>(), 5);
 			Nop(cheats_multiplay_hide.get<void>(10), 5);
@@ -743,10 +1211,11 @@ void OnInitializeHook()
 
 	// Acclaim Juiced: Custom driver names
 	{
+		const LoadTrace::Span span("Acclaim: Driver names");
 		const auto customDriverName = Registry::GetAnsiString(Registry::ACCLAIM_SECTION_NAME, Registry::DRIVER_NAME_KEY_NAME);
 		if (customDriverName) try
 		{
-			auto driver_name = get_pattern("B8 ? ? ? ? 8D 4C 24 18 E8 ? ? ? ? 8B 7D 68", 1);
+			auto driver_name = get_pattern(SIGNATURE("B8 ? ? ? ? 8D 4C 24 18 E8 ? ? ? ? 8B 7D 68"), 1);
 			Patch(driver_name, strndup(customDriverName->c_str(), 19));
 		}
 		TXN_CATCH();
@@ -756,7 +1225,8 @@ void OnInitializeHook()
 	// THQ Juiced (January 2005): Fix a startup crash with more than 4 cores
 	try
 	{
-		auto get_core_count = get_pattern("03 C8 83 F9 20 7C EE 5F", 2 + 2);
+		const LoadTrace::Span span("THQ: Core count crash");
+		auto get_core_count = get_pattern(SIGNATURE("03 C8 83 F9 20 7C EE 5F"), 2 + 2);
 		Patch<uint8_t>(get_core_count, 4);
 	}
 	TXN_CATCH();
@@ -765,7 +1235,8 @@ void OnInitializeHook()
 	// THQ Juiced (April/May 2005): Fix "Juiced requires virtual memory to be enabled"
 	try
 	{
-		auto global_memory_status = pattern("3B 4C 24 08 76 07 83 7C 24 ? 00 77 20").get_one();
+		const LoadTrace::Span span("THQ: Virtual memory check");
+		auto global_memory_status = pattern(SIGNATURE("3B 4C 24 08 76 07 83 7C 24 ? 00 77 20")).get_one();
 
 		Nop(global_memory_status.get<void>(4), 2);
 		Patch<uint8_t>(global_memory_status.get<void>(11), 0xEB);
@@ -776,16 +1247,27 @@ void OnInitializeHook()
 	// THQ Juiced (April/May 2005): Zero initialize string? allocations as they break with page heap enabled
 	try
 	{
+		const LoadTrace::Span span("THQ: Zero string allocations");
 		using namespace ZeroInitializeAllocations;
 
-		auto allocs = pattern("8D 14 9D ? ? ? ? 52 E8 ? ? ? ? 83 C4 04 8B E8").count(2);
+		auto allocs = pattern(SIGNATURE("8D 14 9D ? ? ? ? 52 E8 ? ? ? ? 83 C4 04 8B E8")).count(2);
 		std::array<void*, 2> allocations = 
 		{
 			allocs.get(0).get<void>(8),
 			allocs.get(1).get<void>(8),
 		};
 
+		void* alloc_memory;
+		ReadCallFrom(allocations[0], alloc_memory);
+
 		HookEach(allocations, InterceptCall);
+
+		// Debug: Profile every call to this allocator, chaining on top of the zero initialization
+		if (Registry::GetDword(Registry::DEBUG_SECTION_NAME, Registry::HEAP_PROFILE_KEY_NAME).value_or(0) != 0)
+		{
+			const size_t numCallSites = HeapProfiler::Install(Signature::GetModuleXrefs(), alloc_memory, { allocations.begin(), allocations.end() });
+			Log::Write("Done: HeapProfiler (%zu call sites)", numCallSites);
+		}
 	}
 	TXN_CATCH();
 
@@ -794,7 +1276,8 @@ void OnInitializeHook()
 	// Facepalm...
 	try
 	{
-		auto languages_switch = pattern("B8 05 00 00 00 C3 B8 06 00 00 00 C3 B8 07 00 00 00 C3").get_one();
+		const LoadTrace::Span span("THQ: Languages");
+		auto languages_switch = pattern(SIGNATURE("B8 05 00 00 00 C3 B8 06 00 00 00 C3 B8 07 00 00 00 C3")).get_one();
 
 		Patch<int32_t>(languages_switch.get<void>(1), 0);
 		Patch<int32_t>(languages_switch.get<void>(6 + 1), 0);
@@ -806,15 +1289,16 @@ void OnInitializeHook()
 	// THQ Juiced: Custom starter car
 	if (CareerFilePresent()) try
 	{
+		const LoadTrace::Span span("THQ: Starter car");
 		auto cms_player_crew_collection = [] {
 			try {
 				// January 2005
-				return get_pattern("68 ? ? ? ? E8 ? ? ? ? 8B 85 84 00 00 00 8B 08 8B 11", 1);
+				return get_pattern(SIGNATURE("68 ? ? ? ? E8 ? ? ? ? 8B 85 84 00 00 00 8B 08 8B 11"), 1);
 			}
 			catch (hook::txn_exception&)
 			{
 				// April/May
-				return get_pattern("68 ? ? ? ? E8 ? ? ? ? 8B 9D 84 00 00 00 8B 33 33 C0", 1);
+				return get_pattern(SIGNATURE("68 ? ? ? ? E8 ? ? ? ? 8B 9D 84 00 00 00 8B 33 33 C0"), 1);
 			}
 		}();
 		Patch<const char*>(cms_player_crew_collection, "CMSPlayersCrewCollection2.txt");
@@ -825,21 +1309,33 @@ void OnInitializeHook()
 	// THQ Juiced: Customizable second race
 	if (HasRegistry) try
 	{
+		const LoadTrace::Span span("THQ: Second race");
 		using namespace THQCustomizableRace;
 
-		auto setup_race = get_pattern("E8 ? ? ? ? 8B 8C 24 ? ? ? ? E8 ? ? ? ? 5F 5E 5B 8B E5 5D C2 0C 00");
-		auto setup_info_for_gamemode = get_pattern("C7 44 24 ? ? ? ? ? E8 ? ? ? ? B8 01 00 00 00", 8);
+		auto setup_race = get_pattern(SIGNATURE("E8 ? ? ? ? 8B 8C 24 ? ? ? ? E8 ? ? ? ? 5F 5E 5B 8B E5 5D C2 0C 00"));
+		auto setup_info_for_gamemode = get_pattern(SIGNATURE("C7 44 24 ? ? ? ? ? E8 ? ? ? ? B8 01 00 00 00"), 8);
 
 		InterceptCall(setup_race, orgSetupRace, SetupRace_Customizable);
-		InterceptCall(setup_info_for_gamemode, orgSetupInfoForGameMode, SetupInfoForGameMode_Hook);
+		InterceptCall(setup_info_for_gamemode, orgSetupInfoForGameMode, CreateSetupInfoForGameMode_Hook());
+
+		// Prefetching relies on the file cache to learn which files are loaded
+		Prefetch::enabled = HasFileCache && Registry::GetDword(Registry::THQ_SECTION_NAME, Registry::PREFETCH_KEY_NAME).value_or(0) != 0;
+
+		// Frame capture sets up one race after another, so it relies on Endless Demo
+		if (Registry::GetDword(Registry::THQ_SECTION_NAME, Registry::FRAME_CAPTURE_KEY_NAME).value_or(0) != 0)
+		{
+			FrameCapture::Init();
+			NeedsD3D9Hooks = true;
+		}
 	}
 	TXN_CATCH();
 
 
 	// THQ Juiced: Endless demo
-	if (Registry::GetDword(Registry::THQ_SECTION_NAME, Registry::ENDLESS_DEMO_KEY_NAME).value_or(0) != 0) try
+	if (Registry::GetDword(Registry::THQ_SECTION_NAME, Registry::ENDLESS_DEMO_KEY_NAME).value_or(0) != 0 || THQCustomizableRace::FrameCapture::playlist) try
 	{
-		auto endless_demo = get_pattern("80 7C D0 32 02 75 ? 8B 5E 70 89 3B", 5);
+		const LoadTrace::Span span("THQ: Endless demo");
+		auto endless_demo = get_pattern(SIGNATURE("80 7C D0 32 02 75 ? 8B 5E 70 89 3B"), 5);
 		Nop(endless_demo, 2);
 	}
 	TXN_CATCH();
@@ -847,11 +1343,12 @@ void OnInitializeHook()
 	
 	// THQ Juiced: Custom driver names
 	{
+		const LoadTrace::Span span("THQ: Driver names");
 		const auto customDriverName = Registry::GetAnsiString(Registry::THQ_SECTION_NAME, Registry::DRIVER_NAME_KEY_NAME);
 		if (customDriverName) try
 		{
-			auto driver_name_switch = get_pattern("FF 52 08 83 C0 FF 83 F8 ? 77 ? FF 24 85 ? ? ? ? B8", 3 + 2);
-			auto driver_name = get_pattern("B8 ? ? ? ? 8D 4C 24 18 E8 ? ? ? ? 8B ? 64", 1);
+			auto driver_name_switch = get_pattern(SIGNATURE("FF 52 08 83 C0 FF 83 F8 ? 77 ? FF 24 85 ? ? ? ? B8"), 3 + 2);
+			auto driver_name = get_pattern(SIGNATURE("B8 ? ? ? ? 8D 4C 24 18 E8 ? ? ? ? 8B ? 64"), 1);
 
 			Patch<int8_t>(driver_name_switch, 127);
 			Patch(driver_name, strndup(customDriverName->c_str(), 19));
@@ -862,11 +1359,12 @@ void OnInitializeHook()
 
 	// THQ Juiced: Customizable starting money
 	{
+		const LoadTrace::Span span("THQ: Starting money");
 		constexpr uint32_t DEFAULT_MONEY = 25000;
 		const auto startingMoney = Registry::GetDword(Registry::THQ_SECTION_NAME, Registry::STARTING_MONEY_KEY_NAME).value_or(DEFAULT_MONEY);
 		if (startingMoney != DEFAULT_MONEY) try
 		{
-			auto money = get_pattern("51 C7 46 0C A8 61 00 00", 1 + 3);
+			auto money = get_pattern(SIGNATURE("51 C7 46 0C A8 61 00 00"), 1 + 3);
 			Patch<uint32_t>(money, startingMoney);
 		}
 		TXN_CATCH();
@@ -876,15 +1374,16 @@ void OnInitializeHook()
 	// THQ Juiced: Unlock all menus
 	if (Registry::GetDword(Registry::THQ_SECTION_NAME, Registry::ALL_UNLOCK_KEY_NAME).value_or(0) != 0) try
 	{
+		const LoadTrace::Span span("THQ: Unlock menus");
 		auto string_ptr = [] {
 			try {
 				// January
-				return *get_pattern<uintptr_t>("B8 ? ? ? ? 8D 91 ? ? ? ? 89 99 ? ? ? ? 2B D0 8A 08 88 0C 02 03 C3 84 C9 75 F5 5E", 1);
+				return *get_pattern<uintptr_t>(SIGNATURE("B8 ? ? ? ? 8D 91 ? ? ? ? 89 99 ? ? ? ? 2B D0 8A 08 88 0C 02 03 C3 84 C9 75 F5 5E"), 1);
 			}
 			catch (hook::txn_exception&)
 			{
 				// April/May
-				return *get_pattern<uintptr_t>("B8 ? ? ? ? 8B CA 2B C8 C7 82 ? ? ? ? ? ? ? ? 8D B1 ? ? ? ? 8D A4 24 00 00 00 00", 1);
+				return *get_pattern<uintptr_t>(SIGNATURE("B8 ? ? ? ? 8B CA 2B C8 C7 82 ? ? ? ? ? ? ? ? 8D B1 ? ? ? ? 8D A4 24 00 00 00 00"), 1);
 			}
 		}();
 
@@ -896,4 +1395,17 @@ void OnInitializeHook()
 		}
 	}
 	TXN_CATCH();
+
+
+	// Patches from an external manifest, applied after the built-in ones so they can fill in for builds those don't match
+	ExternalPatches::Run();
+
+
+	// Hook the D3D9 device for the patches that need it
+	if (NeedsD3D9Hooks)
+	{
+		const LoadTrace::Span span("D3D9Hooks: Direct3DCreate9");
+		D3D9Hooks::ApplyPatches(hModule);
+		Log::Write("Done: D3D9Hooks");
+	}
 }
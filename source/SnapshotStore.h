@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Read-copy-update store for data read far more often than it's written.
+// Readers get an immutable snapshot with a single atomic load, without locking or waiting on writers.
+// Writers copy the current snapshot, modify the copy and publish it. Old snapshots are never freed,
+// as readers may still hold them and nothing tracks when they are done; writes must be rare enough for that to be fine.
+// Portable, so it can be stress tested outside of Windows
+template<typename T>
+class SnapshotStore
+{
+public:
+	explicit SnapshotStore(T initial = T())
+	{
+		Publish(std::make_unique<const T>(std::move(initial)));
+	}
+
+	SnapshotStore(const SnapshotStore&) = delete;
+	SnapshotStore& operator=(const SnapshotStore&) = delete;
+
+	// Stays valid for the lifetime of the store
+	const T& Get() const
+	{
+		return *m_current.load(std::memory_order_acquire);
+	}
+
+	// Calls func with a copy of the current snapshot and publishes it. Writers are serialized,
+	// so func may also write the change through to persistent storage
+	template<typename Func>
+	void Update(Func&& func)
+	{
+		std::lock_guard<std::mutex> lock(m_writeMutex);
+
+		auto copy = std::make_unique<T>(*m_current.load(std::memory_order_relaxed));
+		func(*copy);
+		Publish(std::move(copy));
+	}
+
+	// Replaces the snapshot without looking at the current one
+	void Reset(T value)
+	{
+		std::lock_guard<std::mutex> lock(m_writeMutex);
+		Publish(std::make_unique<const T>(std::move(value)));
+	}
+
+	size_t GetVersionCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_writeMutex);
+		return m_versions.size();
+	}
+
+private:
+	void Publish(std::unique_ptr<const T> snapshot)
+	{
+		m_versions.push_back(std::move(snapshot));
+		m_current.store(m_versions.back().get(), std::memory_order_release);
+	}
+
+	std::atomic<const T*> m_current { nullptr };
+
+	mutable std::mutex m_writeMutex;
+	std::vector<std::unique_ptr<const T>> m_versions;
+};
@@ -0,0 +1,92 @@
+#include "TextConversion.h"
+
+#include "AsciiConversion.h"
+
+#include <algorithm>
+#include <climits>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+
+static_assert(sizeof(wchar_t) == sizeof(char16_t), "Wide strings must be UTF-16");
+
+size_t TextConversion::AnsiToWide(std::string_view text, wchar_t* buffer, size_t bufferSize)
+{
+	if (bufferSize == 0)
+	{
+		return 0;
+	}
+
+	const size_t capacity = bufferSize - 1;
+	const size_t asciiLength = AsciiConversion::Widen(text.data(), std::min(text.size(), capacity), reinterpret_cast<char16_t*>(buffer));
+	size_t length = asciiLength;
+	if (asciiLength != text.size())
+	{
+		// A zero-sized output would make the API only query the size
+		if (asciiLength == capacity || text.size() - asciiLength > INT_MAX)
+		{
+			return 0;
+		}
+
+		// Lead bytes of multi-byte characters are never ASCII, so the remainder starts on a character boundary
+		const int count = MultiByteToWideChar(CP_ACP, 0, text.data() + asciiLength, static_cast<int>(text.size() - asciiLength),
+			buffer + asciiLength, static_cast<int>(std::min<size_t>(capacity - asciiLength, INT_MAX)));
+		if (count == 0)
+		{
+			return 0;
+		}
+		length += count;
+	}
+
+	buffer[length] = L'\0';
+	return length;
+}
+
+size_t TextConversion::WideToAnsi(std::wstring_view text, char* buffer, size_t bufferSize)
+{
+	if (bufferSize == 0)
+	{
+		return 0;
+	}
+
+	const size_t capacity = bufferSize - 1;
+	const size_t asciiLength = AsciiConversion::Narrow(reinterpret_cast<const char16_t*>(text.data()), std::min(text.size(), capacity), buffer);
+	size_t length = asciiLength;
+	if (asciiLength != text.size())
+	{
+		if (asciiLength == capacity || text.size() - asciiLength > INT_MAX)
+		{
+			return 0;
+		}
+
+		const int count = WideCharToMultiByte(CP_ACP, 0, text.data() + asciiLength, static_cast<int>(text.size() - asciiLength),
+			buffer + asciiLength, static_cast<int>(std::min<size_t>(capacity - asciiLength, INT_MAX)), nullptr, nullptr);
+		if (count == 0)
+		{
+			return 0;
+		}
+		length += count;
+	}
+
+	buffer[length] = '\0';
+	return length;
+}
+
+size_t TextConversion::WideLength(std::string_view text)
+{
+	if (text.empty() || text.size() > INT_MAX)
+	{
+		return 0;
+	}
+	return static_cast<size_t>(MultiByteToWideChar(CP_ACP, 0, text.data(), static_cast<int>(text.size()), nullptr, 0));
+}
+
+size_t TextConversion::AnsiLength(std::wstring_view text)
+{
+	if (text.empty() || text.size() > INT_MAX)
+	{
+		return 0;
+	}
+	return static_cast<size_t>(WideCharToMultiByte(CP_ACP, 0, text.data(), static_cast<int>(text.size()), nullptr, 0, nullptr, nullptr));
+}
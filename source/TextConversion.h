@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+
+// ANSI (CP_ACP) <-> wide conversions writing into caller-provided buffers, so short strings never allocate
+namespace TextConversion
+{
+	// Return the number of characters written, not counting the null terminator,
+	// or 0 if the text does not fit in bufferSize characters (terminator included) or cannot be converted
+	size_t AnsiToWide(std::string_view text, wchar_t* buffer, size_t bufferSize);
+	size_t WideToAnsi(std::wstring_view text, char* buffer, size_t bufferSize);
+
+	// Number of characters the converted text takes, not counting the null terminator, or 0 if it cannot be converted
+	size_t WideLength(std::string_view text);
+	size_t AnsiLength(std::wstring_view text);
+
+	// A converted string living on the stack, moving to the heap only if it does not fit
+	template<typename Char, size_t N>
+	class Converted
+	{
+	public:
+		using Source = std::conditional_t<std::is_same_v<Char, wchar_t>, std::string_view, std::wstring_view>;
+
+		explicit Converted(Source text)
+		{
+			if (!Convert(text, m_buffer, N))
+			{
+				// Ask for the exact size, as a character can take up to three bytes when the ANSI code page is UTF-8
+				const size_t size = Length(text) + 1;
+				m_heapBuffer = std::make_unique<Char[]>(size);
+				Convert(text, m_heapBuffer.get(), size);
+			}
+		}
+
+		const Char* c_str() const
+		{
+			return m_heapBuffer ? m_heapBuffer.get() : m_buffer;
+		}
+
+	private:
+		static size_t Length(std::string_view text)
+		{
+			return WideLength(text);
+		}
+
+		static size_t Length(std::wstring_view text)
+		{
+			return AnsiLength(text);
+		}
+
+		static bool Convert(std::string_view text, wchar_t* buffer, size_t size)
+		{
+			buffer[0] = L'\0';
+			return text.empty() || AnsiToWide(text, buffer, size) != 0;
+		}
+
+		static bool Convert(std::wstring_view text, char* buffer, size_t size)
+		{
+			buffer[0] = '\0';
+			return text.empty() || WideToAnsi(text, buffer, size) != 0;
+		}
+
+		Char m_buffer[N];
+		std::unique_ptr<Char[]> m_heapBuffer;
+	};
+
+	// Registry value names are at most a few dozen characters long
+	using WideString = Converted<wchar_t, 128>;
+	using AnsiString = Converted<char, 256>;
+}
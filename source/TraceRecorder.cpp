@@ -0,0 +1,151 @@
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+namespace
+{
+	void AppendJsonString(std::string& out, const char* str)
+	{
+		out.push_back('"');
+		for (const char* ch = str; *ch != '\0'; ch++)
+		{
+			const unsigned char c = static_cast<unsigned char>(*ch);
+			switch (c)
+			{
+			case '"': out.append("\\\""); break;
+			case '\\': out.append("\\\\"); break;
+			case '\n': out.append("\\n"); break;
+			case '\r': out.append("\\r"); break;
+			case '\t': out.append("\\t"); break;
+			default:
+				if (c < 0x20)
+				{
+					char buf[8];
+					snprintf(buf, sizeof(buf), "\\u%04x", c);
+					out.append(buf);
+				}
+				else
+				{
+					// Paths are in the ANSI code page, so anything outside of ASCII is replaced to keep the file valid UTF-8
+					out.push_back(c < 0x80 ? static_cast<char>(c) : '?');
+				}
+				break;
+			}
+		}
+		out.push_back('"');
+	}
+
+	void AppendMicroseconds(std::string& out, uint64_t ticks, uint64_t ticksPerSecond)
+	{
+		// Whole and fractional parts separately, so long traces don't lose precision to doubles
+		const uint64_t whole = ticks / ticksPerSecond * 1000000 + ticks % ticksPerSecond * 1000000 / ticksPerSecond;
+		const uint64_t remainder = ticks % ticksPerSecond * 1000000 % ticksPerSecond;
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%" PRIu64 ".%03" PRIu64, whole, remainder * 1000 / ticksPerSecond);
+		out.append(buf);
+	}
+}
+
+TraceRecorder::TraceRecorder(uint64_t ticksPerSecond, size_t maxSpans)
+	: m_ticksPerSecond(ticksPerSecond), m_maxSpans(maxSpans), m_slots(std::make_unique<Slot[]>(maxSpans))
+{
+}
+
+void TraceRecorder::Add(Span span)
+{
+	const size_t index = m_nextSlot.fetch_add(1, std::memory_order_relaxed);
+	if (index < m_maxSpans)
+	{
+		m_slots[index].span = std::move(span);
+		m_slots[index].ready.store(true, std::memory_order_release);
+	}
+}
+
+void TraceRecorder::NameThread(uint32_t threadId, std::string name)
+{
+	m_threadNames.emplace_back(threadId, std::move(name));
+}
+
+size_t TraceRecorder::GetSpanCount() const
+{
+	const size_t count = std::min(m_nextSlot.load(std::memory_order_relaxed), m_maxSpans);
+	return static_cast<size_t>(std::count_if(m_slots.get(), m_slots.get() + count, [](const Slot& slot) {
+		return slot.ready.load(std::memory_order_acquire);
+	}));
+}
+
+size_t TraceRecorder::GetDroppedCount() const
+{
+	const size_t taken = m_nextSlot.load(std::memory_order_relaxed);
+	return taken > m_maxSpans ? taken - m_maxSpans : 0;
+}
+
+std::string TraceRecorder::ExportChromeTrace(const char* processName) const
+{
+	std::vector<const Span*> spans;
+	const size_t count = std::min(m_nextSlot.load(std::memory_order_relaxed), m_maxSpans);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (m_slots[i].ready.load(std::memory_order_acquire))
+		{
+			spans.push_back(&m_slots[i].span);
+		}
+	}
+
+	// Viewers nest spans of a thread in the order they appear in, so outer spans go first
+	std::stable_sort(spans.begin(), spans.end(), [](const Span* left, const Span* right) {
+		if (left->beginTicks != right->beginTicks)
+		{
+			return left->beginTicks < right->beginTicks;
+		}
+		return left->endTicks > right->endTicks;
+	});
+
+	const uint64_t origin = !spans.empty() ? spans.front()->beginTicks : 0;
+
+	std::string out;
+	out.append("{\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedSpans\":\"");
+	out.append(std::to_string(GetDroppedCount()));
+	out.append("\"},\"traceEvents\":[\n");
+
+	out.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":");
+	AppendJsonString(out, processName);
+	out.append("}}");
+	for (const auto& [threadId, name] : m_threadNames)
+	{
+		out.append(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+		out.append(std::to_string(threadId));
+		out.append(",\"args\":{\"name\":");
+		AppendJsonString(out, name.c_str());
+		out.append("}}");
+	}
+
+	for (const Span* span : spans)
+	{
+		// A span can't end before it began, but clocks of different CPUs might disagree slightly
+		const uint64_t begin = span->beginTicks - origin;
+		const uint64_t end = std::max(span->endTicks, span->beginTicks) - origin;
+
+		out.append(",\n{\"name\":");
+		AppendJsonString(out, span->name);
+		out.append(",\"cat\":");
+		AppendJsonString(out, span->category);
+		out.append(",\"ph\":\"X\",\"ts\":");
+		AppendMicroseconds(out, begin, m_ticksPerSecond);
+		out.append(",\"dur\":");
+		AppendMicroseconds(out, end - begin, m_ticksPerSecond);
+		out.append(",\"pid\":1,\"tid\":");
+		out.append(std::to_string(span->threadId));
+		if (!span->detail.empty())
+		{
+			out.append(",\"args\":{\"detail\":");
+			AppendJsonString(out, span->detail.c_str());
+			out.push_back('}');
+		}
+		out.push_back('}');
+	}
+	out.append("\n]}\n");
+	return out;
+}
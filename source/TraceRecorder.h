@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Spans of time recorded by any thread, exported in the Chrome trace event format for chrome://tracing, Perfetto and the like.
+// Timestamps are ticks of any clock, given by the caller along with the clock's frequency. Recording takes a slot
+// without locking, so the trace can be exported at any time, even when a thread was terminated halfway through recording.
+// Once all slots are taken, new spans are dropped and counted.
+// Portable, so it can be tested outside of Windows
+class TraceRecorder
+{
+public:
+	struct Span
+	{
+		const char* name; // Must outlive the recorder, e.g. a string literal
+		const char* category; // Likewise
+		std::string detail; // Shown as an argument of the span if not empty
+		uint64_t beginTicks;
+		uint64_t endTicks;
+		uint32_t threadId;
+	};
+
+	// Timestamps in the trace are relative to the earliest span
+	TraceRecorder(uint64_t ticksPerSecond, size_t maxSpans);
+
+	void Add(Span span);
+
+	// Not thread safe, threads should be named before spans are recorded from other threads
+	void NameThread(uint32_t threadId, std::string name);
+
+	// Snapshots, spans still being recorded are not counted
+	size_t GetSpanCount() const;
+	size_t GetDroppedCount() const;
+
+	// Trace of all spans recorded so far, as a JSON object
+	std::string ExportChromeTrace(const char* processName) const;
+
+private:
+	struct Slot
+	{
+		Span span;
+		std::atomic<bool> ready { false };
+	};
+
+	uint64_t m_ticksPerSecond;
+	size_t m_maxSpans;
+	std::unique_ptr<Slot[]> m_slots;
+	std::atomic<size_t> m_nextSlot { 0 };
+	std::vector<std::pair<uint32_t, std::string>> m_threadNames;
+};
@@ -0,0 +1,241 @@
+#include "Trampoline.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	using Trampoline::Register;
+
+	constexpr Trampoline::RegisterSet SCRATCH_REGISTERS = Trampoline::Registers({ Register::Eax, Register::Ecx, Register::Edx });
+
+	// Bytes for the frame fxsave needs: 512 bytes, 16 byte aligned
+	constexpr uint32_t FXSAVE_AREA_SIZE = 512;
+
+	class Emitter
+	{
+	public:
+		explicit Emitter(uintptr_t address)
+			: m_address(address)
+		{
+		}
+
+		void Byte(uint8_t byte) { m_code.push_back(byte); }
+		void Bytes(std::initializer_list<uint8_t> bytes) { m_code.insert(m_code.end(), bytes); }
+		void Bytes(const std::vector<uint8_t>& bytes) { m_code.insert(m_code.end(), bytes.begin(), bytes.end()); }
+
+		void Dword(uint32_t value)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				Byte(static_cast<uint8_t>(value >> (i * 8)));
+			}
+		}
+
+		void Push(Register reg)
+		{
+			Byte(static_cast<uint8_t>(0x50 + static_cast<uint8_t>(reg)));
+			m_stackDepth += 4;
+		}
+
+		void Pop(Register reg)
+		{
+			Byte(static_cast<uint8_t>(0x58 + static_cast<uint8_t>(reg)));
+			m_stackDepth -= 4;
+		}
+
+		// push dword ptr [esp+offset]
+		void PushStack(uint32_t offset)
+		{
+			if (offset < 0x80)
+			{
+				Bytes({ 0xFF, 0x74, 0x24, static_cast<uint8_t>(offset) });
+			}
+			else
+			{
+				Bytes({ 0xFF, 0xB4, 0x24 });
+				Dword(offset);
+			}
+			m_stackDepth += 4;
+		}
+
+		void AddEsp(uint32_t bytes)
+		{
+			if (bytes < 0x80)
+			{
+				Bytes({ 0x83, 0xC4, static_cast<uint8_t>(bytes) });
+			}
+			else
+			{
+				Bytes({ 0x81, 0xC4 });
+				Dword(bytes);
+			}
+			m_stackDepth -= bytes;
+		}
+
+		void CallRelative(const void* target)
+		{
+			Byte(0xE8);
+			Dword(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(target) - (m_address + m_code.size() + 4)));
+		}
+
+		// call/jmp dword ptr [pointer]
+		void CallIndirect(void* const* pointer)
+		{
+			Bytes({ 0xFF, 0x15 });
+			Dword(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pointer)));
+		}
+
+		void JumpIndirect(void* const* pointer)
+		{
+			Bytes({ 0xFF, 0x25 });
+			Dword(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pointer)));
+		}
+
+		// Offset from esp to the stub's stack argument index, valid while no frame is set up
+		uint32_t StackArgumentOffset(size_t index) const
+		{
+			return static_cast<uint32_t>(m_stackDepth + 4 + index * 4);
+		}
+
+		// For bytes popped by the callee
+		void Popped(uint32_t bytes) { m_stackDepth -= bytes; }
+
+		std::vector<uint8_t> Take() { return std::move(m_code); }
+
+	private:
+		uintptr_t m_address;
+		std::vector<uint8_t> m_code;
+		// Bytes pushed since the entry, to address stack arguments
+		uint32_t m_stackDepth = 0;
+	};
+
+	void EmitCall(Emitter& emitter, const Trampoline::Call& call, bool hasFrame)
+	{
+		if ((call.function == nullptr) == (call.indirectFunction == nullptr))
+		{
+			throw std::invalid_argument("A call needs exactly one of function and indirectFunction");
+		}
+		if (hasFrame && call.stackArguments != 0)
+		{
+			throw std::invalid_argument("Stack arguments can't be forwarded past an fxsave frame");
+		}
+
+		// Live scratch registers get clobbered by the call, everything else is preserved by the callee
+		const Trampoline::RegisterSet saved = call.live & SCRATCH_REGISTERS;
+		for (uint8_t reg = 0; reg < 8; reg++)
+		{
+			if ((saved & (1 << reg)) != 0)
+			{
+				emitter.Push(static_cast<Register>(reg));
+			}
+		}
+
+		// Arguments are pushed last to first. Every push moves esp, so the next argument deeper in the stack
+		// is at the same offset as the one just pushed
+		for (size_t i = call.stackArguments; i > 0; i--)
+		{
+			emitter.PushStack(emitter.StackArgumentOffset(i - 1));
+		}
+		for (auto it = call.arguments.rbegin(); it != call.arguments.rend(); ++it)
+		{
+			emitter.Push(*it);
+		}
+
+		if (call.function != nullptr)
+		{
+			emitter.CallRelative(call.function);
+		}
+		else
+		{
+			emitter.CallIndirect(call.indirectFunction);
+		}
+
+		const uint32_t argumentBytes = static_cast<uint32_t>((call.arguments.size() + call.stackArguments) * 4);
+		if (call.calleePops)
+		{
+			emitter.Popped(argumentBytes);
+		}
+		else if (argumentBytes != 0)
+		{
+			emitter.AddEsp(argumentBytes);
+		}
+
+		for (uint8_t reg = 8; reg > 0; reg--)
+		{
+			if ((saved & (1 << (reg - 1))) != 0)
+			{
+				emitter.Pop(static_cast<Register>(reg - 1));
+			}
+		}
+	}
+}
+
+Trampoline::Code Trampoline::StoreByte(const volatile void* address, uint8_t value)
+{
+	const uint32_t target = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(address));
+	return { 0xC6, 0x05, static_cast<uint8_t>(target), static_cast<uint8_t>(target >> 8), static_cast<uint8_t>(target >> 16), static_cast<uint8_t>(target >> 24), value };
+}
+
+std::vector<uint8_t> Trampoline::Emit(const Spec& spec, uintptr_t address)
+{
+	if (spec.exit == Spec::Exit::Jump && spec.jumpTarget == nullptr)
+	{
+		throw std::invalid_argument("Jump exits need a jump target");
+	}
+
+	Emitter emitter(address);
+	if (spec.saveFpu)
+	{
+		// push ebp / mov ebp, esp / and esp, -16 / sub esp, 512 / fxsave [esp]
+		emitter.Bytes({ 0x55, 0x8B, 0xEC, 0x83, 0xE4, 0xF0, 0x81, 0xEC });
+		emitter.Dword(FXSAVE_AREA_SIZE);
+		emitter.Bytes({ 0x0F, 0xAE, 0x04, 0x24 });
+	}
+
+	for (const auto& step : spec.steps)
+	{
+		if (const Call* call = std::get_if<Call>(&step))
+		{
+			EmitCall(emitter, *call, spec.saveFpu);
+		}
+		else
+		{
+			emitter.Bytes(std::get<Code>(step));
+		}
+	}
+
+	if (spec.saveFpu)
+	{
+		// fxrstor [esp] / mov esp, ebp / pop ebp
+		emitter.Bytes({ 0x0F, 0xAE, 0x0C, 0x24, 0x8B, 0xE5, 0x5D });
+	}
+
+	if (spec.exit == Spec::Exit::Jump)
+	{
+		if (spec.testResult)
+		{
+			throw std::invalid_argument("Jump exits leave the flags to the jump target");
+		}
+		emitter.JumpIndirect(spec.jumpTarget);
+	}
+	else
+	{
+		if (spec.testResult)
+		{
+			// test eax, eax
+			emitter.Bytes({ 0x85, 0xC0 });
+		}
+		if (spec.returnPopBytes != 0)
+		{
+			emitter.Byte(0xC2);
+			emitter.Byte(static_cast<uint8_t>(spec.returnPopBytes));
+			emitter.Byte(static_cast<uint8_t>(spec.returnPopBytes >> 8));
+		}
+		else
+		{
+			emitter.Byte(0xC3);
+		}
+	}
+	return emitter.Take();
+}
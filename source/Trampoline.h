@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <variant>
+#include <vector>
+
+// Generates the x86 stubs that glue game code with custom register usage to regular C++ functions.
+// A stub is described by what it must do, not how: which registers go to a handler as arguments,
+// which registers must survive the call, and how to leave. Only the scratch registers (eax, ecx, edx)
+// that are live get saved, as cdecl and stdcall functions preserve the others themselves.
+// The emitter itself is portable, so stubs can be decoded and checked outside of Windows
+namespace Trampoline
+{
+	enum class Register : uint8_t
+	{
+		Eax, Ecx, Edx, Ebx, Esp, Ebp, Esi, Edi,
+	};
+
+	using RegisterSet = uint8_t;
+	constexpr RegisterSet Registers(std::initializer_list<Register> registers)
+	{
+		RegisterSet set = 0;
+		for (Register reg : registers)
+		{
+			set |= static_cast<RegisterSet>(1 << static_cast<uint8_t>(reg));
+		}
+		return set;
+	}
+
+	struct Call
+	{
+		// Called directly if set, otherwise through indirectFunction, e.g. the pointer to an original function
+		const void* function = nullptr;
+		void* const* indirectFunction = nullptr;
+
+		// Passed as the first arguments, in order
+		std::vector<Register> arguments;
+		// The stub's own stack arguments, passed after the register arguments
+		size_t stackArguments = 0;
+		// stdcall handlers pop their arguments
+		bool calleePops = false;
+		// Registers whose values must be the same after the call
+		RegisterSet live = 0;
+	};
+
+	// Instructions copied as is, e.g. the ones moved out of the hooked code to make room for the jump.
+	// Must not be relative to their address
+	using Code = std::vector<uint8_t>;
+
+	struct Spec
+	{
+		// Preserves the entire x87/SSE state with fxsave, for code that calls into functions trashing it
+		bool saveFpu = false;
+
+		std::vector<std::variant<Call, Code>> steps;
+
+		enum class Exit
+		{
+			Jump, // To *jumpTarget
+			Return, // Popping returnPopBytes of stack arguments
+		};
+		Exit exit = Exit::Return;
+		void* const* jumpTarget = nullptr;
+		uint16_t returnPopBytes = 0;
+		// Sets the flags from eax before returning, for call sites that tested the result in the instructions replaced by the call
+		bool testResult = false;
+	};
+
+	// mov byte ptr [address], value. Leaves all registers and flags intact
+	Code StoreByte(const volatile void* address, uint8_t value);
+
+	// Emits the stub as it would run from address. Throws std::invalid_argument on specs it can't express
+	std::vector<uint8_t> Emit(const Spec& spec, uintptr_t address);
+
+	// Emits the stub into executable memory kept for the lifetime of the process
+	void* Create(const Spec& spec);
+}
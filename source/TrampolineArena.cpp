@@ -0,0 +1,62 @@
+#include "Trampoline.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+// Stubs are packed into pages that are only writable while a stub is being added
+static std::mutex arenaMutex;
+static uint8_t* arenaPage;
+static size_t arenaUsed;
+static size_t arenaSize;
+
+static size_t GetPageSize()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwPageSize;
+}
+
+void* Trampoline::Create(const Spec& spec)
+{
+	std::lock_guard lock(arenaMutex);
+
+	// Emit against the next free address, and if it doesn't fit, again against a fresh page
+	// as call rel32 depends on where the stub is placed
+	std::vector<uint8_t> code;
+	if (arenaPage != nullptr)
+	{
+		code = Emit(spec, reinterpret_cast<uintptr_t>(arenaPage + arenaUsed));
+	}
+	if (arenaPage == nullptr || arenaUsed + code.size() > arenaSize)
+	{
+		static const size_t pageSize = GetPageSize();
+		const size_t size = std::max(pageSize, (Emit(spec, 0).size() + pageSize - 1) & ~(pageSize - 1));
+		void* page = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READONLY);
+		if (page == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		arenaPage = static_cast<uint8_t*>(page);
+		arenaUsed = 0;
+		arenaSize = size;
+		code = Emit(spec, reinterpret_cast<uintptr_t>(arenaPage));
+	}
+
+	// Stubs already on the page may be running on other threads, so it stays executable while being written
+	uint8_t* stub = arenaPage + arenaUsed;
+	DWORD oldProtect;
+	VirtualProtect(arenaPage, arenaSize, PAGE_EXECUTE_READWRITE, &oldProtect);
+	std::memcpy(stub, code.data(), code.size());
+	VirtualProtect(arenaPage, arenaSize, PAGE_EXECUTE_READ, &oldProtect);
+	FlushInstructionCache(GetCurrentProcess(), stub, code.size());
+
+	// Keep stubs 16 byte aligned, like the compiler does for functions
+	arenaUsed = (arenaUsed + code.size() + 15) & ~size_t(15);
+	return stub;
+}
@@ -0,0 +1,50 @@
+#include "VertexBufferRing.h"
+
+#include <algorithm>
+
+VertexBufferRing::VertexBufferRing(uint32_t size)
+	: m_size(size)
+{
+}
+
+VertexBufferRing::LockMode VertexBufferRing::Lock(uint32_t offset, uint32_t size)
+{
+	size = ClampSize(offset, size);
+
+	if (offset >= m_cursor)
+	{
+		m_cursor = offset + size;
+		return LockMode::NoOverwrite;
+	}
+
+	// Discarding drops everything outside of the locked range, so only a wraparound rewriting all the data written
+	// since the last discard can do it. Partial rewrites may still need the rest of the data
+	if (offset == 0 && size >= m_cursor)
+	{
+		m_cursor = size;
+		return LockMode::Discard;
+	}
+
+	m_cursor = std::max(m_cursor, offset + size);
+	return LockMode::Wait;
+}
+
+void VertexBufferRing::Discard(uint32_t offset, uint32_t size)
+{
+	m_cursor = offset + ClampSize(offset, size);
+}
+
+void VertexBufferRing::NoOverwrite(uint32_t offset, uint32_t size)
+{
+	m_cursor = std::max(m_cursor, offset + ClampSize(offset, size));
+}
+
+uint32_t VertexBufferRing::ClampSize(uint32_t offset, uint32_t size) const
+{
+	if (offset >= m_size)
+	{
+		return 0;
+	}
+	const uint32_t remaining = m_size - offset;
+	return size == 0 ? remaining : std::min(size, remaining);
+}
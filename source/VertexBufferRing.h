@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+// Treats a dynamic vertex buffer as a ring and picks lock flags that don't make the CPU wait for the GPU.
+// Locks appending past everything written since the last discard can't touch data the GPU may still read,
+// so they don't overwrite; locks wrapping around to the start of the buffer and rewriting all of that data discard it instead.
+// Portable, so it can be tested outside of Windows against a mock device
+class VertexBufferRing
+{
+public:
+	enum class LockMode
+	{
+		Wait, // Overlaps data written since the last discard, keep the original flags
+		NoOverwrite,
+		Discard,
+	};
+
+	explicit VertexBufferRing(uint32_t size);
+
+	// Size of 0 locks until the end of the buffer, like in D3D9
+	LockMode Lock(uint32_t offset, uint32_t size);
+
+	// The caller discarded or overwrote the buffer on its own
+	void Discard(uint32_t offset, uint32_t size);
+	void NoOverwrite(uint32_t offset, uint32_t size);
+
+	uint32_t GetSize() const { return m_size; }
+	uint32_t GetCursor() const { return m_cursor; }
+
+private:
+	uint32_t ClampSize(uint32_t offset, uint32_t size) const;
+
+	uint32_t m_size;
+	// End of the data written since the last discard
+	uint32_t m_cursor = 0;
+};
@@ -0,0 +1,162 @@
+#include "VideoReadAhead.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::unique_ptr<VideoReadAhead> VideoReadAhead::Open(const char* path)
+{
+	std::unique_ptr<VideoReadAhead> result;
+
+	wil::unique_hfile file(CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
+	if (file)
+	{
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file.get(), &size) != FALSE && size.QuadPart != 0)
+		{
+			result.reset(new VideoReadAhead(std::move(file), static_cast<uint64_t>(size.QuadPart)));
+		}
+	}
+	return result;
+}
+
+VideoReadAhead::VideoReadAhead(wil::unique_hfile file, uint64_t size)
+	: m_file(std::move(file)), m_size(size)
+{
+	for (Chunk& chunk : m_chunks)
+	{
+		chunk.data = std::make_unique<uint8_t[]>(CHUNK_SIZE);
+	}
+
+	m_thread = std::thread(&VideoReadAhead::WorkerThread, this);
+	SetThreadPriority(m_thread.native_handle(), THREAD_PRIORITY_BELOW_NORMAL);
+}
+
+VideoReadAhead::~VideoReadAhead()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+DWORD VideoReadAhead::Read(uint64_t position, void* buffer, DWORD size)
+{
+	uint8_t* out = static_cast<uint8_t*>(buffer);
+	DWORD bytesCopied = 0;
+
+	std::unique_lock lock(m_mutex);
+	while (bytesCopied < size && position < m_size)
+	{
+		Chunk* chunk = FindChunk(position);
+		if (chunk == nullptr)
+		{
+			// Not buffered, so this must have been a seek
+			Restart(position + (size - bytesCopied));
+			break;
+		}
+
+		if (chunk->state == Chunk::State::Filling)
+		{
+			// The data is on its way, waiting for it is still faster than reading it again
+			m_cv.wait(lock);
+			continue;
+		}
+
+		const uint64_t chunkEnd = chunk->start + chunk->length;
+		const DWORD bytesToCopy = static_cast<DWORD>(std::min<uint64_t>(size - bytesCopied, chunkEnd - position));
+		memcpy(out + bytesCopied, chunk->data.get() + (position - chunk->start), bytesToCopy);
+		bytesCopied += bytesToCopy;
+		position += bytesToCopy;
+
+		// Reads are sequential, so a fully consumed chunk can be refilled
+		if (position == chunkEnd)
+		{
+			chunk->state = Chunk::State::Empty;
+			m_cv.notify_all();
+		}
+	}
+	return bytesCopied;
+}
+
+void VideoReadAhead::WorkerThread()
+{
+	std::unique_lock lock(m_mutex);
+	while (!m_quit)
+	{
+		auto chunk = std::find_if(std::begin(m_chunks), std::end(m_chunks), [](const Chunk& chunk) {
+			return chunk.state == Chunk::State::Empty;
+		});
+		if (chunk == std::end(m_chunks) || m_nextReadPosition >= m_size)
+		{
+			m_cv.wait(lock);
+			continue;
+		}
+
+		const uint32_t generation = m_generation;
+		chunk->state = Chunk::State::Filling;
+		chunk->start = m_nextReadPosition;
+		const DWORD bytesToRead = static_cast<DWORD>(std::min<uint64_t>(CHUNK_SIZE, m_size - m_nextReadPosition));
+		m_nextReadPosition += bytesToRead;
+
+		lock.unlock();
+
+		LARGE_INTEGER filePointer;
+		filePointer.QuadPart = static_cast<LONGLONG>(chunk->start);
+		DWORD bytesRead = 0;
+		const bool success = SetFilePointerEx(m_file.get(), filePointer, nullptr, FILE_BEGIN) != FALSE &&
+			ReadFile(m_file.get(), chunk->data.get(), bytesToRead, &bytesRead, nullptr) != FALSE && bytesRead != 0;
+
+		lock.lock();
+
+		if (generation != m_generation)
+		{
+			// Restarted while reading, this data is not needed anymore
+			chunk->state = Chunk::State::Empty;
+		}
+		else if (success)
+		{
+			chunk->length = bytesRead;
+			chunk->state = Chunk::State::Ready;
+		}
+		else
+		{
+			// Leave it to the caller to read the file directly
+			chunk->state = Chunk::State::Empty;
+			m_nextReadPosition = m_size;
+		}
+		m_cv.notify_all();
+	}
+}
+
+void VideoReadAhead::Restart(uint64_t position)
+{
+	m_generation++;
+	m_nextReadPosition = position;
+	for (Chunk& chunk : m_chunks)
+	{
+		if (chunk.state == Chunk::State::Ready)
+		{
+			chunk.state = Chunk::State::Empty;
+		}
+	}
+	m_cv.notify_all();
+}
+
+VideoReadAhead::Chunk* VideoReadAhead::FindChunk(uint64_t position)
+{
+	for (Chunk& chunk : m_chunks)
+	{
+		if (chunk.state == Chunk::State::Ready && position >= chunk.start && position < chunk.start + chunk.length)
+		{
+			return &chunk;
+		}
+		// Chunks being filled are only waited for if they start exactly where the read starts, as their length is not known yet
+		if (chunk.state == Chunk::State::Filling && position == chunk.start)
+		{
+			return &chunk;
+		}
+	}
+	return nullptr;
+}
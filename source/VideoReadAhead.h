@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <wil/resource.h>
+
+// Reads a video file sequentially on a low priority thread into two alternating buffers,
+// so the decoder only ever copies from memory
+class VideoReadAhead
+{
+public:
+	static std::unique_ptr<VideoReadAhead> Open(const char* path);
+	~VideoReadAhead();
+
+	uint64_t GetSize() const { return m_size; }
+
+	// Returns the number of bytes copied from the buffers, the caller must read the remainder from the file.
+	// Reads that don't continue from the buffered data restart the read-ahead past the requested range
+	DWORD Read(uint64_t position, void* buffer, DWORD size);
+
+private:
+	static constexpr DWORD CHUNK_SIZE = 1024 * 1024;
+
+	struct Chunk
+	{
+		enum class State
+		{
+			Empty,
+			Filling,
+			Ready,
+		};
+
+		std::unique_ptr<uint8_t[]> data;
+		uint64_t start = 0;
+		DWORD length = 0;
+		State state = State::Empty;
+	};
+
+	VideoReadAhead(wil::unique_hfile file, uint64_t size);
+
+	void WorkerThread();
+	void Restart(uint64_t position);
+	Chunk* FindChunk(uint64_t position);
+
+	wil::unique_hfile m_file;
+	const uint64_t m_size;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	Chunk m_chunks[2];
+	uint64_t m_nextReadPosition = 0;
+	uint32_t m_generation = 0;
+	bool m_quit = false;
+
+	std::thread m_thread;
+};
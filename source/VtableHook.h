@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+
+// Hooks methods of COM objects, shared by the Direct3D 9 and DirectSound patches
+namespace VtableHook
+{
+	// Replaces a method in the object's vtable. Vtables are shared by all instances of a class,
+	// so hooking the same method twice is a no-op. Checking orgFunc rather than the vtable entry
+	// keeps this true when several subsystems chain hooks on the same method
+	template<typename Func>
+	void Hook(void* object, size_t index, Func*& orgFunc, Func* hook)
+	{
+		if (orgFunc != nullptr)
+		{
+			return;
+		}
+
+		void** vtable = *static_cast<void***>(object);
+
+		DWORD dwProtect;
+		VirtualProtect(&vtable[index], sizeof(void*), PAGE_READWRITE, &dwProtect);
+		orgFunc = reinterpret_cast<Func*>(vtable[index]);
+		vtable[index] = reinterpret_cast<void*>(hook);
+		VirtualProtect(&vtable[index], sizeof(void*), dwProtect, &dwProtect);
+	}
+}
@@ -0,0 +1,351 @@
+#include "XrefIndex.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// Just the parts of the PE format needed to find executable sections, read with memcpy as nothing is aligned
+	constexpr uint32_t PE_SIGNATURE = 0x00004550; // PE\0\0
+	constexpr uint32_t SECTION_EXECUTABLE = 0x20000000 | 0x00000020; // IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_CNT_CODE
+	constexpr size_t SECTION_HEADER_SIZE = 40;
+
+	template<typename T>
+	bool ReadAt(const uint8_t* image, size_t size, size_t offset, T& value)
+	{
+		if (offset > size || sizeof(T) > size - offset)
+		{
+			return false;
+		}
+		std::memcpy(&value, image + offset, sizeof(T));
+		return true;
+	}
+
+	// Length of the 32-bit x86 instruction at code, or 0 if it can't be decoded: invalid and uncommon encodings,
+	// 16-bit addressing or not enough bytes. Covers the one and two byte opcode maps compilers of the era emit
+	size_t InstructionLength(const uint8_t* code, size_t available)
+	{
+		size_t pos = 0;
+		bool operandSize16 = false;
+		auto next = [&](uint8_t& byte) {
+			if (pos >= available) return false;
+			byte = code[pos++];
+			return true;
+		};
+
+		uint8_t opcode;
+		for (;;)
+		{
+			if (!next(opcode)) return 0;
+			if (opcode == 0x66) operandSize16 = true;
+			else if (opcode == 0x67) return 0;
+			else if (opcode != 0x26 && opcode != 0x2E && opcode != 0x36 && opcode != 0x3E && opcode != 0x64 && opcode != 0x65
+				&& opcode != 0xF0 && opcode != 0xF2 && opcode != 0xF3) break;
+		}
+
+		const size_t immZ = operandSize16 ? 2 : 4;
+		bool hasModRM = false;
+		size_t immediate = 0;
+		if (opcode == 0x0F)
+		{
+			if (!next(opcode)) return 0;
+			if (opcode == 0x38)
+			{
+				if (!next(opcode)) return 0;
+				hasModRM = true;
+			}
+			else if (opcode == 0x3A)
+			{
+				if (!next(opcode)) return 0;
+				hasModRM = true;
+				immediate = 1;
+			}
+			else if (opcode >= 0x80 && opcode <= 0x8F) immediate = immZ; // jcc rel32
+			else if (opcode == 0x05 || opcode == 0x06 || opcode == 0x0B || opcode == 0x31 || opcode == 0x77 || opcode == 0xA0
+				|| opcode == 0xA1 || opcode == 0xA2 || opcode == 0xA8 || opcode == 0xA9 || (opcode >= 0xC8 && opcode <= 0xCF))
+			{
+			}
+			else if (opcode == 0x70 || opcode == 0x71 || opcode == 0x72 || opcode == 0x73 || opcode == 0xA4 || opcode == 0xAC
+				|| opcode == 0xBA || opcode == 0xC2 || opcode == 0xC4 || opcode == 0xC5 || opcode == 0xC6)
+			{
+				hasModRM = true;
+				immediate = 1;
+			}
+			else if (opcode <= 0x03 || opcode == 0x0D || (opcode >= 0x10 && opcode <= 0x17) || (opcode >= 0x18 && opcode <= 0x1F)
+				|| (opcode >= 0x20 && opcode <= 0x23) || (opcode >= 0x28 && opcode <= 0x2F) || (opcode >= 0x40 && opcode <= 0x6F)
+				|| (opcode >= 0x74 && opcode <= 0x76) || opcode == 0x7E || opcode == 0x7F || (opcode >= 0x90 && opcode <= 0x9F)
+				|| opcode == 0xA3 || opcode == 0xA5 || opcode == 0xAB || opcode == 0xAD || opcode == 0xAE || opcode == 0xAF
+				|| (opcode >= 0xB0 && opcode <= 0xB7) || (opcode >= 0xBB && opcode <= 0xC1) || opcode == 0xC3 || opcode == 0xC7
+				|| opcode >= 0xD0)
+			{
+				hasModRM = true;
+			}
+			else return 0;
+		}
+		else
+		{
+			const uint8_t low = opcode & 7;
+			if (opcode < 0x40 && low < 4) hasModRM = true; // add, or, adc, sbb, and, sub, xor, cmp with ModRM
+			else if (opcode < 0x40 && low == 4) immediate = 1; // Same with al, imm8
+			else if (opcode < 0x40 && low == 5) immediate = immZ; // Same with eax, imm32
+			else if (opcode < 0x60) { } // Segment pushes and pops, daa and the like, inc, dec, push, pop
+			else if (opcode == 0x60 || opcode == 0x61) { }
+			else if (opcode == 0x62 || opcode == 0x63) hasModRM = true;
+			else if (opcode == 0x68) immediate = immZ;
+			else if (opcode == 0x69) { hasModRM = true; immediate = immZ; }
+			else if (opcode == 0x6A) immediate = 1;
+			else if (opcode == 0x6B) { hasModRM = true; immediate = 1; }
+			else if (opcode >= 0x6C && opcode <= 0x6F) { }
+			else if (opcode >= 0x70 && opcode <= 0x7F) immediate = 1; // jcc rel8
+			else if (opcode == 0x80 || opcode == 0x82 || opcode == 0x83) { hasModRM = true; immediate = 1; }
+			else if (opcode == 0x81) { hasModRM = true; immediate = immZ; }
+			else if (opcode >= 0x84 && opcode <= 0x8F) hasModRM = true;
+			else if (opcode >= 0x90 && opcode <= 0x99) { }
+			else if (opcode == 0x9A) immediate = immZ + 2; // call far ptr16:32
+			else if (opcode >= 0x9B && opcode <= 0x9F) { }
+			else if (opcode >= 0xA0 && opcode <= 0xA3) immediate = 4; // mov with moffs32
+			else if (opcode == 0xA8) immediate = 1;
+			else if (opcode == 0xA9) immediate = immZ;
+			else if (opcode >= 0xA4 && opcode <= 0xAF) { } // String instructions
+			else if (opcode >= 0xB0 && opcode <= 0xB7) immediate = 1;
+			else if (opcode >= 0xB8 && opcode <= 0xBF) immediate = immZ;
+			else if (opcode == 0xC0 || opcode == 0xC1 || opcode == 0xC6) { hasModRM = true; immediate = 1; }
+			else if (opcode == 0xC7) { hasModRM = true; immediate = immZ; }
+			else if (opcode == 0xC2 || opcode == 0xCA) immediate = 2;
+			else if (opcode == 0xC3 || opcode == 0xC9 || opcode == 0xCB || opcode == 0xCC || opcode == 0xCE || opcode == 0xCF) { }
+			else if (opcode == 0xC4 || opcode == 0xC5) hasModRM = true;
+			else if (opcode == 0xC8) immediate = 3;
+			else if (opcode == 0xCD || opcode == 0xD4 || opcode == 0xD5) immediate = 1;
+			else if (opcode >= 0xD0 && opcode <= 0xD3) hasModRM = true;
+			else if (opcode == 0xD6 || opcode == 0xD7) { }
+			else if (opcode >= 0xD8 && opcode <= 0xDF) hasModRM = true; // x87
+			else if (opcode >= 0xE0 && opcode <= 0xE7) immediate = 1; // loop, jecxz, in, out
+			else if (opcode == 0xE8 || opcode == 0xE9) immediate = immZ;
+			else if (opcode == 0xEA) immediate = immZ + 2;
+			else if (opcode == 0xEB) immediate = 1;
+			else if (opcode >= 0xEC && opcode <= 0xEF) { }
+			else if (opcode == 0xF1 || opcode == 0xF4 || opcode == 0xF5 || (opcode >= 0xF8 && opcode <= 0xFD)) { }
+			else if (opcode == 0xF6 || opcode == 0xF7)
+			{
+				// Only test takes an immediate
+				hasModRM = true;
+				if (pos < available && ((code[pos] >> 3) & 7) < 2) immediate = opcode == 0xF6 ? 1 : immZ;
+			}
+			else if (opcode == 0xFE || opcode == 0xFF) hasModRM = true;
+			else return 0;
+		}
+
+		if (hasModRM)
+		{
+			uint8_t modRM;
+			if (!next(modRM)) return 0;
+			const uint8_t mod = modRM >> 6;
+			const uint8_t rm = modRM & 7;
+			if (mod != 3)
+			{
+				if (rm == 4)
+				{
+					uint8_t sib;
+					if (!next(sib)) return 0;
+					if (mod == 0 && (sib & 7) == 5) pos += 4;
+				}
+				else if (mod == 0 && rm == 5)
+				{
+					pos += 4;
+				}
+				pos += mod == 1 ? 1 : (mod == 2 ? 4 : 0);
+			}
+		}
+		pos += immediate;
+		return pos <= available ? pos : 0;
+	}
+}
+
+bool XrefIndex::Build(const uint8_t* image, size_t size)
+{
+	if (size > SOURCE_MASK)
+	{
+		return false;
+	}
+
+	uint32_t peOffset, signature;
+	uint16_t numSections, optionalHeaderSize;
+	if (!ReadAt(image, size, 0x3C, peOffset) || !ReadAt(image, size, peOffset, signature) || signature != PE_SIGNATURE
+		|| !ReadAt(image, size, peOffset + 6, numSections) || !ReadAt(image, size, peOffset + 20, optionalHeaderSize))
+	{
+		return false;
+	}
+
+	std::vector<CodeRange> ranges;
+	const size_t sectionTable = static_cast<size_t>(peOffset) + 24 + optionalHeaderSize;
+	for (uint16_t i = 0; i < numSections; i++)
+	{
+		const size_t header = sectionTable + i * SECTION_HEADER_SIZE;
+		uint32_t virtualSize, virtualAddress, characteristics;
+		if (!ReadAt(image, size, header + 8, virtualSize) || !ReadAt(image, size, header + 12, virtualAddress)
+			|| !ReadAt(image, size, header + 36, characteristics))
+		{
+			return false;
+		}
+		if ((characteristics & SECTION_EXECUTABLE) != 0 && virtualAddress < size)
+		{
+			ranges.push_back({ virtualAddress, std::min<size_t>(static_cast<size_t>(virtualAddress) + virtualSize, size) });
+		}
+	}
+
+	m_image = image;
+	m_size = size;
+	Index(ranges);
+	return true;
+}
+
+void XrefIndex::BuildRange(const uint8_t* image, size_t size, size_t codeBegin, size_t codeEnd)
+{
+	m_image = image;
+	m_size = std::min<size_t>(size, SOURCE_MASK);
+	Index({ { codeBegin, std::min(codeEnd, m_size) } });
+}
+
+void XrefIndex::Index(const std::vector<CodeRange>& ranges)
+{
+	m_entries.clear();
+
+	auto isCode = [&ranges](int64_t offset) {
+		for (const CodeRange& range : ranges)
+		{
+			if (offset >= static_cast<int64_t>(range.begin) && offset < static_cast<int64_t>(range.end))
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	for (const CodeRange& range : ranges)
+	{
+		for (size_t offset = range.begin; offset + 5 <= range.end; offset++)
+		{
+			const uint8_t opcode = m_image[offset];
+			size_t length;
+			Kind kind;
+			if (opcode == 0xE8 || opcode == 0xE9)
+			{
+				length = 5;
+				kind = opcode == 0xE8 ? Kind::Call : Kind::Jump;
+			}
+			else if (opcode == 0x0F && (m_image[offset + 1] & 0xF0) == 0x80 && offset + 6 <= range.end)
+			{
+				length = 6;
+				kind = Kind::ConditionalJump;
+			}
+			else
+			{
+				continue;
+			}
+
+			int32_t rel;
+			std::memcpy(&rel, m_image + offset + length - 4, sizeof(rel));
+			const int64_t target = static_cast<int64_t>(offset + length) + rel;
+			if (isCode(target))
+			{
+				m_entries.push_back((static_cast<uint64_t>(target) << 32) | (static_cast<uint64_t>(kind) << KIND_SHIFT) | offset);
+			}
+		}
+	}
+
+	std::sort(m_entries.begin(), m_entries.end(), [](Entry left, Entry right) {
+		return (left & ~static_cast<uint64_t>(~SOURCE_MASK)) < (right & ~static_cast<uint64_t>(~SOURCE_MASK));
+	});
+}
+
+std::pair<const XrefIndex::Entry*, const XrefIndex::Entry*> XrefIndex::Find(const void* target) const
+{
+	const uint8_t* pointer = static_cast<const uint8_t*>(target);
+	if (m_image == nullptr || pointer < m_image || pointer >= m_image + m_size)
+	{
+		return {};
+	}
+
+	const uint64_t offset = static_cast<uint64_t>(pointer - m_image);
+	const auto range = std::equal_range(m_entries.begin(), m_entries.end(), offset << 32, [](Entry left, Entry right) {
+		return (left >> 32) < (right >> 32);
+	});
+	return { m_entries.data() + (range.first - m_entries.begin()), m_entries.data() + (range.second - m_entries.begin()) };
+}
+
+std::vector<XrefIndex::Xref> XrefIndex::Xrefs(const void* target) const
+{
+	std::vector<Xref> result;
+	const auto [begin, end] = Find(target);
+	for (const Entry* entry = begin; entry != end; ++entry)
+	{
+		result.push_back({ m_image + (*entry & SOURCE_MASK), static_cast<Kind>((*entry >> KIND_SHIFT) & 3) });
+	}
+	return result;
+}
+
+std::vector<const uint8_t*> XrefIndex::Callers(const void* target) const
+{
+	std::vector<const uint8_t*> result;
+	const auto [begin, end] = Find(target);
+	for (const Entry* entry = begin; entry != end; ++entry)
+	{
+		if (static_cast<Kind>((*entry >> KIND_SHIFT) & 3) == Kind::Call)
+		{
+			result.push_back(m_image + (*entry & SOURCE_MASK));
+		}
+	}
+	return result;
+}
+
+bool XrefIndex::IsInstructionStart(const void* address) const
+{
+	const uint8_t* pointer = static_cast<const uint8_t*>(address);
+	if (m_image == nullptr || pointer < m_image || pointer >= m_image + m_size)
+	{
+		return false;
+	}
+
+	// Walk back over the targets preceding the address, and decode from the closest ones that look like function entries
+	const uint64_t offset = static_cast<uint64_t>(pointer - m_image);
+	auto it = std::upper_bound(m_entries.begin(), m_entries.end(), offset << 32 | UINT32_MAX, [](Entry left, Entry right) {
+		return (left >> 32) < (right >> 32);
+	});
+	size_t attempts = 0;
+	while (it != m_entries.begin() && attempts < MAX_DECODE_ATTEMPTS)
+	{
+		const uint64_t target = *(it - 1) >> 32;
+		if (offset - target > MAX_DECODE_DISTANCE)
+		{
+			break;
+		}
+
+		size_t calls = 0;
+		while (it != m_entries.begin() && (*(it - 1) >> 32) == target)
+		{
+			--it;
+			if (static_cast<Kind>((*it >> KIND_SHIFT) & 3) == Kind::Call) calls++;
+		}
+		if (calls < 2)
+		{
+			continue;
+		}
+
+		attempts++;
+		size_t position = static_cast<size_t>(target);
+		while (position < offset)
+		{
+			const size_t length = InstructionLength(m_image + position, m_size - position);
+			if (length == 0)
+			{
+				break;
+			}
+			position += length;
+		}
+		if (position == offset)
+		{
+			return true;
+		}
+	}
+	return false;
+}
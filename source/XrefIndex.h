@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index of the relative calls and jumps in a module's code, from branch targets to the instructions branching there.
+// Built in one pass over the executable sections, after which all callers of a function are found with a binary search
+// instead of a scan of the whole image. Code is not disassembled: every E8, E9 and 0F 8x byte is taken as a potential
+// branch, and kept only if it lands in executable code. Bytes in the middle of other instructions rarely
+// land exactly on a function entry, but lookups of other addresses should be treated as a superset.
+// Portable, so it can be tested on PE images outside of Windows
+class XrefIndex
+{
+public:
+	enum class Kind : uint8_t
+	{
+		Call, // E8 rel32
+		Jump, // E9 rel32
+		ConditionalJump, // 0F 80..8F rel32
+	};
+
+	struct Xref
+	{
+		const uint8_t* source; // The branch instruction
+		Kind kind;
+	};
+
+	XrefIndex() = default;
+
+	// image is a 32-bit PE module laid out in memory the way the loader maps it, size bytes long.
+	// Returns false if it doesn't look like one
+	bool Build(const uint8_t* image, size_t size);
+
+	// Indexes a single code range of an image
+	void BuildRange(const uint8_t* image, size_t size, size_t codeBegin, size_t codeEnd);
+
+	size_t Size() const { return m_entries.size(); }
+
+	// All branches to target, sorted by address
+	std::vector<Xref> Xrefs(const void* target) const;
+
+	// Only the calls to target, sorted by address
+	std::vector<const uint8_t*> Callers(const void* target) const;
+
+	// Whether decoding code forward from one of the closest function entries before address lands on it, to weed out
+	// branches found in the middle of other instructions. Function entries are call targets with at least two callers,
+	// as those are hardly ever found by accident. False when in doubt, e.g. when there is no such entry nearby
+	// or decoding runs into an instruction it doesn't know
+	bool IsInstructionStart(const void* address) const;
+
+private:
+	// Target offset in the upper half and source offset in the lower, so sorting orders by target, then by source.
+	// Kind takes the top two bits of the source, as offsets in 32-bit images fit in 30 bits
+	using Entry = uint64_t;
+	static constexpr unsigned int KIND_SHIFT = 30;
+	static constexpr uint32_t SOURCE_MASK = (1u << KIND_SHIFT) - 1;
+
+	static constexpr uint64_t MAX_DECODE_DISTANCE = 64 * 1024;
+	static constexpr size_t MAX_DECODE_ATTEMPTS = 4;
+
+	struct CodeRange
+	{
+		size_t begin, end;
+	};
+
+	void Index(const std::vector<CodeRange>& ranges);
+	std::pair<const Entry*, const Entry*> Find(const void* target) const;
+
+	const uint8_t* m_image = nullptr;
+	size_t m_size = 0;
+	std::vector<Entry> m_entries;
+};
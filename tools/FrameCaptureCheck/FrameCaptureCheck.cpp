@@ -0,0 +1,237 @@
+// Checks frame time capture: races configured in settings.ini are parsed like the Race.* options, percentiles follow
+// the nearest-rank method, and the playlist captures each race for the configured duration after a warmup, driven
+// by simulated Present timestamps. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/FrameCaptureCheck/FrameCaptureCheck.cpp source/CapturePlaylist.cpp source/FrameStats.cpp -o FrameCaptureCheck
+//
+// Usage: FrameCaptureCheck
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CapturePlaylist.h"
+#include "FrameStats.h"
+
+namespace
+{
+	class Failure : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	std::string Format(const char* format, ...)
+	{
+		char buf[512];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buf, sizeof(buf), format, args);
+		va_end(args);
+		return buf;
+	}
+
+	void Expect(bool condition, const std::string& message)
+	{
+		if (!condition)
+		{
+			throw Failure(message);
+		}
+	}
+
+	void ExpectNear(double value, double expected, const char* what)
+	{
+		Expect(std::fabs(value - expected) < 1e-9, Format("%s is %.6f, expected %.6f", what, value, expected));
+	}
+
+	std::string Describe(const std::optional<uint32_t>& value)
+	{
+		return value ? std::to_string(*value) : "none";
+	}
+
+	void CheckParseRace()
+	{
+		struct Case
+		{
+			const char* text;
+			bool valid;
+			const char* gameMode;
+			const char* route;
+			const char* timeOfDay;
+			const char* weather;
+			std::optional<uint32_t> numCars;
+			std::optional<uint32_t> numLaps;
+		};
+		const Case cases[] = {
+			{ "race,Downtown_r1,night,wet,6,3", true, "race", "Downtown_r1", "night", "wet", 6, 3 },
+			{ " sprint , Harbour_r2 ,day, dry ", true, "sprint", "Harbour_r2", "day", "dry", std::nullopt, std::nullopt },
+			{ ",,,,,2", true, "", "", "", "", std::nullopt, 2 },
+			{ "race", true, "race", "", "", "", std::nullopt, std::nullopt },
+			{ "race,,,,8", true, "race", "", "", "", 8, std::nullopt },
+			{ "", false, "", "", "", "", std::nullopt, std::nullopt },
+			{ "   ", false, "", "", "", "", std::nullopt, std::nullopt },
+			{ "race,Downtown_r1,night,wet,6,3,extra", false, "", "", "", "", std::nullopt, std::nullopt },
+			{ "race,Downtown_r1,night,wet,six,3", false, "", "", "", "", std::nullopt, std::nullopt },
+			{ "race,Downtown_r1,night,wet,6,3laps", false, "", "", "", "", std::nullopt, std::nullopt },
+		};
+
+		for (const Case& c : cases)
+		{
+			const auto race = CapturePlaylist::ParseRace(c.text);
+			Expect(race.has_value() == c.valid, Format("\"%s\" was %s", c.text, race ? "accepted" : "rejected"));
+			if (!race)
+			{
+				continue;
+			}
+
+			Expect(race->gameMode == c.gameMode && race->route == c.route && race->timeOfDay == c.timeOfDay && race->weather == c.weather
+				&& race->numCars == c.numCars && race->numLaps == c.numLaps,
+				Format("\"%s\" parsed as \"%s\",\"%s\",\"%s\",\"%s\",%s,%s", c.text, race->gameMode.c_str(), race->route.c_str(),
+					race->timeOfDay.c_str(), race->weather.c_str(), Describe(race->numCars).c_str(), Describe(race->numLaps).c_str()));
+		}
+
+		const auto race = CapturePlaylist::ParseRace("  race,Downtown_r1  ");
+		Expect(race && race->description == "race,Downtown_r1", "Description is not the trimmed text");
+	}
+
+	void CheckPercentiles()
+	{
+		FrameStats stats;
+		ExpectNear(stats.Summarize(&FrameStats::Frame::frameMs).p99, 0.0, "p99 of no frames");
+
+		// 1..1000 ms added out of order, so the nearest rank of p is p * 10
+		for (size_t i = 0; i < 1000; i++)
+		{
+			const double value = static_cast<double>((i * 617) % 1000 + 1);
+			stats.AddFrame({ value, value / 2.0, 1.0 });
+		}
+		FrameStats::Summary summary = stats.Summarize(&FrameStats::Frame::frameMs);
+		ExpectNear(summary.average, 500.5, "Average");
+		ExpectNear(summary.p50, 500.0, "p50");
+		ExpectNear(summary.p90, 900.0, "p90");
+		ExpectNear(summary.p99, 990.0, "p99");
+		ExpectNear(summary.p999, 999.0, "p99.9");
+		ExpectNear(summary.max, 1000.0, "Max");
+		ExpectNear(stats.Summarize(&FrameStats::Frame::cpuMs).p50, 250.0, "CPU p50");
+
+		// Ranks round up, so with 10 frames p99 and p99.9 are the largest value and p50 the 5th
+		stats.Clear();
+		for (size_t i = 1; i <= 10; i++)
+		{
+			stats.AddFrame({ static_cast<double>(i), 0.0, 0.0 });
+		}
+		summary = stats.Summarize(&FrameStats::Frame::frameMs);
+		ExpectNear(summary.p50, 5.0, "p50 of 10 frames");
+		ExpectNear(summary.p90, 9.0, "p90 of 10 frames");
+		ExpectNear(summary.p99, 10.0, "p99 of 10 frames");
+		ExpectNear(summary.p999, 10.0, "p99.9 of 10 frames");
+
+		stats.Clear();
+		stats.AddFrame({ 7.0, 0.0, 0.0 });
+		summary = stats.Summarize(&FrameStats::Frame::frameMs);
+		ExpectNear(summary.p50, 7.0, "p50 of a single frame");
+		ExpectNear(summary.p999, 7.0, "p99.9 of a single frame");
+	}
+
+	// Presents every 10 ms, each taking 2 ms, from nowMs until the playlist returns a result or untilMs passes
+	const CapturePlaylist::Result* RunFrames(CapturePlaylist& playlist, double& nowMs, double untilMs)
+	{
+		for (; nowMs < untilMs; nowMs += 10.0)
+		{
+			if (const CapturePlaylist::Result* result = playlist.OnFrame(nowMs, nowMs + 2.0); result != nullptr)
+			{
+				nowMs += 10.0;
+				return result;
+			}
+		}
+		return nullptr;
+	}
+
+	void CheckPlaylist()
+	{
+		std::vector<CapturePlaylist::Race> races(2);
+		races[0].description = "first";
+		races[1].description = "second";
+		CapturePlaylist playlist(std::move(races), 1000.0, 5000.0);
+
+		// Nothing is captured until the game sets up a race
+		double nowMs = 0.0;
+		Expect(RunFrames(playlist, nowMs, 10000.0) == nullptr, "Captured before the race was set up");
+		Expect(playlist.GetCurrentRace() != nullptr && playlist.GetCurrentRace()->description == "first", "First race is not current");
+
+		// An attempt abandoned halfway is restarted from scratch by the next setup
+		playlist.BeginRace();
+		Expect(RunFrames(playlist, nowMs, nowMs + 3000.0) == nullptr, "Race finished before its duration");
+		playlist.BeginRace();
+
+		const double beginMs = nowMs;
+		const CapturePlaylist::Result* result = RunFrames(playlist, nowMs, nowMs + 20000.0);
+		Expect(result != nullptr, "First race never finished");
+		Expect(result->race.description == "first", Format("Finished race is %s", result->race.description.c_str()));
+
+		// The first frame starts the warmup, the first frame past it starts the capture, which stops once its duration passes
+		const double elapsedMs = nowMs - beginMs;
+		Expect(elapsedMs >= 6000.0 && elapsedMs <= 6030.0, Format("Warmup and capture took %.0f ms", elapsedMs));
+		Expect(result->stats.GetFrameCount() == 500, Format("Captured %zu frames, expected 500", result->stats.GetFrameCount()));
+
+		const FrameStats::Frame& frame = result->stats.GetFrames().front();
+		ExpectNear(frame.frameMs, 10.0, "Frame time");
+		ExpectNear(frame.cpuMs, 8.0, "CPU time");
+		ExpectNear(frame.presentMs, 2.0, "Present time");
+
+		Expect(playlist.GetCurrentRace() != nullptr && playlist.GetCurrentRace()->description == "second", "Second race is not current");
+		Expect(RunFrames(playlist, nowMs, nowMs + 10000.0) == nullptr, "Second race captured before it was set up");
+
+		playlist.BeginRace();
+		result = RunFrames(playlist, nowMs, nowMs + 20000.0);
+		Expect(result != nullptr && result->race.description == "second", "Second race never finished");
+
+		Expect(playlist.GetCurrentRace() == nullptr, "Playlist did not end");
+		Expect(playlist.GetResults().size() == 2, Format("%zu results, expected 2", playlist.GetResults().size()));
+
+		// Setting up races past the end of the playlist does nothing
+		playlist.BeginRace();
+		Expect(RunFrames(playlist, nowMs, nowMs + 20000.0) == nullptr, "Captured past the end of the playlist");
+	}
+
+	struct NamedCheck
+	{
+		const char* name;
+		void (*check)();
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+	{
+		fprintf(stderr, "Usage: %s\n", argv[0]);
+		return 2;
+	}
+
+	const NamedCheck checks[] = {
+		{ "ParseRace", CheckParseRace },
+		{ "Percentiles", CheckPercentiles },
+		{ "Playlist", CheckPlaylist },
+	};
+
+	int failures = 0;
+	for (const NamedCheck& check : checks)
+	{
+		try
+		{
+			check.check();
+			printf("%-16s OK\n", check.name);
+		}
+		catch (const std::exception& e)
+		{
+			printf("%-16s FAILED: %s\n", check.name, e.what());
+			failures++;
+		}
+	}
+
+	return failures != 0 ? 1 : 0;
+}
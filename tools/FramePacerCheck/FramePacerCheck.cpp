@@ -0,0 +1,263 @@
+// Checks FramePacer against a simulated clock: frames sleep and then spin up to their deadline, the spin margin follows
+// how much sleeps overshoot, late frames start a new schedule instead of rushing the next ones, and the reported jitter
+// matches the simulated frame times. Spinning advances the clock in quarter milliseconds and frame targets are whole
+// milliseconds, so frames that make their deadline land on it exactly. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/FramePacerCheck/FramePacerCheck.cpp source/FramePacer.cpp -o FramePacerCheck
+//
+// Usage: FramePacerCheck
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "FramePacer.h"
+
+namespace
+{
+	constexpr double TARGET_FRAME_MS = 16.0;
+	constexpr double SPIN_STEP_MS = 0.25;
+
+	class Failure : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	std::string Format(const char* format, ...)
+	{
+		char buf[512];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buf, sizeof(buf), format, args);
+		va_end(args);
+		return buf;
+	}
+
+	void Expect(bool condition, const std::string& message)
+	{
+		if (!condition)
+		{
+			throw Failure(message);
+		}
+	}
+
+	class FakeClock final : public FramePacer::Clock
+	{
+	public:
+		double NowMs() override
+		{
+			return m_nowMs;
+		}
+
+		void SleepMs(double ms) override
+		{
+			m_sleeps++;
+			m_nowMs += ms + m_oversleepMs;
+			m_wakeMs = m_nowMs;
+		}
+
+		void Spin() override
+		{
+			m_spins++;
+			m_nowMs = (std::floor(m_nowMs / SPIN_STEP_MS) + 1.0) * SPIN_STEP_MS;
+		}
+
+		// Time the game spends on a frame outside of the pacer
+		void Work(double ms)
+		{
+			m_nowMs += ms;
+		}
+
+		void SetOversleep(double ms)
+		{
+			m_oversleepMs = ms;
+		}
+
+		void ResetCounts()
+		{
+			m_sleeps = 0;
+			m_spins = 0;
+		}
+
+		size_t GetSleeps() const { return m_sleeps; }
+		size_t GetSpins() const { return m_spins; }
+		double GetWakeMs() const { return m_wakeMs; }
+
+	private:
+		double m_nowMs = 0.0;
+		double m_oversleepMs = 0.0;
+		double m_wakeMs = 0.0;
+		size_t m_sleeps = 0;
+		size_t m_spins = 0;
+	};
+
+	void CheckDeadlines()
+	{
+		FakeClock clock;
+		FramePacer pacer(clock, TARGET_FRAME_MS);
+		pacer.Wait();
+
+		for (size_t frame = 1; frame <= 100; frame++)
+		{
+			const double workMs = static_cast<double>(frame % 12);
+			clock.Work(workMs);
+			clock.ResetCounts();
+			pacer.Wait();
+
+			const double deadlineMs = frame * TARGET_FRAME_MS;
+			Expect(clock.NowMs() == deadlineMs, Format("Frame %zu presented at %.3f ms, deadline %.3f ms", frame, clock.NowMs(), deadlineMs));
+			Expect(clock.GetSleeps() == 1, Format("Frame %zu with %.0f ms of work slept %zu times", frame, workMs, clock.GetSleeps()));
+
+			// Only the margin is left to spin, which never exceeds 4 ms
+			Expect(clock.GetSpins() >= 1 && clock.GetSpins() <= 4.0 / SPIN_STEP_MS,
+				Format("Frame %zu spun %zu times", frame, clock.GetSpins()));
+		}
+
+		// Too little time left to sleep reliably, so the frame only spins
+		clock.Work(TARGET_FRAME_MS - 0.75);
+		clock.ResetCounts();
+		pacer.Wait();
+		Expect(clock.GetSleeps() == 0 && clock.NowMs() == 101 * TARGET_FRAME_MS, "Frame without time to sleep missed its deadline or slept");
+	}
+
+	void CheckSpinMargin()
+	{
+		FakeClock clock;
+		FramePacer pacer(clock, TARGET_FRAME_MS);
+		pacer.Wait();
+
+		// Sleeps overshooting by 3 ms make the first frame late by 1 ms past the initial 2 ms margin
+		clock.SetOversleep(3.0);
+		clock.Work(5.0);
+		pacer.Wait();
+		Expect(clock.NowMs() == TARGET_FRAME_MS + 1.0, Format("First oversleeping frame presented at %.3f ms", clock.NowMs()));
+
+		// The margin then grows to cover the overshoot, and frames make their deadline again
+		for (size_t frame = 2; frame <= 50; frame++)
+		{
+			clock.Work(5.0);
+			pacer.Wait();
+			Expect(clock.NowMs() == frame * TARGET_FRAME_MS, Format("Frame %zu presented at %.3f ms while oversleeping", frame, clock.NowMs()));
+		}
+
+		// Once sleeps are accurate, the margin shrinks back to its minimum of 0.5 ms over a few hundred frames
+		clock.SetOversleep(0.0);
+		double spinMs = 0.0;
+		for (size_t frame = 51; frame <= 500; frame++)
+		{
+			clock.Work(5.0);
+			pacer.Wait();
+			Expect(clock.NowMs() == frame * TARGET_FRAME_MS, Format("Frame %zu presented at %.3f ms after oversleeping", frame, clock.NowMs()));
+
+			const double lastSpinMs = spinMs;
+			spinMs = clock.NowMs() - clock.GetWakeMs();
+			Expect(frame == 51 || spinMs <= lastSpinMs, Format("Frame %zu spun for %.3f ms, up from %.3f ms", frame, spinMs, lastSpinMs));
+		}
+		Expect(std::fabs(spinMs - 0.5) < 1e-9, Format("Spin margin settled at %.3f ms", spinMs));
+	}
+
+	void CheckLateFrames()
+	{
+		FakeClock clock;
+		FramePacer pacer(clock, TARGET_FRAME_MS);
+		pacer.Wait();
+
+		clock.Work(5.0);
+		pacer.Wait();
+		Expect(clock.NowMs() == 16.0, "Frame before the late one missed its deadline");
+
+		// Late by 8 ms, the next frame still gets its full frame time instead of being due 8 ms later
+		clock.Work(24.0);
+		pacer.Wait();
+		Expect(clock.NowMs() == 40.0, Format("Late frame presented at %.3f ms", clock.NowMs()));
+
+		clock.Work(5.0);
+		pacer.Wait();
+		Expect(clock.NowMs() == 56.0, Format("Frame after a late one presented at %.3f ms, expected 56 ms", clock.NowMs()));
+
+		// Late by several frames, the schedule restarts without presenting the skipped frames back to back
+		clock.Work(70.0);
+		pacer.Wait();
+		clock.Work(1.0);
+		pacer.Wait();
+		Expect(clock.NowMs() == 126.0 + TARGET_FRAME_MS, Format("Frame after a very late one presented at %.3f ms", clock.NowMs()));
+
+		Expect(pacer.GetJitter().missedFrames == 2, Format("%zu missed frames, expected 2", pacer.GetJitter().missedFrames));
+	}
+
+	void CheckJitter()
+	{
+		FakeClock clock;
+		FramePacer pacer(clock, TARGET_FRAME_MS);
+
+		const FramePacer::Jitter none = pacer.GetJitter();
+		Expect(none.frames == 0 && none.averageMs == 0.0 && none.maxMs == 0.0 && none.missedFrames == 0, "Jitter reported before any frames");
+
+		// The first call only starts the schedule, and isn't a frame yet
+		pacer.Wait();
+		Expect(pacer.GetJitter().frames == 0, "First call counted as a frame");
+
+		// 10 frames on time, one taking 24 ms and another 30 ms, and 10 more on time
+		for (size_t i = 0; i < 10; i++)
+		{
+			clock.Work(5.0);
+			pacer.Wait();
+		}
+		clock.Work(24.0);
+		pacer.Wait();
+		clock.Work(30.0);
+		pacer.Wait();
+		for (size_t i = 0; i < 10; i++)
+		{
+			clock.Work(5.0);
+			pacer.Wait();
+		}
+
+		const FramePacer::Jitter jitter = pacer.GetJitter();
+		Expect(jitter.frames == 22, Format("%zu frames, expected 22", jitter.frames));
+		Expect(jitter.missedFrames == 2, Format("%zu missed frames, expected 2", jitter.missedFrames));
+		Expect(jitter.maxMs == 14.0, Format("Max jitter %.3f ms, expected 14 ms", jitter.maxMs));
+		Expect(std::fabs(jitter.averageMs - 22.0 / 22) < 1e-9, Format("Average jitter %.3f ms, expected 1 ms", jitter.averageMs));
+	}
+
+	struct NamedCheck
+	{
+		const char* name;
+		void (*check)();
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+	{
+		fprintf(stderr, "Usage: %s\n", argv[0]);
+		return 2;
+	}
+
+	const NamedCheck checks[] = {
+		{ "Deadlines", CheckDeadlines },
+		{ "Spin margin", CheckSpinMargin },
+		{ "Late frames", CheckLateFrames },
+		{ "Jitter", CheckJitter },
+	};
+
+	int failures = 0;
+	for (const NamedCheck& check : checks)
+	{
+		try
+		{
+			check.check();
+			printf("%-16s OK\n", check.name);
+		}
+		catch (const std::exception& e)
+		{
+			printf("%-16s FAILED: %s\n", check.name, e.what());
+			failures++;
+		}
+	}
+
+	return failures != 0 ? 1 : 0;
+}
@@ -0,0 +1,260 @@
+// Checks LogQueue formatting against snprintf, then stress tests its rings with several producer threads logging
+// and one consumer draining them, like the log writer thread does. Every message carries its thread and a counter,
+// so lost, repeated, reordered or torn records are all caught, and dropped ones must add up. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -pthread -Isource tools/LogQueueStress/LogQueueStress.cpp source/LogQueue.cpp -o LogQueueStress
+//
+// Usage: LogQueueStress [--threads <n>] [--messages <n>] [--slots <n>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LogQueue.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	template<typename... Args>
+	bool CheckFormat(const char* expected, const char* format, const Args&... args)
+	{
+		LogQueue::Record record;
+		LogQueue::Capture(record, format, args...);
+		const std::string result = LogQueue::Format(record);
+		if (result != expected)
+		{
+			printf("FAILED: \"%s\" formatted as \"%s\", expected \"%s\"\n", format, result.c_str(), expected);
+			return false;
+		}
+
+		// Into a buffer, every size cuts the text like snprintf would
+		const size_t length = strlen(expected);
+		for (size_t size = 0; size <= length + 1; size++)
+		{
+			char buf[512];
+			memset(buf, '#', sizeof(buf));
+			const size_t written = LogQueue::Format(record, buf, size);
+			if (written != length || (size != 0 && (strncmp(buf, expected, size - 1) != 0 || buf[std::min(size - 1, length)] != '\0'))
+				|| buf[size] != '#')
+			{
+				printf("FAILED: \"%s\" into %zu bytes returned %zu, expected \"%.*s\"\n", format, size, written, static_cast<int>(size), expected);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template<typename... Args>
+	std::string Snprintf(const char* format, const Args&... args)
+	{
+		char buf[512];
+		snprintf(buf, sizeof(buf), format, args...);
+		return buf;
+	}
+
+	bool CheckFormats()
+	{
+		bool success = true;
+		const uint64_t big = 18446744073709551615ull;
+		const std::string longString(300, 'x');
+
+		// The formats the patches log with
+		success &= CheckFormat(Snprintf("D3D9StateFilter: %s filtered %" PRIu64 " of %" PRIu64 " calls (%.1f%%)", "SetTexture", uint64_t(12), big, 33.333).c_str(),
+			"D3D9StateFilter: %s filtered %llu of %llu calls (%.1f%%)", "SetTexture", uint64_t(12), big, 33.333);
+		success &= CheckFormat("Prefetch: Race 00A1B2 opened 42 files, I/O took 7.5 ms", "Prefetch: Race %06X opened %zu files, I/O took %.1f ms", 0xA1B2u, size_t(42), 7.45);
+		success &= CheckFormat("FileCache: 4294967295 hits", "FileCache: %u hits", UINT32_MAX);
+		success &= CheckFormat("Large address aware: no", "Large address aware: %s", false ? "yes" : "no");
+		success &= CheckFormat("D3D9Hooks: Direct3DCreate9 not imported", "D3D9Hooks: Direct3DCreate9 not imported");
+
+		// Width, precision, flags, signedness and length modifiers that don't match the argument
+		success &= CheckFormat("[-5|    -5|-0005|ff|0XFF|  +3.14|x  ]", "[%d|%6i|%05d|%x|%#X|%+7.2f|%-3c]", -5, -5, -5, 255, 255, 3.14159, 'x');
+		success &= CheckFormat("-9223372036854775807 18446744073709551615", "%lld %I64u", -INT64_MAX, big);
+		success &= CheckFormat("short 65535, char 200", "short %hu, char %hhu", uint16_t(65535), uint8_t(200));
+		success &= CheckFormat("2.5 -> 2, 7 -> 7.000", "%.1f -> %d, %d -> %.3f", 2.5, 2.5, 7, 7);
+		success &= CheckFormat("100% done", "%d%% done", 100);
+		success &= CheckFormat(Snprintf("%p", reinterpret_cast<void*>(0x1234)).c_str(), "%p", reinterpret_cast<void*>(0x1234));
+
+		// Strings are copied and cut to what fits
+		char temporary[] = "temporary";
+		LogQueue::Record record;
+		LogQueue::Capture(record, "%s %s", temporary, longString.c_str());
+		strcpy(temporary, "changed!!");
+		const std::string result = LogQueue::Format(record);
+		const std::string expected = "temporary " + longString.substr(0, LogQueue::TEXT_SIZE - sizeof("temporary") - 1);
+		if (result != expected)
+		{
+			printf("FAILED: strings were not copied or truncated correctly, got \"%s\"\n", result.c_str());
+			success = false;
+		}
+		success &= CheckFormat("(null) <missing> %*d", "%s %d %*d", static_cast<const char*>(nullptr));
+		return success;
+	}
+
+	struct Producer
+	{
+		std::unique_ptr<LogQueue::Ring> ring;
+		uint64_t written = 0;
+		uint64_t retries = 0;
+		double seconds = 0.0;
+	};
+
+	// Flat out, producers drop what doesn't fit like the log does. Retrying, they wait for the consumer instead,
+	// so every message must arrive
+	bool Run(size_t numThreads, uint32_t numMessages, size_t numSlots, bool retry)
+	{
+		std::vector<Producer> producers(numThreads);
+		for (Producer& producer : producers)
+		{
+			producer.ring = std::make_unique<LogQueue::Ring>(numSlots);
+		}
+
+		std::atomic<uint32_t> nextSequence { 0 };
+		std::atomic<size_t> producersDone { 0 };
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < numThreads; t++)
+		{
+			threads.emplace_back([&, t] {
+				Producer& producer = producers[t];
+				const std::string name = "thread" + std::to_string(t);
+				const auto start = Clock::now();
+				for (uint32_t i = 0; i < numMessages; i++)
+				{
+					LogQueue::Record* record = producer.ring->BeginWrite();
+					while (record == nullptr && retry)
+					{
+						producer.retries++;
+						std::this_thread::yield();
+						record = producer.ring->BeginWrite();
+					}
+					if (record != nullptr)
+					{
+						record->sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+						LogQueue::Capture(*record, "%s: message %u of %u, %.2f", name.c_str(), i, numMessages, i * 0.25);
+						producer.ring->EndWrite();
+						producer.written++;
+					}
+				}
+				producer.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+				producersDone.fetch_add(1, std::memory_order_release);
+			});
+		}
+
+		// The consumer, formatting everything like the writer thread, and freeing the slots only once a whole batch is done
+		uint64_t received = 0, dropped = 0, errors = 0;
+		std::vector<int64_t> lastCounter(numThreads, -1);
+		auto drain = [&] {
+			for (size_t t = 0; t < numThreads; t++)
+			{
+				LogQueue::Ring& ring = *producers[t].ring;
+				size_t taken = 0;
+				while (const LogQueue::Record* record = ring.Peek(taken))
+				{
+					unsigned thread, counter, total;
+					double value;
+					char buf[256];
+					LogQueue::Format(*record, buf, sizeof(buf));
+					const std::string text = buf;
+					const bool parsed = sscanf(text.c_str(), "thread%u: message %u of %u, %lf", &thread, &counter, &total, &value) == 4;
+					// Counters only grow, and without drops each one follows the previous
+					if (!parsed || thread != t || static_cast<int64_t>(counter) <= lastCounter[t] || (retry && counter != lastCounter[t] + 1)
+						|| total != numMessages || text != Snprintf("thread%u: message %u of %u, %.2f", thread, counter, total, counter * 0.25))
+					{
+						if (errors++ < 10)
+						{
+							printf("FAILED: unexpected message \"%s\" from thread %zu\n", text.c_str(), t);
+						}
+					}
+					if (parsed)
+					{
+						lastCounter[t] = counter;
+					}
+					received++;
+					taken++;
+				}
+				ring.EndRead(taken);
+				dropped += ring.TakeDropped();
+			}
+		};
+		while (producersDone.load(std::memory_order_acquire) != numThreads)
+		{
+			drain();
+		}
+		drain();
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		uint64_t written = 0, retries = 0;
+		double producerSeconds = 0.0;
+		for (const Producer& producer : producers)
+		{
+			written += producer.written;
+			retries += producer.retries;
+			producerSeconds += producer.seconds;
+		}
+
+		// Every time the ring was full counts as a drop, including the ones retried
+		bool success = true;
+		const uint64_t total = static_cast<uint64_t>(numMessages) * numThreads;
+		if (errors != 0 || received != written || (retry && written != total) || written + dropped - retries != total)
+		{
+			printf("FAILED: %" PRIu64 " errors, %" PRIu64 " written, %" PRIu64 " received, %" PRIu64 " dropped\n", errors, written, received, dropped);
+			success = false;
+		}
+		printf("%s: %zu threads, %u messages each, %zu slots: %" PRIu64 " received, %" PRIu64 " %s, %.0f ns per message on the producer\n",
+			retry ? "Retrying" : "Flat out", numThreads, numMessages, numSlots, received, retry ? retries : dropped, retry ? "retries" : "dropped",
+			producerSeconds * 1e9 / static_cast<double>(total));
+		return success;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t numThreads = 4;
+	uint32_t numMessages = 1000000;
+	size_t numSlots = 256;
+	for (int i = 1; i < argc; i++)
+	{
+		auto nextArg = [&]() -> const char* {
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "Missing value for %s\n", argv[i]);
+				exit(2);
+			}
+			return argv[++i];
+		};
+
+		if (strcmp(argv[i], "--threads") == 0) numThreads = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--messages") == 0) numMessages = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--slots") == 0) numSlots = strtoul(nextArg(), nullptr, 10);
+		else
+		{
+			fprintf(stderr, "Usage: LogQueueStress [--threads <n>] [--messages <n>] [--slots <n>]\n");
+			return 2;
+		}
+	}
+	if (numThreads == 0 || numSlots == 0)
+	{
+		fprintf(stderr, "Threads and slots must be non-zero\n");
+		return 2;
+	}
+
+	bool success = CheckFormats();
+	printf("Formatting checked against snprintf\n");
+
+	// Retrying formats every message on the consumer, so it runs a tenth of them
+	success &= Run(numThreads, numMessages, numSlots, false);
+	success &= Run(numThreads, std::max<uint32_t>(numMessages / 10, 1), numSlots, true);
+
+	printf(success ? "All checks passed\n" : "Checks failed\n");
+	return success ? 0 : 1;
+}
@@ -0,0 +1,474 @@
+// Compiles patch manifests into the bytecode SilentPatch loads, and checks the compiler and the interpreter
+// against a synthetic image. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/PatchManifest/PatchManifest.cpp source/PatchManifest.cpp -o PatchManifest
+//
+// Usage: PatchManifest compile <manifest.txt> <output.patches>
+//        PatchManifest dump <file.patches>
+//        PatchManifest check [--iterations <n>]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "PatchManifest.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	bool ReadFile(const char* path, std::vector<uint8_t>& data)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			return false;
+		}
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	int Compile(const char* inputPath, const char* outputPath)
+	{
+		std::vector<uint8_t> source;
+		if (!ReadFile(inputPath, source))
+		{
+			fprintf(stderr, "Can't read %s\n", inputPath);
+			return 1;
+		}
+
+		const PatchManifest::CompileResult result = PatchManifest::Compile(std::string_view(reinterpret_cast<const char*>(source.data()), source.size()));
+		if (!result.error.empty())
+		{
+			fprintf(stderr, "%s:%s\n", inputPath, result.error.c_str() + 5);
+			return 1;
+		}
+
+		std::ofstream output(outputPath, std::ios::binary);
+		output.write(reinterpret_cast<const char*>(result.bytecode.data()), result.bytecode.size());
+		if (!output)
+		{
+			fprintf(stderr, "Can't write %s\n", outputPath);
+			return 1;
+		}
+		printf("%s: %zu bytes of source, %zu bytes of bytecode\n", outputPath, source.size(), result.bytecode.size());
+		return 0;
+	}
+
+	int Dump(const char* path)
+	{
+		std::vector<uint8_t> bytecode;
+		if (!ReadFile(path, bytecode))
+		{
+			fprintf(stderr, "Can't read %s\n", path);
+			return 1;
+		}
+		const auto listing = PatchManifest::Disassemble(bytecode.data(), bytecode.size());
+		if (!listing)
+		{
+			fprintf(stderr, "%s is not valid bytecode\n", path);
+			return 1;
+		}
+		fputs(listing->c_str(), stdout);
+		return 0;
+	}
+
+	// ===== Checks =====
+
+	int failures = 0;
+
+	void Expect(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	}
+
+	// A synthetic image with known code planted in random bytes, and symbols placed inside it so
+	// rel32 branches to them can be checked exactly on 64-bit hosts too
+	struct Image
+	{
+		std::vector<uint8_t> bytes;
+		void* original = nullptr;
+		std::vector<PatchManifest::Symbol> symbols;
+		size_t writes = 0;
+		size_t creates = 0;
+		bool outOfRange = false;
+
+		static Image* current;
+
+		explicit Image(uint32_t seed)
+			: bytes(64 * 1024)
+		{
+			std::mt19937 random(seed);
+			for (uint8_t& byte : bytes)
+			{
+				// Keep the planted opcodes out of the noise, so signatures match exactly where planted
+				do
+				{
+					byte = static_cast<uint8_t>(random());
+				}
+				while (byte == 0x51 || byte == 0x75 || byte == 0xE8 || byte == 0xB8);
+			}
+			Plant(0x1000, { 0x51, 0xC7, 0x46, 0x0C, 0xA8, 0x61, 0x00, 0x00 });
+			Plant(0x2000, { 0x75, 0x11, 0x6A, 0x00, 0xFF, 0x15, 0x12, 0x34, 0x56, 0x78, 0x5F });
+			// call rel32 to 0x3800
+			Plant(0x3000, { 0xE8, 0xFB, 0x07, 0x00, 0x00, 0x8B, 0xF8 });
+			// Twice
+			Plant(0x4000, { 0xB8, 0x01, 0x02, 0x03, 0x04, 0xC3 });
+			Plant(0x4100, { 0xB8, 0x05, 0x06, 0x07, 0x08, 0xC3 });
+			// jmp rel32 to 0x3900, a tail call
+			Plant(0x5000, { 0xE9, 0xFB, 0xE8, 0xFF, 0xFF, 0x51, 0x75 });
+
+			symbols = {
+				{ "Hook", bytes.data() + 0x8000, nullptr },
+				{ "Intercept", bytes.data() + 0x8100, &original },
+				{ "Variable", bytes.data() + 0x8200, nullptr },
+				{ "Lazy", nullptr, &original, &CreateLazy },
+				{ "Unbuildable", nullptr, nullptr, [] () -> const void* { return nullptr; } },
+			};
+		}
+
+		static const void* CreateLazy()
+		{
+			current->creates++;
+			return current->bytes.data() + 0x8300;
+		}
+
+		void Plant(size_t offset, std::initializer_list<uint8_t> code)
+		{
+			std::copy(code.begin(), code.end(), bytes.begin() + offset);
+		}
+
+		PatchManifest::Host Host()
+		{
+			current = this;
+			return { bytes.data(), bytes.data() + bytes.size(), symbols.data(), symbols.size(), &Write };
+		}
+
+		static void Write(uint8_t* address, const void* data, size_t size)
+		{
+			Image& image = *current;
+			if (address < image.bytes.data() || size > static_cast<size_t>(image.bytes.data() + image.bytes.size() - address))
+			{
+				image.outOfRange = true;
+				return;
+			}
+			std::memcpy(address, data, size);
+			image.writes++;
+		}
+
+		uint32_t Dword(size_t offset) const
+		{
+			uint32_t value;
+			std::memcpy(&value, bytes.data() + offset, sizeof(value));
+			return value;
+		}
+	};
+	Image* Image::current;
+
+	std::vector<uint8_t> CompileOrFail(const char* source)
+	{
+		const PatchManifest::CompileResult result = PatchManifest::Compile(source);
+		if (!result.error.empty())
+		{
+			printf("  FAILED: unexpected compile error %s\n", result.error.c_str());
+			failures++;
+		}
+		return result.bytecode;
+	}
+
+	void CheckOperations()
+	{
+		printf("Operations\n");
+		const std::vector<uint8_t> bytecode = CompileOrFail(R"(
+# Every operation once
+patch "Writes"
+	find money "51 C7 46 0C A8 61 00 00"
+	find exit "75 11 6A 00 FF 15 ? ? ? ? 5F" count 1
+	write money+4 u32 50000
+	write money+1 bytes "90 C3"
+	write exit-16 i8 -2
+	write exit-12 f32 1.5
+	write exit-8 u16 0x1234
+	write exit+6 address Variable
+	nop exit+2 2
+end
+# Sees the code as left by the previous patch
+patch "Branches"
+	find exit "75 11 90 90 ? ? ? ? ? ? 5F"
+	find call "E8 ? ? ? ? 8B F8"
+	find second "B8 ? ? ? ? C3" count 2 index 1
+	jump exit+4 Hook
+	intercept call Intercept
+	call second Hook
+end
+)");
+
+		Image image(1);
+		const auto results = PatchManifest::Run(bytecode.data(), bytecode.size(), image.Host());
+		Expect(results && results->size() == 2 && (*results)[0].applied && (*results)[1].applied, "both patches applied");
+		Expect(image.Dword(0x1000 + 4) == 50000, "write u32");
+		Expect(image.bytes[0x1001] == 0x90 && image.bytes[0x1002] == 0xC3, "write bytes");
+		Expect(image.bytes[0x2000 - 16] == 0xFE, "write i8");
+		float f;
+		std::memcpy(&f, &image.bytes[0x2000 - 12], sizeof(f));
+		Expect(f == 1.5f, "write f32");
+		Expect(image.Dword(0x2000 - 8) == (0x1234u | (image.bytes[0x2000 - 6] << 16) | (static_cast<uint32_t>(image.bytes[0x2000 - 5]) << 24)), "write u16 leaves the next bytes");
+		Expect(image.bytes[0x2002] == 0x90 && image.bytes[0x2003] == 0x90, "nop");
+		// The branch to Hook overwrote exit+4..exit+8, the address written at exit+6 before it is partially overwritten too
+		Expect(image.bytes[0x2004] == 0xE9 && image.Dword(0x2005) == 0x8000 - (0x2004 + 5), "jump");
+		Expect(image.original == image.bytes.data() + 0x3800, "intercept stores the original target");
+		Expect(image.bytes[0x3000] == 0xE8 && image.Dword(0x3001) == 0x8100 - (0x3000 + 5), "intercept redirects the call");
+		Expect(image.bytes[0x4100] == 0xE8 && image.Dword(0x4101) == 0x8000 - (0x4100 + 5), "call on the second match");
+		Expect(image.bytes[0x4000] == 0xB8, "first match untouched");
+		Expect(!image.outOfRange, "no writes out of range");
+		Expect(image.creates == 0, "unused symbols not built");
+
+		// Symbols built on first use
+		const std::vector<uint8_t> lazy = CompileOrFail(R"(
+patch "Lazy"
+	find call "E8 ? ? ? ? 8B F8"
+	find second "B8 ? ? ? ? C3" count 2 index 1
+	intercept call Lazy
+	write second+1 address Lazy
+end
+)");
+		Image lazyImage(5);
+		const auto lazyResults = PatchManifest::Run(lazy.data(), lazy.size(), lazyImage.Host());
+		Expect(lazyResults && lazyResults->size() == 1 && (*lazyResults)[0].applied, "patch with a built symbol applied");
+		Expect(lazyImage.creates != 0, "symbol built");
+		Expect(lazyImage.original == lazyImage.bytes.data() + 0x3800, "intercept with a built symbol stores the original target");
+		Expect(lazyImage.bytes[0x3000] == 0xE8 && lazyImage.Dword(0x3001) == 0x8300 - (0x3000 + 5), "intercept redirects to the built symbol");
+		Expect(lazyImage.Dword(0x4101) == static_cast<uint32_t>(reinterpret_cast<uintptr_t>(lazyImage.bytes.data() + 0x8300)), "address of the built symbol");
+
+		// A tail call stays a jump, as a call would leave its return address on the stack
+		const std::vector<uint8_t> tail = CompileOrFail(R"(
+patch "Tail call"
+	find tail "E9 ? ? ? ? 51 75"
+	intercept tail Intercept
+end
+)");
+		Image tailImage(6);
+		const auto tailResults = PatchManifest::Run(tail.data(), tail.size(), tailImage.Host());
+		Expect(tailResults && tailResults->size() == 1 && (*tailResults)[0].applied, "intercept of a jump applied");
+		Expect(tailImage.original == tailImage.bytes.data() + 0x3900, "intercept of a jump stores the original target");
+		Expect(tailImage.bytes[0x5000] == 0xE9 && tailImage.Dword(0x5001) == 0x8100 - (0x5000 + 5), "intercept of a jump stays a jump");
+	}
+
+	void CheckAllOrNothing()
+	{
+		printf("All or nothing\n");
+		const char* sources[] = {
+			// Second signature missing
+			"patch \"a\"\n find a \"51 C7 46 0C\"\n find b \"DE AD BE EF 11 22 33 44\"\n write a u8 1\nend\n",
+			// Wrong match count
+			"patch \"a\"\n find a \"51 C7 46 0C\"\n find b \"B8 ? ? ? ? C3\" count 3\n write a u8 1\nend\n",
+			// Unknown symbol after a valid write
+			"patch \"a\"\n find a \"51 C7 46 0C\"\n write a u8 1\n call a Missing\nend\n",
+			// Can't intercept what isn't a call
+			"patch \"a\"\n find a \"51 C7 46 0C\"\n write a u8 1\n intercept a Intercept\nend\n",
+			// Symbol without an original pointer
+			"patch \"a\"\n find a \"E8 ? ? ? ? 8B F8\"\n intercept a Hook\nend\n",
+			// Two intercepts storing to the same original pointer
+			"patch \"a\"\n find a \"E8 ? ? ? ? 8B F8\"\n find b \"E9 ? ? ? ? 51 75\"\n intercept a Intercept\n intercept b Intercept\nend\n",
+			"patch \"a\"\n find a \"E8 ? ? ? ? 8B F8\"\n find b \"E9 ? ? ? ? 51 75\"\n intercept a Intercept\n intercept b Lazy\nend\n",
+			// Symbol that can't be built
+			"patch \"a\"\n find a \"51 C7 46 0C\"\n write a u8 1\n call a Unbuildable\nend\n",
+			// Out of range
+			"patch \"a\"\n find a \"51 C7 46 0C\"\n write a u8 1\n write a-0x2000 u8 1\nend\n",
+			"patch \"a\"\n find a \"51 C7 46 0C\"\n write a u8 1\n nop a+0x10000 1\nend\n",
+		};
+		for (const char* source : sources)
+		{
+			const std::vector<uint8_t> bytecode = CompileOrFail(source);
+			Image image(2);
+			const std::vector<uint8_t> before = image.bytes;
+			const auto results = PatchManifest::Run(bytecode.data(), bytecode.size(), image.Host());
+			Expect(results && results->size() == 1 && !(*results)[0].applied && !(*results)[0].reason.empty(), "patch rejected with a reason");
+			Expect(image.bytes == before && image.writes == 0, "nothing written");
+		}
+
+		// A failed patch doesn't stop the next one
+		const std::vector<uint8_t> bytecode = CompileOrFail("patch \"a\"\n find a \"DE AD BE EF 11 22\"\n write a u8 1\nend\npatch \"b\"\n find b \"51 C7 46 0C\"\n write b u8 0xCC\nend\n");
+		Image image(3);
+		const auto results = PatchManifest::Run(bytecode.data(), bytecode.size(), image.Host());
+		Expect(results && results->size() == 2 && !(*results)[0].applied && (*results)[1].applied && image.bytes[0x1000] == 0xCC, "next patch applied");
+
+		// A later patch can't intercept with a symbol an earlier one already did
+		const std::vector<uint8_t> twice = CompileOrFail("patch \"a\"\n find a \"E8 ? ? ? ? 8B F8\"\n intercept a Intercept\nend\n"
+			"patch \"b\"\n find b \"E9 ? ? ? ? 51 75\"\n intercept b Intercept\nend\n");
+		Image twiceImage(3);
+		const auto twiceResults = PatchManifest::Run(twice.data(), twice.size(), twiceImage.Host());
+		Expect(twiceResults && twiceResults->size() == 2 && (*twiceResults)[0].applied && !(*twiceResults)[1].applied, "second intercept with a symbol rejected");
+		Expect(twiceImage.original == twiceImage.bytes.data() + 0x3800 && twiceImage.bytes[0x5000] == 0xE9 && twiceImage.Dword(0x5001) == static_cast<uint32_t>(0x3900 - (0x5000 + 5)),
+			"first intercept kept");
+	}
+
+	void CheckCompileErrors()
+	{
+		printf("Compile errors\n");
+		const struct
+		{
+			const char* source;
+			size_t line;
+		} cases[] = {
+			{ "find a \"90\"\n", 1 },
+			{ "patch \"a\"\n\n find a \"9\"\nend\n", 3 },
+			{ "patch \"a\"\n find a \"? ?\"\nend\n", 2 },
+			{ "patch \"a\"\n find a \"90\"\n find a \"91\"\nend\n", 3 },
+			{ "patch \"a\"\n write a u8 1\nend\n", 2 },
+			{ "patch \"a\"\n find a \"90\"\n write a u8 256\nend\n", 3 },
+			{ "patch \"a\"\n find a \"90\"\n write a i8 -129\nend\n", 3 },
+			{ "patch \"a\"\n find a \"90\"\n write a bytes \"90 ?\"\nend\n", 3 },
+			{ "patch \"a\"\n find a \"90\"\n write a f32 x\nend\n", 3 },
+			{ "patch \"a\"\n find a \"90\" count 2 index 2\nend\n", 2 },
+			{ "patch \"a\"\n find a \"90\" count 17\nend\n", 2 },
+			{ "patch \"a\"\n find a \"90\"\n nop a 0\nend\n", 3 },
+			{ "patch \"a\"\n find a \"90\"\n frobnicate a\nend\n", 3 },
+			{ "patch \"a\"\n find a \"90\n", 2 },
+			{ "patch \"a\"\n find a \"90\"\n", 3 },
+			{ "patch \"a\"\npatch \"b\"\n", 2 },
+		};
+		for (const auto& test : cases)
+		{
+			const PatchManifest::CompileResult result = PatchManifest::Compile(test.source);
+			const std::string expected = "line " + std::to_string(test.line) + ":";
+			if (result.error.compare(0, expected.size(), expected) != 0 || !result.bytecode.empty())
+			{
+				printf("  FAILED: expected an error on %s got \"%s\" for:\n%s", expected.c_str(), result.error.c_str(), test.source);
+				failures++;
+			}
+		}
+
+		const PatchManifest::CompileResult empty = PatchManifest::Compile("# Nothing\n");
+		Expect(empty.error.empty() && PatchManifest::Validate(empty.bytecode.data(), empty.bytecode.size()), "empty manifest compiles");
+	}
+
+	// Corrupted bytecode that still passes validation must be rejected or run without writing out of range
+	void CheckCorruption(size_t iterations)
+	{
+		printf("Corruption (%zu mutations)\n", iterations);
+		const std::vector<uint8_t> bytecode = CompileOrFail(R"(
+patch "a"
+	find money "51 C7 46 0C A8 61 00 00"
+	find exit "75 11 6A 00 FF 15 ? ? ? ? 5F"
+	write money+4 u32 50000
+	nop exit+2 2
+	call exit+4 Hook
+end
+patch "b"
+	find call "E8 ? ? ? ? 8B F8"
+	intercept call Intercept
+	write call-8 address Variable
+end
+)");
+
+		// Truncated and unfixed mutations fail validation
+		Expect(!PatchManifest::Validate(bytecode.data(), bytecode.size() - 1), "truncated bytecode invalid");
+		std::vector<uint8_t> flipped = bytecode;
+		flipped[20] ^= 1;
+		Expect(!PatchManifest::Validate(flipped.data(), flipped.size()), "flipped bit invalid");
+
+		std::mt19937 random(4);
+		size_t outOfRange = 0;
+		for (size_t i = 0; i < iterations; i++)
+		{
+			std::vector<uint8_t> mutated = bytecode;
+			const size_t mutations = 1 + random() % 4;
+			for (size_t j = 0; j < mutations; j++)
+			{
+				mutated[16 + random() % (mutated.size() - 16)] = static_cast<uint8_t>(random());
+			}
+			if (random() % 4 == 0)
+			{
+				mutated.resize(16 + random() % (mutated.size() - 16));
+			}
+
+			// Fix up the header, so the interpreter gets to see the damage
+			uint32_t size = static_cast<uint32_t>(mutated.size());
+			uint32_t checksum = 2166136261u;
+			for (size_t j = 16; j < mutated.size(); j++)
+			{
+				checksum = (checksum ^ mutated[j]) * 16777619u;
+			}
+			std::memcpy(&mutated[8], &size, sizeof(size));
+			std::memcpy(&mutated[12], &checksum, sizeof(checksum));
+
+			Image image(5);
+			PatchManifest::Run(mutated.data(), mutated.size(), image.Host());
+			PatchManifest::Disassemble(mutated.data(), mutated.size());
+			if (image.outOfRange)
+			{
+				outOfRange++;
+			}
+		}
+		Expect(outOfRange == 0, "no writes out of range");
+	}
+
+	void CheckLoadCost()
+	{
+		printf("Load cost\n");
+		// A manifest the size of all fixes SilentPatch has
+		std::string source;
+		for (int i = 0; i < 40; i++)
+		{
+			source += "patch \"Patch " + std::to_string(i) + "\"\n";
+			source += "\tfind a \"8B 46 08 3B F8 ? ? 33 C0 5B C3 " + std::to_string(10 + i % 90) + "\"\n";
+			source += "\twrite a+4 u32 " + std::to_string(i) + "\n";
+			source += "end\n";
+		}
+		const std::vector<uint8_t> bytecode = CompileOrFail(source.c_str());
+
+		Image image(6);
+		const auto start = Clock::now();
+		const auto results = PatchManifest::Run(bytecode.data(), bytecode.size(), image.Host());
+		const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		Expect(results && results->size() == 40, "all patches run");
+		printf("  %zu bytes of source, %zu bytes of bytecode, run over 64 KB in %.3f ms\n", source.size(), bytecode.size(), ms);
+	}
+
+	int Check(size_t iterations)
+	{
+		CheckOperations();
+		CheckAllOrNothing();
+		CheckCompileErrors();
+		CheckCorruption(iterations);
+		CheckLoadCost();
+		printf(failures == 0 ? "All checks passed\n" : "%d checks failed\n", failures);
+		return failures == 0 ? 0 : 1;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc == 4 && std::strcmp(argv[1], "compile") == 0)
+	{
+		return Compile(argv[2], argv[3]);
+	}
+	if (argc == 3 && std::strcmp(argv[1], "dump") == 0)
+	{
+		return Dump(argv[2]);
+	}
+	if (argc >= 2 && std::strcmp(argv[1], "check") == 0)
+	{
+		size_t iterations = 100000;
+		if (argc == 4 && std::strcmp(argv[2], "--iterations") == 0)
+		{
+			iterations = std::strtoul(argv[3], nullptr, 10);
+		}
+		return Check(iterations);
+	}
+
+	fprintf(stderr, "Usage: %s compile <manifest.txt> <output.patches>\n"
+		"       %s dump <file.patches>\n"
+		"       %s check [--iterations <n>]\n", argv[0], argv[0], argv[0]);
+	return 2;
+}
@@ -0,0 +1,141 @@
+// Stress tests PcmRing with a producer and a consumer thread running flat out, and at the pace of music streaming.
+// Every chunk is filled with a pattern derived from its sequence number, so lost, repeated, reordered
+// or torn chunks are all caught. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -pthread -Isource tools/PcmRingStress/PcmRingStress.cpp source/PcmRing.cpp -o PcmRingStress
+//
+// Usage: PcmRingStress [--chunks <n>] [--slots <n>] [--slot-size <bytes>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "PcmRing.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	uint8_t PatternByte(uint32_t sequence, size_t index)
+	{
+		return static_cast<uint8_t>((sequence * 2654435761u) >> 24) ^ static_cast<uint8_t>(index * 31);
+	}
+
+	// Sizes vary per chunk, like locks that don't always cover a whole slot
+	uint32_t ChunkSize(uint32_t sequence, size_t slotSize)
+	{
+		return static_cast<uint32_t>(slotSize - (sequence * 7919) % (slotSize / 2));
+	}
+
+	struct Result
+	{
+		uint64_t errors = 0;
+		uint64_t fullSpins = 0;
+		uint64_t emptySpins = 0;
+		double seconds = 0.0;
+	};
+
+	// producerDelay/consumerDelay simulate decode time and the wait for the next notification
+	Result Run(uint32_t chunks, size_t slots, size_t slotSize, std::chrono::microseconds producerDelay, std::chrono::microseconds consumerDelay)
+	{
+		PcmRing ring(slots, slotSize);
+		Result result;
+
+		const auto start = Clock::now();
+		std::thread producer([&] {
+			for (uint32_t sequence = 0; sequence < chunks; sequence++)
+			{
+				uint8_t* data;
+				while ((data = ring.BeginWrite()) == nullptr)
+				{
+					result.fullSpins++;
+					std::this_thread::yield();
+				}
+
+				const uint32_t size = ChunkSize(sequence, slotSize);
+				for (size_t i = 0; i < size; i++)
+				{
+					data[i] = PatternByte(sequence, i);
+				}
+				ring.EndWrite(size, sequence);
+				if (producerDelay.count() != 0)
+				{
+					std::this_thread::sleep_for(producerDelay);
+				}
+			}
+		});
+
+		std::thread consumer([&] {
+			for (uint32_t sequence = 0; sequence < chunks; sequence++)
+			{
+				const PcmRing::Chunk* chunk;
+				while ((chunk = ring.BeginRead()) == nullptr)
+				{
+					result.emptySpins++;
+					std::this_thread::yield();
+				}
+
+				bool valid = chunk->tag == sequence && chunk->size == ChunkSize(sequence, slotSize);
+				for (size_t i = 0; valid && i < chunk->size; i++)
+				{
+					valid = chunk->data[i] == PatternByte(sequence, i);
+				}
+				result.errors += valid ? 0 : 1;
+				ring.EndRead();
+				if (consumerDelay.count() != 0)
+				{
+					std::this_thread::sleep_for(consumerDelay);
+				}
+			}
+		});
+
+		producer.join();
+		consumer.join();
+		result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		return result;
+	}
+
+	bool Print(const char* name, uint32_t chunks, size_t slotSize, const Result& result)
+	{
+		printf("%-22s %10u %10llu %12llu %12llu %10.1f\n", name, chunks, static_cast<unsigned long long>(result.errors),
+			static_cast<unsigned long long>(result.fullSpins), static_cast<unsigned long long>(result.emptySpins),
+			chunks * (slotSize * 0.75) / (1024.0 * 1024.0) / result.seconds);
+		return result.errors == 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t chunks = 200000;
+	size_t slots = 4;
+	size_t slotSize = 4096;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--chunks") == 0 && i + 1 < argc) chunks = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+		else if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc) slots = static_cast<size_t>(std::max(1, atoi(argv[++i])));
+		else if (strcmp(argv[i], "--slot-size") == 0 && i + 1 < argc) slotSize = static_cast<size_t>(std::max(16, atoi(argv[++i])));
+		else
+		{
+			fprintf(stderr, "Usage: PcmRingStress [--chunks <n>] [--slots <n>] [--slot-size <bytes>]\n");
+			return 2;
+		}
+	}
+
+	printf("%zu slots of %zu bytes\n", slots, slotSize);
+	printf("%-22s %10s %10s %12s %12s %10s\n", "Run", "Chunks", "Errors", "Full spins", "Empty spins", "MB/s");
+
+	bool correct = true;
+	correct &= Print("Flat out", chunks, slotSize, Run(chunks, slots, slotSize, std::chrono::microseconds(0), std::chrono::microseconds(0)));
+	correct &= Print("Single slot", chunks, slotSize, Run(chunks, 1, slotSize, std::chrono::microseconds(0), std::chrono::microseconds(0)));
+
+	// Paced runs take real time, so they use fewer chunks
+	const uint32_t pacedChunks = std::min<uint32_t>(chunks, 2000);
+	correct &= Print("Slow producer", pacedChunks, slotSize, Run(pacedChunks, slots, slotSize, std::chrono::microseconds(200), std::chrono::microseconds(0)));
+	correct &= Print("Slow consumer", pacedChunks, slotSize, Run(pacedChunks, slots, slotSize, std::chrono::microseconds(0), std::chrono::microseconds(200)));
+
+	printf("\nCorrectness: %s\n", correct ? "PASS" : "FAIL");
+	return correct ? 0 : 1;
+}
@@ -0,0 +1,460 @@
+// Checks RenderStateCache against a mock device counting the calls it receives, wired up like the D3D9StateFilter hooks:
+// repeated values are filtered, states and stages outside of the cached ranges always pass through, nothing is cached
+// while a state block is being recorded, and Reset and state block Apply make the cache forget all values.
+// Random call sequences are also run against a filtered and an unfiltered device, which must end up in the same state.
+// Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/RenderStateCheck/RenderStateCheck.cpp source/RenderStateCache.cpp -o RenderStateCheck
+//
+// Usage: RenderStateCheck [--iterations <n>]
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "RenderStateCache.h"
+
+namespace
+{
+	// Values from d3d9types.h
+	constexpr uint32_t D3DRS_ZENABLE = 7;
+	constexpr uint32_t D3DRS_ALPHABLENDENABLE = 27;
+	constexpr uint32_t D3DRS_BLENDOPALPHA = 209;
+	constexpr uint32_t D3DSAMP_MAGFILTER = 5;
+	constexpr uint32_t D3DSAMP_DMAPOFFSET = 13;
+	constexpr uint32_t D3DDMAPSAMPLER = 256;
+	constexpr uint32_t D3DVERTEXTEXTURESAMPLER0 = 257;
+	constexpr uint32_t D3DTSS_COLOROP = 1;
+	constexpr uint32_t D3DTSS_CONSTANT = 32;
+
+	class Failure : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	std::string Format(const char* format, ...)
+	{
+		char buf[512];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buf, sizeof(buf), format, args);
+		va_end(args);
+		return buf;
+	}
+
+	void Expect(bool condition, const std::string& message)
+	{
+		if (!condition)
+		{
+			throw Failure(message);
+		}
+	}
+
+	const void* FakeTexture(uintptr_t id)
+	{
+		return reinterpret_cast<const void*>(id * 0x1000);
+	}
+
+	// Calls in the order of RenderStateCache::Call, with the stage or sampler and the state type where they apply
+	using StateKey = std::tuple<RenderStateCache::Call, uint32_t, uint32_t>;
+	using DeviceState = std::map<StateKey, uintptr_t>;
+
+	// Records every call it receives. Calls made while recording a state block go to the state block instead
+	class MockDevice
+	{
+	public:
+		void Set(RenderStateCache::Call call, uint32_t index, uint32_t type, uintptr_t value)
+		{
+			m_calls++;
+			(m_recording ? m_stateBlock : m_state)[{ call, index, type }] = value;
+		}
+
+		// Back to the default state, which is no entries
+		void Reset()
+		{
+			m_state.clear();
+		}
+
+		void BeginStateBlock()
+		{
+			m_recording = true;
+			m_stateBlock.clear();
+		}
+
+		DeviceState EndStateBlock()
+		{
+			m_recording = false;
+			return m_stateBlock;
+		}
+
+		void Apply(const DeviceState& stateBlock)
+		{
+			for (const auto& state : stateBlock)
+			{
+				m_state[state.first] = state.second;
+			}
+		}
+
+		const DeviceState& GetState() const { return m_state; }
+		size_t GetCalls() const { return m_calls; }
+
+	private:
+		DeviceState m_state;
+		DeviceState m_stateBlock;
+		bool m_recording = false;
+		size_t m_calls = 0;
+	};
+
+	// The device as the game sees it, through the D3D9StateFilter hooks when given a cache
+	class Device
+	{
+	public:
+		explicit Device(RenderStateCache* cache) : m_cache(cache) {}
+
+		void SetRenderState(uint32_t state, uint32_t value)
+		{
+			if (m_cache == nullptr || m_cache->SetRenderState(state, value))
+			{
+				m_device.Set(RenderStateCache::Call::RenderState, 0, state, value);
+			}
+		}
+
+		void SetTexture(uint32_t stage, const void* texture)
+		{
+			if (m_cache == nullptr || m_cache->SetTexture(stage, texture))
+			{
+				m_device.Set(RenderStateCache::Call::Texture, stage, 0, reinterpret_cast<uintptr_t>(texture));
+			}
+		}
+
+		void SetSamplerState(uint32_t sampler, uint32_t type, uint32_t value)
+		{
+			if (m_cache == nullptr || m_cache->SetSamplerState(sampler, type, value))
+			{
+				m_device.Set(RenderStateCache::Call::SamplerState, sampler, type, value);
+			}
+		}
+
+		void SetTextureStageState(uint32_t stage, uint32_t type, uint32_t value)
+		{
+			if (m_cache == nullptr || m_cache->SetTextureStageState(stage, type, value))
+			{
+				m_device.Set(RenderStateCache::Call::TextureStageState, stage, type, value);
+			}
+		}
+
+		void Reset()
+		{
+			if (m_cache != nullptr)
+			{
+				m_cache->Invalidate();
+			}
+			m_device.Reset();
+		}
+
+		void BeginStateBlock()
+		{
+			m_device.BeginStateBlock();
+			if (m_cache != nullptr)
+			{
+				m_cache->SetRecording(true);
+			}
+		}
+
+		DeviceState EndStateBlock()
+		{
+			DeviceState stateBlock = m_device.EndStateBlock();
+			if (m_cache != nullptr)
+			{
+				m_cache->SetRecording(false);
+			}
+			return stateBlock;
+		}
+
+		void Apply(const DeviceState& stateBlock)
+		{
+			if (m_cache != nullptr)
+			{
+				m_cache->Invalidate();
+			}
+			m_device.Apply(stateBlock);
+		}
+
+		const MockDevice& GetMock() const { return m_device; }
+
+	private:
+		RenderStateCache* m_cache;
+		MockDevice m_device;
+	};
+
+	// Counts the device calls made by a function
+	template<typename Func>
+	size_t CountCalls(const Device& device, Func&& func)
+	{
+		const size_t before = device.GetMock().GetCalls();
+		func();
+		return device.GetMock().GetCalls() - before;
+	}
+
+	void CheckDuplicates()
+	{
+		RenderStateCache cache;
+		Device device(&cache);
+
+		Expect(CountCalls(device, [&] { device.SetRenderState(D3DRS_ZENABLE, 1); }) == 1, "First render state was filtered");
+		Expect(CountCalls(device, [&] { device.SetRenderState(D3DRS_ZENABLE, 1); }) == 0, "Repeated render state was passed through");
+		Expect(CountCalls(device, [&] { device.SetRenderState(D3DRS_ZENABLE, 0); }) == 1, "Changed render state was filtered");
+		Expect(CountCalls(device, [&] { device.SetRenderState(D3DRS_ALPHABLENDENABLE, 0); }) == 1, "Another render state was filtered");
+
+		Expect(CountCalls(device, [&] { device.SetTexture(0, FakeTexture(1)); device.SetTexture(0, FakeTexture(1)); }) == 1, "Repeated texture was passed through");
+		Expect(CountCalls(device, [&] { device.SetTexture(1, FakeTexture(1)); }) == 1, "Texture on another stage was filtered");
+		Expect(CountCalls(device, [&] { device.SetTexture(0, nullptr); device.SetTexture(0, nullptr); }) == 1, "Repeated null texture was passed through");
+
+		Expect(CountCalls(device, [&] { device.SetSamplerState(2, D3DSAMP_MAGFILTER, 2); device.SetSamplerState(2, D3DSAMP_MAGFILTER, 2); }) == 1,
+			"Repeated sampler state was passed through");
+		Expect(CountCalls(device, [&] { device.SetSamplerState(3, D3DSAMP_MAGFILTER, 2); }) == 1, "Sampler state of another sampler was filtered");
+
+		Expect(CountCalls(device, [&] { device.SetTextureStageState(1, D3DTSS_COLOROP, 4); device.SetTextureStageState(1, D3DTSS_COLOROP, 4); }) == 1,
+			"Repeated texture stage state was passed through");
+
+		// Each call is counted, and filtered calls separately
+		const RenderStateCache::Counters& counters = cache.GetCounters();
+		const uint64_t expectedCalls[] = { 4, 5, 3, 2 };
+		const uint64_t expectedFiltered[] = { 1, 2, 1, 1 };
+		for (size_t i = 0; i < static_cast<size_t>(RenderStateCache::Call::Count); i++)
+		{
+			Expect(counters.calls[i] == expectedCalls[i] && counters.filtered[i] == expectedFiltered[i],
+				Format("Call %zu counted %llu calls and %llu filtered, expected %llu and %llu", i, static_cast<unsigned long long>(counters.calls[i]),
+					static_cast<unsigned long long>(counters.filtered[i]), static_cast<unsigned long long>(expectedCalls[i]),
+					static_cast<unsigned long long>(expectedFiltered[i])));
+		}
+	}
+
+	void CheckOutOfRange()
+	{
+		RenderStateCache cache;
+		Device device(&cache);
+
+		// The last cached states are filtered, anything past them is not
+		Expect(CountCalls(device, [&] { device.SetRenderState(D3DRS_BLENDOPALPHA, 1); device.SetRenderState(D3DRS_BLENDOPALPHA, 1); }) == 1,
+			"Last render state is not cached");
+		Expect(CountCalls(device, [&] { device.SetSamplerState(15, D3DSAMP_DMAPOFFSET, 1); device.SetSamplerState(15, D3DSAMP_DMAPOFFSET, 1); }) == 1,
+			"Last sampler state is not cached");
+		Expect(CountCalls(device, [&] { device.SetTextureStageState(7, D3DTSS_CONSTANT, 1); device.SetTextureStageState(7, D3DTSS_CONSTANT, 1); }) == 1,
+			"Last texture stage state is not cached");
+
+		struct Case
+		{
+			const char* name;
+			void (*set)(Device& device);
+		};
+		const Case cases[] = {
+			{ "Render state past the last one", [](Device& device) { device.SetRenderState(D3DRS_BLENDOPALPHA + 1, 1); } },
+			{ "Huge render state", [](Device& device) { device.SetRenderState(0x7FFFFFFF, 1); } },
+			{ "Texture on the displacement map sampler", [](Device& device) { device.SetTexture(D3DDMAPSAMPLER, FakeTexture(1)); } },
+			{ "Texture on a vertex sampler", [](Device& device) { device.SetTexture(D3DVERTEXTEXTURESAMPLER0, FakeTexture(1)); } },
+			{ "Texture on sampler 16", [](Device& device) { device.SetTexture(16, FakeTexture(1)); } },
+			{ "Sampler state of a vertex sampler", [](Device& device) { device.SetSamplerState(D3DVERTEXTEXTURESAMPLER0, D3DSAMP_MAGFILTER, 1); } },
+			{ "Sampler state past the last one", [](Device& device) { device.SetSamplerState(0, D3DSAMP_DMAPOFFSET + 1, 1); } },
+			{ "Texture stage state of stage 8", [](Device& device) { device.SetTextureStageState(8, D3DTSS_COLOROP, 1); } },
+			{ "Texture stage state past the last one", [](Device& device) { device.SetTextureStageState(0, D3DTSS_CONSTANT + 1, 1); } },
+		};
+		for (const Case& c : cases)
+		{
+			Expect(CountCalls(device, [&] { c.set(device); c.set(device); c.set(device); }) == 3, Format("%s was filtered", c.name));
+		}
+	}
+
+	void CheckRecording()
+	{
+		RenderStateCache cache;
+		Device device(&cache);
+
+		device.SetRenderState(D3DRS_ZENABLE, 1);
+		device.SetTexture(0, FakeTexture(1));
+
+		// Values already in effect must still be recorded, and values recorded must not be taken as in effect
+		device.BeginStateBlock();
+		Expect(CountCalls(device, [&] {
+			device.SetRenderState(D3DRS_ZENABLE, 1);
+			device.SetRenderState(D3DRS_ZENABLE, 1);
+			device.SetTexture(0, FakeTexture(2));
+			device.SetTexture(0, FakeTexture(2));
+			device.SetSamplerState(0, D3DSAMP_MAGFILTER, 3);
+			device.SetTextureStageState(0, D3DTSS_COLOROP, 4);
+		}) == 6, "Calls were filtered while recording");
+		const DeviceState stateBlock = device.EndStateBlock();
+		Expect(stateBlock.size() == 4, Format("State block recorded %zu states, expected 4", stateBlock.size()));
+
+		// Recording did not apply anything, so the values recorded have to reach the device and the old ones are still cached
+		Expect(CountCalls(device, [&] { device.SetTexture(0, FakeTexture(2)); }) == 1, "Texture recorded in a state block was cached");
+		Expect(CountCalls(device, [&] { device.SetSamplerState(0, D3DSAMP_MAGFILTER, 3); }) == 1, "Sampler state recorded in a state block was cached");
+		Expect(CountCalls(device, [&] { device.SetRenderState(D3DRS_ZENABLE, 1); }) == 0, "Render state set before recording was forgotten");
+	}
+
+	void CheckInvalidate()
+	{
+		RenderStateCache cache;
+		Device device(&cache);
+
+		auto setAll = [&] {
+			device.SetRenderState(D3DRS_ZENABLE, 1);
+			device.SetTexture(0, FakeTexture(1));
+			device.SetSamplerState(0, D3DSAMP_MAGFILTER, 2);
+			device.SetTextureStageState(0, D3DTSS_COLOROP, 4);
+		};
+
+		setAll();
+		Expect(CountCalls(device, setAll) == 0, "Repeated values were passed through");
+
+		// Reset restores the defaults, so every value has to be set again
+		device.Reset();
+		Expect(CountCalls(device, setAll) == 4, "Values were filtered after Reset");
+		Expect(CountCalls(device, setAll) == 0, "Values were not cached again after Reset");
+
+		// Applying a state block changes the device state behind the cache's back
+		device.BeginStateBlock();
+		device.SetRenderState(D3DRS_ZENABLE, 0);
+		device.SetTexture(0, nullptr);
+		const DeviceState stateBlock = device.EndStateBlock();
+		device.Apply(stateBlock);
+		Expect(CountCalls(device, setAll) == 4, "Values were filtered after applying a state block");
+		Expect(device.GetMock().GetState().at({ RenderStateCache::Call::RenderState, 0, D3DRS_ZENABLE }) == 1, "Render state overwritten by a state block");
+	}
+
+	// Random calls on a small set of states so values repeat often, with resets and state blocks mixed in
+	void CheckRandom(size_t iterations)
+	{
+		std::mt19937 random(1234);
+		auto pick = [&random](uint32_t count) {
+			return std::uniform_int_distribution<uint32_t>(0, count - 1)(random);
+		};
+
+		RenderStateCache cache;
+		Device filtered(&cache);
+		Device unfiltered(nullptr);
+		std::vector<DeviceState> stateBlocks[2];
+		bool recording = false;
+
+		for (size_t i = 0; i < iterations; i++)
+		{
+			const uint32_t op = pick(100);
+			const uint32_t value = pick(3);
+			for (size_t j = 0; j < 2; j++)
+			{
+				Device& device = j == 0 ? filtered : unfiltered;
+				if (op < 30)
+				{
+					const uint32_t states[] = { D3DRS_ZENABLE, D3DRS_ALPHABLENDENABLE, D3DRS_BLENDOPALPHA, D3DRS_BLENDOPALPHA + 1 };
+					device.SetRenderState(states[op % 4], value);
+				}
+				else if (op < 50)
+				{
+					const uint32_t stages[] = { 0, 1, 15, D3DDMAPSAMPLER, D3DVERTEXTEXTURESAMPLER0 };
+					device.SetTexture(stages[op % 5], value != 0 ? FakeTexture(value) : nullptr);
+				}
+				else if (op < 70)
+				{
+					const uint32_t samplers[] = { 0, 15, D3DVERTEXTEXTURESAMPLER0 };
+					device.SetSamplerState(samplers[op % 3], op % 2 != 0 ? D3DSAMP_MAGFILTER : D3DSAMP_DMAPOFFSET + 1, value);
+				}
+				else if (op < 90)
+				{
+					device.SetTextureStageState(op % 9, op % 2 != 0 ? D3DTSS_COLOROP : D3DTSS_CONSTANT, value);
+				}
+				else if (op < 92)
+				{
+					device.Reset();
+				}
+				else if (op < 96)
+				{
+					if (!recording)
+					{
+						device.BeginStateBlock();
+					}
+					else
+					{
+						stateBlocks[j].push_back(device.EndStateBlock());
+					}
+				}
+				else if (!recording && !stateBlocks[j].empty())
+				{
+					device.Apply(stateBlocks[j][value % stateBlocks[j].size()]);
+				}
+			}
+			if (op >= 92 && op < 96)
+			{
+				recording = !recording;
+			}
+
+			Expect(filtered.GetMock().GetState() == unfiltered.GetMock().GetState(), Format("Filtered device state diverged after call %zu", i));
+		}
+
+		Expect(filtered.GetMock().GetCalls() < unfiltered.GetMock().GetCalls(), "Nothing was filtered");
+	}
+
+	struct NamedCheck
+	{
+		const char* name;
+		void (*check)();
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	size_t iterations = 100000;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--iterations <n>]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	const NamedCheck checks[] = {
+		{ "Duplicates", CheckDuplicates },
+		{ "Out of range", CheckOutOfRange },
+		{ "Recording", CheckRecording },
+		{ "Invalidate", CheckInvalidate },
+	};
+
+	int failures = 0;
+	for (const NamedCheck& check : checks)
+	{
+		try
+		{
+			check.check();
+			printf("%-16s OK\n", check.name);
+		}
+		catch (const std::exception& e)
+		{
+			printf("%-16s FAILED: %s\n", check.name, e.what());
+			failures++;
+		}
+	}
+
+	try
+	{
+		CheckRandom(iterations);
+		printf("%-16s OK (%zu calls)\n", "Random calls", iterations);
+	}
+	catch (const std::exception& e)
+	{
+		printf("%-16s FAILED: %s\n", "Random calls", e.what());
+		failures++;
+	}
+
+	return failures != 0 ? 1 : 0;
+}
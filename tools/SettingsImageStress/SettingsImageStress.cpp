@@ -0,0 +1,269 @@
+// Checks SettingsImage limits, then stress tests its seqlock with a writer rewriting every setting in rounds while
+// reader threads keep copying the table, like the game and JuicedConfig.exe sharing their settings.
+// Round r writes r into every byte of every setting in slot order, so torn settings, torn snapshots
+// (anything but a run of round r followed by a run of round r - 1) and sequence numbers going backwards are all caught.
+// Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -pthread -Isource tools/SettingsImageStress/SettingsImageStress.cpp source/SettingsImage.cpp -o SettingsImageStress
+//
+// Usage: SettingsImageStress [--readers <n>] [--rounds <n>] [--settings <n>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SettingsImage.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Zeroed and aligned for the sequence number, like a fresh file mapping
+	struct Memory
+	{
+		Memory() : words((SettingsImage::SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0) {}
+		void* Get() { return words.data(); }
+
+		std::vector<uint64_t> words;
+	};
+
+	std::string SettingName(size_t index)
+	{
+		return "Setting" + std::to_string(index);
+	}
+
+	bool CheckLimits()
+	{
+		bool success = true;
+		auto expect = [&success](bool condition, const char* message) {
+			if (!condition)
+			{
+				printf("FAILED: %s\n", message);
+				success = false;
+			}
+		};
+
+		Memory memory;
+		SettingsImage image(memory.Get());
+		expect(!image.IsValid(), "Zeroed memory is valid");
+		image.Initialize();
+		expect(image.IsValid(), "Initialized image is not valid");
+
+		const uint32_t dword = 1;
+		const uint8_t data[SettingsImage::MAX_DATA_SIZE + 1] {};
+		const std::string longestName(SettingsImage::MAX_NAME_LENGTH, 'N');
+		expect(image.Write(longestName.c_str(), SettingsImage::Type::Dword, &dword, sizeof(dword)), "Name of the maximum length was rejected");
+		expect(!image.Write((longestName + "N").c_str(), SettingsImage::Type::Dword, &dword, sizeof(dword)), "Name over the maximum length was accepted");
+		expect(image.Write("Data", SettingsImage::Type::Guid, data, SettingsImage::MAX_DATA_SIZE), "Data of the maximum size was rejected");
+		expect(!image.Write("Data", SettingsImage::Type::Guid, data, SettingsImage::MAX_DATA_SIZE + 1), "Data over the maximum size was accepted");
+
+		// Names are case insensitive, like registry values
+		const uint32_t updated = 2;
+		expect(image.Write("data", SettingsImage::Type::Dword, &updated, sizeof(updated)), "Update with a different case was rejected");
+
+		for (size_t i = 2; i < SettingsImage::MAX_SLOTS; i++)
+		{
+			expect(image.Write(SettingName(i).c_str(), SettingsImage::Type::Dword, &dword, sizeof(dword)), "Write within the slot limit was rejected");
+		}
+		expect(!image.Write("OneTooMany", SettingsImage::Type::Dword, &dword, sizeof(dword)), "Write past the slot limit was accepted");
+		expect(image.Write(SettingName(2).c_str(), SettingsImage::Type::Dword, &updated, sizeof(updated)), "Update of a full table was rejected");
+
+		std::vector<SettingsImage::Entry> entries;
+		uint32_t sequence;
+		expect(image.ReadAll(entries, sequence) && entries.size() == SettingsImage::MAX_SLOTS, "Full table did not read back");
+		if (entries.size() == SettingsImage::MAX_SLOTS)
+		{
+			expect(entries[0].name == longestName, "Name of the maximum length did not read back");
+			expect(entries[1].name == "Data" && entries[1].type == SettingsImage::Type::Dword && entries[1].size == sizeof(uint32_t)
+				&& memcmp(entries[1].data, &updated, sizeof(updated)) == 0, "Update with a different case did not replace the setting");
+		}
+
+		// A writer dying mid-write leaves the sequence odd, which readers can't get past until it is repaired
+		reinterpret_cast<SettingsImage::Layout*>(memory.Get())->sequence.fetch_add(1);
+		expect(!image.ReadAll(entries, sequence), "Image read in the middle of a write");
+		image.Repair();
+		expect(image.ReadAll(entries, sequence) && entries.size() == SettingsImage::MAX_SLOTS, "Repaired image did not read back");
+		image.Repair();
+		expect(image.GetSequence() == sequence, "Repairing an intact image changed it");
+
+		// Initialized memory is picked up by another process as is
+		SettingsImage other(memory.Get());
+		expect(other.IsValid() && other.ReadAll(entries, sequence) && entries.size() == SettingsImage::MAX_SLOTS, "Image not shared through memory");
+
+		printf("Limits: %zu character names, %zu byte values, %zu settings\n", SettingsImage::MAX_NAME_LENGTH, SettingsImage::MAX_DATA_SIZE,
+			SettingsImage::MAX_SLOTS);
+		return success;
+	}
+
+	bool Run(size_t numReaders, uint32_t numRounds, size_t numSettings)
+	{
+		Memory memory;
+		SettingsImage image(memory.Get());
+		image.Initialize();
+
+		std::vector<std::string> names;
+		for (size_t i = 0; i < numSettings; i++)
+		{
+			names.push_back(SettingName(i));
+		}
+
+		std::atomic<bool> writerDone { false };
+		double writerSeconds = 0.0;
+		std::thread writer([&] {
+			const auto start = Clock::now();
+			for (uint32_t round = 1; round <= numRounds; round++)
+			{
+				uint8_t data[SettingsImage::MAX_DATA_SIZE];
+				memset(data, static_cast<uint8_t>(round), sizeof(data));
+				for (size_t i = 0; i < numSettings; i++)
+				{
+					// Alternate the types and sizes, so readers also see a slot changing shape
+					const bool guid = (round + i) % 2 == 0;
+					image.Write(names[i].c_str(), guid ? SettingsImage::Type::Guid : SettingsImage::Type::Dword, data, guid ? 16 : 4);
+				}
+			}
+			writerSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+			writerDone.store(true, std::memory_order_release);
+		});
+
+		struct Reader
+		{
+			uint64_t reads = 0;
+			uint64_t failedReads = 0;
+			uint64_t errors = 0;
+		};
+		std::vector<Reader> readers(numReaders);
+		std::vector<std::thread> threads;
+		for (size_t r = 0; r < numReaders; r++)
+		{
+			threads.emplace_back([&, r] {
+				Reader& reader = readers[r];
+				std::vector<SettingsImage::Entry> entries;
+				uint32_t lastSequence = 0;
+				auto fail = [&reader](const char* message, size_t index) {
+					if (reader.errors++ < 10)
+					{
+						printf("FAILED: %s at setting %zu\n", message, index);
+					}
+				};
+
+				bool done;
+				do
+				{
+					done = writerDone.load(std::memory_order_acquire);
+
+					uint32_t sequence;
+					if (!image.ReadAll(entries, sequence))
+					{
+						reader.failedReads++;
+						continue;
+					}
+					reader.reads++;
+					if ((sequence & 1) != 0 || sequence < lastSequence)
+					{
+						fail("Sequence odd or going backwards", 0);
+					}
+					lastSequence = sequence;
+
+					// Slots are appended in the first round, so a snapshot may hold only some of them
+					if (entries.size() > numSettings || (done && entries.size() != numSettings))
+					{
+						fail("Unexpected number of settings", entries.size());
+						continue;
+					}
+					for (size_t i = 0; i < entries.size(); i++)
+					{
+						const SettingsImage::Entry& entry = entries[i];
+						const uint8_t round = entry.data[0];
+						const bool guid = (round + i) % 2 == 0;
+						if (entry.name != names[i] || entry.type != (guid ? SettingsImage::Type::Guid : SettingsImage::Type::Dword) || entry.size != (guid ? 16u : 4u)
+							|| std::any_of(entry.data, entry.data + entry.size, [round](uint8_t value) { return value != round; }))
+						{
+							fail("Torn setting", i);
+						}
+						else if (i != 0 && round != entries[0].data[0] && static_cast<uint8_t>(round + 1) != entries[0].data[0])
+						{
+							fail("Settings from more than two rounds", i);
+						}
+						else if (i != 0 && round != entries[i - 1].data[0] && round != static_cast<uint8_t>(entries[0].data[0] - 1))
+						{
+							fail("Settings out of order", i);
+						}
+						else if (done && round != static_cast<uint8_t>(numRounds))
+						{
+							fail("Last round missing", i);
+						}
+					}
+				}
+				while (!done);
+			});
+		}
+
+		writer.join();
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		// Reads give up after a thousand retries, which a writer going flat out can cause. Registry then retries with writers locked out
+		uint64_t reads = 0, failedReads = 0, errors = 0;
+		for (const Reader& reader : readers)
+		{
+			reads += reader.reads;
+			failedReads += reader.failedReads;
+			errors += reader.errors;
+		}
+		printf("%zu readers, %u rounds of %zu settings: %" PRIu64 " snapshots, %" PRIu64 " failed reads, %.0f ns per write\n",
+			numReaders, numRounds, numSettings, reads, failedReads, writerSeconds * 1e9 / (static_cast<double>(numRounds) * numSettings));
+		if (errors != 0 || image.GetSequence() != 2u * numRounds * numSettings)
+		{
+			printf("FAILED: %" PRIu64 " errors, sequence %u\n", errors, image.GetSequence());
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t numReaders = 3;
+	uint32_t numRounds = 50000;
+	size_t numSettings = 48;
+	for (int i = 1; i < argc; i++)
+	{
+		auto nextArg = [&]() -> const char* {
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "Missing value for %s\n", argv[i]);
+				exit(2);
+			}
+			return argv[++i];
+		};
+
+		if (strcmp(argv[i], "--readers") == 0) numReaders = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--rounds") == 0) numRounds = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--settings") == 0) numSettings = strtoul(nextArg(), nullptr, 10);
+		else
+		{
+			fprintf(stderr, "Usage: SettingsImageStress [--readers <n>] [--rounds <n>] [--settings <n>]\n");
+			return 2;
+		}
+	}
+	if (numReaders == 0 || numRounds == 0 || numSettings == 0 || numSettings > SettingsImage::MAX_SLOTS)
+	{
+		fprintf(stderr, "Readers and rounds must be non-zero, settings between 1 and %zu\n", SettingsImage::MAX_SLOTS);
+		return 2;
+	}
+
+	bool success = CheckLimits();
+	success &= Run(numReaders, numRounds, numSettings);
+
+	printf(success ? "All checks passed\n" : "Checks failed\n");
+	return success ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+#include "PeImage.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	template<typename T>
+	T Get(const std::vector<uint8_t>& data, size_t offset)
+	{
+		T value {};
+		if (offset + sizeof(T) <= data.size())
+		{
+			std::memcpy(&value, data.data() + offset, sizeof(T));
+		}
+		return value;
+	}
+}
+
+bool PeImage::LayOut(const std::vector<uint8_t>& file)
+{
+	const uint32_t peOffset = Get<uint32_t>(file, 0x3C);
+	if (Get<uint32_t>(file, peOffset) != 0x00004550 || Get<uint16_t>(file, peOffset + 24) != 0x10B)
+	{
+		return false;
+	}
+	const uint16_t numSections = Get<uint16_t>(file, peOffset + 6);
+	const uint16_t optionalHeaderSize = Get<uint16_t>(file, peOffset + 20);
+	const uint32_t sizeOfImage = Get<uint32_t>(file, peOffset + 24 + 56);
+	const uint32_t sizeOfHeaders = Get<uint32_t>(file, peOffset + 24 + 60);
+	if (sizeOfImage == 0 || sizeOfImage > 512 * 1024 * 1024 || sizeOfHeaders > file.size())
+	{
+		return false;
+	}
+
+	imageBase = Get<uint32_t>(file, peOffset + 24 + 28);
+	code.clear();
+	initializedData.clear();
+	data.assign(sizeOfImage, 0);
+	std::copy_n(file.begin(), std::min<size_t>(sizeOfHeaders, sizeOfImage), data.begin());
+	const size_t sectionTable = peOffset + 24 + optionalHeaderSize;
+	for (uint16_t i = 0; i < numSections; i++)
+	{
+		const size_t header = sectionTable + i * 40;
+		const uint32_t virtualSize = Get<uint32_t>(file, header + 8);
+		const uint32_t virtualAddress = Get<uint32_t>(file, header + 12);
+		const uint32_t rawSize = Get<uint32_t>(file, header + 16);
+		const uint32_t rawOffset = Get<uint32_t>(file, header + 20);
+		const uint32_t characteristics = Get<uint32_t>(file, header + 36);
+		if (virtualAddress >= sizeOfImage || rawOffset > file.size())
+		{
+			return false;
+		}
+		const size_t size = std::min({ static_cast<size_t>(rawSize), file.size() - rawOffset, static_cast<size_t>(sizeOfImage - virtualAddress) });
+		std::copy_n(file.begin() + rawOffset, size, data.begin() + virtualAddress);
+		const PeSection section { virtualAddress, std::min<size_t>(static_cast<size_t>(virtualAddress) + virtualSize, sizeOfImage) };
+		if ((characteristics & 0x20000020) != 0)
+		{
+			code.push_back(section);
+		}
+		else if ((characteristics & 0x00000040) != 0)
+		{
+			initializedData.push_back(section);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct PeSection
+{
+	size_t begin, end;
+};
+
+// A 32-bit PE file mapped to its virtual addresses, like the loader does
+struct PeImage
+{
+	std::vector<uint8_t> data;
+	std::vector<PeSection> code;
+	std::vector<PeSection> initializedData; // Not executable
+	uint32_t imageBase = 0;
+
+	// Returns false if file is not a 32-bit PE image
+	bool LayOut(const std::vector<uint8_t>& file);
+};
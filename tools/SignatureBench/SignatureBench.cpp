@@ -0,0 +1,440 @@
+// Measures signature scanning on a synthetic 32-bit PE image with every signature from OnInitializeHook embedded in it,
+// so scanner changes can be compared without the demos. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/SignatureBench/*.cpp source/SignatureNearMiss.cpp -o SignatureBench
+//
+// Usage: SignatureBench [--size <MB>] [--seed <n>] [--iterations <n>] [--write <path>] [--input <path>] [--near-miss <k>]
+//
+// --near-miss runs the approximate search used by the SignatureDiagnostics option. On a synthetic image every signature
+// gets k of its bytes changed and must still be found. With --input, signatures without exact matches get their closest candidates listed
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SignatureNearMiss.h"
+#include "SyntheticImage.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Keeps the scans from being optimized away
+	volatile size_t resultSink;
+
+	// Keep in sync with OnInitializeHook. count is what the lookup asks for, and every lookup stops once it has that many
+	// matches, like hook::pattern. Exact lookups (get_one, count) fail with fewer, while get_pattern and count_hint don't
+	struct Lookup
+	{
+		const char* name;
+		const char* signature;
+		size_t count;
+		bool exact;
+	};
+
+	const Lookup LOOKUPS[] = {
+		{ "is_windowed (Acclaim)", "56 0F 85 ? ? ? ? FF D7 50 FF D3", 1, false },
+		{ "is_windowed (Acclaim Debug)", "83 F8 01 0F 85 ? ? ? ? 8B F4", 1, false },
+		{ "is_windowed (THQ)", "53 0F 85 ? ? ? ? FF D6 50 FF D7", 1, false },
+		{ "get_version", "53 57 32 DB 33 FF 57 89 44 24 48", 1, false },
+		{ "get_version (Debug build)", "53 56 57 8D BD ? ? ? ? B9 ? ? ? ? B8 ? ? ? ? F3 AB C6 45 EF 00", 1, false },
+		{ "lock_vb", "53 8D 5E 1C C7 03 ? ? ? ? 76 04 33 C0 5B C3", 1, true },
+		{ "set_notifications", "FF 51 0C 85 C0 74 0F 8B 4E 28 E8", 1, false },
+		{ "exit_process", "75 11 6A 00 FF 15 ? ? ? ? 5F", 1, false },
+		{ "set_ar_func (June/July)", "E8 ? ? ? ? 8B F8 85 FF 74 55", 1, false },
+		{ "set_ar_func (May)", "0F 94 C2 56 E8 ? ? ? ? 8B F8 85 FF", 1, false },
+		{ "widescreen_flag_and_mult", "A1 ? ? ? ? 85 C0 74 10 D9 44 24 04 D8 0D ? ? ? ? D9 99 A8 00 00 00", 1, true },
+		{ "widescreen_div", "D8 0D ? ? ? ? C3 D9 81 A8 00 00 00 C3", 1, false },
+		{ "demo_unlock", "8B 49 2C 8B 11 8D 44 24 10 50 55 68 ? ? ? ? FF 12", 1, false },
+		{ "courses_lock1 (June/July)", "83 7F 18 01 6A 01 68 ? ? ? ? 0F 84", 1, false },
+		{ "courses_lock1 (May)", "74 0F 8B 94 24 ? ? ? ? 52", 1, false },
+		{ "courses_lock2", "8B 0C 81 3B CD 74 02 89 29", 4, false },
+		{ "forced_course_begin", "72 B4 8B 47 10 8B 90 1C 01 00 00 2B 90 18 01 00 00", 1, false },
+		{ "forced_course_end", "E8 ? ? ? ? 39 2D ? ? ? ? 0F 84 ? ? ? ? 8B 4F 10 8B 91 1C 01 00 00", 1, false },
+		{ "race_modes", "8B CD 8B 0C 81 3B CB 74 02 89 19", 2, false },
+		{ "up_to_6_laps", "46 83 FE ? 89 74 24 08 0F 8C", 1, false },
+		{ "max_opponents_at_night", "BB 04 00 00 00 8B 51 70 8B 42 54", 1, false },
+		{ "arcade_menu_unlock (June/July only)", "83 F8 02 74 2E 83 F8 09 74 29 83 F8 FF 7E 24", 1, true },
+		{ "arcade_menu_unlock (May)", "85 C0 74 33 83 F8 09 74 2E 83 F8 05 74 29 83 F8 FF", 1, true },
+		{ "cheats_multiplay_hide", "E8 ? ? ? ? BB ? ? ? ? E8 ? ? ? ? 8B 15 ? ? ? ?", 1, true },
+		{ "driver_name (Acclaim Juiced)", "B8 ? ? ? ? 8D 4C 24 18 E8 ? ? ? ? 8B 7D 68", 1, false },
+		{ "get_core_count", "03 C8 83 F9 20 7C EE 5F", 1, false },
+		{ "global_memory_status", "3B 4C 24 08 76 07 83 7C 24 ? 00 77 20", 1, true },
+		{ "allocs", "8D 14 9D ? ? ? ? 52 E8 ? ? ? ? 83 C4 04 8B E8", 2, true },
+		{ "languages_switch", "B8 05 00 00 00 C3 B8 06 00 00 00 C3 B8 07 00 00 00 C3", 1, true },
+		{ "cms_player_crew_collection (January 2005)", "68 ? ? ? ? E8 ? ? ? ? 8B 85 84 00 00 00 8B 08 8B 11", 1, false },
+		{ "cms_player_crew_collection (April/May)", "68 ? ? ? ? E8 ? ? ? ? 8B 9D 84 00 00 00 8B 33 33 C0", 1, false },
+		{ "setup_race", "E8 ? ? ? ? 8B 8C 24 ? ? ? ? E8 ? ? ? ? 5F 5E 5B 8B E5 5D C2 0C 00", 1, false },
+		{ "setup_info_for_gamemode", "C7 44 24 ? ? ? ? ? E8 ? ? ? ? B8 01 00 00 00", 1, false },
+		{ "endless_demo", "80 7C D0 32 02 75 ? 8B 5E 70 89 3B", 1, false },
+		{ "driver_name_switch", "FF 52 08 83 C0 FF 83 F8 ? 77 ? FF 24 85 ? ? ? ? B8", 1, false },
+		{ "driver_name (THQ Juiced)", "B8 ? ? ? ? 8D 4C 24 18 E8 ? ? ? ? 8B ? 64", 1, false },
+		{ "money", "51 C7 46 0C A8 61 00 00", 1, false },
+		{ "string_ptr (January)", "B8 ? ? ? ? 8D 91 ? ? ? ? 89 99 ? ? ? ? 2B D0 8A 08 88 0C 02 03 C3 84 C9 75 F5 5E", 1, false },
+		{ "string_ptr (April/May)", "B8 ? ? ? ? 8B CA 2B C8 C7 82 ? ? ? ? ? ? ? ? 8D B1 ? ? ? ? 8D A4 24 00 00 00 00", 1, false },
+	};
+
+	// The scanner before signatures were parsed at compile time: parses the string on every lookup
+	// and compares every position byte by byte
+	template<typename Func>
+	void NaiveForEachMatch(const uint8_t* begin, const uint8_t* end, const char* signature, Func&& func)
+	{
+		std::vector<uint8_t> bytes, mask;
+		Signature::details::Tokenize(signature, [&](uint8_t byte, bool isWildcard) {
+			bytes.push_back(byte);
+			mask.push_back(isWildcard ? 0x00 : 0xFF);
+		});
+
+		if (static_cast<size_t>(end - begin) < bytes.size())
+		{
+			return;
+		}
+		for (const uint8_t* ptr = begin; ptr <= end - bytes.size(); ptr++)
+		{
+			bool matches = true;
+			for (size_t i = 0; i < bytes.size(); i++)
+			{
+				if ((ptr[i] & mask[i]) != bytes[i])
+				{
+					matches = false;
+					break;
+				}
+			}
+			if (matches && !func(ptr))
+			{
+				break;
+			}
+		}
+	}
+
+	struct Scanner
+	{
+		const char* name;
+		// Returns the number of matches found, stopping after maxCount (or never if 0)
+		size_t (*scan)(const uint8_t* begin, const uint8_t* end, const BenchSignature& signature, const char* text, size_t maxCount, std::vector<size_t>* offsets);
+	};
+
+	size_t ScanSignature(const uint8_t* begin, const uint8_t* end, const BenchSignature& signature, const char*, size_t maxCount, std::vector<size_t>* offsets)
+	{
+		size_t count = 0;
+		Signature::ForEachMatch(begin, end, signature.View(), [&](const uint8_t* match) {
+			if (offsets != nullptr) offsets->push_back(static_cast<size_t>(match - begin));
+			return ++count != maxCount;
+		});
+		return count;
+	}
+
+	size_t ScanNaive(const uint8_t* begin, const uint8_t* end, const BenchSignature&, const char* text, size_t maxCount, std::vector<size_t>* offsets)
+	{
+		size_t count = 0;
+		NaiveForEachMatch(begin, end, text, [&](const uint8_t* match) {
+			if (offsets != nullptr) offsets->push_back(static_cast<size_t>(match - begin));
+			return ++count != maxCount;
+		});
+		return count;
+	}
+
+	const Scanner SCANNERS[] = {
+		{ "Signature::ForEachMatch", ScanSignature },
+		{ "Naive (runtime parse)", ScanNaive },
+	};
+
+	// Reference for the near-miss search: every position compared in full
+	std::vector<Signature::NearMiss> NaiveNearMisses(const uint8_t* begin, const uint8_t* end, const Signature::PatternView& pattern, size_t maxMismatches, size_t maxResults)
+	{
+		std::vector<Signature::NearMiss> results;
+		for (const uint8_t* ptr = begin; ptr + pattern.size <= end; ptr++)
+		{
+			size_t mismatches = 0;
+			for (size_t i = 0; i < pattern.size; i++)
+			{
+				if ((ptr[i] & pattern.mask[i]) != pattern.bytes[i]) mismatches++;
+			}
+			if (mismatches <= maxMismatches) results.push_back({ ptr, mismatches });
+		}
+		std::stable_sort(results.begin(), results.end(), [](const Signature::NearMiss& left, const Signature::NearMiss& right) {
+			return left.mismatches < right.mismatches;
+		});
+		if (results.size() > maxResults) results.resize(maxResults);
+		return results;
+	}
+
+	double Median(std::vector<double> values)
+	{
+		std::sort(values.begin(), values.end());
+		return values[values.size() / 2];
+	}
+
+	double ElapsedMs(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	[[noreturn]] void Usage()
+	{
+		fprintf(stderr, "Usage: SignatureBench [--size <MB>] [--seed <n>] [--iterations <n>] [--write <path>] [--input <path>] [--near-miss <k>]\n");
+		exit(2);
+	}
+
+	constexpr size_t NEAR_MISS_RESULTS = 4;
+
+	// Lists the closest candidates of signatures that don't match a real image
+	void ReportNearMisses(const SyntheticImage& image, const std::vector<BenchSignature>& signatures, size_t maxMismatches)
+	{
+		const uint8_t* begin = image.data.data();
+		const uint8_t* end = begin + image.data.size();
+
+		printf("\nNear misses (up to %zu mismatches)\n", maxMismatches);
+		const auto start = Clock::now();
+		for (size_t i = 0; i < signatures.size(); i++)
+		{
+			if (ScanSignature(begin, end, signatures[i], LOOKUPS[i].signature, 1, nullptr) != 0)
+			{
+				continue;
+			}
+
+			const auto nearMisses = Signature::FindNearMisses(begin, end, signatures[i].View(), maxMismatches, NEAR_MISS_RESULTS);
+			printf("  %s: %s\n", LOOKUPS[i].name, nearMisses.empty() ? "no candidates" : "");
+			for (const Signature::NearMiss& nearMiss : nearMisses)
+			{
+				printf("    file offset 0x%zX, %zu mismatches: %s\n", static_cast<size_t>(nearMiss.match - begin), nearMiss.mismatches,
+					Signature::FormatNearMiss(signatures[i].View(), nearMiss.match).c_str());
+			}
+		}
+		printf("Searched in %.2f ms\n", ElapsedMs(start));
+	}
+
+	// Changes k bytes of the first embedded copy of every signature, then checks the search still finds it,
+	// and gives the same results as comparing every position in full
+	bool CheckNearMisses(const SyntheticImage& image, const std::vector<BenchSignature>& signatures, size_t maxMismatches, uint32_t seed, int iterations)
+	{
+		std::vector<uint8_t> data = image.data;
+		std::mt19937 rng(seed);
+		std::vector<size_t> changed(signatures.size(), 0);
+		for (size_t i = 0; i < signatures.size(); i++)
+		{
+			if (image.expectedOffsets[i].empty())
+			{
+				continue;
+			}
+
+			std::vector<size_t> fixed;
+			for (size_t j = 0; j < signatures[i].mask.size(); j++)
+			{
+				if (signatures[i].mask[j] != 0) fixed.push_back(j);
+			}
+			std::shuffle(fixed.begin(), fixed.end(), rng);
+			changed[i] = std::min(maxMismatches, fixed.size() - 1);
+			for (size_t j = 0; j < changed[i]; j++)
+			{
+				data[image.expectedOffsets[i][0] + fixed[j]] ^= static_cast<uint8_t>(1 + rng() % 255);
+			}
+		}
+
+		const uint8_t* begin = data.data();
+		const uint8_t* end = begin + data.size();
+
+		// The full comparison is too slow to repeat, so it's timed only once
+		size_t failures = 0, outranked = 0;
+		double naiveMs = 0.0;
+		for (size_t i = 0; i < signatures.size(); i++)
+		{
+			const auto nearMisses = Signature::FindNearMisses(begin, end, signatures[i].View(), maxMismatches, NEAR_MISS_RESULTS);
+			const auto naiveStart = Clock::now();
+			const auto expected = NaiveNearMisses(begin, end, signatures[i].View(), maxMismatches, NEAR_MISS_RESULTS);
+			naiveMs += ElapsedMs(naiveStart);
+			const bool sameAsNaive = nearMisses.size() == expected.size() && std::equal(nearMisses.begin(), nearMisses.end(), expected.begin(),
+				[](const Signature::NearMiss& left, const Signature::NearMiss& right) { return left.match == right.match && left.mismatches == right.mismatches; });
+			const bool foundChanged = image.expectedOffsets[i].empty() || std::any_of(nearMisses.begin(), nearMisses.end(), [&](const Signature::NearMiss& nearMiss) {
+				return nearMiss.match == begin + image.expectedOffsets[i][0] && nearMiss.mismatches == changed[i];
+			});
+			// Short signatures can have closer candidates by chance, which is fine as long as they really are closer
+			const bool isOutranked = !foundChanged && nearMisses.size() == NEAR_MISS_RESULTS && nearMisses.back().mismatches <= changed[i];
+			if (!sameAsNaive || (!foundChanged && !isOutranked))
+			{
+				printf("  %s: %s\n", LOOKUPS[i].name, sameAsNaive ? "changed copy not found" : "differs from the full comparison");
+				failures++;
+			}
+			else if (isOutranked)
+			{
+				outranked++;
+			}
+		}
+		printf("\n%-24s correctness: %s", "Near miss search", failures == 0 ? "PASS" : "FAIL");
+		printf(outranked != 0 ? " (%zu signatures have closer candidates than the changed copy)\n" : "\n", outranked);
+
+		std::vector<double> times;
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			size_t found = 0;
+			const auto start = Clock::now();
+			for (const BenchSignature& signature : signatures)
+			{
+				found += Signature::FindNearMisses(begin, end, signature.View(), maxMismatches, NEAR_MISS_RESULTS).size();
+			}
+			times.push_back(ElapsedMs(start));
+			resultSink = found;
+		}
+		printf("%-24s %12s %12s\n", "Near miss search", "All (ms)", "MB/s");
+		const double imageMB = data.size() / (1024.0 * 1024.0);
+		for (const auto& [name, time] : { std::make_pair("FindNearMisses", Median(times)), std::make_pair("Full comparison", naiveMs) })
+		{
+			printf("%-24s %12.2f %12.1f\n", name, time, (imageMB * signatures.size()) / (time / 1000.0));
+		}
+		return failures == 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t textSize = 6 * 1024 * 1024;
+	uint32_t seed = 1;
+	int iterations = 5;
+	std::string writePath;
+	std::string inputPath;
+	int nearMiss = -1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		auto nextArg = [&]() -> const char* {
+			if (i + 1 >= argc) Usage();
+			return argv[++i];
+		};
+
+		if (strcmp(argv[i], "--size") == 0) textSize = static_cast<size_t>(atof(nextArg()) * 1024 * 1024);
+		else if (strcmp(argv[i], "--seed") == 0) seed = static_cast<uint32_t>(strtoul(nextArg(), nullptr, 0));
+		else if (strcmp(argv[i], "--iterations") == 0) iterations = std::max(1, atoi(nextArg()));
+		else if (strcmp(argv[i], "--write") == 0) writePath = nextArg();
+		else if (strcmp(argv[i], "--input") == 0) inputPath = nextArg();
+		else if (strcmp(argv[i], "--near-miss") == 0) nearMiss = std::max(0, atoi(nextArg()));
+		else Usage();
+	}
+
+	std::vector<BenchSignature> signatures;
+	for (const Lookup& lookup : LOOKUPS)
+	{
+		signatures.emplace_back(lookup.name, lookup.signature, lookup.count);
+	}
+
+	SyntheticImage image;
+	bool checkResults = true;
+	if (!inputPath.empty())
+	{
+		// Real images have no known offsets, so only counts are reported
+		std::ifstream file(inputPath, std::ios::binary);
+		if (!file)
+		{
+			fprintf(stderr, "Failed to open %s\n", inputPath.c_str());
+			return 2;
+		}
+		image.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		image.textEnd = image.data.size();
+		checkResults = false;
+		printf("Image: %s, %.2f MB\n", inputPath.c_str(), image.data.size() / (1024.0 * 1024.0));
+	}
+	else
+	{
+		const auto start = Clock::now();
+		size_t unresolvedMatches = 0;
+		image = SyntheticImage::Generate(signatures, textSize, seed, unresolvedMatches);
+		printf("Image: synthetic, seed %u, %.2f MB (.text %.2f MB), generated in %.0f ms\n", seed, image.data.size() / (1024.0 * 1024.0),
+			(image.textEnd - image.textBegin) / (1024.0 * 1024.0), ElapsedMs(start));
+		if (unresolvedMatches != 0)
+		{
+			printf("Warning: %zu overlapping matches between embedded signatures\n", unresolvedMatches);
+		}
+
+		if (!writePath.empty())
+		{
+			if (!image.Write(writePath))
+			{
+				fprintf(stderr, "Failed to write %s\n", writePath.c_str());
+				return 2;
+			}
+			printf("Written to %s\n", writePath.c_str());
+		}
+	}
+
+	const uint8_t* begin = image.data.data();
+	const uint8_t* end = begin + image.data.size();
+	const double imageMB = image.data.size() / (1024.0 * 1024.0);
+	bool success = true;
+
+	// Correctness: every embedded copy and nothing else, for every scanner
+	if (checkResults)
+	{
+		for (const Scanner& scanner : SCANNERS)
+		{
+			size_t failures = 0;
+			for (size_t i = 0; i < signatures.size(); i++)
+			{
+				std::vector<size_t> offsets;
+				scanner.scan(begin, end, signatures[i], LOOKUPS[i].signature, 0, &offsets);
+				if (offsets != image.expectedOffsets[i])
+				{
+					printf("  %s: %s found %zu matches, expected %zu\n", scanner.name, LOOKUPS[i].name, offsets.size(), image.expectedOffsets[i].size());
+					failures++;
+				}
+			}
+			printf("%-24s correctness: %s\n", scanner.name, failures == 0 ? "PASS" : "FAIL");
+			success = success && failures == 0;
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < signatures.size(); i++)
+		{
+			const size_t count = ScanSignature(begin, end, signatures[i], LOOKUPS[i].signature, 0, nullptr);
+			printf("  %-28s %zu matches\n", LOOKUPS[i].name, count);
+		}
+	}
+
+	printf("\n%-24s %12s %12s %12s\n", "Scanner", "Init (ms)", "Full (ms)", "MB/s");
+	for (const Scanner& scanner : SCANNERS)
+	{
+		std::vector<double> initTimes, fullTimes;
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			// Init: every lookup the way OnInitializeHook performs it, stopping as soon as the answer is known
+			auto start = Clock::now();
+			size_t found = 0;
+			for (size_t i = 0; i < signatures.size(); i++)
+			{
+				found += scanner.scan(begin, end, signatures[i], LOOKUPS[i].signature, LOOKUPS[i].count, nullptr);
+			}
+			initTimes.push_back(ElapsedMs(start));
+
+			// Full: every signature scanned to the end of the image, like lookups failing on a different demo
+			start = Clock::now();
+			for (size_t i = 0; i < signatures.size(); i++)
+			{
+				found += scanner.scan(begin, end, signatures[i], LOOKUPS[i].signature, 0, nullptr);
+			}
+			fullTimes.push_back(ElapsedMs(start));
+			resultSink = found;
+		}
+
+		const double fullMs = Median(fullTimes);
+		printf("%-24s %12.2f %12.2f %12.1f\n", scanner.name, Median(initTimes), fullMs, (imageMB * signatures.size()) / (fullMs / 1000.0));
+	}
+
+	if (nearMiss >= 0)
+	{
+		if (checkResults)
+		{
+			success = CheckNearMisses(image, signatures, static_cast<size_t>(nearMiss), seed, iterations) && success;
+		}
+		else
+		{
+			ReportNearMisses(image, signatures, static_cast<size_t>(nearMiss));
+		}
+	}
+
+	return success ? 0 : 1;
+}
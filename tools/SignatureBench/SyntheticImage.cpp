@@ -0,0 +1,458 @@
+#include "SyntheticImage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+BenchSignature::BenchSignature(const char* name, std::string_view signature, size_t count)
+	: name(name), count(count)
+{
+	Signature::details::Tokenize(signature, [this](uint8_t byte, bool isWildcard) {
+		bytes.push_back(byte);
+		mask.push_back(isWildcard ? 0x00 : 0xFF);
+	});
+	const auto firstByte = std::find(mask.begin(), mask.end(), 0xFF);
+	if (firstByte == mask.end())
+	{
+		throw std::invalid_argument("Signature must contain at least one byte that is not a wildcard");
+	}
+	anchor = static_cast<size_t>(firstByte - mask.begin());
+}
+
+namespace
+{
+	constexpr size_t ALIGNMENT = 0x1000;
+	constexpr uint32_t IMAGE_BASE = 0x400000;
+
+	// Offsets into the headers, so the generator does not depend on winnt.h
+	constexpr size_t PE_HEADER_OFFSET = 0x80;
+	constexpr size_t FILE_HEADER_OFFSET = PE_HEADER_OFFSET + 4;
+	constexpr size_t OPTIONAL_HEADER_OFFSET = FILE_HEADER_OFFSET + 20;
+	constexpr size_t OPTIONAL_HEADER_SIZE = 224;
+	constexpr size_t SECTION_HEADERS_OFFSET = OPTIONAL_HEADER_OFFSET + OPTIONAL_HEADER_SIZE;
+	constexpr size_t SECTION_HEADER_SIZE = 40;
+
+	size_t AlignUp(size_t value)
+	{
+		return (value + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	void Put16(std::vector<uint8_t>& data, size_t offset, uint16_t value)
+	{
+		data[offset] = static_cast<uint8_t>(value);
+		data[offset + 1] = static_cast<uint8_t>(value >> 8);
+	}
+
+	void Put32(std::vector<uint8_t>& data, size_t offset, uint32_t value)
+	{
+		Put16(data, offset, static_cast<uint16_t>(value));
+		Put16(data, offset + 2, static_cast<uint16_t>(value >> 16));
+	}
+
+	struct Section
+	{
+		const char* name;
+		size_t offset;
+		size_t size;
+		uint32_t characteristics;
+	};
+
+	void WriteHeaders(std::vector<uint8_t>& data, const std::vector<Section>& sections)
+	{
+		// DOS header
+		data[0] = 'M';
+		data[1] = 'Z';
+		Put32(data, 0x3C, PE_HEADER_OFFSET);
+
+		data[PE_HEADER_OFFSET] = 'P';
+		data[PE_HEADER_OFFSET + 1] = 'E';
+
+		// File header
+		Put16(data, FILE_HEADER_OFFSET + 0, 0x14C); // i386
+		Put16(data, FILE_HEADER_OFFSET + 2, static_cast<uint16_t>(sections.size()));
+		Put16(data, FILE_HEADER_OFFSET + 16, OPTIONAL_HEADER_SIZE);
+		Put16(data, FILE_HEADER_OFFSET + 18, 0x010F); // Executable, 32-bit, relocations/line numbers/symbols stripped
+
+		// Optional header
+		const size_t o = OPTIONAL_HEADER_OFFSET;
+		Put16(data, o + 0, 0x10B);
+		Put32(data, o + 4, static_cast<uint32_t>(sections[0].size));
+		Put32(data, o + 16, static_cast<uint32_t>(sections[0].offset));
+		Put32(data, o + 20, static_cast<uint32_t>(sections[0].offset));
+		Put32(data, o + 24, static_cast<uint32_t>(sections[1].offset));
+		Put32(data, o + 28, IMAGE_BASE);
+		Put32(data, o + 32, ALIGNMENT);
+		Put32(data, o + 36, ALIGNMENT);
+		Put16(data, o + 40, 4);
+		Put16(data, o + 48, 4);
+		Put32(data, o + 56, static_cast<uint32_t>(data.size()));
+		Put32(data, o + 60, ALIGNMENT);
+		Put16(data, o + 68, 2); // GUI subsystem
+		Put32(data, o + 72, 0x100000);
+		Put32(data, o + 76, 0x1000);
+		Put32(data, o + 80, 0x100000);
+		Put32(data, o + 84, 0x1000);
+		Put32(data, o + 92, 16);
+
+		for (size_t i = 0; i < sections.size(); i++)
+		{
+			const size_t s = SECTION_HEADERS_OFFSET + (i * SECTION_HEADER_SIZE);
+			std::copy_n(sections[i].name, std::min<size_t>(strlen(sections[i].name), 8), data.begin() + s);
+			Put32(data, s + 8, static_cast<uint32_t>(sections[i].size));
+			Put32(data, s + 12, static_cast<uint32_t>(sections[i].offset));
+			Put32(data, s + 16, static_cast<uint32_t>(sections[i].size));
+			Put32(data, s + 20, static_cast<uint32_t>(sections[i].offset));
+			Put32(data, s + 36, sections[i].characteristics);
+		}
+	}
+
+	// Emits x86-like instructions with a rough distribution of what MSVC generates,
+	// so memchr sees a realistic density of common anchor bytes (8B, E8, 83, 89...)
+	class CodeGenerator
+	{
+	public:
+		CodeGenerator(std::mt19937& rng, size_t textBegin, size_t textSize)
+			: m_rng(rng), m_textBegin(textBegin), m_textSize(textSize)
+		{
+		}
+
+		void Fill(uint8_t* begin, uint8_t* end)
+		{
+			uint8_t* ptr = begin;
+			while (ptr < end)
+			{
+				uint8_t instruction[16];
+				const size_t length = Emit(instruction, static_cast<size_t>(ptr - begin));
+				const size_t bytesToCopy = std::min<size_t>(length, end - ptr);
+				std::copy_n(instruction, bytesToCopy, ptr);
+				ptr += bytesToCopy;
+			}
+		}
+
+	private:
+		uint8_t Byte() { return static_cast<uint8_t>(m_rng()); }
+		uint8_t Reg() { return static_cast<uint8_t>(m_rng() % 8); }
+
+		void Imm32(uint8_t* out, uint32_t value)
+		{
+			out[0] = static_cast<uint8_t>(value);
+			out[1] = static_cast<uint8_t>(value >> 8);
+			out[2] = static_cast<uint8_t>(value >> 16);
+			out[3] = static_cast<uint8_t>(value >> 24);
+		}
+
+		// Addresses inside the image, like the absolute operands of real code
+		uint32_t Address()
+		{
+			return IMAGE_BASE + static_cast<uint32_t>(m_textBegin + (m_rng() % (m_textSize * 2)));
+		}
+
+		// ModRM for a register or a stack/structure operand, returns the total length of ModRM and displacement
+		size_t ModRM(uint8_t* out, uint8_t reg)
+		{
+			const uint32_t form = m_rng() % 8;
+			if (form < 3)
+			{
+				out[0] = static_cast<uint8_t>(0xC0 | (reg << 3) | Reg());
+				return 1;
+			}
+			if (form < 5)
+			{
+				// [esp+disp8]
+				out[0] = static_cast<uint8_t>(0x44 | (reg << 3));
+				out[1] = 0x24;
+				out[2] = static_cast<uint8_t>((m_rng() % 64) * 4);
+				return 3;
+			}
+			if (form < 7)
+			{
+				// [reg+disp8]
+				uint8_t base = Reg();
+				if (base == 4) base = 6;
+				out[0] = static_cast<uint8_t>(0x40 | (reg << 3) | base);
+				out[1] = static_cast<uint8_t>((m_rng() % 64) * 4);
+				return 2;
+			}
+			// [disp32]
+			out[0] = static_cast<uint8_t>(0x05 | (reg << 3));
+			Imm32(out + 1, Address());
+			return 5;
+		}
+
+		size_t Emit(uint8_t* out, size_t position)
+		{
+			const uint32_t kind = m_rng() % 100;
+			if (kind < 22)
+			{
+				out[0] = 0x8B; // mov r32, r/m32
+				return 1 + ModRM(out + 1, Reg());
+			}
+			if (kind < 30)
+			{
+				out[0] = 0x89; // mov r/m32, r32
+				return 1 + ModRM(out + 1, Reg());
+			}
+			if (kind < 38)
+			{
+				out[0] = static_cast<uint8_t>(0x50 + Reg()); // push r32
+				return 1;
+			}
+			if (kind < 42)
+			{
+				out[0] = static_cast<uint8_t>(0x58 + Reg()); // pop r32
+				return 1;
+			}
+			if (kind < 50)
+			{
+				// call rel32, to a plausible target within .text
+				out[0] = 0xE8;
+				const int64_t target = static_cast<int64_t>(m_rng() % m_textSize);
+				Imm32(out + 1, static_cast<uint32_t>(target - static_cast<int64_t>(position + 5)));
+				return 5;
+			}
+			if (kind < 57)
+			{
+				out[0] = static_cast<uint8_t>(0x70 + (m_rng() % 16)); // jcc rel8
+				out[1] = Byte();
+				return 2;
+			}
+			if (kind < 63)
+			{
+				out[0] = 0x83; // add/sub/cmp r/m32, imm8
+				const size_t length = 1 + ModRM(out + 1, static_cast<uint8_t>(m_rng() % 2 == 0 ? 7 : (m_rng() % 2 == 0 ? 0 : 5)));
+				out[length] = static_cast<uint8_t>(m_rng() % 32);
+				return length + 1;
+			}
+			if (kind < 68)
+			{
+				out[0] = 0x8D; // lea
+				return 1 + ModRM(out + 1, Reg());
+			}
+			if (kind < 72)
+			{
+				out[0] = static_cast<uint8_t>(0x84 + (m_rng() % 2)); // test
+				return 1 + ModRM(out + 1, Reg());
+			}
+			if (kind < 75)
+			{
+				out[0] = static_cast<uint8_t>(0x31 + (m_rng() % 2) * 2); // xor
+				out[1] = static_cast<uint8_t>(0xC0 | (Reg() << 3) | Reg());
+				return 2;
+			}
+			if (kind < 79)
+			{
+				out[0] = static_cast<uint8_t>(0xB8 + Reg()); // mov r32, imm32
+				Imm32(out + 1, m_rng() % 2 == 0 ? Address() : m_rng() % 256);
+				return 5;
+			}
+			if (kind < 82)
+			{
+				out[0] = 0x6A; // push imm8
+				out[1] = static_cast<uint8_t>(m_rng() % 64);
+				return 2;
+			}
+			if (kind < 84)
+			{
+				out[0] = 0x68; // push imm32
+				Imm32(out + 1, Address());
+				return 5;
+			}
+			if (kind < 89)
+			{
+				out[0] = static_cast<uint8_t>(0xD8 + (m_rng() % 2) * 1); // x87 arithmetic/loads
+				return 1 + ModRM(out + 1, Reg());
+			}
+			if (kind < 91)
+			{
+				out[0] = 0x0F; // jcc rel32/setcc/movzx
+				out[1] = static_cast<uint8_t>(m_rng() % 2 == 0 ? 0x80 + (m_rng() % 16) : 0xB6);
+				out[2] = Byte();
+				return 3;
+			}
+			if (kind < 94)
+			{
+				out[0] = 0xE9; // jmp rel32
+				Imm32(out + 1, static_cast<uint32_t>(m_rng() % 0x1000));
+				return 5;
+			}
+			if (kind < 97)
+			{
+				// Function epilogue and alignment padding
+				out[0] = 0xC3;
+				const size_t padding = m_rng() % 8;
+				std::fill_n(out + 1, padding, 0xCC);
+				return 1 + padding;
+			}
+			out[0] = 0xC2; // ret imm16
+			out[1] = static_cast<uint8_t>((m_rng() % 8) * 4);
+			out[2] = 0x00;
+			return 3;
+		}
+
+		std::mt19937& m_rng;
+		const size_t m_textBegin;
+		const size_t m_textSize;
+	};
+
+	bool MatchesAt(const uint8_t* data, const BenchSignature& signature)
+	{
+		for (size_t i = 0; i < signature.bytes.size(); i++)
+		{
+			if ((data[i] & signature.mask[i]) != signature.bytes[i])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+SyntheticImage SyntheticImage::Generate(const std::vector<BenchSignature>& signatures, size_t textSize, uint32_t seed, size_t& unresolvedMatches)
+{
+	std::mt19937 rng(seed);
+
+	SyntheticImage image;
+
+	textSize = AlignUp(textSize);
+	const size_t rdataSize = AlignUp(textSize / 4);
+	const size_t dataSize = AlignUp(textSize / 8);
+
+	std::vector<Section> sections = {
+		{ ".text", ALIGNMENT, textSize, 0x60000020 },
+		{ ".rdata", ALIGNMENT + textSize, rdataSize, 0x40000040 },
+		{ ".data", ALIGNMENT + textSize + rdataSize, dataSize, 0xC0000040 },
+	};
+	image.data.resize(sections.back().offset + sections.back().size);
+	WriteHeaders(image.data, sections);
+
+	image.textBegin = sections[0].offset;
+	image.textEnd = sections[0].offset + sections[0].size;
+
+	CodeGenerator code(rng, image.textBegin, textSize);
+	code.Fill(image.data.data() + image.textBegin, image.data.data() + image.textEnd);
+
+	// Read-only data is mostly floats, strings and vtables, writable data is mostly zeroes
+	for (size_t i = sections[1].offset; i < sections[1].offset + sections[1].size; i += 4)
+	{
+		float value = std::uniform_real_distribution<float>(-1000.0f, 1000.0f)(rng);
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		Put32(image.data, i, bits);
+	}
+	for (size_t i = sections[2].offset; i < sections[2].offset + sections[2].size; i += 64)
+	{
+		image.data[i] = static_cast<uint8_t>(rng());
+	}
+
+	// Embed every copy of every signature at a random offset within its own slot of .text, in a random order
+	std::vector<size_t> embeds;
+	for (size_t i = 0; i < signatures.size(); i++)
+	{
+		embeds.insert(embeds.end(), signatures[i].count, i);
+	}
+	std::shuffle(embeds.begin(), embeds.end(), rng);
+
+	size_t maxSignatureSize = 0;
+	for (const BenchSignature& signature : signatures)
+	{
+		maxSignatureSize = std::max(maxSignatureSize, signature.bytes.size());
+	}
+
+	const size_t slotSize = textSize / embeds.size();
+	if (slotSize < maxSignatureSize * 2)
+	{
+		throw std::invalid_argument("Image is too small to embed all signatures");
+	}
+
+	image.expectedOffsets.resize(signatures.size());
+	std::vector<std::pair<size_t, size_t>> embeddedRanges;
+	for (size_t slot = 0; slot < embeds.size(); slot++)
+	{
+		const BenchSignature& signature = signatures[embeds[slot]];
+		const size_t offset = image.textBegin + (slot * slotSize) + (rng() % (slotSize - signature.bytes.size()));
+		for (size_t i = 0; i < signature.bytes.size(); i++)
+		{
+			image.data[offset + i] = signature.mask[i] != 0 ? signature.bytes[i] : static_cast<uint8_t>(rng());
+		}
+		image.expectedOffsets[embeds[slot]].push_back(offset);
+		embeddedRanges.emplace_back(offset, offset + signature.bytes.size());
+	}
+	for (auto& offsets : image.expectedOffsets)
+	{
+		std::sort(offsets.begin(), offsets.end());
+	}
+
+	// Random filler can match short signatures by accident. Break such matches by changing a filler byte within them,
+	// so the expected results are exact
+	auto isEmbedded = [&embeddedRanges](size_t offset) {
+		return std::any_of(embeddedRanges.begin(), embeddedRanges.end(), [offset](const auto& range) {
+			return offset >= range.first && offset < range.second;
+		});
+	};
+
+	auto forEachUnexpectedMatch = [&image, &signatures](size_t index, auto&& func) {
+		const std::vector<size_t>& expected = image.expectedOffsets[index];
+		Signature::ForEachMatch(image.data.data(), image.data.data() + image.data.size(), signatures[index].View(), [&](const uint8_t* match) {
+			const size_t offset = static_cast<size_t>(match - image.data.data());
+			if (!std::binary_search(expected.begin(), expected.end(), offset))
+			{
+				func(offset);
+			}
+			return true;
+		});
+	};
+
+	// Changing a byte may create a match for another signature, so repeat until nothing changes
+	bool changed = true;
+	for (int pass = 0; changed && pass < 16; pass++)
+	{
+		changed = false;
+		for (size_t i = 0; i < signatures.size(); i++)
+		{
+			const BenchSignature& signature = signatures[i];
+			forEachUnexpectedMatch(i, [&](size_t offset) {
+				for (size_t j = 0; j < signature.bytes.size(); j++)
+				{
+					if (signature.mask[j] != 0 && !isEmbedded(offset + j))
+					{
+						image.data[offset + j] ^= 0x5A;
+						changed = true;
+						break;
+					}
+				}
+			});
+		}
+	}
+
+	// Whatever is left is made of other embedded signatures, so it cannot be broken without changing those
+	unresolvedMatches = 0;
+	for (size_t i = 0; i < signatures.size(); i++)
+	{
+		forEachUnexpectedMatch(i, [&unresolvedMatches](size_t) {
+			unresolvedMatches++;
+		});
+	}
+
+	// Breaking a match could not have broken an embedded copy, but verify it anyway
+	for (size_t i = 0; i < signatures.size(); i++)
+	{
+		for (size_t offset : image.expectedOffsets[i])
+		{
+			if (!MatchesAt(image.data.data() + offset, signatures[i]))
+			{
+				throw std::logic_error("Embedded signature got overwritten");
+			}
+		}
+	}
+
+	return image;
+}
+
+bool SyntheticImage::Write(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	return file.good();
+}
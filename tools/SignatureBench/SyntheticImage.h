@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Signature.h"
+
+// A signature parsed at runtime, so the benchmark can hold a list of them
+struct BenchSignature
+{
+	const char* name;
+	std::vector<uint8_t> bytes;
+	std::vector<uint8_t> mask;
+	size_t anchor;
+	size_t count; // How many times it is expected to match
+
+	BenchSignature(const char* name, std::string_view signature, size_t count = 1);
+
+	Signature::PatternView View() const
+	{
+		return { bytes.data(), mask.data(), bytes.size(), anchor };
+	}
+};
+
+// A 32-bit PE image with file alignment equal to section alignment, so its file and memory layouts are identical
+struct SyntheticImage
+{
+	std::vector<uint8_t> data;
+	size_t textBegin = 0;
+	size_t textEnd = 0;
+
+	// Offsets of all embedded copies of each signature, sorted
+	std::vector<std::vector<size_t>> expectedOffsets;
+
+	// Returns the number of accidental matches that could not be removed from the filler code
+	static SyntheticImage Generate(const std::vector<BenchSignature>& signatures, size_t textSize, uint32_t seed, size_t& unresolvedMatches);
+
+	bool Write(const std::string& path) const;
+};
@@ -0,0 +1,214 @@
+// Stress tests SnapshotStore with concurrent readers and writers, and measures its read throughput
+// against a store guarded by a mutex and by a reader/writer lock. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -pthread -Isource tools/SnapshotStoreBench/SnapshotStoreBench.cpp -o SnapshotStoreBench
+//
+// Usage: SnapshotStoreBench [--readers <n>] [--writes <n>] [--duration <ms>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "SnapshotStore.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Stands in for the game settings. Every value of a version is the same, so a reader
+	// seeing a mix of two versions is caught
+	struct Settings
+	{
+		uint32_t version = 0;
+		std::vector<uint32_t> values = std::vector<uint32_t>(24, 0);
+	};
+
+	bool IsConsistent(const Settings& settings)
+	{
+		return std::all_of(settings.values.begin(), settings.values.end(), [&](uint32_t value) { return value == settings.version; });
+	}
+
+	void Bump(Settings& settings)
+	{
+		settings.version++;
+		for (uint32_t& value : settings.values)
+		{
+			value = settings.version;
+		}
+	}
+
+	class MutexStore
+	{
+	public:
+		template<typename Func>
+		auto Read(Func&& func) const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return func(m_settings);
+		}
+
+		void Write()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			Bump(m_settings);
+		}
+
+	private:
+		mutable std::mutex m_mutex;
+		Settings m_settings;
+	};
+
+	class SharedMutexStore
+	{
+	public:
+		template<typename Func>
+		auto Read(Func&& func) const
+		{
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+			return func(m_settings);
+		}
+
+		void Write()
+		{
+			std::unique_lock<std::shared_mutex> lock(m_mutex);
+			Bump(m_settings);
+		}
+
+	private:
+		mutable std::shared_mutex m_mutex;
+		Settings m_settings;
+	};
+
+	class RcuStore
+	{
+	public:
+		template<typename Func>
+		auto Read(Func&& func) const
+		{
+			return func(m_store.Get());
+		}
+
+		void Write()
+		{
+			m_store.Update(Bump);
+		}
+
+	private:
+		SnapshotStore<Settings> m_store;
+	};
+
+	struct Result
+	{
+		double readsPerSecond = 0.0;
+		uint64_t writes = 0;
+		uint64_t inconsistent = 0;
+		uint64_t wentBack = 0;
+	};
+
+	// Readers look a value up the way the registry redirect does, check the snapshot and that versions never go back.
+	// One writer publishes a new version every writeIntervalUs microseconds
+	template<typename Store>
+	Result Run(int readers, int writeIntervalUs, int durationMs)
+	{
+		Store store;
+		std::atomic<bool> stop { false };
+		std::atomic<uint64_t> reads { 0 }, inconsistent { 0 }, wentBack { 0 };
+		uint64_t writes = 0;
+
+		std::vector<std::thread> threads;
+		for (int i = 0; i < readers; i++)
+		{
+			threads.emplace_back([&] {
+				uint64_t localReads = 0, localInconsistent = 0, localWentBack = 0;
+				uint32_t lastVersion = 0;
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					const auto [version, consistent] = store.Read([](const Settings& settings) {
+						return std::make_pair(settings.version, IsConsistent(settings));
+					});
+					localInconsistent += consistent ? 0 : 1;
+					localWentBack += version < lastVersion ? 1 : 0;
+					lastVersion = version;
+					localReads++;
+				}
+				reads += localReads;
+				inconsistent += localInconsistent;
+				wentBack += localWentBack;
+			});
+		}
+
+		const auto start = Clock::now();
+		const auto end = start + std::chrono::milliseconds(durationMs);
+		while (Clock::now() < end)
+		{
+			store.Write();
+			writes++;
+			if (writeIntervalUs > 0)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(writeIntervalUs));
+			}
+		}
+		stop = true;
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		Result result;
+		result.readsPerSecond = reads / std::chrono::duration<double>(Clock::now() - start).count();
+		result.writes = writes;
+		result.inconsistent = inconsistent;
+		result.wentBack = wentBack;
+		return result;
+	}
+
+	bool Print(const char* name, const Result& result)
+	{
+		printf("%-14s %14.0f %10llu %14llu %10llu\n", name, result.readsPerSecond, static_cast<unsigned long long>(result.writes),
+			static_cast<unsigned long long>(result.inconsistent), static_cast<unsigned long long>(result.wentBack));
+		return result.inconsistent == 0 && result.wentBack == 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int readers = std::max(2, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+	int durationMs = 1000;
+	int writes = 200;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--readers") == 0 && i + 1 < argc) readers = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--writes") == 0 && i + 1 < argc) writes = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) durationMs = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "Usage: SnapshotStoreBench [--readers <n>] [--writes <n>] [--duration <ms>]\n");
+			return 2;
+		}
+	}
+
+	bool correct = true;
+	printf("%d readers, %d ms per run\n", readers, durationMs);
+
+	// Settings are saved a handful of times per session, this is already far more
+	const int writeIntervalUs = std::max(1, durationMs * 1000 / writes);
+	printf("\nOccasional writes (%d per run)\n", writes);
+	printf("%-14s %14s %10s %14s %10s\n", "Store", "Reads/s", "Writes", "Inconsistent", "Went back");
+	correct &= Print("Snapshot", Run<RcuStore>(readers, writeIntervalUs, durationMs));
+	correct &= Print("Mutex", Run<MutexStore>(readers, writeIntervalUs, durationMs));
+	correct &= Print("Shared mutex", Run<SharedMutexStore>(readers, writeIntervalUs, durationMs));
+
+	// Stress only, a snapshot is retained per write so keep this run short
+	printf("\nBack to back writes\n");
+	printf("%-14s %14s %10s %14s %10s\n", "Store", "Reads/s", "Writes", "Inconsistent", "Went back");
+	correct &= Print("Snapshot", Run<RcuStore>(readers, 0, std::min(durationMs, 200)));
+
+	printf("\nCorrectness: %s\n", correct ? "PASS" : "FAIL");
+	return correct ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+#include "StringIndex.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace
+{
+	constexpr uint32_t PE_SIGNATURE = 0x00004550; // PE\0\0
+	constexpr uint32_t SECTION_EXECUTABLE = 0x20000000 | 0x00000020; // IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_CNT_CODE
+	constexpr uint32_t SECTION_INITIALIZED_DATA = 0x00000040; // IMAGE_SCN_CNT_INITIALIZED_DATA
+	constexpr size_t SECTION_HEADER_SIZE = 40;
+
+	template<typename T>
+	bool ReadAt(const uint8_t* image, size_t size, size_t offset, T& value)
+	{
+		if (offset > size || sizeof(T) > size - offset)
+		{
+			return false;
+		}
+		std::memcpy(&value, image + offset, sizeof(T));
+		return true;
+	}
+
+	uint32_t Hash(std::string_view text)
+	{
+		uint32_t hash = 2166136261u;
+		for (char ch : text)
+		{
+			hash = (hash ^ static_cast<uint8_t>(ch)) * 16777619u;
+		}
+		return hash;
+	}
+
+	// Printable ASCII and the whitespace found in strings, as a table since every byte of data is tested
+	constexpr std::array<bool, 256> PRINTABLE = [] {
+		std::array<bool, 256> table {};
+		for (size_t ch = 0x20; ch < 0x7F; ch++)
+		{
+			table[ch] = true;
+		}
+		table['\t'] = table['\n'] = table['\r'] = true;
+		return table;
+	}();
+
+	struct Range
+	{
+		size_t begin, end;
+	};
+}
+
+bool StringIndex::Build(const uint8_t* image, size_t size, uintptr_t loadAddress)
+{
+	uint32_t peOffset, signature;
+	uint16_t numSections, optionalHeaderSize;
+	if (size > UINT32_MAX || !ReadAt(image, size, 0x3C, peOffset) || !ReadAt(image, size, peOffset, signature) || signature != PE_SIGNATURE
+		|| !ReadAt(image, size, peOffset + 6, numSections) || !ReadAt(image, size, peOffset + 20, optionalHeaderSize))
+	{
+		return false;
+	}
+
+	std::vector<Range> code, data;
+	const size_t sectionTable = static_cast<size_t>(peOffset) + 24 + optionalHeaderSize;
+	for (uint16_t i = 0; i < numSections; i++)
+	{
+		const size_t header = sectionTable + i * SECTION_HEADER_SIZE;
+		uint32_t virtualSize, virtualAddress, characteristics;
+		if (!ReadAt(image, size, header + 8, virtualSize) || !ReadAt(image, size, header + 12, virtualAddress)
+			|| !ReadAt(image, size, header + 36, characteristics))
+		{
+			return false;
+		}
+		if (virtualAddress >= size)
+		{
+			continue;
+		}
+		const Range range { virtualAddress, std::min<size_t>(static_cast<size_t>(virtualAddress) + virtualSize, size) };
+		if ((characteristics & SECTION_EXECUTABLE) != 0)
+		{
+			code.push_back(range);
+		}
+		else if ((characteristics & SECTION_INITIALIZED_DATA) != 0)
+		{
+			data.push_back(range);
+		}
+	}
+
+	m_image = image;
+	m_size = size;
+	m_strings.clear();
+	m_references.clear();
+
+	// Strings start after a non-printable byte and end with a null terminator
+	for (const Range& range : data)
+	{
+		size_t start = range.begin;
+		for (size_t offset = range.begin; offset < range.end; offset++)
+		{
+			const uint8_t ch = image[offset];
+			if (PRINTABLE[ch])
+			{
+				continue;
+			}
+			if (ch == '\0' && offset - start >= MIN_LENGTH)
+			{
+				const std::string_view text(reinterpret_cast<const char*>(image + start), offset - start);
+				m_strings.push_back({ Hash(text), static_cast<uint32_t>(start), static_cast<uint32_t>(text.size()) });
+			}
+			start = offset + 1;
+		}
+	}
+	std::sort(m_strings.begin(), m_strings.end(), [](const String& left, const String& right) {
+		return left.hash != right.hash ? left.hash < right.hash : left.offset < right.offset;
+	});
+
+	if (m_strings.empty())
+	{
+		return true;
+	}
+
+	// String starts as a bitmap spanning from the first one to the last, so every value in code is resolved with one test
+	uint32_t first = UINT32_MAX, last = 0;
+	for (const String& str : m_strings)
+	{
+		first = std::min(first, str.offset);
+		last = std::max(last, str.offset);
+	}
+	std::vector<uint64_t> starts(((last - first) / 64) + 1);
+	for (const String& str : m_strings)
+	{
+		const uint32_t bit = str.offset - first;
+		starts[bit / 64] |= uint64_t(1) << (bit % 64);
+	}
+
+	const uint64_t lowest = static_cast<uint64_t>(loadAddress) + first;
+	const uint64_t span = last - first;
+	for (const Range& range : code)
+	{
+		for (size_t offset = range.begin; offset + 4 <= range.end; offset++)
+		{
+			uint32_t value;
+			std::memcpy(&value, image + offset, sizeof(value));
+			// Values below the first string wrap around and fail the span test too
+			const uint64_t bit = static_cast<uint64_t>(value) - lowest;
+			if (bit <= span && (starts[bit / 64] & (uint64_t(1) << (bit % 64))) != 0)
+			{
+				m_references.push_back((static_cast<uint64_t>(first + bit) << 32) | offset);
+			}
+		}
+	}
+	std::sort(m_references.begin(), m_references.end());
+	return true;
+}
+
+std::vector<const char*> StringIndex::Find(std::string_view text) const
+{
+	std::vector<const char*> result;
+	const uint32_t hash = Hash(text);
+	auto it = std::lower_bound(m_strings.begin(), m_strings.end(), hash, [](const String& str, uint32_t value) {
+		return str.hash < value;
+	});
+	for (; it != m_strings.end() && it->hash == hash; ++it)
+	{
+		const char* str = reinterpret_cast<const char*>(m_image + it->offset);
+		if (std::string_view(str, it->length) == text)
+		{
+			result.push_back(str);
+		}
+	}
+	return result;
+}
+
+std::vector<const uint8_t*> StringIndex::References(const char* str) const
+{
+	std::vector<const uint8_t*> result;
+	const uint8_t* pointer = reinterpret_cast<const uint8_t*>(str);
+	if (m_image == nullptr || pointer < m_image || pointer >= m_image + m_size)
+	{
+		return result;
+	}
+
+	const uint64_t key = static_cast<uint64_t>(pointer - m_image) << 32;
+	for (auto it = std::lower_bound(m_references.begin(), m_references.end(), key); it != m_references.end() && (*it >> 32) == (key >> 32); ++it)
+	{
+		result.push_back(m_image + static_cast<uint32_t>(*it));
+	}
+	return result;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Index of the null terminated strings in a module's initialized data, and of the code referencing them by address.
+// Strings are runs of at least MIN_LENGTH printable ASCII characters, found by a hash of their text.
+// References are 32-bit values in executable sections equal to the address of a string's first character,
+// as in mov reg, offset str or push offset str. Like XrefIndex, code is not disassembled, so a reference is
+// any 4 bytes holding such an address.
+// No patch needs it yet, so it's only built into StringIndexBench. Portable, so it can be tested on PE images outside of Windows
+class StringIndex
+{
+public:
+	static constexpr size_t MIN_LENGTH = 4;
+
+	StringIndex() = default;
+
+	// image is a 32-bit PE module laid out in memory the way the loader maps it, size bytes long, with absolute
+	// addresses in its code relative to loadAddress. Returns false if it doesn't look like one
+	bool Build(const uint8_t* image, size_t size, uintptr_t loadAddress);
+
+	size_t StringCount() const { return m_strings.size(); }
+	size_t ReferenceCount() const { return m_references.size(); }
+
+	// Every copy of text in the image, sorted by address
+	std::vector<const char*> Find(std::string_view text) const;
+
+	// Code locations holding the address of str, which must be a result of Find, sorted by address
+	std::vector<const uint8_t*> References(const char* str) const;
+
+private:
+	struct String
+	{
+		uint32_t hash;
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	std::vector<String> m_strings; // Sorted by hash, then offset
+	std::vector<uint64_t> m_references; // String offset in the upper half, code offset in the lower
+	const uint8_t* m_image = nullptr;
+	size_t m_size = 0;
+};
@@ -0,0 +1,285 @@
+// Checks StringIndex against a brute force scan and measures building it against the signature scans it replaces.
+// Runs on a synthetic 32-bit PE image with strings and references planted in it, or on a real executable laid out like the loader would.
+// Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/StringIndexBench/StringIndexBench.cpp tools/SignatureBench/SyntheticImage.cpp tools/SignatureBench/PeImage.cpp tools/StringIndexBench/StringIndex.cpp -o StringIndexBench
+//
+// Usage: StringIndexBench [--size <MB>] [--seed <n>] [--references <n>] [--input <path>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../SignatureBench/PeImage.h"
+#include "../SignatureBench/SyntheticImage.h"
+#include "StringIndex.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedMs(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	bool IsPrintable(uint8_t ch)
+	{
+		return (ch >= 0x20 && ch < 0x7F) || ch == '\t' || ch == '\n' || ch == '\r';
+	}
+
+	// The string starting at offset, if one starts there
+	bool StringAt(const std::vector<uint8_t>& image, const PeSection& section, size_t offset, std::string_view& text)
+	{
+		if (offset != section.begin && IsPrintable(image[offset - 1]))
+		{
+			return false;
+		}
+		size_t end = offset;
+		while (end < section.end && IsPrintable(image[end]))
+		{
+			end++;
+		}
+		if (end == section.end || image[end] != '\0' || end - offset < StringIndex::MIN_LENGTH)
+		{
+			return false;
+		}
+		text = std::string_view(reinterpret_cast<const char*>(image.data() + offset), end - offset);
+		return true;
+	}
+
+	struct Planted
+	{
+		std::string text;
+		std::vector<size_t> copies;
+		std::vector<size_t> references;
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	size_t sizeMB = 4;
+	uint32_t seed = 1;
+	size_t numReferences = 8;
+	std::string inputPath;
+	for (int i = 1; i < argc; i++)
+	{
+		auto nextArg = [&]() -> const char* {
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "Missing value for %s\n", argv[i]);
+				exit(2);
+			}
+			return argv[++i];
+		};
+
+		if (strcmp(argv[i], "--size") == 0) sizeMB = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--seed") == 0) seed = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--references") == 0) numReferences = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--input") == 0) inputPath = nextArg();
+		else
+		{
+			fprintf(stderr, "Usage: StringIndexBench [--size <MB>] [--seed <n>] [--references <n>] [--input <path>]\n");
+			return 2;
+		}
+	}
+
+	PeImage pe;
+	std::mt19937 rng(seed);
+	std::vector<Planted> planted;
+	if (!inputPath.empty())
+	{
+		std::ifstream file(inputPath, std::ios::binary);
+		const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (!file.good() && !file.eof())
+		{
+			fprintf(stderr, "Failed to read %s\n", inputPath.c_str());
+			return 2;
+		}
+		if (!pe.LayOut(data))
+		{
+			fprintf(stderr, "%s is not a 32-bit PE image\n", inputPath.c_str());
+			return 2;
+		}
+		printf("Image: %s, %.2f MB laid out\n", inputPath.c_str(), pe.data.size() / (1024.0 * 1024.0));
+	}
+	else
+	{
+		// One signature is needed for the generator to lay out its slots
+		size_t unresolvedMatches;
+		const std::vector<BenchSignature> signatures { BenchSignature("Placeholder", "8B 46 08 3B F8 76 04 33 C0") };
+		SyntheticImage synthetic = SyntheticImage::Generate(signatures, sizeMB * 1024 * 1024, seed, unresolvedMatches);
+		// File and memory layouts of the synthetic image are identical, so laying it out only reads its sections
+		if (!pe.LayOut(synthetic.data) || pe.code.empty() || pe.initializedData.empty())
+		{
+			fprintf(stderr, "Failed to lay out the synthetic image\n");
+			return 1;
+		}
+
+		// Strings go to 32 byte cells of .rdata, references to 16 byte cells of .text, so neither overlaps another.
+		// DemoMenu has two copies, and MyDemoMenu must not be found as DemoMenu
+		const PeSection& rdata = pe.initializedData.front();
+		const PeSection& text = pe.code.front();
+		std::vector<bool> usedStrings((rdata.end - rdata.begin) / 32), usedCode((text.end - text.begin) / 16);
+		auto takeCell = [&](std::vector<bool>& used) {
+			size_t cell;
+			do
+			{
+				cell = rng() % used.size();
+			}
+			while (used[cell]);
+			used[cell] = true;
+			return cell;
+		};
+
+		for (const char* str : { "DemoMenu", "DemoMenu", "MyDemoMenu", "CMSPlayersCrewCollection2.txt", "Player", "Demo2Unlock.txt" })
+		{
+			auto it = std::find_if(planted.begin(), planted.end(), [str](const Planted& p) { return p.text == str; });
+			if (it == planted.end())
+			{
+				it = planted.insert(planted.end(), Planted { str, {}, {} });
+			}
+			const size_t offset = rdata.begin + takeCell(usedStrings) * 32 + 1;
+			pe.data[offset - 1] = '\0';
+			std::copy_n(str, strlen(str) + 1, pe.data.begin() + offset);
+			it->copies.push_back(offset);
+
+			// mov eax, offset str or push offset str
+			const size_t count = 1 + rng() % numReferences;
+			for (size_t i = 0; i < count; i++)
+			{
+				const size_t reference = text.begin + takeCell(usedCode) * 16 + rng() % 8;
+				pe.data[reference] = rng() % 2 != 0 ? 0xB8 : 0x68;
+				const uint32_t address = pe.imageBase + static_cast<uint32_t>(offset);
+				std::memcpy(&pe.data[reference + 1], &address, sizeof(address));
+				it->references.push_back(reference + 1);
+			}
+		}
+		printf("Image: synthetic, seed %u, %.2f MB, %zu strings planted\n", seed, pe.data.size() / (1024.0 * 1024.0), planted.size());
+	}
+
+	const std::vector<uint8_t>& image = pe.data;
+	auto start = Clock::now();
+	StringIndex index;
+	if (!index.Build(image.data(), image.size(), pe.imageBase))
+	{
+		fprintf(stderr, "Failed to index the image\n");
+		return 1;
+	}
+	const double buildMs = ElapsedMs(start);
+	printf("Index: %zu strings and %zu references in %.2f ms\n", index.StringCount(), index.ReferenceCount(), buildMs);
+
+	bool success = true;
+
+	// Planted strings must be found with all their copies and references
+	for (const Planted& p : planted)
+	{
+		const std::vector<const char*> copies = index.Find(p.text);
+		std::vector<size_t> offsets, expectedCopies = p.copies;
+		for (const char* copy : copies)
+		{
+			offsets.push_back(reinterpret_cast<const uint8_t*>(copy) - image.data());
+		}
+		std::sort(expectedCopies.begin(), expectedCopies.end());
+		if (offsets != expectedCopies)
+		{
+			printf("FAILED: \"%s\" has %zu copies, %zu planted\n", p.text.c_str(), offsets.size(), p.copies.size());
+			success = false;
+			continue;
+		}
+
+		std::vector<size_t> references, expected = p.references;
+		for (const char* copy : copies)
+		{
+			for (const uint8_t* reference : index.References(copy))
+			{
+				references.push_back(reference - image.data());
+			}
+		}
+		std::sort(references.begin(), references.end());
+		std::sort(expected.begin(), expected.end());
+		if (!std::includes(references.begin(), references.end(), expected.begin(), expected.end()))
+		{
+			printf("FAILED: \"%s\" is missing planted references (%zu found, %zu planted)\n", p.text.c_str(), references.size(), expected.size());
+			success = false;
+		}
+	}
+
+	// And the index must agree with a brute force scan on every address in the code
+	start = Clock::now();
+	size_t expectedReferences = 0, mismatches = 0;
+	for (const PeSection& section : pe.code)
+	{
+		for (size_t offset = section.begin; offset + 4 <= section.end; offset++)
+		{
+			uint32_t value;
+			std::memcpy(&value, &image[offset], sizeof(value));
+			const uint64_t target = static_cast<uint64_t>(value) - pe.imageBase;
+			for (const PeSection& data : pe.initializedData)
+			{
+				std::string_view text;
+				if (target < data.begin || target >= data.end || !StringAt(image, data, static_cast<size_t>(target), text))
+				{
+					continue;
+				}
+				expectedReferences++;
+
+				const char* str = text.data();
+				const std::vector<const char*> copies = index.Find(text);
+				const std::vector<const uint8_t*> references = index.References(str);
+				if (std::find(copies.begin(), copies.end(), str) == copies.end()
+					|| !std::binary_search(references.begin(), references.end(), image.data() + offset))
+				{
+					mismatches++;
+				}
+			}
+		}
+	}
+	if (mismatches != 0 || expectedReferences != index.ReferenceCount())
+	{
+		printf("FAILED: %zu of %zu references differ from a brute force scan, index has %zu\n", mismatches, expectedReferences, index.ReferenceCount());
+		success = false;
+	}
+	printf("Checked %zu references against a brute force scan in %.0f ms\n", expectedReferences, ElapsedMs(start));
+
+	// Nothing outside the image resolves, and strings are only found whole
+	if (!index.References(reinterpret_cast<const char*>(image.data() + image.size())).empty() || !index.Find("emoMenu").empty()
+		|| !index.Find("").empty())
+	{
+		printf("FAILED: lookups outside of the index returned results\n");
+		success = false;
+	}
+
+	// What the unlock all menus patch did before: two signatures locating the code referencing DemoMenu,
+	// searched through the whole image when the build is not the one they were made for
+	const std::vector<BenchSignature> menuSignatures {
+		BenchSignature("January", "B8 ? ? ? ? 8D 91 ? ? ? ? 89 99 ? ? ? ? 2B D0 8A 08 88 0C 02 03 C3 84 C9 75 F5 5E"),
+		BenchSignature("April/May", "B8 ? ? ? ? 8B CA 2B C8 C7 82 ? ? ? ? ? ? ? ? 8D B1 ? ? ? ? 8D A4 24 00 00 00 00"),
+	};
+	start = Clock::now();
+	size_t scanMatches = 0;
+	for (const BenchSignature& signature : menuSignatures)
+	{
+		scanMatches += Signature::FindFirst(image.data(), image.data() + image.size(), signature.View()) != nullptr ? 1 : 0;
+	}
+	const double scanMs = ElapsedMs(start);
+
+	start = Clock::now();
+	size_t lookupReferences = 0;
+	for (const char* copy : index.Find("DemoMenu"))
+	{
+		lookupReferences += index.References(copy).size();
+	}
+	const double lookupMs = ElapsedMs(start);
+	printf("DemoMenu: build + lookup %.2f ms (lookup alone %.4f ms, %zu references), two signature scans %.2f ms (%zu matched)\n",
+		buildMs + lookupMs, lookupMs, lookupReferences, scanMs, scanMatches);
+
+	printf(success ? "All checks passed\n" : "Checks failed\n");
+	return success ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+// Measures the ASCII fast path of ANSI <-> wide conversions against a scalar loop and against
+// the previous approach of sizing, allocating and converting every string. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/TextConversionBench/TextConversionBench.cpp -o TextConversionBench
+//
+// Usage: TextConversionBench [--iterations <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "AsciiConversion.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Keeps the conversions from being optimized away
+	volatile size_t resultSink;
+
+	size_t WidenScalar(const char* src, size_t length, char16_t* dst)
+	{
+		size_t i = 0;
+		for (; i < length; i++)
+		{
+			const uint8_t ch = static_cast<uint8_t>(src[i]);
+			if (ch >= 0x80)
+			{
+				break;
+			}
+			dst[i] = ch;
+		}
+		return i;
+	}
+
+	size_t NarrowScalar(const char16_t* src, size_t length, char* dst)
+	{
+		size_t i = 0;
+		for (; i < length; i++)
+		{
+			if (src[i] >= 0x80)
+			{
+				break;
+			}
+			dst[i] = static_cast<char>(src[i]);
+		}
+		return i;
+	}
+
+	// Stands in for the code page conversion: one pass to size the output, one to convert it, into a new string
+	std::u16string WidenAllocating(const std::string& text)
+	{
+		std::u16string result;
+		const size_t count = std::char_traits<char>::length(text.c_str());
+		if (count != 0)
+		{
+			result.resize(count);
+			std::transform(text.begin(), text.end(), result.begin(), [](char ch) { return static_cast<char16_t>(static_cast<uint8_t>(ch)); });
+		}
+		return result;
+	}
+
+	std::string NarrowAllocating(const std::u16string& text)
+	{
+		std::string result;
+		const size_t count = std::char_traits<char16_t>::length(text.c_str());
+		if (count != 0)
+		{
+			result.resize(count);
+			std::transform(text.begin(), text.end(), result.begin(), [](char16_t ch) { return static_cast<char>(ch); });
+		}
+		return result;
+	}
+
+	template<typename Func>
+	double NsPerCall(int iterations, const std::vector<std::string>& inputs, Func&& func)
+	{
+		const auto start = Clock::now();
+		size_t total = 0;
+		for (int i = 0; i < iterations; i++)
+		{
+			for (const std::string& input : inputs)
+			{
+				total += func(input);
+			}
+		}
+		resultSink = total;
+		return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (static_cast<double>(iterations) * inputs.size());
+	}
+
+	std::vector<std::string> MakeInputs(size_t length)
+	{
+		std::vector<std::string> inputs;
+		for (size_t i = 0; i < 64; i++)
+		{
+			std::string input;
+			for (size_t j = 0; j < length; j++)
+			{
+				input.push_back(static_cast<char>('A' + ((i * 7 + j) % 58)));
+			}
+			inputs.push_back(std::move(input));
+		}
+		return inputs;
+	}
+
+	bool CheckCorrectness()
+	{
+		// Every length around the vector width, with the first non-ASCII character at every position
+		for (size_t length = 0; length <= 80; length++)
+		{
+			for (size_t bad = 0; bad <= length; bad++)
+			{
+				std::string text(length, 'x');
+				for (size_t i = 0; i < length; i++) text[i] = static_cast<char>(0x20 + ((i * 13) % 0x5F));
+				if (bad < length) text[bad] = static_cast<char>(0x80 + (bad % 0x80));
+
+				std::u16string wide(length, u'\0'), wideExpected(length, u'\0');
+				const size_t widened = AsciiConversion::Widen(text.data(), length, wide.data());
+				const size_t widenedExpected = WidenScalar(text.data(), length, wideExpected.data());
+				if (widened != widenedExpected || wide.compare(0, widened, wideExpected, 0, widened) != 0)
+				{
+					printf("Widen mismatch at length %zu, non-ASCII at %zu\n", length, bad);
+					return false;
+				}
+
+				std::u16string source(length, u'\0');
+				for (size_t i = 0; i < length; i++) source[i] = static_cast<char16_t>(static_cast<uint8_t>(text[i]));
+				if (bad < length) source[bad] = static_cast<char16_t>(0x100 + bad); // Only the high byte set
+				std::string narrow(length, '\0'), narrowExpected(length, '\0');
+				const size_t narrowed = AsciiConversion::Narrow(source.data(), length, narrow.data());
+				const size_t narrowedExpected = NarrowScalar(source.data(), length, narrowExpected.data());
+				if (narrowed != narrowedExpected || narrow.compare(0, narrowed, narrowExpected, 0, narrowed) != 0)
+				{
+					printf("Narrow mismatch at length %zu, non-ASCII at %zu\n", length, bad);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int iterations = 200000;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "Usage: TextConversionBench [--iterations <n>]\n");
+			return 2;
+		}
+	}
+
+	const bool correct = CheckCorrectness();
+	printf("Correctness: %s\n", correct ? "PASS" : "FAIL");
+#if !ASCII_CONVERSION_SSE2
+	printf("Warning: built without SSE2, the fast path is scalar\n");
+#endif
+
+	printf("\n%8s %12s %12s %12s %12s %12s %12s\n", "Length", "Widen SIMD", "scalar", "alloc", "Narrow SIMD", "scalar", "alloc");
+	// Registry value names are 6-24 characters, longer strings show the throughput
+	for (size_t length : { 8, 16, 24, 64, 256, 4096 })
+	{
+		const std::vector<std::string> inputs = MakeInputs(length);
+		std::vector<std::u16string> wideInputs;
+		for (const std::string& input : inputs) wideInputs.emplace_back(input.begin(), input.end());
+
+		const int scaledIterations = std::max(1, static_cast<int>(iterations * 16 / (length + 16)));
+		char16_t wideBuffer[4096];
+		char buffer[4096];
+
+		const double widenSimd = NsPerCall(scaledIterations, inputs, [&](const std::string& input) {
+			return AsciiConversion::Widen(input.data(), input.size(), wideBuffer);
+		});
+		const double widenScalar = NsPerCall(scaledIterations, inputs, [&](const std::string& input) {
+			return WidenScalar(input.data(), input.size(), wideBuffer);
+		});
+		const double widenAlloc = NsPerCall(scaledIterations, inputs, [&](const std::string& input) {
+			return WidenAllocating(input).size();
+		});
+
+		size_t index = 0;
+		const double narrowSimd = NsPerCall(scaledIterations, inputs, [&](const std::string&) {
+			const std::u16string& input = wideInputs[index++ % wideInputs.size()];
+			return AsciiConversion::Narrow(input.data(), input.size(), buffer);
+		});
+		const double narrowScalar = NsPerCall(scaledIterations, inputs, [&](const std::string&) {
+			const std::u16string& input = wideInputs[index++ % wideInputs.size()];
+			return NarrowScalar(input.data(), input.size(), buffer);
+		});
+		const double narrowAlloc = NsPerCall(scaledIterations, inputs, [&](const std::string&) {
+			return NarrowAllocating(wideInputs[index++ % wideInputs.size()]).size();
+		});
+
+		printf("%8zu %10.1fns %10.1fns %10.1fns %10.1fns %10.1fns %10.1fns\n", length, widenSimd, widenScalar, widenAlloc, narrowSimd, narrowScalar, narrowAlloc);
+	}
+
+	return correct ? 0 : 1;
+}
@@ -0,0 +1,443 @@
+// Checks TraceRecorder: spans recorded from several threads at once are all exported exactly once, the export is valid JSON
+// in the Chrome trace event format with exact timestamps, and spans past the limit are dropped and counted.
+// Optionally writes a sample trace to open in a trace viewer. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -pthread -Isource tools/TraceRecorderCheck/TraceRecorderCheck.cpp source/TraceRecorder.cpp -o TraceRecorderCheck
+//
+// Usage: TraceRecorderCheck [--threads <n>] [--spans <n>] [--output <path>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "TraceRecorder.h"
+
+namespace
+{
+	// Just enough of a JSON parser to check the export: objects, arrays, strings with escapes, numbers and literals
+	struct Json
+	{
+		std::variant<std::nullptr_t, bool, double, std::string, std::vector<Json>, std::map<std::string, Json>> value;
+
+		const Json* Get(const char* key) const
+		{
+			const auto* object = std::get_if<std::map<std::string, Json>>(&value);
+			if (object == nullptr)
+			{
+				return nullptr;
+			}
+			auto it = object->find(key);
+			return it != object->end() ? &it->second : nullptr;
+		}
+		const std::string* String(const char* key) const
+		{
+			const Json* member = Get(key);
+			return member != nullptr ? std::get_if<std::string>(&member->value) : nullptr;
+		}
+		const double* Number(const char* key) const
+		{
+			const Json* member = Get(key);
+			return member != nullptr ? std::get_if<double>(&member->value) : nullptr;
+		}
+	};
+
+	class JsonParser
+	{
+	public:
+		explicit JsonParser(const std::string& text) : m_text(text) {}
+
+		bool Parse(Json& out)
+		{
+			if (!ParseValue(out))
+			{
+				return false;
+			}
+			SkipWhitespace();
+			return m_pos == m_text.size();
+		}
+
+	private:
+		void SkipWhitespace()
+		{
+			while (m_pos < m_text.size() && strchr(" \t\r\n", m_text[m_pos]) != nullptr) m_pos++;
+		}
+
+		bool Consume(char ch)
+		{
+			SkipWhitespace();
+			if (m_pos < m_text.size() && m_text[m_pos] == ch)
+			{
+				m_pos++;
+				return true;
+			}
+			return false;
+		}
+
+		bool ParseString(std::string& out)
+		{
+			if (!Consume('"'))
+			{
+				return false;
+			}
+			while (m_pos < m_text.size())
+			{
+				const unsigned char ch = m_text[m_pos++];
+				if (ch == '"')
+				{
+					return true;
+				}
+				if (ch < 0x20 || ch >= 0x80)
+				{
+					// Control characters must be escaped, and the exporter only writes ASCII
+					return false;
+				}
+				if (ch != '\\')
+				{
+					out.push_back(static_cast<char>(ch));
+					continue;
+				}
+				if (m_pos >= m_text.size())
+				{
+					return false;
+				}
+				const char escape = m_text[m_pos++];
+				switch (escape)
+				{
+				case '"': case '\\': case '/': out.push_back(escape); break;
+				case 'n': out.push_back('\n'); break;
+				case 'r': out.push_back('\r'); break;
+				case 't': out.push_back('\t'); break;
+				case 'b': out.push_back('\b'); break;
+				case 'f': out.push_back('\f'); break;
+				case 'u':
+				{
+					if (m_pos + 4 > m_text.size())
+					{
+						return false;
+					}
+					const unsigned long code = strtoul(m_text.substr(m_pos, 4).c_str(), nullptr, 16);
+					if (code >= 0x80)
+					{
+						return false;
+					}
+					out.push_back(static_cast<char>(code));
+					m_pos += 4;
+					break;
+				}
+				default:
+					return false;
+				}
+			}
+			return false;
+		}
+
+		bool ParseValue(Json& out)
+		{
+			SkipWhitespace();
+			if (m_pos >= m_text.size())
+			{
+				return false;
+			}
+
+			const char ch = m_text[m_pos];
+			if (ch == '{')
+			{
+				m_pos++;
+				std::map<std::string, Json> object;
+				if (!Consume('}'))
+				{
+					do
+					{
+						std::string key;
+						Json member;
+						if (!ParseString(key) || !Consume(':') || !ParseValue(member) || !object.emplace(std::move(key), std::move(member)).second)
+						{
+							return false;
+						}
+					}
+					while (Consume(','));
+					if (!Consume('}'))
+					{
+						return false;
+					}
+				}
+				out.value = std::move(object);
+				return true;
+			}
+			if (ch == '[')
+			{
+				m_pos++;
+				std::vector<Json> array;
+				if (!Consume(']'))
+				{
+					do
+					{
+						Json element;
+						if (!ParseValue(element))
+						{
+							return false;
+						}
+						array.push_back(std::move(element));
+					}
+					while (Consume(','));
+					if (!Consume(']'))
+					{
+						return false;
+					}
+				}
+				out.value = std::move(array);
+				return true;
+			}
+			if (ch == '"')
+			{
+				std::string str;
+				if (!ParseString(str))
+				{
+					return false;
+				}
+				out.value = std::move(str);
+				return true;
+			}
+			for (const auto& [literal, value] : { std::pair<const char*, Json>{ "true", Json{ true } }, { "false", Json{ false } }, { "null", Json{ nullptr } } })
+			{
+				if (m_text.compare(m_pos, strlen(literal), literal) == 0)
+				{
+					m_pos += strlen(literal);
+					out = value;
+					return true;
+				}
+			}
+
+			const char* begin = m_text.c_str() + m_pos;
+			char* end;
+			const double number = strtod(begin, &end);
+			if (end == begin)
+			{
+				return false;
+			}
+			m_pos += end - begin;
+			out.value = number;
+			return true;
+		}
+
+		const std::string& m_text;
+		size_t m_pos = 0;
+	};
+
+	// Fake clock ticking in 100 ns units like QueryPerformanceCounter usually does, so timestamps are known exactly
+	constexpr uint64_t TICKS_PER_SECOND = 10000000;
+
+	uint64_t BeginTicks(size_t thread, size_t index)
+	{
+		return 5000000000ull + thread * 1000000 + index * 1234567;
+	}
+	uint64_t EndTicks(size_t thread, size_t index)
+	{
+		return BeginTicks(thread, index) + 1 + index % 7 * 333;
+	}
+
+	const std::vector<Json>* Events(const Json& trace)
+	{
+		const Json* events = trace.Get("traceEvents");
+		return events != nullptr ? std::get_if<std::vector<Json>>(&events->value) : nullptr;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t numThreads = 4;
+	size_t numSpans = 5000;
+	std::string outputPath;
+	for (int i = 1; i < argc; i++)
+	{
+		auto nextArg = [&]() -> const char* {
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "Missing value for %s\n", argv[i]);
+				exit(2);
+			}
+			return argv[++i];
+		};
+
+		if (strcmp(argv[i], "--threads") == 0) numThreads = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--spans") == 0) numSpans = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--output") == 0) outputPath = nextArg();
+		else
+		{
+			fprintf(stderr, "Usage: TraceRecorderCheck [--threads <n>] [--spans <n>] [--output <path>]\n");
+			return 2;
+		}
+	}
+	if (numThreads == 0 || numSpans == 0)
+	{
+		fprintf(stderr, "Threads and spans must be non-zero\n");
+		return 2;
+	}
+
+	bool success = true;
+
+	// Every thread records its spans while the main thread keeps exporting, like the exit handler could at any moment
+	TraceRecorder recorder(TICKS_PER_SECOND, numThreads * numSpans);
+	recorder.NameThread(1, "Main \"game\" thread");
+	for (size_t t = 0; t < numThreads; t++)
+	{
+		recorder.NameThread(static_cast<uint32_t>(100 + t), "Loader " + std::to_string(t));
+	}
+
+	std::atomic<size_t> threadsDone { 0 };
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([&, t] {
+			for (size_t i = 0; i < numSpans; i++)
+			{
+				// Paths with characters that must be escaped, and ones outside of ASCII
+				std::string detail = i % 3 == 0 ? "scripts\\\"Race\"\t" + std::to_string(i) + ".txt\x01\xE9" : std::to_string(i);
+				recorder.Add({ "CreateFile", "file", std::move(detail), BeginTicks(t, i), EndTicks(t, i), static_cast<uint32_t>(100 + t) });
+			}
+			threadsDone++;
+		});
+	}
+	size_t exports = 0;
+	while (threadsDone.load() != numThreads)
+	{
+		Json partial;
+		const std::string trace = recorder.ExportChromeTrace("Juiced");
+		if (!JsonParser(trace).Parse(partial) || Events(partial) == nullptr)
+		{
+			printf("FAILED: trace exported while recording is not valid JSON\n");
+			success = false;
+			break;
+		}
+		exports++;
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	// A span starting before all the others, and one ending before it began
+	TraceRecorder edges(TICKS_PER_SECOND, 3);
+	edges.Add({ "Late", "init", "", 3 * TICKS_PER_SECOND, 2 * TICKS_PER_SECOND, 1 });
+	edges.Add({ "OnInitializeHook", "init", "", TICKS_PER_SECOND + 5, 4 * TICKS_PER_SECOND, 1 });
+	edges.Add({ "Nested", "init", "", TICKS_PER_SECOND + 5, TICKS_PER_SECOND + 6, 1 });
+	edges.Add({ "Dropped", "init", "", 0, 1, 1 });
+	edges.Add({ "Dropped", "init", "", 0, 1, 1 });
+
+	const auto start = std::chrono::steady_clock::now();
+	const std::string trace = recorder.ExportChromeTrace("Juiced");
+	const double exportMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	Json json;
+	if (!JsonParser(trace).Parse(json) || Events(json) == nullptr)
+	{
+		printf("FAILED: trace is not valid JSON\n");
+		return 1;
+	}
+
+	// Every span exactly once, with the exact times and details it was recorded with
+	size_t metadata = 0;
+	std::vector<std::vector<bool>> seen(numThreads, std::vector<bool>(numSpans));
+	const uint64_t origin = BeginTicks(0, 0);
+	auto micros = [](uint64_t ticks) { return static_cast<double>(ticks) / (TICKS_PER_SECOND / 1000000); };
+	for (const Json& event : *Events(json))
+	{
+		const std::string* phase = event.String("ph");
+		if (phase != nullptr && *phase == "M")
+		{
+			metadata++;
+			continue;
+		}
+
+		const double* tid = event.Number("tid");
+		const double* ts = event.Number("ts");
+		const double* dur = event.Number("dur");
+		const Json* args = event.Get("args");
+		const std::string* detail = args != nullptr ? args->String("detail") : nullptr;
+		if (phase == nullptr || *phase != "X" || tid == nullptr || ts == nullptr || dur == nullptr || detail == nullptr
+			|| event.String("name") == nullptr || *event.String("name") != "CreateFile" || event.String("cat") == nullptr)
+		{
+			printf("FAILED: malformed event\n");
+			success = false;
+			break;
+		}
+
+		const size_t thread = static_cast<size_t>(*tid) - 100;
+		const size_t index = strtoul(detail->c_str() + (detail->compare(0, 8, "scripts\\") == 0 ? 15 : 0), nullptr, 10);
+		if (thread >= numThreads || index >= numSpans || seen[thread][index])
+		{
+			printf("FAILED: unexpected or repeated span %s on thread %.0f\n", detail->c_str(), *tid);
+			success = false;
+			continue;
+		}
+		seen[thread][index] = true;
+
+		const std::string expectedDetail = index % 3 == 0 ? "scripts\\\"Race\"\t" + std::to_string(index) + ".txt\x01?" : std::to_string(index);
+		if (*detail != expectedDetail || *ts != micros(BeginTicks(thread, index) - origin)
+			|| *dur != micros(EndTicks(thread, index) - BeginTicks(thread, index)))
+		{
+			printf("FAILED: span %zu of thread %zu has ts %.3f, dur %.3f, detail \"%s\"\n", index, thread, *ts, *dur, detail->c_str());
+			success = false;
+		}
+	}
+	size_t missing = 0;
+	for (const std::vector<bool>& thread : seen)
+	{
+		missing += std::count(thread.begin(), thread.end(), false);
+	}
+	if (missing != 0 || metadata != numThreads + 2 || recorder.GetSpanCount() != numThreads * numSpans || recorder.GetDroppedCount() != 0)
+	{
+		printf("FAILED: %zu spans missing, %zu metadata events\n", missing, metadata);
+		success = false;
+	}
+
+	// Outer spans come first and the earliest span starts the trace, spans never end before they begin, extra spans are counted
+	Json edgesJson;
+	if (!JsonParser(edges.ExportChromeTrace("Juiced")).Parse(edgesJson) || Events(edgesJson) == nullptr)
+	{
+		printf("FAILED: edge case trace is not valid JSON\n");
+		return 1;
+	}
+	std::vector<std::string> order;
+	for (const Json& event : *Events(edgesJson))
+	{
+		if (*event.String("ph") == "X")
+		{
+			order.push_back(*event.String("name") + "@" + std::to_string(*event.Number("ts")) + "+" + std::to_string(*event.Number("dur")));
+		}
+	}
+	const std::vector<std::string> expectedOrder {
+		"OnInitializeHook@0.000000+2999999.500000", "Nested@0.000000+0.100000", "Late@1999999.500000+0.000000",
+	};
+	const Json* otherData = edgesJson.Get("otherData");
+	if (order != expectedOrder || otherData == nullptr || otherData->String("droppedSpans") == nullptr || *otherData->String("droppedSpans") != "2")
+	{
+		printf("FAILED: edge cases exported as:\n");
+		for (const std::string& event : order)
+		{
+			printf("  %s\n", event.c_str());
+		}
+		success = false;
+	}
+
+	printf("%zu threads, %zu spans each: %zu exports while recording, final export %.2f MB in %.1f ms\n",
+		numThreads, numSpans, exports, trace.size() / (1024.0 * 1024.0), exportMs);
+
+	if (!outputPath.empty())
+	{
+		std::ofstream(outputPath, std::ios::binary) << trace;
+		printf("Trace written to %s\n", outputPath.c_str());
+	}
+
+	printf(success ? "All checks passed\n" : "Checks failed\n");
+	return success ? 0 : 1;
+}
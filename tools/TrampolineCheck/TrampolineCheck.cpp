@@ -0,0 +1,669 @@
+// Checks the stubs emitted by Trampoline by decoding and running them on a small x86 interpreter.
+// Handlers are simulated by the interpreter, which records the arguments they receive and trashes
+// the scratch registers and flags like a real function would. Every stub is checked for passing the right
+// arguments, preserving live registers and leaving the stack balanced. Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/TrampolineCheck/TrampolineCheck.cpp source/Trampoline.cpp -o TrampolineCheck
+//
+// Usage: TrampolineCheck [--disassemble] [--iterations <n>]
+
+#include <array>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Trampoline.h"
+
+namespace
+{
+	using Trampoline::Register;
+
+	constexpr uint32_t CODE_ADDRESS = 0x00401000;
+	constexpr uint32_t STACK_TOP = 0x00800000;
+	constexpr uint32_t RETURN_ADDRESS = 0x00405678;
+	constexpr uint32_t HANDLER_ADDRESS = 0x10001000;
+	constexpr uint32_t ORIGINAL_ADDRESS = 0x10002000;
+	constexpr uint32_t POINTER_ADDRESS = 0x20000000;
+	constexpr uint32_t FLAG_ADDRESS = 0x20000010;
+	constexpr uint32_t DATA_ADDRESS = 0x20000100;
+
+	const char* const REGISTER_NAMES[] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi" };
+
+	template<typename T>
+	T* FakePointer(uint32_t address)
+	{
+		return reinterpret_cast<T*>(static_cast<uintptr_t>(address));
+	}
+
+	std::string Format(const char* format, ...)
+	{
+		char buffer[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+		return buffer;
+	}
+
+	struct Failure : std::runtime_error
+	{
+		using std::runtime_error::runtime_error;
+	};
+
+	// Decodes only what Trampoline emits, plus the instructions the game hooks replay
+	struct Instruction
+	{
+		enum class Kind
+		{
+			Push, Pop, PushStack, AddEsp, SubEsp, AndEsp, MovEbpEsp, MovEspEbp,
+			CallRelative, CallIndirect, JumpIndirect, StoreByte, Fxsave, Fxrstor,
+			TestEaxEax, MovRegisterMemory, CmpRegisters, Return,
+		};
+		Kind kind;
+		size_t length;
+		uint32_t immediate = 0;
+		uint8_t reg = 0;
+		uint8_t base = 0;
+		uint8_t value = 0;
+	};
+
+	uint32_t ReadDword(const std::vector<uint8_t>& code, size_t offset)
+	{
+		if (offset + 4 > code.size())
+		{
+			throw Failure("Truncated instruction");
+		}
+		uint32_t value;
+		std::memcpy(&value, code.data() + offset, sizeof(value));
+		return value;
+	}
+
+	Instruction Decode(const std::vector<uint8_t>& code, size_t offset)
+	{
+		using Kind = Instruction::Kind;
+
+		auto at = [&](size_t i) -> uint8_t {
+			if (offset + i >= code.size())
+			{
+				throw Failure("Truncated instruction");
+			}
+			return code[offset + i];
+		};
+
+		const uint8_t opcode = at(0);
+		if (opcode >= 0x50 && opcode <= 0x57)
+		{
+			return { Kind::Push, 1, 0, static_cast<uint8_t>(opcode - 0x50) };
+		}
+		if (opcode >= 0x58 && opcode <= 0x5F)
+		{
+			return { Kind::Pop, 1, 0, static_cast<uint8_t>(opcode - 0x58) };
+		}
+		switch (opcode)
+		{
+		case 0xFF:
+			if (at(1) == 0x74 && at(2) == 0x24) return { Kind::PushStack, 4, at(3) };
+			if (at(1) == 0xB4 && at(2) == 0x24) return { Kind::PushStack, 7, ReadDword(code, offset + 3) };
+			if (at(1) == 0x15) return { Kind::CallIndirect, 6, ReadDword(code, offset + 2) };
+			if (at(1) == 0x25) return { Kind::JumpIndirect, 6, ReadDword(code, offset + 2) };
+			break;
+		case 0x83:
+			if (at(1) == 0xC4) return { Kind::AddEsp, 3, at(2) };
+			if (at(1) == 0xE4) return { Kind::AndEsp, 3, static_cast<uint32_t>(static_cast<int8_t>(at(2))) };
+			break;
+		case 0x81:
+			if (at(1) == 0xC4) return { Kind::AddEsp, 6, ReadDword(code, offset + 2) };
+			if (at(1) == 0xEC) return { Kind::SubEsp, 6, ReadDword(code, offset + 2) };
+			break;
+		case 0x8B:
+			if (at(1) == 0xEC) return { Kind::MovEbpEsp, 2 };
+			if (at(1) == 0xE5) return { Kind::MovEspEbp, 2 };
+			// mov r32, [r32+disp8]
+			if ((at(1) & 0xC0) == 0x40 && (at(1) & 7) != 4)
+			{
+				return { Kind::MovRegisterMemory, 3, at(2), static_cast<uint8_t>((at(1) >> 3) & 7), static_cast<uint8_t>(at(1) & 7) };
+			}
+			break;
+		case 0x3B:
+			// cmp r32, r32
+			if ((at(1) & 0xC0) == 0xC0) return { Kind::CmpRegisters, 2, 0, static_cast<uint8_t>((at(1) >> 3) & 7), static_cast<uint8_t>(at(1) & 7) };
+			break;
+		case 0xE8:
+			return { Kind::CallRelative, 5, ReadDword(code, offset + 1) };
+		case 0xC6:
+			if (at(1) == 0x05) return { Kind::StoreByte, 7, ReadDword(code, offset + 2), 0, 0, at(6) };
+			break;
+		case 0x0F:
+			if (at(1) == 0xAE && at(2) == 0x04 && at(3) == 0x24) return { Kind::Fxsave, 4 };
+			if (at(1) == 0xAE && at(2) == 0x0C && at(3) == 0x24) return { Kind::Fxrstor, 4 };
+			break;
+		case 0x85:
+			if (at(1) == 0xC0) return { Kind::TestEaxEax, 2 };
+			break;
+		case 0xC3:
+			return { Kind::Return, 1, 0 };
+		case 0xC2:
+			return { Kind::Return, 3, static_cast<uint32_t>(at(1) | (at(2) << 8)) };
+		}
+		throw Failure(Format("Unknown instruction at +%zu: %02X %02X", offset, opcode, offset + 1 < code.size() ? code[offset + 1] : 0));
+	}
+
+	std::string Disassemble(const Instruction& insn, uint32_t address)
+	{
+		using Kind = Instruction::Kind;
+		switch (insn.kind)
+		{
+		case Kind::Push: return Format("push %s", REGISTER_NAMES[insn.reg]);
+		case Kind::Pop: return Format("pop %s", REGISTER_NAMES[insn.reg]);
+		case Kind::PushStack: return Format("push dword ptr [esp+%u]", insn.immediate);
+		case Kind::AddEsp: return Format("add esp, %u", insn.immediate);
+		case Kind::SubEsp: return Format("sub esp, %u", insn.immediate);
+		case Kind::AndEsp: return Format("and esp, %d", static_cast<int32_t>(insn.immediate));
+		case Kind::MovEbpEsp: return "mov ebp, esp";
+		case Kind::MovEspEbp: return "mov esp, ebp";
+		case Kind::CallRelative: return Format("call %08X", address + static_cast<uint32_t>(insn.length) + insn.immediate);
+		case Kind::CallIndirect: return Format("call dword ptr [%08X]", insn.immediate);
+		case Kind::JumpIndirect: return Format("jmp dword ptr [%08X]", insn.immediate);
+		case Kind::StoreByte: return Format("mov byte ptr [%08X], %u", insn.immediate, insn.value);
+		case Kind::Fxsave: return "fxsave [esp]";
+		case Kind::Fxrstor: return "fxrstor [esp]";
+		case Kind::TestEaxEax: return "test eax, eax";
+		case Kind::MovRegisterMemory: return Format("mov %s, [%s+%u]", REGISTER_NAMES[insn.reg], REGISTER_NAMES[insn.base], insn.immediate);
+		case Kind::CmpRegisters: return Format("cmp %s, %s", REGISTER_NAMES[insn.reg], REGISTER_NAMES[insn.base]);
+		case Kind::Return: return insn.immediate != 0 ? Format("ret %u", insn.immediate) : "ret";
+		}
+		return "?";
+	}
+
+	void PrintListing(const char* name, const std::vector<uint8_t>& code)
+	{
+		printf("%s (%zu bytes):\n", name, code.size());
+		for (size_t offset = 0; offset < code.size();)
+		{
+			const Instruction insn = Decode(code, offset);
+			std::string bytes;
+			for (size_t i = 0; i < insn.length; i++)
+			{
+				bytes += Format("%02X ", code[offset + i]);
+			}
+			printf("  %08zX  %-24s%s\n", CODE_ADDRESS + offset, bytes.c_str(), Disassemble(insn, static_cast<uint32_t>(CODE_ADDRESS + offset)).c_str());
+			offset += insn.length;
+		}
+		printf("\n");
+	}
+
+	// What a simulated handler saw when it was called
+	struct HandlerCall
+	{
+		std::vector<uint32_t> arguments;
+		uint8_t flag = 0;
+		bool zeroFlag = false;
+	};
+
+	class Machine
+	{
+	public:
+		std::array<uint32_t, 8> regs {};
+		bool zeroFlag = false;
+		std::vector<HandlerCall> handlerCalls;
+		// Simulated handlers return this in eax
+		uint32_t handlerResult = 0x600DF00D;
+		// Number of stack arguments simulated handlers pop on return
+		uint32_t handlerPops = 0;
+		size_t handlerArguments = 0;
+		size_t fxsaves = 0;
+		size_t fxrstors = 0;
+
+		uint8_t ReadByte(uint32_t address) const
+		{
+			auto it = m_memory.find(address);
+			return it != m_memory.end() ? it->second : 0xCC;
+		}
+
+		void WriteByte(uint32_t address, uint8_t value) { m_memory[address] = value; }
+
+		uint32_t Read(uint32_t address) const
+		{
+			return ReadByte(address) | (ReadByte(address + 1) << 8) | (ReadByte(address + 2) << 16) | (static_cast<uint32_t>(ReadByte(address + 3)) << 24);
+		}
+
+		void Write(uint32_t address, uint32_t value)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				WriteByte(address + i, static_cast<uint8_t>(value >> (i * 8)));
+			}
+		}
+
+		void Push(uint32_t value)
+		{
+			regs[4] -= 4;
+			Write(regs[4], value);
+		}
+
+		uint32_t Pop()
+		{
+			const uint32_t value = Read(regs[4]);
+			regs[4] += 4;
+			return value;
+		}
+
+		// Runs until the stub returns or jumps away, and returns the address it left to
+		uint32_t Run(const std::vector<uint8_t>& code)
+		{
+			using Kind = Instruction::Kind;
+
+			size_t offset = 0;
+			for (size_t steps = 0; steps < 1000; steps++)
+			{
+				const Instruction insn = Decode(code, offset);
+				const uint32_t next = static_cast<uint32_t>(CODE_ADDRESS + offset + insn.length);
+				offset += insn.length;
+
+				switch (insn.kind)
+				{
+				case Kind::Push: Push(regs[insn.reg]); break;
+				case Kind::Pop: regs[insn.reg] = Pop(); break;
+				case Kind::PushStack: Push(Read(regs[4] + insn.immediate)); break;
+				case Kind::AddEsp: regs[4] += insn.immediate; break;
+				case Kind::SubEsp: regs[4] -= insn.immediate; break;
+				case Kind::AndEsp: regs[4] &= insn.immediate; break;
+				case Kind::MovEbpEsp: regs[5] = regs[4]; break;
+				case Kind::MovEspEbp: regs[4] = regs[5]; break;
+				case Kind::StoreByte: WriteByte(insn.immediate, insn.value); break;
+				case Kind::TestEaxEax: zeroFlag = regs[0] == 0; break;
+				case Kind::MovRegisterMemory: regs[insn.reg] = Read(regs[insn.base] + insn.immediate); break;
+				case Kind::CmpRegisters: zeroFlag = regs[insn.reg] == regs[insn.base]; break;
+				case Kind::Fxsave:
+				case Kind::Fxrstor:
+					if ((regs[4] & 15) != 0)
+					{
+						throw Failure(Format("%s at misaligned esp %08X", insn.kind == Kind::Fxsave ? "fxsave" : "fxrstor", regs[4]));
+					}
+					(insn.kind == Kind::Fxsave ? fxsaves : fxrstors)++;
+					break;
+				case Kind::CallRelative:
+					CallHandler(next + insn.immediate, next);
+					break;
+				case Kind::CallIndirect:
+					CallHandler(Read(insn.immediate), next);
+					break;
+				case Kind::JumpIndirect:
+					return Read(insn.immediate);
+				case Kind::Return:
+				{
+					const uint32_t returnAddress = Pop();
+					regs[4] += insn.immediate;
+					return returnAddress;
+				}
+				}
+				if (offset >= code.size())
+				{
+					throw Failure("Ran past the end of the stub");
+				}
+			}
+			throw Failure("Stub doesn't terminate");
+		}
+
+	private:
+		void CallHandler(uint32_t target, uint32_t returnAddress)
+		{
+			if (target != HANDLER_ADDRESS)
+			{
+				throw Failure(Format("Call to unexpected address %08X", target));
+			}
+
+			// call pushes the return address, the handler reads its arguments above it
+			Push(returnAddress);
+			HandlerCall call;
+			for (size_t i = 0; i < handlerArguments; i++)
+			{
+				call.arguments.push_back(Read(regs[4] + 4 + static_cast<uint32_t>(i) * 4));
+			}
+			call.flag = ReadByte(FLAG_ADDRESS);
+			call.zeroFlag = zeroFlag;
+			handlerCalls.push_back(std::move(call));
+
+			// Scratch registers and flags are not preserved by the callee
+			regs[0] = handlerResult;
+			regs[1] = 0xDEAD0001;
+			regs[2] = 0xDEAD0002;
+			zeroFlag = !zeroFlag;
+
+			if (Pop() != returnAddress)
+			{
+				throw Failure("Return address got overwritten");
+			}
+			regs[4] += handlerPops;
+		}
+
+		std::unordered_map<uint32_t, uint8_t> m_memory;
+	};
+
+	void Expect(bool condition, const std::string& message)
+	{
+		if (!condition)
+		{
+			throw Failure(message);
+		}
+	}
+
+	std::array<uint32_t, 8> EntryRegisters()
+	{
+		std::array<uint32_t, 8> regs;
+		for (size_t i = 0; i < regs.size(); i++)
+		{
+			regs[i] = 0x11111111u * static_cast<uint32_t>(i + 1);
+		}
+		regs[4] = STACK_TOP - 0x100;
+		return regs;
+	}
+
+	// Runs a stub with a single call entered through a call instruction, with stackArguments arguments on the stack
+	Machine RunCallStub(const Trampoline::Call& call, size_t stackArguments)
+	{
+		Machine machine;
+		machine.regs = EntryRegisters();
+		machine.handlerArguments = call.arguments.size() + call.stackArguments;
+		machine.handlerPops = call.calleePops ? static_cast<uint32_t>(machine.handlerArguments * 4) : 0;
+		machine.Write(POINTER_ADDRESS, ORIGINAL_ADDRESS);
+		machine.Write(DATA_ADDRESS + 8, 0x12345678);
+
+		for (size_t i = stackArguments; i > 0; i--)
+		{
+			machine.Push(0xA0000000 + static_cast<uint32_t>(i - 1));
+		}
+		machine.Push(RETURN_ADDRESS);
+		return machine;
+	}
+
+	void CheckCallStub(const Trampoline::Spec& spec, const Trampoline::Call& call, size_t stackArguments)
+	{
+		const std::vector<uint8_t> code = Trampoline::Emit(spec, CODE_ADDRESS);
+		Machine machine = RunCallStub(call, stackArguments);
+		const std::array<uint32_t, 8> entry = machine.regs;
+		const uint32_t target = machine.Run(code);
+
+		Expect(machine.handlerCalls.size() == 1, Format("Handler called %zu times", machine.handlerCalls.size()));
+		const HandlerCall& handlerCall = machine.handlerCalls[0];
+		for (size_t i = 0; i < call.arguments.size(); i++)
+		{
+			const uint32_t expected = entry[static_cast<size_t>(call.arguments[i])];
+			Expect(handlerCall.arguments[i] == expected, Format("Argument %zu is %08X, expected %s = %08X", i, handlerCall.arguments[i], REGISTER_NAMES[static_cast<size_t>(call.arguments[i])], expected));
+		}
+		for (size_t i = 0; i < call.stackArguments; i++)
+		{
+			const uint32_t actual = handlerCall.arguments[call.arguments.size() + i];
+			Expect(actual == 0xA0000000 + i, Format("Stack argument %zu is %08X", i, actual));
+		}
+
+		// Live registers and the callee-saved ones must come out as they went in
+		const Trampoline::RegisterSet preserved = call.live | Trampoline::Registers({ Register::Ebx, Register::Ebp, Register::Esi, Register::Edi });
+		for (uint8_t reg = 0; reg < 8; reg++)
+		{
+			if (reg != 4 && (preserved & (1 << reg)) != 0)
+			{
+				Expect(machine.regs[reg] == entry[reg], Format("%s is %08X, expected %08X", REGISTER_NAMES[reg], machine.regs[reg], entry[reg]));
+			}
+		}
+
+		if (spec.exit == Trampoline::Spec::Exit::Jump)
+		{
+			Expect(target == ORIGINAL_ADDRESS, Format("Jumped to %08X", target));
+			Expect(machine.regs[4] == entry[4], Format("esp off by %d when jumping", static_cast<int32_t>(machine.regs[4] - entry[4])));
+		}
+		else
+		{
+			Expect(target == RETURN_ADDRESS, Format("Returned to %08X", target));
+			Expect(machine.regs[4] == entry[4] + 4 + spec.returnPopBytes, Format("esp off by %d after returning", static_cast<int32_t>(machine.regs[4] - entry[4] - 4 - spec.returnPopBytes)));
+			if (spec.testResult)
+			{
+				Expect(machine.zeroFlag == (machine.regs[0] == 0), "Flags don't match the result");
+			}
+		}
+	}
+
+	struct NamedCheck
+	{
+		const char* name;
+		void (*check)(bool disassemble);
+	};
+
+	// The stubs SilentPatch builds, with the handlers at a fake address
+	void CheckCreateWindow(bool disassemble)
+	{
+		using namespace Trampoline;
+
+		Call call;
+		call.function = FakePointer<const void>(HANDLER_ADDRESS);
+		call.arguments = { Register::Eax, Register::Ecx };
+		call.live = Registers({ Register::Eax, Register::Ecx, Register::Edx });
+
+		Spec spec;
+		spec.steps.emplace_back(call);
+		spec.exit = Spec::Exit::Jump;
+		spec.jumpTarget = FakePointer<void* const>(POINTER_ADDRESS);
+		if (disassemble) PrintListing("CreateWindow_CalculateAR", Emit(spec, CODE_ADDRESS));
+		CheckCallStub(spec, call, 0);
+	}
+
+	void CheckSetupInfoForGameMode(bool disassemble)
+	{
+		using namespace Trampoline;
+
+		Call call;
+		call.function = FakePointer<const void>(HANDLER_ADDRESS);
+		call.arguments = { Register::Edi };
+		call.live = Registers({ Register::Edx });
+
+		Spec spec;
+		spec.steps.emplace_back(call);
+		spec.exit = Spec::Exit::Jump;
+		spec.jumpTarget = FakePointer<void* const>(POINTER_ADDRESS);
+		if (disassemble) PrintListing("SetupInfoForGameMode_Hook", Emit(spec, CODE_ADDRESS));
+		CheckCallStub(spec, call, 0);
+	}
+
+	void CheckSetNotificationPositions(bool disassemble)
+	{
+		using namespace Trampoline;
+
+		Call call;
+		call.function = FakePointer<const void>(HANDLER_ADDRESS);
+		call.stackArguments = 3;
+		call.calleePops = true;
+
+		Spec spec;
+		spec.steps.emplace_back(call);
+		spec.returnPopBytes = 12;
+		spec.testResult = true;
+		if (disassemble) PrintListing("SetNotificationPositions_Hook", Emit(spec, CODE_ADDRESS));
+		CheckCallStub(spec, call, 3);
+
+		// Both outcomes of the test
+		const std::vector<uint8_t> code = Emit(spec, CODE_ADDRESS);
+		for (uint32_t result : { 0u, 0x80004005u })
+		{
+			Machine machine = RunCallStub(call, 3);
+			machine.handlerResult = result;
+			machine.Run(code);
+			Expect(machine.zeroFlag == (result == 0), Format("Flags don't match result %08X", result));
+		}
+	}
+
+	void CheckLockVertexBuffer(bool disassemble)
+	{
+		using namespace Trampoline;
+
+		Call call;
+		call.indirectFunction = FakePointer<void* const>(POINTER_ADDRESS + 4);
+
+		Spec spec;
+		spec.saveFpu = true;
+		spec.steps.emplace_back(StoreByte(FakePointer<const volatile void>(FLAG_ADDRESS), 1));
+		spec.steps.emplace_back(Code{ 0x8B, 0x46, 0x08, 0x3B, 0xF8 });
+		spec.steps.emplace_back(call);
+		spec.steps.emplace_back(StoreByte(FakePointer<const volatile void>(FLAG_ADDRESS), 0));
+
+		const std::vector<uint8_t> code = Emit(spec, CODE_ADDRESS);
+		if (disassemble) PrintListing("LockVertexBuffer_SaveFPU", code);
+
+		// Misalign the stack on purpose, the frame must align it for fxsave
+		for (uint32_t misalignment : { 0u, 4u, 8u, 12u })
+		{
+			for (bool equal : { false, true })
+			{
+				Machine machine;
+				machine.regs = EntryRegisters();
+				machine.regs[4] -= misalignment;
+				machine.regs[6] = DATA_ADDRESS;
+				machine.regs[7] = equal ? 0x12345678 : 0x87654321;
+				machine.Write(DATA_ADDRESS + 8, 0x12345678);
+				machine.Write(POINTER_ADDRESS + 4, HANDLER_ADDRESS);
+				machine.Push(RETURN_ADDRESS);
+				const std::array<uint32_t, 8> entry = machine.regs;
+
+				const uint32_t target = machine.Run(code);
+				Expect(target == RETURN_ADDRESS, Format("Returned to %08X", target));
+				Expect(machine.regs[4] == entry[4] + 4, "esp not restored");
+				Expect(machine.regs[5] == entry[5], "ebp not restored");
+				Expect(machine.fxsaves == 1 && machine.fxrstors == 1, "FPU state not saved and restored once");
+				Expect(machine.handlerCalls.size() == 1, "Original function not called once");
+				Expect(machine.handlerCalls[0].flag == 1, "Flag not set during the call");
+				Expect(machine.handlerCalls[0].zeroFlag == equal, "Flags of the replayed compare didn't reach the original function");
+				Expect(machine.ReadByte(FLAG_ADDRESS) == 0, "Flag not cleared after the call");
+				Expect(machine.regs[0] == machine.handlerResult, "Result of the original function lost");
+			}
+		}
+	}
+
+	// Random specs without the FPU frame, exercising every argument and live register combination
+	void CheckRandomSpecs(size_t iterations, std::mt19937& random)
+	{
+		using namespace Trampoline;
+
+		const Register usable[] = { Register::Eax, Register::Ecx, Register::Edx, Register::Ebx, Register::Ebp, Register::Esi, Register::Edi };
+		for (size_t i = 0; i < iterations; i++)
+		{
+			Call call;
+			call.function = FakePointer<const void>(HANDLER_ADDRESS);
+			const size_t argumentCount = random() % 5;
+			for (size_t j = 0; j < argumentCount; j++)
+			{
+				call.arguments.push_back(usable[random() % std::size(usable)]);
+			}
+			const size_t stackArguments = random() % 4;
+			call.stackArguments = random() % (stackArguments + 1);
+			call.calleePops = (random() & 1) != 0;
+			call.live = static_cast<RegisterSet>(random() & 0xEF);
+
+			Spec spec;
+			spec.steps.emplace_back(call);
+			if ((random() & 1) != 0)
+			{
+				spec.exit = Spec::Exit::Jump;
+				spec.jumpTarget = FakePointer<void* const>(POINTER_ADDRESS);
+			}
+			else
+			{
+				spec.returnPopBytes = static_cast<uint16_t>(stackArguments * 4);
+				spec.testResult = (random() & 1) != 0;
+			}
+
+			try
+			{
+				CheckCallStub(spec, call, stackArguments);
+			}
+			catch (const Failure& e)
+			{
+				PrintListing("Failing random spec", Emit(spec, CODE_ADDRESS));
+				throw Failure(Format("Random spec %zu: %s", i, e.what()));
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool disassemble = false;
+	size_t iterations = 10000;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--disassemble") == 0)
+		{
+			disassemble = true;
+		}
+		else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--disassemble] [--iterations <n>]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	const NamedCheck checks[] = {
+		{ "CreateWindow_CalculateAR", CheckCreateWindow },
+		{ "SetupInfoForGameMode_Hook", CheckSetupInfoForGameMode },
+		{ "SetNotificationPositions_Hook", CheckSetNotificationPositions },
+		{ "LockVertexBuffer_SaveFPU", CheckLockVertexBuffer },
+	};
+
+	int failures = 0;
+	for (const NamedCheck& check : checks)
+	{
+		try
+		{
+			check.check(disassemble);
+			printf("%-32s OK\n", check.name);
+		}
+		catch (const std::exception& e)
+		{
+			printf("%-32s FAILED: %s\n", check.name, e.what());
+			failures++;
+		}
+	}
+
+	std::mt19937 random(1234);
+	try
+	{
+		CheckRandomSpecs(iterations, random);
+		printf("%-32s OK (%zu specs)\n", "Random specs", iterations);
+	}
+	catch (const std::exception& e)
+	{
+		printf("%-32s FAILED: %s\n", "Random specs", e.what());
+		failures++;
+	}
+
+	// Specs the emitter must refuse
+	{
+		using namespace Trampoline;
+
+		Call call;
+		call.function = FakePointer<const void>(HANDLER_ADDRESS);
+		call.stackArguments = 1;
+		Spec spec;
+		spec.saveFpu = true;
+		spec.steps.emplace_back(call);
+		try
+		{
+			Emit(spec, CODE_ADDRESS);
+			printf("%-32s FAILED: stack arguments past an fxsave frame were accepted\n", "Invalid specs");
+			failures++;
+		}
+		catch (const std::invalid_argument&)
+		{
+			printf("%-32s OK\n", "Invalid specs");
+		}
+	}
+
+	return failures != 0 ? 1 : 0;
+}
@@ -0,0 +1,322 @@
+// Checks VertexBufferRing against a mock vertex buffer, with the lock flags picked the same way as the DynamicVertexBuffers hook.
+// The mock tracks which bytes were written since the last discard and fails any lock whose flags would be unsafe for it:
+// no-overwrite locks must not touch those bytes, and discarding locks must rewrite all of them, as a discard drops
+// everything outside of the locked range. Locks flagged by the game are passed through untouched.
+// Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/VertexBufferRingCheck/VertexBufferRingCheck.cpp source/VertexBufferRing.cpp -o VertexBufferRingCheck
+//
+// Usage: VertexBufferRingCheck [--iterations <n>]
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "VertexBufferRing.h"
+
+namespace
+{
+	// Values from d3d9types.h
+	constexpr uint32_t D3DLOCK_NOOVERWRITE = 0x1000;
+	constexpr uint32_t D3DLOCK_DISCARD = 0x2000;
+
+	constexpr uint32_t BUFFER_SIZE = 64 * 1024;
+
+	class Failure : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	std::string Format(const char* format, ...)
+	{
+		char buf[512];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buf, sizeof(buf), format, args);
+		va_end(args);
+		return buf;
+	}
+
+	void Expect(bool condition, const std::string& message)
+	{
+		if (!condition)
+		{
+			throw Failure(message);
+		}
+	}
+
+	const char* FlagsName(uint32_t flags)
+	{
+		switch (flags & (D3DLOCK_NOOVERWRITE | D3DLOCK_DISCARD))
+		{
+		case D3DLOCK_NOOVERWRITE: return "NOOVERWRITE";
+		case D3DLOCK_DISCARD: return "DISCARD";
+		case 0: return "none";
+		default: return "NOOVERWRITE|DISCARD";
+		}
+	}
+
+	// A dynamic vertex buffer, remembering which bytes were written since the last discard
+	class MockVertexBuffer
+	{
+	public:
+		explicit MockVertexBuffer(uint32_t size) : m_written(size, false) {}
+
+		uint32_t GetSize() const { return static_cast<uint32_t>(m_written.size()); }
+
+		// Fails if the flags could make the GPU read overwritten data, or lose data the game did not rewrite
+		void Lock(uint32_t offset, uint32_t size, uint32_t flags, bool gameFlags)
+		{
+			const uint32_t end = size == 0 ? GetSize() : std::min(offset + size, GetSize());
+			if ((flags & D3DLOCK_DISCARD) != 0)
+			{
+				if (!gameFlags)
+				{
+					const auto firstWritten = std::find(m_written.begin(), m_written.end(), true) - m_written.begin();
+					const auto lastWritten = m_written.rend() - std::find(m_written.rbegin(), m_written.rend(), true);
+					Expect(firstWritten >= lastWritten || (offset <= firstWritten && end >= lastWritten),
+						Format("Lock at %u, %u bytes discarded data written at %td-%td", offset, size, firstWritten, lastWritten));
+				}
+				std::fill(m_written.begin(), m_written.end(), false);
+			}
+			else if ((flags & D3DLOCK_NOOVERWRITE) != 0 && !gameFlags)
+			{
+				Expect(std::find(m_written.begin() + offset, m_written.begin() + end, true) == m_written.begin() + end,
+					Format("Lock at %u, %u bytes overwrote data written since the last discard", offset, size));
+			}
+			std::fill(m_written.begin() + offset, m_written.begin() + end, true);
+		}
+
+	private:
+		std::vector<bool> m_written;
+	};
+
+	// The DynamicVertexBuffers hook, respecting the flags the game picked
+	uint32_t LockFlags(VertexBufferRing& ring, uint32_t offset, uint32_t size, uint32_t flags)
+	{
+		if ((flags & D3DLOCK_DISCARD) != 0)
+		{
+			ring.Discard(offset, size);
+		}
+		else if ((flags & D3DLOCK_NOOVERWRITE) != 0)
+		{
+			ring.NoOverwrite(offset, size);
+		}
+		else
+		{
+			switch (ring.Lock(offset, size))
+			{
+			case VertexBufferRing::LockMode::NoOverwrite:
+				flags |= D3DLOCK_NOOVERWRITE;
+				break;
+			case VertexBufferRing::LockMode::Discard:
+				flags |= D3DLOCK_DISCARD;
+				break;
+			default:
+				break;
+			}
+		}
+		return flags;
+	}
+
+	class Buffer
+	{
+	public:
+		Buffer() : m_ring(BUFFER_SIZE), m_buffer(BUFFER_SIZE) {}
+
+		uint32_t Lock(uint32_t offset, uint32_t size, uint32_t flags = 0)
+		{
+			const uint32_t newFlags = LockFlags(m_ring, offset, size, flags);
+			Expect((newFlags & flags) == flags, Format("Lock at %u, %u bytes dropped the game's flags", offset, size));
+			m_buffer.Lock(offset, size, newFlags, flags != 0);
+			return newFlags;
+		}
+
+		void ExpectLock(uint32_t offset, uint32_t size, uint32_t expectedFlags, uint32_t flags = 0)
+		{
+			const uint32_t newFlags = Lock(offset, size, flags);
+			Expect(newFlags == expectedFlags, Format("Lock at %u, %u bytes with flags %s got %s, expected %s", offset, size, FlagsName(flags),
+				FlagsName(newFlags), FlagsName(expectedFlags)));
+		}
+
+		uint32_t GetCursor() const { return m_ring.GetCursor(); }
+
+	private:
+		VertexBufferRing m_ring;
+		MockVertexBuffer m_buffer;
+	};
+
+	void CheckAppend()
+	{
+		Buffer buffer;
+		buffer.ExpectLock(0, 1024, D3DLOCK_NOOVERWRITE);
+		buffer.ExpectLock(1024, 4096, D3DLOCK_NOOVERWRITE);
+		buffer.ExpectLock(8192, 1024, D3DLOCK_NOOVERWRITE); // Gaps are fine
+		Expect(buffer.GetCursor() == 9216, Format("Cursor at %u after appending, expected 9216", buffer.GetCursor()));
+
+		// Size of 0 locks until the end of the buffer
+		buffer.ExpectLock(BUFFER_SIZE - 4096, 0, D3DLOCK_NOOVERWRITE);
+		Expect(buffer.GetCursor() == BUFFER_SIZE, Format("Cursor at %u after locking the rest of the buffer", buffer.GetCursor()));
+	}
+
+	void CheckWrap()
+	{
+		Buffer buffer;
+		buffer.ExpectLock(0, BUFFER_SIZE / 2, D3DLOCK_NOOVERWRITE);
+		buffer.ExpectLock(BUFFER_SIZE / 2, BUFFER_SIZE / 2, D3DLOCK_NOOVERWRITE);
+
+		// Rewriting everything from the start discards the buffer and starts appending again
+		buffer.ExpectLock(0, BUFFER_SIZE, D3DLOCK_DISCARD);
+		buffer.ExpectLock(0, 0, D3DLOCK_DISCARD);
+		Expect(buffer.GetCursor() == BUFFER_SIZE, "Cursor not at the end after discarding the entire buffer");
+
+		// A partially filled buffer is discarded when the wraparound covers all of it
+		Buffer partial;
+		partial.ExpectLock(0, 1024, D3DLOCK_NOOVERWRITE);
+		partial.ExpectLock(1024, 1024, D3DLOCK_NOOVERWRITE);
+		partial.ExpectLock(0, 2048, D3DLOCK_DISCARD);
+		partial.ExpectLock(2048, 512, D3DLOCK_NOOVERWRITE);
+		partial.ExpectLock(0, 4096, D3DLOCK_DISCARD);
+		Expect(partial.GetCursor() == 4096, Format("Cursor at %u after a discard, expected 4096", partial.GetCursor()));
+	}
+
+	void CheckOverlap()
+	{
+		Buffer buffer;
+		buffer.ExpectLock(0, 8192, D3DLOCK_NOOVERWRITE);
+
+		// Wrapping around without rewriting all the data would lose the rest of it
+		buffer.ExpectLock(0, 1024, 0);
+		// Rewrites in the middle can neither discard nor skip the wait
+		buffer.ExpectLock(1024, 1024, 0);
+		buffer.ExpectLock(4096, 8192, 0);
+		Expect(buffer.GetCursor() == 12288, Format("Cursor at %u after a partial overlap, expected 12288", buffer.GetCursor()));
+
+		// Appending is still fine past the overlap
+		buffer.ExpectLock(12288, 1024, D3DLOCK_NOOVERWRITE);
+	}
+
+	void CheckGameFlags()
+	{
+		// The game's own discards reset the ring wherever they are
+		Buffer buffer;
+		buffer.ExpectLock(0, 8192, D3DLOCK_NOOVERWRITE);
+		buffer.ExpectLock(0, 1024, D3DLOCK_DISCARD, D3DLOCK_DISCARD);
+		Expect(buffer.GetCursor() == 1024, Format("Cursor at %u after the game discarded, expected 1024", buffer.GetCursor()));
+		buffer.ExpectLock(1024, 1024, D3DLOCK_NOOVERWRITE);
+
+		// The game's own no-overwrite locks are trusted, but still move the cursor
+		buffer.ExpectLock(4096, 4096, D3DLOCK_NOOVERWRITE, D3DLOCK_NOOVERWRITE);
+		Expect(buffer.GetCursor() == 8192, Format("Cursor at %u after the game appended, expected 8192", buffer.GetCursor()));
+		buffer.ExpectLock(0, 1024, D3DLOCK_NOOVERWRITE, D3DLOCK_NOOVERWRITE);
+		Expect(buffer.GetCursor() == 8192, "Cursor moved back by a no-overwrite lock");
+		buffer.ExpectLock(2048, 1024, 0);
+
+		// Both flags are passed through as they are
+		buffer.ExpectLock(0, 1024, D3DLOCK_NOOVERWRITE | D3DLOCK_DISCARD, D3DLOCK_NOOVERWRITE | D3DLOCK_DISCARD);
+	}
+
+	// Random locks, mostly appending in varying sizes like the game's dynamic geometry, with a few rewrites and game flags
+	void CheckRandom(size_t iterations)
+	{
+		std::mt19937 random(1234);
+		auto pick = [&random](uint32_t min, uint32_t max) {
+			return std::uniform_int_distribution<uint32_t>(min, max)(random);
+		};
+
+		Buffer buffer;
+		size_t counts[3] {};
+		for (size_t i = 0; i < iterations; i++)
+		{
+			const uint32_t op = pick(0, 99);
+			const uint32_t size = pick(1, 64) * 32;
+			uint32_t flags;
+			if (op < 80)
+			{
+				const uint32_t offset = buffer.GetCursor() + size <= BUFFER_SIZE ? buffer.GetCursor() : 0;
+				flags = buffer.Lock(offset, offset == 0 ? std::max(size, buffer.GetCursor() * (op % 2)) : size);
+			}
+			else if (op < 95)
+			{
+				flags = buffer.Lock(pick(0, BUFFER_SIZE / 32 - 1) * 32, op % 5 == 0 ? 0 : size);
+			}
+			else if (op < 97)
+			{
+				flags = buffer.Lock(0, size, D3DLOCK_DISCARD);
+			}
+			else
+			{
+				const uint32_t offset = buffer.GetCursor() + size <= BUFFER_SIZE ? buffer.GetCursor() : 0;
+				flags = buffer.Lock(offset, size, D3DLOCK_NOOVERWRITE);
+			}
+			counts[(flags & D3DLOCK_DISCARD) != 0 ? 2 : (flags & D3DLOCK_NOOVERWRITE) != 0 ? 1 : 0]++;
+		}
+
+		printf("%-16s %zu waiting, %zu no-overwrite, %zu discarding locks\n", "", counts[0], counts[1], counts[2]);
+		Expect(counts[0] != 0 && counts[1] != 0 && counts[2] != 0, "Not every kind of lock was used");
+	}
+
+	struct NamedCheck
+	{
+		const char* name;
+		void (*check)();
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	size_t iterations = 100000;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--iterations <n>]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	const NamedCheck checks[] = {
+		{ "Append", CheckAppend },
+		{ "Wraparound", CheckWrap },
+		{ "Overlap", CheckOverlap },
+		{ "Game flags", CheckGameFlags },
+	};
+
+	int failures = 0;
+	for (const NamedCheck& check : checks)
+	{
+		try
+		{
+			check.check();
+			printf("%-16s OK\n", check.name);
+		}
+		catch (const std::exception& e)
+		{
+			printf("%-16s FAILED: %s\n", check.name, e.what());
+			failures++;
+		}
+	}
+
+	try
+	{
+		CheckRandom(iterations);
+		printf("%-16s OK (%zu locks)\n", "Random locks", iterations);
+	}
+	catch (const std::exception& e)
+	{
+		printf("%-16s FAILED: %s\n", "Random locks", e.what());
+		failures++;
+	}
+
+	return failures != 0 ? 1 : 0;
+}
@@ -0,0 +1,268 @@
+// Checks XrefIndex against a brute force scan and measures it against scanning the image once per looked up function.
+// Runs on a synthetic 32-bit PE image with functions planted in it, or on a real executable laid out like the loader would.
+// Builds with any C++17 compiler:
+//   g++ -O2 -std=c++17 -Isource tools/XrefIndexBench/XrefIndexBench.cpp tools/SignatureBench/SyntheticImage.cpp tools/SignatureBench/PeImage.cpp source/XrefIndex.cpp -o XrefIndexBench
+//
+// Usage: XrefIndexBench [--size <MB>] [--seed <n>] [--functions <n>] [--input <path>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../SignatureBench/PeImage.h"
+#include "../SignatureBench/SyntheticImage.h"
+#include "XrefIndex.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedMs(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// What HeapProfiler used to do for its one allocator: check every byte of code for a call to the target
+	std::vector<const uint8_t*> ScanCallers(const std::vector<uint8_t>& image, const std::vector<PeSection>& code, const uint8_t* target)
+	{
+		std::vector<const uint8_t*> callers;
+		for (const PeSection& section : code)
+		{
+			for (size_t offset = section.begin; offset + 5 <= section.end; offset++)
+			{
+				if (image[offset] == 0xE8)
+				{
+					int32_t rel;
+					std::memcpy(&rel, &image[offset + 1], sizeof(rel));
+					if (image.data() + offset + 5 + rel == target)
+					{
+						callers.push_back(image.data() + offset);
+					}
+				}
+			}
+		}
+		return callers;
+	}
+
+	// Every call in the code, by brute force, to check the whole index and not just planted functions
+	std::map<size_t, std::vector<const uint8_t*>> AllCalls(const std::vector<uint8_t>& image, const std::vector<PeSection>& code)
+	{
+		std::map<size_t, std::vector<const uint8_t*>> calls;
+		for (const PeSection& section : code)
+		{
+			for (size_t offset = section.begin; offset + 5 <= section.end; offset++)
+			{
+				if (image[offset] == 0xE8)
+				{
+					int32_t rel;
+					std::memcpy(&rel, &image[offset + 1], sizeof(rel));
+					const int64_t target = static_cast<int64_t>(offset) + 5 + rel;
+					const bool inCode = std::any_of(code.begin(), code.end(), [target](const PeSection& s) {
+						return target >= static_cast<int64_t>(s.begin) && target < static_cast<int64_t>(s.end);
+					});
+					if (inCode)
+					{
+						calls[static_cast<size_t>(target)].push_back(image.data() + offset);
+					}
+				}
+			}
+		}
+		return calls;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t sizeMB = 4;
+	uint32_t seed = 1;
+	size_t numFunctions = 12;
+	std::string inputPath;
+	for (int i = 1; i < argc; i++)
+	{
+		auto nextArg = [&]() -> const char* {
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "Missing value for %s\n", argv[i]);
+				exit(2);
+			}
+			return argv[++i];
+		};
+
+		if (strcmp(argv[i], "--size") == 0) sizeMB = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--seed") == 0) seed = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--functions") == 0) numFunctions = strtoul(nextArg(), nullptr, 10);
+		else if (strcmp(argv[i], "--input") == 0) inputPath = nextArg();
+		else
+		{
+			fprintf(stderr, "Usage: XrefIndexBench [--size <MB>] [--seed <n>] [--functions <n>] [--input <path>]\n");
+			return 2;
+		}
+	}
+
+	std::vector<uint8_t> image;
+	std::vector<PeSection> code;
+	std::mt19937 rng(seed);
+
+	// Planted functions and their callers, by offset
+	std::vector<std::pair<size_t, std::vector<size_t>>> planted;
+	if (!inputPath.empty())
+	{
+		std::ifstream file(inputPath, std::ios::binary);
+		const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (!file.good() && !file.eof())
+		{
+			fprintf(stderr, "Failed to read %s\n", inputPath.c_str());
+			return 2;
+		}
+		PeImage pe;
+		if (!pe.LayOut(data))
+		{
+			fprintf(stderr, "%s is not a 32-bit PE image\n", inputPath.c_str());
+			return 2;
+		}
+		image = std::move(pe.data);
+		code = std::move(pe.code);
+		printf("Image: %s, %.2f MB laid out\n", inputPath.c_str(), image.size() / (1024.0 * 1024.0));
+	}
+	else
+	{
+		// One signature is needed for the generator to lay out its slots
+		size_t unresolvedMatches;
+		const std::vector<BenchSignature> signatures { BenchSignature("Placeholder", "8B 46 08 3B F8 76 04 33 C0") };
+		SyntheticImage synthetic = SyntheticImage::Generate(signatures, sizeMB * 1024 * 1024, seed, unresolvedMatches);
+		image = std::move(synthetic.data);
+		code.push_back({ synthetic.textBegin, synthetic.textEnd });
+
+		// Plant functions with up to a few hundred callers each, like an allocator. Calls are planted on a grid of
+		// 16 byte cells, so they never overlap each other
+		const size_t cells = (synthetic.textEnd - synthetic.textBegin) / 16;
+		std::vector<bool> used(cells);
+		auto takeCell = [&] {
+			size_t cell;
+			do
+			{
+				cell = rng() % cells;
+			}
+			while (used[cell]);
+			used[cell] = true;
+			return synthetic.textBegin + cell * 16;
+		};
+		for (size_t i = 0; i < numFunctions; i++)
+		{
+			const size_t function = takeCell();
+			const size_t numCallers = 1 + rng() % (i == 0 ? 400 : 40);
+			std::vector<size_t> callers;
+			for (size_t j = 0; j < numCallers; j++)
+			{
+				const size_t caller = takeCell() + rng() % 8;
+				image[caller] = 0xE8;
+				const int32_t rel = static_cast<int32_t>(static_cast<int64_t>(function) - static_cast<int64_t>(caller + 5));
+				std::memcpy(&image[caller + 1], &rel, sizeof(rel));
+				callers.push_back(caller);
+			}
+			std::sort(callers.begin(), callers.end());
+			planted.emplace_back(function, std::move(callers));
+		}
+		printf("Image: synthetic, seed %u, %.2f MB, %zu functions planted\n", seed, image.size() / (1024.0 * 1024.0), numFunctions);
+	}
+
+	auto start = Clock::now();
+	XrefIndex index;
+	if (!index.Build(image.data(), image.size()))
+	{
+		fprintf(stderr, "Failed to index the image\n");
+		return 1;
+	}
+	const double buildMs = ElapsedMs(start);
+	printf("Index: %zu branches in %.2f ms, %.2f MB\n", index.Size(), buildMs, index.Size() * 8.0 / (1024.0 * 1024.0));
+
+	bool success = true;
+
+	// Planted callers must all be found, in order
+	for (const auto& [function, callers] : planted)
+	{
+		const std::vector<const uint8_t*> found = index.Callers(image.data() + function);
+		std::vector<size_t> offsets;
+		for (const uint8_t* caller : found)
+		{
+			offsets.push_back(caller - image.data());
+		}
+		if (!std::includes(offsets.begin(), offsets.end(), callers.begin(), callers.end()))
+		{
+			printf("FAILED: function at %zX is missing planted callers (%zu found, %zu planted)\n", function, offsets.size(), callers.size());
+			success = false;
+		}
+	}
+
+	// And the index must agree with a brute force scan on every call target
+	start = Clock::now();
+	const auto allCalls = AllCalls(image, code);
+	size_t mismatches = 0;
+	for (const auto& [target, callers] : allCalls)
+	{
+		if (index.Callers(image.data() + target) != callers)
+		{
+			mismatches++;
+		}
+	}
+	if (mismatches != 0)
+	{
+		printf("FAILED: %zu of %zu call targets differ from a brute force scan\n", mismatches, allCalls.size());
+		success = false;
+	}
+	printf("Checked %zu call targets against a brute force scan in %.0f ms\n", allCalls.size(), ElapsedMs(start));
+
+	// Nothing outside the image or code resolves
+	if (!index.Callers(image.data() + image.size()).empty() || !index.Callers(image.data() - 1).empty())
+	{
+		printf("FAILED: addresses outside the image have callers\n");
+		success = false;
+	}
+
+	// Lookups of the most called functions, against one scan per function
+	std::vector<std::pair<size_t, size_t>> byCallers;
+	for (const auto& [target, callers] : allCalls)
+	{
+		byCallers.emplace_back(callers.size(), target);
+	}
+	std::sort(byCallers.rbegin(), byCallers.rend());
+	byCallers.resize(std::min(byCallers.size(), std::max<size_t>(numFunctions, 1)));
+
+	start = Clock::now();
+	size_t indexedCallers = 0;
+	for (const auto& [count, target] : byCallers)
+	{
+		indexedCallers += index.Callers(image.data() + target).size();
+	}
+	const double lookupMs = ElapsedMs(start);
+
+	start = Clock::now();
+	size_t scannedCallers = 0;
+	for (const auto& [count, target] : byCallers)
+	{
+		scannedCallers += ScanCallers(image, code, image.data() + target).size();
+	}
+	const double scanMs = ElapsedMs(start);
+
+	if (indexedCallers != scannedCallers)
+	{
+		printf("FAILED: lookups found %zu callers, scans %zu\n", indexedCallers, scannedCallers);
+		success = false;
+	}
+	printf("%zu most called functions: build + lookups %.2f ms (lookups alone %.3f ms), one scan each %.2f ms\n",
+		byCallers.size(), buildMs + lookupMs, lookupMs, scanMs);
+	for (size_t i = 0; i < std::min<size_t>(byCallers.size(), 5); i++)
+	{
+		printf("  %08zX: %zu callers\n", byCallers[i].second, byCallers[i].first);
+	}
+
+	printf(success ? "All checks passed\n" : "Checks failed\n");
+	return success ? 0 : 1;
+}